@@ -11,7 +11,12 @@ set RUN_AFTER_BUILD=0
 if not exist %PROJ%\build (mkdir %PROJ%\build)
 pushd %PROJ%\build
 
-g++ %TARGET% %SRC%\main.cpp -Wno-write-strings -o shoki.exe -m64 -mwindows -mwin32 -lgdiplus
+rem The default font is baked into shoki.exe when shoki-bake manages
+rem to write it, and rasterized when a key is first shown otherwise.
+g++ %TARGET% %SRC%\bake_main.cpp -Wno-write-strings -o shoki-bake.exe -m64 -lgdiplus
+if exist shoki-bake.exe shoki-bake.exe baked_fonts.inc
+
+g++ %TARGET% -I%PROJ%\build %SRC%\main.cpp -Wno-write-strings -o shoki.exe -m64 -mwindows -mwin32 -lgdiplus
 
 if %RUN_AFTER_BUILD%==1 shoki.exe
 
@@ -0,0 +1,19 @@
+#!/bin/sh
+#
+# Builds the portable, headless parts of shoki.  The overlay itself is
+# Windows only; see build-msvc.bat and build-gcc.bat for that.
+#
+set -e
+
+PROJ=$(pwd)
+SRC=$PROJ/src
+DEBUG="-g -DDEBUG"
+RELEASE="-O3"
+TARGET=$RELEASE
+
+mkdir -p "$PROJ/build"
+cd "$PROJ/build"
+
+g++ $TARGET -std=c++17 -pthread "$SRC/bench_main.cpp" -o shoki-bench
+g++ $TARGET -std=c++17 -pthread "$SRC/offline_main.cpp" -o shoki-offline
+g++ $TARGET -std=c++17 "$SRC/linux_main.cpp" -o shoki-linux
@@ -11,7 +11,13 @@ set RUN_AFTER_BUILD=0
 if not exist %PROJ%\build (mkdir %PROJ%\build)
 pushd %PROJ%\build
 
-cl -nologo %TARGET% %SRC%\main.cpp -Fe:shoki.exe ^
+rem The default font is baked into shoki.exe when shoki-bake manages
+rem to write it, and rasterized when a key is first shown otherwise.
+cl -nologo %TARGET% %SRC%\bake_main.cpp -Fe:shoki-bake.exe ^
+   -link gdi32.lib gdiplus.lib user32.lib
+if exist shoki-bake.exe shoki-bake.exe baked_fonts.inc
+
+cl -nologo %TARGET% -I%PROJ%\build %SRC%\main.cpp -Fe:shoki.exe ^
    -link gdi32.lib gdiplus.lib user32.lib
 
 if %RUN_AFTER_BUILD%==1 shoki.exe
@@ -0,0 +1,88 @@
+/*
+ * Bakes the default font's labels into the overlay.  Builds the
+ * distance field fonts for every printable ASCII character the way the
+ * overlay would with GDI+ and writes them out as C++ source, which
+ * main.cpp includes when it's on the include path.  The build scripts
+ * run it into the build directory before building shoki.
+ *
+ *     shoki-bake [out]   out is baked_fonts.inc unless given
+ */
+#include "bl_common.hpp"
+
+#include <windows.h>
+#include <gdiplus.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <cmath>
+#include <cassert>
+
+#include "key_info.cpp"
+#include "key_combos.cpp"
+#include "key_chords.cpp"
+#include "combo_layout.cpp"
+#include "glyph_atlas.cpp"
+#include "composite.cpp"
+#include "sdf_atlas.cpp"
+#include "sdf_bake.cpp"
+
+namespace gp {
+using namespace Gdiplus;
+}
+
+#include "sdf_gdiplus.cpp"
+
+// The family default_config() uses.
+static wchar_t const BAKED_FAMILY[] = L"Consolas";
+
+int main(int argc, char **argv)
+{
+    auto path = argc > 1 ? argv[1] : "baked_fonts.inc";
+
+    auto gpInput = gp::GdiplusStartupInput{};
+    auto gpToken = ULONG_PTR{};
+
+    if (gp::GdiplusStartup(&gpToken, &gpInput, nullptr) != gp::Ok) {
+        fprintf(stderr, "can't start GDI+\n");
+        return 1;
+    }
+    defer(gp::GdiplusShutdown(gpToken));
+
+    static SdfFont letters;
+    static SdfFont modifiers;
+    defer(free_sdf_font(&letters); free_sdf_font(&modifiers));
+
+    u32 codepoints[0x7F - 0x20];
+    u32 count = 0;
+    u32 calls = 0;
+
+    for (u32 ch = 0x20; ch < 0x7F; ++ch)
+        codepoints[count++] = ch;
+
+    if (!build_sdf_font_gdiplus(&letters, BAKED_FAMILY, gp::FontStyleBold, codepoints, count, &calls) ||
+        !build_sdf_font_gdiplus(&modifiers, BAKED_FAMILY, gp::FontStyleRegular, codepoints, count, &calls)) {
+        fprintf(stderr, "can't build the fonts\n");
+        return 1;
+    }
+
+    auto out = fopen(path, "wb");
+    if (!out) {
+        fprintf(stderr, "can't write %s\n", path);
+        return 1;
+    }
+
+    fprintf(out, "// Written by shoki-bake.  Don't edit.\n\n");
+
+    auto isWritten = (write_baked_sdf_font(out, "BAKED_LETTER_FONT", BAKED_FAMILY, letters) &&
+                      write_baked_sdf_font(out, "BAKED_MODIFIER_FONT", BAKED_FAMILY, modifiers));
+
+    if (fclose(out) != 0 || !isWritten) {
+        fprintf(stderr, "can't write %s\n", path);
+        remove(path);
+        return 1;
+    }
+
+    printf("baked %u glyphs of %ls into %s\n", count, BAKED_FAMILY, path);
+    return 0;
+}
@@ -0,0 +1,3639 @@
+/*
+ * Headless benchmarks for the portable parts of shoki.  This builds and
+ * runs without Windows so the hot paths can be measured anywhere.
+ *
+ *     shoki-bench [composite|replay|ring|spsc|golden [dir]|sdf|bake|config|mouse|chords|stats|broadcast|evdev]
+ *
+ * broadcast stresses the shared memory key broadcast with reader
+ * threads and, on Linux, reader processes.  evdev reads synthetic
+ * keyboard input back through the Linux input backend and is only
+ * built on Linux.
+ */
+#include "bl_common.hpp"
+#include "bl_ring.hpp"
+#include "bl_spsc_queue.hpp"
+#include "bl_rcu.hpp"
+#include "bl_shared_memory.hpp"
+#include "bl_seqlock_ring.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <cmath>
+#include <cassert>
+#include <chrono>
+#include <atomic>
+#include <thread>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#endif
+
+#include "key_info.cpp"
+#include "key_combos.cpp"
+#include "key_chords.cpp"
+#include "typing_stats.cpp"
+#include "combo_layout.cpp"
+#include "glyph_atlas.cpp"
+#include "fade.cpp"
+#include "frame_scheduler.cpp"
+#include "metrics.cpp"
+#include "composite.cpp"
+#include "combo_render.cpp"
+#include "mouse_input.cpp"
+#include "key_text.cpp"
+#include "key_broadcast.cpp"
+#include "png_writer.cpp"
+#include "synth_input.cpp"
+#include "sdf_atlas.cpp"
+#include "sdf_bake.cpp"
+#include "segment_font.cpp"
+#include "config.cpp"
+
+#if defined(__linux__)
+#include "evdev_input.cpp"
+#endif
+
+/*
+ * Every heap allocation the bench makes is counted, so a steady state
+ * that's meant to allocate nothing can be checked to.  glibc lets a
+ * program replace malloc and still reach its own, and C++ allocations
+ * go through malloc as well.  Elsewhere nothing is counted.
+ */
+static std::atomic<u64> HEAP_ALLOCATIONS;
+
+#if defined(__GLIBC__)
+constexpr bool IS_COUNTING_ALLOCATIONS = true;
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+
+extern "C" void *malloc(size_t size) noexcept
+{
+    HEAP_ALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) noexcept
+{
+    HEAP_ALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size) noexcept
+{
+    HEAP_ALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+#else
+constexpr bool IS_COUNTING_ALLOCATIONS = false;
+#endif
+
+inline u64 heap_allocations()
+{
+    return HEAP_ALLOCATIONS.load(std::memory_order_relaxed);
+}
+
+typedef std::chrono::steady_clock BenchClock;
+
+f64 seconds_since(BenchClock::time_point start)
+{
+    return std::chrono::duration<f64>(BenchClock::now() - start).count();
+}
+
+/*
+ * Small xorshift generator so every run sees the same pixels.
+ */
+struct BenchRandom {
+    u64 state;
+
+    u32 next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return u32(state >> 32);
+    }
+
+    u32 premultiplied_pixel() {
+        u32 pixel = next();
+        u32 alpha = pixel >> 24;
+        return scale_pixel(pixel | 0xFF000000, alpha) | (alpha << 24);
+    }
+};
+
+struct BenchSurface {
+    Surface surface;
+
+    BenchSurface(i32 width, i32 height) {
+        surface = Surface{ (u32 *)malloc(size_t(width) * height * sizeof(u32)), width, height, width };
+    }
+    ~BenchSurface() { free(surface.pixels); }
+
+    void fill_random(BenchRandom *random) {
+        for (i32 i = 0; i < surface.width * surface.height; ++i)
+            surface.pixels[i] = random->premultiplied_pixel();
+    }
+};
+
+/*
+ * Draw the same operations at every compositing level the CPU supports,
+ * check the results match the scalar reference bit for bit, then time
+ * each level.
+ */
+int bench_composite()
+{
+    constexpr i32 WIDTH      = 650;
+    constexpr i32 HEIGHT     = 150;
+    constexpr i32 ITERATIONS = 2000;
+
+    auto best   = detect_composite_level();
+    auto random = BenchRandom{ 0x5eed };
+
+    BenchSurface background(WIDTH, HEIGHT);
+    BenchSurface sprite(WIDTH, HEIGHT);
+    BenchSurface reference(WIDTH, HEIGHT);
+    BenchSurface target(WIDTH, HEIGHT);
+
+    background.fill_random(&random);
+    sprite.fill_random(&random);
+
+    auto frame_bytes = size_t(WIDTH) * HEIGHT * sizeof(u32);
+    auto draw = [&](Surface *surface, i32 op) {
+        switch (op) {
+        case 0: fill_rounded_rect(surface, 3, 2, WIDTH - 7, HEIGHT - 5, 5.0f, 0xC0000000); break;
+        case 1: blit_over(surface, sprite.surface.pixels, WIDTH, -3, 1, WIDTH, HEIGHT, 255); break;
+        case 2: blit_over(surface, sprite.surface.pixels, WIDTH, 1, -2, WIDTH, HEIGHT, 77); break;
+        case 3: scale_alpha(surface, 131); break;
+        }
+    };
+    char const *names[] = { "rounded rect", "blit", "blit alpha", "scale alpha" };
+
+    int mismatches = 0;
+
+    for (i32 op = 0; op < 4; ++op) {
+        set_composite_level(Composite_Scalar);
+        memcpy(reference.surface.pixels, background.surface.pixels, frame_bytes);
+        draw(&reference.surface, op);
+
+        for (i32 level = 0; level <= best; ++level) {
+            set_composite_level(CompositeLevel(level));
+            memcpy(target.surface.pixels, background.surface.pixels, frame_bytes);
+            draw(&target.surface, op);
+
+            bool isExact = memcmp(target.surface.pixels, reference.surface.pixels, frame_bytes) == 0;
+            if (!isExact)
+                ++mismatches;
+
+            auto start = BenchClock::now();
+            for (i32 iter = 0; iter < ITERATIONS; ++iter)
+                draw(&target.surface, op);
+            auto elapsed = seconds_since(start);
+
+            printf("%-12s %-6s %9.1f Mpixels/s%s\n",
+                   names[op],
+                   COMPOSITE_LEVEL_NAMES[level],
+                   f64(WIDTH) * HEIGHT * ITERATIONS / elapsed / 1e6,
+                   isExact ? "" : "  MISMATCH");
+        }
+    }
+
+    // A radius past half the shorter side is cut down to it, so the
+    // corners of a small box stay circles around the same centres and
+    // the box comes out mirrored both ways.
+    struct SmallBox {
+        i32 width;
+        i32 height;
+        f32 radius;
+    };
+
+    static SmallBox const SMALL_BOXES[] = {
+        { 12, 12, 100.0f }, { 9, 9, 4.7f }, { 20, 7, 5.0f }, { 6, 15, 3.5f }, { 11, 8, 2.25f },
+    };
+
+    set_composite_level(best);
+
+    for (auto &box : SMALL_BOXES) {
+        BenchSurface drawn(box.width, box.height);
+        BenchSurface clamped(box.width, box.height);
+
+        auto half  = 0.5f * (box.width < box.height ? box.width : box.height);
+        auto bytes = size_t(box.width) * box.height * sizeof(u32);
+
+        memset(drawn.surface.pixels, 0, bytes);
+        memset(clamped.surface.pixels, 0, bytes);
+        fill_rounded_rect(&drawn.surface, 0, 0, box.width, box.height, box.radius, 0xFF000000);
+        fill_rounded_rect(&clamped.surface, 0, 0, box.width, box.height, box.radius < half ? box.radius : half, 0xFF000000);
+
+        auto pixel = [&](i32 px, i32 py) { return drawn.surface.pixels[py * drawn.surface.stride + px]; };
+        auto isRight = memcmp(drawn.surface.pixels, clamped.surface.pixels, bytes) == 0 &&
+                       pixel(box.width / 2, box.height / 2) == 0xFF000000;
+
+        for (i32 py = 0; py < box.height; ++py) {
+            for (i32 px = 0; px < box.width; ++px) {
+                isRight &= pixel(px, py) == pixel(box.width - 1 - px, py);
+                isRight &= pixel(px, py) == pixel(px, box.height - 1 - py);
+            }
+        }
+
+        if (!isRight) {
+            printf("rounded rect %dx%d with radius %.2f drawn wrong\n", box.width, box.height, box.radius);
+            ++mismatches;
+        }
+    }
+
+    return mismatches == 0 ? 0 : 1;
+}
+
+/*
+ * Durations of one kind of work, kept so percentiles can be reported.
+ */
+struct LatencySamples {
+    u32 *nanoseconds;
+    u32  count;
+    u32  capacity;
+
+    void add(BenchClock::time_point start) {
+        if (count == capacity) {
+            capacity    = capacity ? 2*capacity : 4096;
+            nanoseconds = (u32 *)realloc(nanoseconds, capacity * sizeof(u32));
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start);
+        nanoseconds[count++] = u32(elapsed.count());
+    }
+};
+
+int compare_u32(void const *a, void const *b)
+{
+    auto x = *(u32 const *)a;
+    auto y = *(u32 const *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+void print_percentiles(char const *stream, char const *what, LatencySamples *samples)
+{
+    if (samples->count == 0) {
+        printf("%-14s %-12s %8u\n", stream, what, 0u);
+        return;
+    }
+
+    qsort(samples->nanoseconds, samples->count, sizeof(u32), compare_u32);
+
+    auto at = [&](f64 percentile) {
+        auto idx = u32(percentile / 100.0 * (samples->count - 1) + 0.5);
+        return samples->nanoseconds[idx] / 1000.0;
+    };
+
+    printf("%-14s %-12s %8u %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+           stream,
+           what,
+           samples->count,
+           at(50.0),
+           at(90.0),
+           at(99.0),
+           at(99.9),
+           samples->nanoseconds[samples->count - 1] / 1000.0);
+
+    free(samples->nanoseconds);
+    *samples = LatencySamples{};
+}
+
+/*
+ * The stroke font for every printable ASCII character, built and
+ * packed the way shoki-bake builds and packs the default font.
+ */
+struct BenchBakedFont {
+    SdfFont      built;
+    u8          *packed;
+    BakedSdfFont baked;
+};
+
+/**
+ * @return False if the font couldn't be built or packed.
+ */
+bool bake_bench_font(BenchBakedFont *font)
+{
+    u32 codepoints[0x7F - 0x20];
+    u32 count = 0;
+    for (u32 ch = 0x20; ch < 0x7F; ++ch)
+        codepoints[count++] = ch;
+
+    auto &built = font->built;
+    if (!build_segment_sdf_font(&built, codepoints, count))
+        return false;
+
+    auto texelCount = u32(built.width) * u32(built.height);
+    auto capacity   = texelCount + texelCount / 128 + 1;
+
+    font->packed = (u8 *)malloc(capacity);
+    if (!font->packed)
+        return false;
+
+    font->baked = BakedSdfFont{ L"segments",
+                                built.width,
+                                built.height,
+                                built.cellWidth,
+                                built.cellHeight,
+                                built.lineHeight,
+                                built.glyphCount,
+                                built.glyphs,
+                                font->packed,
+                                pack_texels(built.texels, texelCount, font->packed, capacity) };
+
+    return font->baked.packedSize > 0;
+}
+
+void free_bench_baked_font(BenchBakedFont *font)
+{
+    free_sdf_font(&font->built);
+    free(font->packed);
+    *font = BenchBakedFont{};
+}
+
+/*
+ * Where the labels of the first frame come from.
+ */
+enum LabelSource {
+    LabelSource_BakedFields,   // distance fields unpacked from the program
+    LabelSource_BuiltFields,   // the font rasterized and turned into fields
+    LabelSource_DirectLabels,  // every label rasterized at its size
+    LabelSource_BakedAtlas,    // a finished atlas unpacked from the program
+    LabelSource_Count
+};
+
+char const *LABEL_SOURCE_NAMES[LabelSource_Count] = { "baked fields", "built fields", "direct labels", "baked atlas" };
+
+/*
+ * A finished glyph atlas of premultiplied pixels packed the way fonts
+ * are baked, along with the measurements it was laid out from.  It
+ * only holds the labels at one size, DPI and color.
+ */
+struct BenchBakedAtlas {
+    LabelMeasurements labels;
+    u8               *packed;
+    u32               packedSize;
+};
+
+struct FirstFrame {
+    SdfFont           letters;
+    SdfFont           modifiers;
+    LabelMeasurements labels;
+    GlyphAtlas        atlas;
+    ComboLayout       layout;
+    f64               fontSeconds;   // getting the label fonts ready
+    f64               atlasSeconds;  // measuring the labels and filling the atlas
+    f64               frameSeconds;  // everything up to the first frame
+};
+
+void free_first_frame(FirstFrame *frame)
+{
+    free_sdf_font(&frame->letters);
+    free_sdf_font(&frame->modifiers);
+    free_glyph_atlas(&frame->atlas);
+}
+
+/**
+ * Draw the first frame of a strip from nothing, the way the overlay
+ * does the first time a key is shown: get the label fonts ready,
+ * measure the labels and fill the glyph atlas, then lay out the strip
+ * and composite it at the default font sizes times a DPI scale.  A
+ * baked atlas only has the labels at the scale it was baked at.  The
+ * stroke font stands
+ * in for the default font.  Building its fields is what the overlay
+ * does with GDI+ for a font that isn't baked, and drawing its strokes
+ * into the atlas is how every label was rasterized before there were
+ * fields.
+ *
+ * @return False if something couldn't be allocated.
+ */
+bool draw_first_frame(LabelSource source,
+                      BakedSdfFont const &bakedFont,
+                      BenchBakedAtlas const &bakedAtlas,
+                      f32 scale,
+                      KeyComboStack *combos,
+                      Placement const &place,
+                      Surface *surface,
+                      FirstFrame *frame)
+{
+    auto config = default_config();
+    auto start  = BenchClock::now();
+
+    config.letterSize   *= scale;
+    config.modifierSize *= scale;
+    auto isOk   = true;
+
+    u32  codepoints[MAX_SDF_GLYPHS];
+    auto count = collect_label_characters(*KEY_TABLE, codepoints, COUNT_OF(codepoints));
+
+    switch (source) {
+    case LabelSource_BakedFields:
+        isOk = load_baked_sdf_font(bakedFont, &frame->letters) && load_baked_sdf_font(bakedFont, &frame->modifiers);
+        break;
+    case LabelSource_BuiltFields:
+        isOk = build_segment_sdf_font(&frame->letters, codepoints, count) && build_segment_sdf_font(&frame->modifiers, codepoints, count);
+        break;
+    case LabelSource_DirectLabels:
+        // Only the advances, which a font system has without drawing.
+        isOk = begin_sdf_font(&frame->letters, codepoints, count, SEGMENT_ADVANCE, SEGMENT_LINE_HEIGHT);
+        break;
+    default:
+        break;
+    }
+
+    frame->fontSeconds = seconds_since(start);
+
+    if (source == LabelSource_BakedAtlas) {
+        frame->labels = bakedAtlas.labels;
+
+        isOk = (layout_glyph_atlas(&frame->atlas, frame->labels) &&
+                unpack_texels(bakedAtlas.packed,
+                              bakedAtlas.packedSize,
+                              (u8 *)frame->atlas.pixels,
+                              u32(frame->atlas.width) * u32(frame->atlas.height) * sizeof(u32)));
+    }
+    else if (isOk) {
+        auto &modifiers = source == LabelSource_DirectLabels ? frame->letters : frame->modifiers;
+
+        measure_sdf_labels(&frame->labels, frame->letters, modifiers, config.letterSize, config.modifierSize);
+        isOk = layout_glyph_atlas(&frame->atlas, frame->labels);
+
+        if (isOk && source == LabelSource_DirectLabels)
+            draw_segment_labels(&frame->atlas, frame->labels, config.letterSize, config.modifierSize);
+        else if (isOk)
+            draw_sdf_labels(&frame->atlas,
+                            frame->labels,
+                            frame->letters,
+                            frame->modifiers,
+                            config.letterSize,
+                            config.modifierSize,
+                            premultiply_color(config.textColor));
+    }
+
+    frame->atlasSeconds = seconds_since(start) - frame->fontSeconds;
+
+    layout_combos(combos, frame->labels, &frame->layout);
+    clear_rect(surface, 0, 0, surface->width, surface->height);
+    composite_combo_strip(surface, frame->layout, frame->atlas, place);
+
+    frame->frameSeconds = seconds_since(start);
+    return isOk;
+}
+
+/**
+ * Type a word into a combo stack for a first frame to show.
+ */
+void type_first_frame_keys(KeyComboStack *combos)
+{
+    auto config = default_config();
+
+    *combos = KeyComboStack{};
+    combos->set_max_combos(config.maxCombos);
+
+    for (u32 idx = 0; idx < 5; ++idx) {
+        auto combo = KeyCombo{};
+
+        combo.vk_key      = u32("SHOKI"[idx]);
+        combo.time        = 1000 + 100*idx;
+        combo.isShiftDown = idx == 0;
+        combos->add_combo(combo);
+    }
+}
+
+/*
+ * A clock that only moves when the replay moves it.
+ */
+struct ReplayClock : Clock {
+    u64 now;
+
+    u64 now_microseconds() override { return now; }
+};
+
+/*
+ * Replay a key stream through the same steps the overlay takes.  Each
+ * event goes through set_key, and add_combo and a relayout when it makes
+ * a combo.  Frames are paced by the frame scheduler on a replay clock
+ * with a 60 Hz refresh; a frame after the strip changed clears and
+ * composites only where the strip was and now is in an offscreen
+ * surface, like display mode.  Display mode has the compositor fade
+ * the same bitmap for every other frame, but here a fade frame is
+ * drawn in full: it lays the strip out again, renders it and blends it
+ * into a screen surface at the fade alpha, which every frame does in
+ * place of the compositor.  Every frame is checked against one drawn
+ * from scratch, outside the timing.  The loop sleeps for as long as
+ * the scheduler says it can, so any wakeup that doesn't draw is
+ * wasted.
+ *
+ * The pipeline metrics are recorded on the replay clock as well, which
+ * leaves out processing time and shows how long keys wait for frames.
+ * Startup is how long the first frame took to get ready from nothing.
+ *
+ * Once everything is set up nothing an event or a frame does should
+ * touch the heap, so any allocation in either fails the replay.
+ *
+ * @return Zero if events and frames allocated nothing.
+ */
+int bench_replay_stream(char const *name,
+                         SynthStream *stream,
+                         FirstFrame const &first,
+                         FadeTable const &fade)
+{
+    constexpr i32 WIDTH  = 650;
+    constexpr i32 HEIGHT = 150;
+
+    auto &labels = first.labels;
+    auto &atlas  = first.atlas;
+
+    BenchSurface target(WIDTH, HEIGHT);
+    BenchSurface reference(WIDTH, HEIGHT);
+    BenchSurface screen(WIDTH, HEIGHT);
+
+    memset(target.surface.pixels, 0, size_t(WIDTH) * HEIGHT * sizeof(u32));
+    memset(screen.surface.pixels, 0, size_t(WIDTH) * HEIGHT * sizeof(u32));
+
+    auto combos    = KeyComboStack{};
+    auto layout    = ComboLayout{};
+    auto place     = Placement{ 20, 15, WIDTH, HEIGHT, Justification_Center };
+    auto clock     = ReplayClock{};
+    auto scheduler = FrameScheduler{};
+
+    combos.set_max_combos(4);
+    scheduler.clock         = &clock;
+    scheduler.frameInterval = 1000000 / 60;
+
+    u32 presentedGeneration = combos.generation;
+    u64 lastKeyUp           = 0;
+    u32 keyUps              = 0;
+
+    LatencySamples eventSamples  = {};
+    LatencySamples renderSamples = {};
+    LatencySamples fadeSamples   = {};
+
+    u64 eventAllocations  = 0;
+    u64 renderAllocations = 0;
+    u64 fadeAllocations   = 0;
+
+    auto presentedBounds = PixelRect{};
+    u64  presentedBytes  = 0;
+    u32  redrawnFrames   = 0;
+    u32  fadeFrames      = 0;
+    u32  mismatches      = 0;
+
+    auto metrics  = (Metrics *)calloc(1, sizeof(Metrics));
+    auto recorder = MetricsRecorder{};
+
+    init_metrics(metrics);
+    recorder.metrics = metrics;
+
+    metrics->startupMicroseconds.store(u32(first.frameSeconds * 1e6), std::memory_order_relaxed);
+    metrics->labelFontMicroseconds.store(u32(first.fontSeconds * 1e6), std::memory_order_relaxed);
+
+    // Stands in for the compositor blending the window's bitmap.
+    auto present = [&](PixelRect const &dirty, u8 alpha) {
+        auto offset = size_t(dirty.y0) * WIDTH + dirty.x0;
+
+        clear_rect(&screen.surface, dirty.x0, dirty.y0, dirty.x1 - dirty.x0, dirty.y1 - dirty.y0);
+        blit_over(&screen.surface, target.surface.pixels + offset, WIDTH, dirty.x0, dirty.y0, dirty.x1 - dirty.x0, dirty.y1 - dirty.y0, alpha);
+    };
+
+    auto run_frames_until = [&](u64 until) {
+        for (;;) {
+            auto wait = scheduler.wait_microseconds();
+            if (wait == NO_FRAME_DUE || clock.now + wait > until)
+                break;
+
+            clock.now += wait;
+            if (!scheduler.begin_frame())
+                continue;
+
+            auto start       = BenchClock::now();
+            auto allocations = heap_allocations();
+            auto alpha       = fade_alpha(fade, u32((clock.now - lastKeyUp) / 1000));
+
+            u32 bytes = 0;
+
+            recorder.render_started(u32(clock.now));
+
+            if (presentedGeneration != combos.generation) {
+                auto bounds = combo_strip_bounds(layout, atlas, place);
+                auto dirty  = union_rects(bounds, presentedBounds);
+
+                clear_rect(&target.surface, dirty.x0, dirty.y0, dirty.x1 - dirty.x0, dirty.y1 - dirty.y0);
+                composite_combo_strip(&target.surface, layout, atlas, place);
+                present(dirty, alpha);
+
+                presentedGeneration = combos.generation;
+                presentedBounds     = bounds;
+                bytes               = dirty.area() * sizeof(u32);
+                ++redrawnFrames;
+                renderAllocations  += heap_allocations() - allocations;
+                renderSamples.add(start);
+
+                memset(reference.surface.pixels, 0, size_t(WIDTH) * HEIGHT * sizeof(u32));
+                composite_combo_strip(&reference.surface, layout, atlas, place);
+                mismatches += memcmp(reference.surface.pixels, target.surface.pixels, size_t(WIDTH) * HEIGHT * sizeof(u32)) != 0;
+            }
+            else {
+                layout_combos(&combos, labels, &layout);
+
+                auto bounds = combo_strip_bounds(layout, atlas, place);
+
+                clear_rect(&target.surface, bounds.x0, bounds.y0, bounds.x1 - bounds.x0, bounds.y1 - bounds.y0);
+                composite_combo_strip(&target.surface, layout, atlas, place);
+                present(bounds, alpha);
+
+                presentedBounds  = bounds;
+                ++fadeFrames;
+                fadeAllocations += heap_allocations() - allocations;
+                fadeSamples.add(start);
+
+                mismatches += memcmp(reference.surface.pixels, target.surface.pixels, size_t(WIDTH) * HEIGHT * sizeof(u32)) != 0;
+            }
+
+            presentedBytes += bytes;
+            recorder.frame_presented(u32(clock.now), alpha, bytes);
+            scheduler.set_animating(alpha > 0);
+
+            if (alpha == 0) {
+                combos.reset_combos();
+                layout_combos(&combos, labels, &layout);
+                presentedGeneration = combos.generation;
+            }
+        }
+    };
+
+    for (u32 idx = 0; idx < stream->count; ++idx) {
+        auto &event  = stream->events[idx];
+        auto  isDown = (event.flags & KEY_FLAG_UP) == 0;
+        auto  now    = u64(event.time) * 1000;
+
+        run_frames_until(now);
+        clock.now   = now;
+        event.stamp = u32(now);
+
+        auto start       = BenchClock::now();
+        auto allocations = heap_allocations();
+        auto isCombo     = combos.set_key(event);
+
+        if (isCombo)
+            layout_combos(&combos, labels, &layout);
+
+        eventAllocations += heap_allocations() - allocations;
+        eventSamples.add(start);
+
+        bump(&metrics->events);
+        recorder.event_processed(event, u32(clock.now), isCombo, combos.overwrittenCombos);
+
+        if (!isDown) {
+            recorder.frame_requested(event.stamp);
+            lastKeyUp = now;
+            ++keyUps;
+            scheduler.request_frame();
+            scheduler.set_animating(true);
+        }
+    }
+
+    run_frames_until(NO_FRAME_DUE - 1);
+
+    print_percentiles(name, "event", &eventSamples);
+    print_percentiles(name, "render frame", &renderSamples);
+    print_percentiles(name, "fade frame", &fadeSamples);
+
+    printf("%-14s %-12s %8u frames for %u key ups, %u wasted wakeups, %s when faded out\n",
+           name,
+           "scheduler",
+           scheduler.frames,
+           keyUps,
+           scheduler.wakeups - scheduler.frames,
+           scheduler.is_idle() ? "idle" : "NOT IDLE");
+
+    auto isAllocating = eventAllocations + renderAllocations + fadeAllocations > 0;
+
+    printf("%-14s %-12s %8.1f MB, %.1f MB for whole frames, %u of %u frames wrong%s\n",
+           name,
+           "presented",
+           f64(presentedBytes) / 1e6,
+           f64(redrawnFrames) * WIDTH * HEIGHT * sizeof(u32) / 1e6,
+           mismatches,
+           redrawnFrames + fadeFrames,
+           mismatches ? "  MISMATCH" : "");
+
+    if (IS_COUNTING_ALLOCATIONS) {
+        printf("%-14s %-12s %8llu in events, %llu in render frames, %llu in fade frames%s\n",
+               name,
+               "allocations",
+               (unsigned long long)eventAllocations,
+               (unsigned long long)renderAllocations,
+               (unsigned long long)fadeAllocations,
+               isAllocating ? "  ALLOCATES" : "");
+    }
+    else {
+        printf("%-14s %-12s %8s\n", name, "allocations", "not counted");
+    }
+
+    print_metrics(stdout, *metrics);
+    printf("\n");
+    free(metrics);
+
+    return isAllocating || mismatches ? 1 : 0;
+}
+
+/*
+ * Fast typing with everything that trips up attributing modifiers to
+ * keys, scripted along with the combo each key has to become.  Keys
+ * are held across the next two or three, so they come up in a
+ * different order than they went down.  Modifiers are held around a
+ * key's down and let go of before its up, the way shift often is, and
+ * only ever around one key's down, so what each key needs is known
+ * without working it out from the events.  Some keys go down while
+ * both shifts overlap with one already let go of.  Some are injected,
+ * extended, or modified through the generic VK_CONTROL and VK_MENU
+ * codes with the extended flag marking the right hand key.
+ */
+struct RolloverKey {
+    KeyCombo combo;       // what the strip has to show
+    u32      upTime;
+    bool     isShiftUpFirst;
+    bool     isBothShifts;
+    bool     hasFlags;
+};
+
+enum : u32 {
+    RolloverCase_ShiftUpFirst,
+    RolloverCase_BothShifts,
+    RolloverCase_OutOfOrder,
+    RolloverCase_Flags,
+    ROLLOVER_CASE_COUNT
+};
+
+static char const *const ROLLOVER_CASE_NAMES[ROLLOVER_CASE_COUNT] = {
+    "shift up first", "both shifts", "out of order", "flags",
+};
+
+/**
+ * Script keyCount keys at about keysPerSecond, at least 50 so every key
+ * overlaps the next.  Events carry their key's index plus one as their
+ * stamp, and modifiers carry zero.
+ */
+void synth_rollover_typing(SynthStream *stream, RolloverKey *keys, u32 keyCount, u32 keysPerSecond)
+{
+    constexpr u32 ROLLOVER_KEYS[] = {
+        'A', 'S', 'D', 'F', 'J', 'K', 'L', 'E', 'R', 'T', 'U', 'I', 'O', '1', '2', '9',
+        0x20, 0xBA, 0xBC, 0xBE,
+        0x25, 0x26, 0x27, 0x28, 0x2E, 0x24,  // arrows, DELETE and HOME are extended
+    };
+    constexpr u32 FIRST_EXTENDED = 20;
+
+    auto interval = 1000 / keysPerSecond;
+    auto t        = stream->time;
+
+    auto push = [&](u32 vk, bool isDown, u32 at, u32 flags, u32 stamp) {
+        stream->push(vk, isDown, at);
+        stream->events[stream->count - 1].flags |= flags;
+        stream->events[stream->count - 1].stamp  = stamp;
+    };
+
+    // Every key's modifiers are pressed and let go of within half of
+    // the gaps either side of it, so they never span another key's down.
+    u32 gapBefore = interval;
+    u32 gapAfter  = stream->between(interval * 8 / 10, interval * 12 / 10);
+
+    for (u32 idx = 0; idx < keyCount; ++idx) {
+        auto &key = keys[idx];
+        auto  vk  = 0u;
+        auto  pick = 0u;
+
+        // Not a key that may still be held.
+        for (bool isHeld = true; isHeld;) {
+            pick   = stream->next_random() % COUNT_OF(ROLLOVER_KEYS);
+            vk     = ROLLOVER_KEYS[pick];
+            isHeld = false;
+            for (u32 back = 1; back <= 4 && back <= idx; ++back)
+                isHeld |= keys[idx - back].combo.vk_key == vk;
+        }
+
+        auto before = (gapBefore - 1) / 2;
+        auto after  = (gapAfter - 1) / 2;
+        auto dwell  = stream->between(interval, 3*interval);
+        auto flags  = pick >= FIRST_EXTENDED ? KEY_FLAG_EXTENDED : 0u;
+
+        key          = RolloverKey{};
+        key.combo.vk_key = vk;
+        key.combo.time   = t;
+        key.upTime       = t + dwell;
+
+        switch (stream->next_random() % 8) {
+        case 4: {
+            auto shift = stream->next_random() % 2 ? KEY_LSHIFT : KEY_RSHIFT;
+            auto up    = t + stream->between(1, after);
+
+            push(shift, true, t - stream->between(1, before), 0, 0);
+            push(shift, false, up, 0, 0);
+
+            key.combo.isShiftDown = true;
+            key.isShiftUpFirst    = up < key.upTime;
+            break;
+        }
+        case 5: {
+            auto first  = stream->next_random() % 2 ? KEY_LSHIFT : KEY_RSHIFT;
+            auto second = first == KEY_LSHIFT ? KEY_RSHIFT : KEY_LSHIFT;
+            auto at     = t - stream->between(3, before);
+
+            push(first, true, at, 0, 0);
+            push(second, true, at + 1, 0, 0);
+            push(first, false, at + 2, 0, 0);
+            push(second, false, t + stream->between(1, after), 0, 0);
+
+            key.combo.isShiftDown = true;
+            key.isBothShifts      = true;
+            break;
+        }
+        case 6: {
+            // The right CTRL as injected input often sends it.
+            auto isRight = stream->next_random() % 2 == 0;
+            auto ctrl    = isRight ? KEY_CONTROL : KEY_LCONTROL;
+            auto extra   = isRight ? KEY_FLAG_EXTENDED|KEY_FLAG_INJECTED : 0u;
+
+            push(ctrl, true, t - stream->between(1, before), extra, 0);
+            push(ctrl, false, t + stream->between(1, after), extra, 0);
+
+            flags |= KEY_FLAG_INJECTED;
+            key.combo.isCtrlDown = true;
+            key.hasFlags         = true;
+            break;
+        }
+        case 7: {
+            auto alt   = stream->next_random() % 2 ? KEY_MENU : KEY_RMENU;
+            auto extra = KEY_FLAG_EXTENDED | (alt == KEY_MENU ? KEY_FLAG_INJECTED : 0u);
+
+            push(alt, true, t - stream->between(1, before), extra, 0);
+            push(alt, false, t + stream->between(1, after), extra, 0);
+
+            key.combo.isAltDown = true;
+            key.hasFlags        = true;
+            break;
+        }
+        }
+
+        key.hasFlags |= flags != 0;
+
+        push(vk, true, t, flags, idx + 1);
+        push(vk, false, key.upTime, flags, idx + 1);
+
+        t         += gapAfter;
+        gapBefore  = gapAfter;
+        gapAfter   = stream->between(interval * 8 / 10, interval * 12 / 10);
+    }
+
+    stream->time = t + 1000;
+}
+
+/**
+ * Replay scripted rollover typing through the combo stack and check
+ * after every event that the strip holds exactly the keys released so
+ * far, in the order they went down, with the modifiers they were typed
+ * with.
+ *
+ * @return Non-zero if any combo was wrong or a case never came up.
+ */
+int check_rollover(u32 keysPerSecond, u64 seed)
+{
+    constexpr u32 KEY_COUNT = 20000;
+
+    auto stream   = make_synth_stream(8 * KEY_COUNT, seed);
+    auto keys     = (RolloverKey *)malloc(KEY_COUNT * sizeof(RolloverKey));
+    auto released = (u32 *)malloc(KEY_COUNT * sizeof(u32));
+    defer(free_synth_stream(&stream));
+    defer(free(keys));
+    defer(free(released));
+
+    synth_rollover_typing(&stream, keys, KEY_COUNT, keysPerSecond);
+    synth_finish(&stream);
+
+    u32 cases[ROLLOVER_CASE_COUNT] = {};
+
+    for (u32 idx = 0; idx < KEY_COUNT; ++idx) {
+        cases[RolloverCase_ShiftUpFirst] += keys[idx].isShiftUpFirst;
+        cases[RolloverCase_BothShifts]   += keys[idx].isBothShifts;
+        cases[RolloverCase_OutOfOrder]   += idx + 1 < KEY_COUNT && keys[idx].upTime > keys[idx + 1].upTime;
+        cases[RolloverCase_Flags]        += keys[idx].hasFlags;
+    }
+
+    static KeyComboStack combos;
+    combos = KeyComboStack{};
+    combos.set_max_combos(MAX_KEY_COMBOS);
+
+    u32 releasedCount = 0;
+    u32 mismatches    = 0;
+
+    for (u32 idx = 0; idx < stream.count && mismatches == 0; ++idx) {
+        auto &event   = stream.events[idx];
+        auto  isCombo = combos.set_key(event);
+        auto  isKeyUp = event.stamp && (event.flags & KEY_FLAG_UP);
+
+        if (isKeyUp) {
+            // Released keys stay in the order they went down.
+            auto at = releasedCount++;
+            while (at > 0 && released[at - 1] > event.stamp - 1) {
+                released[at] = released[at - 1];
+                --at;
+            }
+            released[at] = event.stamp - 1;
+        }
+
+        auto shown = releasedCount < MAX_KEY_COMBOS ? releasedCount : MAX_KEY_COMBOS;
+
+        if (isCombo != isKeyUp || combos.keyCombos.size() != shown) {
+            printf("rollover %u/s FAILED at event %u: %u combos shown, expected %u\n",
+                   keysPerSecond, idx, combos.keyCombos.size(), shown);
+            ++mismatches;
+            break;
+        }
+
+        for (u32 age = 0; age < shown; ++age) {
+            auto &actual   = combos.keyCombos.at_newest(age);
+            auto  key      = released[releasedCount - 1 - age];
+            auto &expected = keys[key].combo;
+
+            if (actual.vk_key != expected.vk_key ||
+                actual.time != expected.time ||
+                actual.isShiftDown != expected.isShiftDown ||
+                actual.isCtrlDown != expected.isCtrlDown ||
+                actual.isAltDown != expected.isAltDown) {
+                printf("rollover %u/s FAILED at event %u: key %u shown as vk %02X at %u %s%s%s, typed as vk %02X at %u %s%s%s\n",
+                       keysPerSecond, idx, key,
+                       actual.vk_key, actual.time,
+                       actual.isCtrlDown ? "C" : "-", actual.isAltDown ? "M" : "-", actual.isShiftDown ? "S" : "-",
+                       expected.vk_key, expected.time,
+                       expected.isCtrlDown ? "C" : "-", expected.isAltDown ? "M" : "-", expected.isShiftDown ? "S" : "-");
+                ++mismatches;
+                break;
+            }
+        }
+    }
+
+    auto isCovered = true;
+    for (u32 kind = 0; kind < ROLLOVER_CASE_COUNT; ++kind)
+        isCovered &= cases[kind] > 0;
+
+    auto isOk = mismatches == 0 && releasedCount == KEY_COUNT && isCovered;
+
+    printf("rollover %3u/s %u keys,", keysPerSecond, releasedCount);
+    for (u32 kind = 0; kind < ROLLOVER_CASE_COUNT; ++kind)
+        printf(" %u %s%s", cases[kind], ROLLOVER_CASE_NAMES[kind], kind + 1 < ROLLOVER_CASE_COUNT ? "," : "");
+    printf(" %s\n", isOk ? "ok" : "FAILED");
+
+    return isOk ? 0 : 1;
+}
+
+/*
+ * The replay draws the stroke font's labels, baked and unpacked the way
+ * the overlay gets the default font's ready.
+ */
+int bench_replay()
+{
+    static BenchBakedFont  font;
+    static FirstFrame      first;
+    static KeyComboStack   combos;
+    defer(free_bench_baked_font(&font); free_first_frame(&first));
+
+    BenchSurface frame(650, 150);
+
+    auto place  = Placement{ 20, 15, 650, 150, Justification_Center };
+    auto fade   = FadeTable{};
+    auto result = 0;
+
+    type_first_frame_keys(&combos);
+
+    if (!bake_bench_font(&font) ||
+        !draw_first_frame(LabelSource_BakedFields, font.baked, BenchBakedAtlas{}, 1.0f, &combos, place, &frame.surface, &first)) {
+        printf("replay: can't get the labels ready\n");
+        return 1;
+    }
+
+    build_fade_table(&fade, FadeConfig{ 300, 400, FadeCurve_Linear });
+
+    result |= check_rollover(50, 11);
+    result |= check_rollover(80, 12);
+    printf("\n");
+
+    printf("%-14s %-12s %8s %9s %9s %9s %9s %9s  (microseconds)\n",
+           "stream", "stage", "count", "p50", "p90", "p99", "p99.9", "max");
+
+    auto typing = make_synth_stream(1 << 20, 1);
+    synth_typing(&typing, 100000, 20);
+    synth_finish(&typing);
+    result |= bench_replay_stream("typing 20/s", &typing, first, fade);
+    free_synth_stream(&typing);
+
+    auto fast = make_synth_stream(1 << 20, 4);
+    synth_fast_typing(&fast, 100000, 60);
+    synth_finish(&fast);
+    result |= bench_replay_stream("typing 60/s", &fast, first, fade);
+    free_synth_stream(&fast);
+
+    auto repeats = make_synth_stream(1 << 20, 2);
+    synth_repeat_storm(&repeats, 2000, 60, 33);
+    synth_finish(&repeats);
+    result |= bench_replay_stream("repeat storm", &repeats, first, fade);
+    free_synth_stream(&repeats);
+
+    auto chords = make_synth_stream(1 << 20, 3);
+    synth_chords(&chords, 50000);
+    synth_finish(&chords);
+    result |= bench_replay_stream("chords", &chords, first, fade);
+    free_synth_stream(&chords);
+
+    return result;
+}
+
+/*
+ * The combo stack as it was before it moved onto Ring, kept as the
+ * reference the ring is checked against.  It holds at most eight
+ * combos and walks them newest first with explicit wraparound.
+ */
+struct LegacyComboStack {
+    KeyCombo keyCombos[8];
+    u32      maxUserConfigCombos;
+    i32      keyComboIndex;
+    bool     isOverflowed;
+
+    void set_max_combos(u32 maxCombos) {
+        maxUserConfigCombos = maxCombos;
+        reset_combos();
+    }
+
+    void reset_combos() {
+        keyComboIndex = -1;
+        isOverflowed  = false;
+    }
+
+    void add_combo(KeyCombo combo) {
+        ++keyComboIndex;
+        if (keyComboIndex == i32(maxUserConfigCombos)) {
+            isOverflowed  = true;
+            keyComboIndex = 0;
+        }
+
+        keyCombos[keyComboIndex] = combo;
+
+        auto count = isOverflowed ? i32(maxUserConfigCombos) : keyComboIndex + 1;
+        auto idx   = keyComboIndex;
+
+        for (i32 n = 1; n < count; ++n) {
+            auto prev = idx == 0 ? i32(maxUserConfigCombos) - 1 : idx - 1;
+
+            if (i32(keyCombos[prev].time - keyCombos[idx].time) <= 0)
+                break;
+
+            auto swap       = keyCombos[prev];
+            keyCombos[prev] = keyCombos[idx];
+            keyCombos[idx]  = swap;
+            idx             = prev;
+        }
+    }
+
+    // Newest first, the way the old iterator walked the stack.
+    u32 copy_combos(KeyCombo *out) {
+        if (keyComboIndex == -1)
+            return 0;
+
+        u32  count      = 0;
+        auto index      = keyComboIndex;
+        bool hasWrapped = false;
+
+        do {
+            out[count++] = keyCombos[index];
+
+            if (--index == -1 && isOverflowed) {
+                hasWrapped = true;
+                index      = maxUserConfigCombos - 1;
+            }
+        } while (isOverflowed && hasWrapped ? index != keyComboIndex : index != -1);
+
+        return count;
+    }
+};
+
+u32 copy_combos(KeyComboStack *stack, KeyCombo *out)
+{
+    u32 count = 0;
+    for (auto &combo : stack->keyCombos.newest_first())
+        out[count++] = combo;
+    return count;
+}
+
+/*
+ * Push combos with jittered times, so some arrive out of order, and
+ * the odd reset through both stacks and compare them after every step.
+ * Depths past what the old stack could hold are checked against a
+ * plain array that shifts on every push.
+ */
+int check_ring(BenchRandom *random)
+{
+    constexpr u32 TRIALS = 2000;
+    constexpr u32 STEPS  = 500;
+
+    KeyCombo expected[MAX_KEY_COMBOS];
+    KeyCombo actual[MAX_KEY_COMBOS];
+    u32      failures = 0;
+
+    auto same = [](KeyCombo const *a, KeyCombo const *b, u32 count) {
+        for (u32 idx = 0; idx < count; ++idx) {
+            if (a[idx].vk_key != b[idx].vk_key || a[idx].time != b[idx].time)
+                return false;
+        }
+        return true;
+    };
+
+    for (u32 trial = 0; trial < TRIALS && failures == 0; ++trial) {
+        auto isLegacy = trial % 2 == 0;
+        auto depth    = isLegacy ? 1 + random->next() % 8 : 1 + random->next() % MAX_KEY_COMBOS;
+        auto legacy   = LegacyComboStack{};
+        auto stack    = KeyComboStack{};
+        u32  time     = random->next();
+        u32  count    = 0;
+
+        legacy.set_max_combos(depth);
+        stack.set_max_combos(depth);
+
+        for (u32 step = 0; step < STEPS; ++step) {
+            if (random->next() % 50 == 0) {
+                legacy.reset_combos();
+                stack.reset_combos();
+                count = 0;
+                continue;
+            }
+
+            time += random->next() % 100;
+
+            auto combo = KeyCombo{};
+            combo.vk_key = step;
+            combo.time   = time - random->next() % 150;
+
+            stack.add_combo(combo);
+
+            if (isLegacy) {
+                legacy.add_combo(combo);
+                count = legacy.copy_combos(expected);
+            }
+            else {
+                // Newest first, dropping the oldest when full, then
+                // moved back past anything that went down after it.
+                if (count < depth)
+                    ++count;
+                memmove(expected + 1, expected, (count - 1) * sizeof(KeyCombo));
+                expected[0] = combo;
+
+                for (u32 idx = 0; idx + 1 < count; ++idx) {
+                    if (i32(expected[idx + 1].time - expected[idx].time) <= 0)
+                        break;
+
+                    auto swap         = expected[idx];
+                    expected[idx]     = expected[idx + 1];
+                    expected[idx + 1] = swap;
+                }
+            }
+
+            auto actualCount = copy_combos(&stack, actual);
+            if (actualCount != count || !same(expected, actual, count)) {
+                printf("ring mismatch: trial %u step %u depth %u\n", trial, step, depth);
+                ++failures;
+                break;
+            }
+        }
+    }
+
+    printf("ring         %u randomized trials %s\n", TRIALS, failures ? "FAILED" : "match");
+    return failures ? 1 : 0;
+}
+
+/*
+ * Cost of adding a combo and walking the stack, which is what happens
+ * for every key press.
+ */
+template <typename Stack, typename Copy>
+void time_combo_stack(char const *name, Stack *stack, u32 depth, Copy copy)
+{
+    constexpr u32 ITERATIONS = 2000000;
+
+    KeyCombo out[MAX_KEY_COMBOS];
+    u32      checksum = 0;
+
+    stack->set_max_combos(depth);
+
+    auto start = BenchClock::now();
+    for (u32 iter = 0; iter < ITERATIONS; ++iter) {
+        auto combo = KeyCombo{};
+        combo.vk_key = iter;
+        combo.time   = iter;
+
+        stack->add_combo(combo);
+        checksum += copy(stack, out);
+    }
+    auto elapsed = seconds_since(start);
+
+    printf("%-12s depth %-3u %7.2f ns per push and walk (%u)\n",
+           name,
+           depth,
+           elapsed * 1e9 / ITERATIONS,
+           checksum & 0xF);
+}
+
+int bench_ring()
+{
+    auto random = BenchRandom{ 0x12345 };
+    auto result = check_ring(&random);
+
+    auto legacy = LegacyComboStack{};
+    auto stack  = KeyComboStack{};
+
+    auto copy_legacy = [](LegacyComboStack *s, KeyCombo *out) { return s->copy_combos(out); };
+    auto copy_ring   = [](KeyComboStack *s, KeyCombo *out) { return copy_combos(s, out); };
+
+    time_combo_stack("old stack", &legacy, 4, copy_legacy);
+    time_combo_stack("ring", &stack, 4, copy_ring);
+    time_combo_stack("old stack", &legacy, 8, copy_legacy);
+    time_combo_stack("ring", &stack, 8, copy_ring);
+    time_combo_stack("ring", &stack, MAX_KEY_COMBOS, copy_ring);
+
+    return result;
+}
+
+/*
+ * A producer and a consumer thread pass sequenced key events through
+ * the queue the hook feeds, which checks every event arrives once and
+ * in order.  The counters start just short of wrapping so they wrap
+ * during the run.  When the queue is made to fill, the consumer only
+ * pops once it finds the queue full, so the producer keeps running into
+ * a full queue.  When it is made to run dry, the producer only pushes
+ * into an empty queue, so the consumer keeps finding it empty.  Pushes
+ * and pops come in batches of odd sizes so they start all over the
+ * queue.
+ */
+KeyEvent make_sequenced_event(u32 sequence)
+{
+    return KeyEvent{ sequence * 2654435761u, sequence >> 24, ~sequence, sequence };
+}
+
+int check_spsc(bool isFilling)
+{
+    constexpr u32 CAPACITY = 64;
+    constexpr u32 EVENTS   = 1 << 22;
+    constexpr u32 START    = 0xFFFFFFFFu - 1000;
+
+    using BenchQueue = SpscQueue<KeyEvent, CAPACITY>;
+
+    auto queue = (BenchQueue *)calloc(1, sizeof(BenchQueue));
+    defer(free(queue));
+
+    queue->head.store(START);
+    queue->tail.store(START);
+
+    std::atomic<bool> isStopped{ false };  // the consumer has failed
+
+    u32 fullPushes = 0;
+    u32 emptyPops  = 0;
+
+    auto producer = [&]() {
+        u32 sequence = 0;
+
+        while (sequence < EVENTS && !isStopped.load(std::memory_order_relaxed)) {
+            while (!isFilling && !queue->is_empty() && !isStopped.load(std::memory_order_relaxed))
+                std::this_thread::yield();
+
+            auto burst = 1 + sequence % 37;
+            for (u32 idx = 0; idx < burst && sequence < EVENTS && !isStopped.load(std::memory_order_relaxed); ++idx) {
+                if (queue->push(make_sequenced_event(sequence))) {
+                    ++sequence;
+                    continue;
+                }
+
+                ++fullPushes;
+                std::this_thread::yield();
+            }
+        }
+    };
+
+    auto thread = std::thread(producer);
+
+    KeyEvent batch[CAPACITY];
+    u32      expected = 0;
+    u32      failures = 0;
+
+    auto start = BenchClock::now();
+
+    while (expected < EVENTS && failures == 0) {
+        // Wait for a full queue, or for the last of the events.
+        while (isFilling) {
+            auto queued = queue->tail.load(std::memory_order_acquire) - queue->head.load(std::memory_order_relaxed);
+            if (queued == CAPACITY || expected + queued == EVENTS)
+                break;
+            std::this_thread::yield();
+        }
+
+        auto want  = 1 + expected % 23;
+        auto count = want == 1 ? u32(queue->pop(batch)) : queue->pop_batch(batch, want);
+
+        if (count == 0) {
+            ++emptyPops;
+            std::this_thread::yield();
+            continue;
+        }
+
+        for (u32 idx = 0; idx < count; ++idx, ++expected) {
+            auto should = make_sequenced_event(expected);
+
+            if (batch[idx].vk_key != should.vk_key ||
+                batch[idx].flags != should.flags ||
+                batch[idx].time != should.time ||
+                batch[idx].stamp != should.stamp) {
+                printf("spsc FAILED, event %u arrived as event %u\n", expected, batch[idx].stamp);
+                ++failures;
+                break;
+            }
+        }
+    }
+
+    auto elapsed = seconds_since(start);
+
+    isStopped.store(true);
+    thread.join();
+
+    // Nothing may be left over or made up once every event is in.
+    auto isDrained = failures || queue->is_empty();
+    auto isCovered = isFilling ? fullPushes > 0 : emptyPops > 0;
+
+    failures += !isDrained || !isCovered || expected != EVENTS;
+
+    printf("spsc %-7s %u events in order, %u pushes on a full queue, %u pops on an empty one, %.1f ns per event %s\n",
+           isFilling ? "filling" : "dry",
+           expected,
+           fullPushes,
+           emptyPops,
+           elapsed * 1e9 / EVENTS,
+           failures ? "FAILED" : "ok");
+
+    return failures ? 1 : 0;
+}
+
+int bench_spsc()
+{
+    auto result = check_spsc(true);
+    result |= check_spsc(false);
+    return result;
+}
+
+/*
+ * Frames of the strip drawn by the software renderer for a set of
+ * scenes, checked against hashes of frames known to be right.  The
+ * placeholder atlas is generated, so the frames are the same on every
+ * machine and every compositing level.  Any change to layout, placement
+ * or compositing that moves a pixel shows up here; once the new frames
+ * have been looked at, written out as PNGs by passing a directory, their
+ * hashes replace the old ones.
+ */
+constexpr u16 GOLDEN_CTRL  = Modifier_Ctrl << 8;
+constexpr u16 GOLDEN_ALT   = Modifier_Alt << 8;
+constexpr u16 GOLDEN_SHIFT = Modifier_Shift << 8;
+
+struct GoldenScene {
+    char const            *name;
+    i32                    width;
+    i32                    height;
+    PlacementJustification justification;
+    u32                    depth;
+    u8                     alpha;
+    u16                    keys[16];  // virtual key and GOLDEN_* modifiers, zero ends
+    u64                    hash;
+};
+
+static GoldenScene const GOLDEN_SCENES[] = {
+    { "single key", 650, 150, Justification_Center, 4, 255,
+      { 'A' }, 0xcf76b5f5e1ab7f70ull },
+    { "typing", 650, 150, Justification_Center, 4, 255,
+      { 'H', 'E', 'L', 'L', 'O', 0x20, 'W', 'O', 'R', 'L', 'D' }, 0x9e16f35535ccce95ull },
+    { "chords left", 650, 150, Justification_Left, 4, 255,
+      { 'S' | GOLDEN_CTRL, 0x75 | GOLDEN_CTRL|GOLDEN_ALT|GOLDEN_SHIFT, 0x0D | GOLDEN_SHIFT, 'T' | GOLDEN_ALT }, 0xc037a081c438d18cull },
+    { "chords right", 650, 150, Justification_Right, 6, 255,
+      { 0x09 | GOLDEN_ALT, 0x2E | GOLDEN_CTRL|GOLDEN_ALT, '1' | GOLDEN_SHIFT, 0xBF, 0x25 | GOLDEN_CTRL|GOLDEN_SHIFT, 0x70 }, 0x25f61a648ac5e518ull },
+    { "clipped", 320, 90, Justification_Center, 8, 255,
+      { 'Q' | GOLDEN_CTRL, 'W', 'E' | GOLDEN_ALT, 'R', 'T' | GOLDEN_SHIFT, 0x21, 0x22, 0x7B | GOLDEN_CTRL }, 0xc0a55eeee52bc545ull },
+    { "faded", 650, 150, Justification_Center, 4, 96,
+      { 'Z' | GOLDEN_CTRL, 'Y' | GOLDEN_CTRL }, 0x71176c0be88b76e0ull },
+    { "mouse", 650, 150, Justification_Center, 4, 255,
+      { u16(KEY_LBUTTON) | GOLDEN_CTRL, u16(KEY_WHEEL_DOWN), 'C', u16(KEY_RBUTTON) | GOLDEN_SHIFT }, 0x27ffcbb88961c5f5ull },
+};
+
+u64 hash_pixels(u32 const *pixels, u32 count)
+{
+    u64 hash = 14695981039346656037ull;
+
+    for (u32 idx = 0; idx < count; ++idx) {
+        hash ^= pixels[idx];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+void draw_golden_scene(GoldenScene const &scene, ComboLayout const &layout, GlyphAtlas const &atlas, Surface *surface)
+{
+    auto place = Placement{ 20, 15, scene.width, scene.height, scene.justification };
+
+    memset(surface->pixels, 0, size_t(surface->width) * surface->height * sizeof(u32));
+    composite_combo_strip(surface, layout, atlas, place);
+    if (scene.alpha < 255)
+        scale_alpha(surface, scene.alpha);
+}
+
+int bench_golden(char const *writeDir)
+{
+    constexpr u32 ITERATIONS = 2000;
+
+    static LabelMeasurements labels;
+    static GlyphAtlas        atlas;
+    static KeyComboStack     combos;
+    static ComboLayout       layout;
+
+    make_placeholder_atlas(&labels, &atlas);
+    defer(free_glyph_atlas(&atlas));
+
+    auto best     = detect_composite_level();
+    auto failures = 0;
+    auto rgba     = (u8 *)nullptr;
+    auto encoder  = PngEncoder{};
+    defer(free(rgba); free_png_encoder(&encoder));
+
+    printf("%-14s %-12s %8s %9s %9s %9s %9s %9s  (microseconds)\n",
+           "scene", "frame", "count", "p50", "p90", "p99", "p99.9", "max");
+
+    for (auto &scene : GOLDEN_SCENES) {
+        BenchSurface target(scene.width, scene.height);
+
+        auto count = u32(scene.width) * u32(scene.height);
+
+        combos = KeyComboStack{};
+        combos.set_max_combos(scene.depth);
+
+        for (u32 idx = 0; idx < COUNT_OF(scene.keys) && scene.keys[idx]; ++idx) {
+            auto key   = scene.keys[idx];
+            auto combo = KeyCombo{};
+
+            combo.vk_key      = key & 0xFF;
+            combo.time        = 1000 + 100*idx;
+            combo.isCtrlDown  = (key & GOLDEN_CTRL) != 0;
+            combo.isAltDown   = (key & GOLDEN_ALT) != 0;
+            combo.isShiftDown = (key & GOLDEN_SHIFT) != 0;
+            combos.add_combo(combo);
+        }
+
+        layout_combos(&combos, labels, &layout);
+
+        // Every level has to draw the same frame.
+        u64 hash = 0;
+        for (i32 level = 0; level <= best; ++level) {
+            set_composite_level(CompositeLevel(level));
+            draw_golden_scene(scene, layout, atlas, &target.surface);
+
+            auto levelHash = hash_pixels(target.surface.pixels, count);
+            if (level > 0 && levelHash != hash) {
+                printf("%s: %s draws a different frame than scalar\n", scene.name, COMPOSITE_LEVEL_NAMES[level]);
+                ++failures;
+            }
+            hash = levelHash;
+        }
+
+        if (hash != scene.hash) {
+            printf("%s: frame hash %016llx, expected %016llx\n",
+                   scene.name,
+                   (unsigned long long)hash,
+                   (unsigned long long)scene.hash);
+            ++failures;
+        }
+
+        if (writeDir) {
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/%s.png", writeDir, scene.name);
+
+            rgba = (u8 *)realloc(rgba, count * 4);
+            convert_frame(target.surface.pixels, count, rgba, true);
+            encode_png(&encoder, rgba, scene.width, scene.height);
+
+            auto file = fopen(path, "wb");
+            if (file) {
+                fwrite(encoder.png.bytes, 1, encoder.png.count, file);
+                fclose(file);
+            }
+        }
+
+        auto samples = LatencySamples{};
+        for (u32 iter = 0; iter < ITERATIONS; ++iter) {
+            auto start = BenchClock::now();
+            draw_golden_scene(scene, layout, atlas, &target.surface);
+            samples.add(start);
+        }
+
+        print_percentiles(scene.name, COMPOSITE_LEVEL_NAMES[best], &samples);
+    }
+
+    if (failures == 0)
+        printf("golden: %u scenes match\n", u32(COUNT_OF(GOLDEN_SCENES)));
+
+    return failures ? 1 : 0;
+}
+
+/*
+ * Labels drawn from signed distance fields against the same labels
+ * rasterized directly, at sizes from small overlays to large ones.  The
+ * stroke font stands in for a system font: its fields are built once
+ * and every size is drawn from them, while the reference is rasterized
+ * from the strokes at each size with 64 samples a pixel.  The SIMD
+ * sampler has to draw the same atlas as the scalar one, and the
+ * difference from the reference has to stay under about a pixel's worth
+ * of edge.  Timing compares rebuilding the atlas from the fields, which
+ * is what a font size or DPI change costs, with rasterizing it.
+ */
+/*
+ * How far labels drawn from the fields are from the same labels drawn
+ * directly, over the pixels either version covers so the empty space
+ * around them doesn't water it down.
+ */
+struct SdfError {
+    u64 sum;
+    u32 max;
+    u32 covered;
+    u32 large;  // pixels off by more than an eighth
+};
+
+void add_sdf_error(SdfError *error, GlyphAtlas const &reference, GlyphAtlas const &drawn, Sprite sprite)
+{
+    for (i32 y = sprite.y; y < sprite.y + sprite.height; ++y) {
+        for (i32 x = sprite.x; x < sprite.x + sprite.width; ++x) {
+            auto a = reference.pixels[size_t(y) * reference.width + x] >> 24;
+            auto b = drawn.pixels[size_t(y) * drawn.width + x] >> 24;
+            if (a == 0 && b == 0)
+                continue;
+
+            auto difference = a > b ? a - b : b - a;
+
+            error->sum     += difference;
+            error->max      = difference > error->max ? difference : error->max;
+            error->large   += difference > 32;
+            error->covered += 1;
+        }
+    }
+}
+
+/*
+ * Edges count as crisp and in place when the labels are off by 10
+ * levels of 255 or less on average and hardly any pixel is off by more
+ * than an eighth, which only happens where a field can't follow the
+ * outline, in the corners where strokes meet.  That holds down to the
+ * smallest modifiers, where strokes are about a pixel wide and the
+ * fields are supersampled.
+ */
+constexpr f64 SDF_MAX_MEAN_ERROR = 10.0;   // alpha levels
+constexpr f64 SDF_MAX_LARGE      = 0.01;   // of covered pixels
+
+/**
+ * @return False if labels aren't close enough to the direct ones.
+ */
+bool check_sdf_error(char const *what, f32 size, SdfError const &error, f64 sdfTime, f64 directTime)
+{
+    auto mean  = error.covered ? f64(error.sum) / error.covered : 0.0;
+    auto large = error.covered ? f64(error.large) / error.covered : 0.0;
+    auto isOk  = mean <= SDF_MAX_MEAN_ERROR && large <= SDF_MAX_LARGE;
+
+    printf("%-10s %6g %9.2f %9u %8.2f%% %11.2f %11.2f%s\n",
+           what,
+           size,
+           mean,
+           error.max,
+           100.0 * large,
+           sdfTime * 1e3,
+           directTime * 1e3,
+           isOk ? "" : "  FAILED");
+
+    return isOk;
+}
+
+int bench_sdf()
+{
+    constexpr f32 SIZES[]            = { 8.0f, 12.0f, 16.0f, 24.0f, 40.0f, 64.0f, 96.0f };
+    constexpr i32 SAMPLER_ITERATIONS = 1000000;
+
+    static u32               codepoints[MAX_SDF_GLYPHS];
+    static SdfFont           font;
+    static LabelMeasurements labels;
+    static GlyphAtlas        reference;
+    static GlyphAtlas        drawn;
+
+    auto best     = detect_composite_level();
+    auto failures = 0;
+    auto count    = collect_label_characters(US_KEY_TABLE, codepoints, COUNT_OF(codepoints));
+
+    auto start = BenchClock::now();
+    build_segment_sdf_font(&font, codepoints, count);
+    auto buildTime = seconds_since(start);
+    defer(free_sdf_font(&font); free_glyph_atlas(&reference); free_glyph_atlas(&drawn));
+
+    printf("sdf font: %u glyphs in %dx%d texels, built in %.1f ms\n",
+           font.glyphCount, font.width, font.height, buildTime * 1e3);
+    printf("%-10s %6s %9s %9s %9s %11s %11s\n",
+           "labels", "size", "mean err", "max err", "off >32", "sdf ms", "direct ms");
+
+    for (auto size : SIZES) {
+        auto modifierSize = default_modifier_size(size);
+
+        measure_sdf_labels(&labels, font, font, size, modifierSize);
+
+        start = BenchClock::now();
+        layout_glyph_atlas(&reference, labels);
+        draw_segment_labels(&reference, labels, size, modifierSize);
+        auto directTime = seconds_since(start);
+
+        // Every level has to draw the same atlas.
+        auto pixels = size_t(reference.width) * reference.height;
+        auto scalar = (u32 *)nullptr;
+        defer(free(scalar));
+
+        auto sdfTime = 0.0;
+        for (i32 level = 0; level <= best; ++level) {
+            set_composite_level(CompositeLevel(level));
+
+            start = BenchClock::now();
+            layout_glyph_atlas(&drawn, labels);
+            draw_sdf_labels(&drawn, labels, font, font, size, modifierSize, 0xFFFFFFFF);
+            sdfTime = seconds_since(start);
+
+            if (level == 0) {
+                scalar = (u32 *)malloc(pixels * sizeof(u32));
+                memcpy(scalar, drawn.pixels, pixels * sizeof(u32));
+            }
+            else if (memcmp(scalar, drawn.pixels, pixels * sizeof(u32)) != 0) {
+                printf("sdf %g: %s draws a different atlas than scalar\n", size, COMPOSITE_LEVEL_NAMES[level]);
+                ++failures;
+            }
+        }
+
+        // Keys and chords are drawn at the letter size and modifiers at
+        // the modifier size, so they are checked apart.
+        auto keys      = SdfError{};
+        auto modifiers = SdfError{};
+
+        for (auto &levels : reference.keys) {
+            for (auto &sprite : levels)
+                add_sdf_error(&keys, reference, drawn, sprite);
+        }
+        for (auto &sprite : reference.chords)
+            add_sdf_error(&keys, reference, drawn, sprite);
+        for (auto &sprite : reference.modifiers)
+            add_sdf_error(&modifiers, reference, drawn, sprite);
+
+        failures += !check_sdf_error("keys", size, keys, sdfTime, directTime);
+        failures += !check_sdf_error("modifiers", modifierSize, modifiers, sdfTime, directTime);
+    }
+
+    // The sampler alone, over the pixels of one row of a glyph cell at
+    // 40 pixels, which is what draw_sdf_text hands it.
+    f32 values[SDF_ATLAS_WIDTH];
+    u32 out[256];
+
+    for (i32 col = 0; col < font.cellWidth; ++col)
+        values[col] = f32(font.texels[size_t(font.cellHeight / 2) * font.width + col]);
+
+    auto scale  = 40.0f / f32(SDF_EM);
+    auto slope  = SDF_SPREAD * scale / 127.0f;
+    auto row    = SdfRow{ values, font.cellWidth, 1.0f / scale, -0.5f, slope, 0.5f - 128.0f * slope };
+    auto pixels = i32(ceilf(font.cellWidth * scale));
+
+    for (i32 level = 0; level <= best; ++level) {
+        auto sample = SDF_ROW_SAMPLERS[level];
+
+        start = BenchClock::now();
+        for (i32 iter = 0; iter < SAMPLER_ITERATIONS; ++iter)
+            sample(row, iter & 7, pixels, out);
+        auto elapsed = seconds_since(start);
+
+        printf("sdf sampler %-6s %9.1f Mpixels/s\n",
+               COMPOSITE_LEVEL_NAMES[level],
+               f64(pixels) * SAMPLER_ITERATIONS / elapsed / 1e6);
+    }
+
+    if (failures == 0)
+        printf("sdf: labels from %g px match the direct labels\n", MIN_MODIFIER_SIZE);
+
+    return failures ? 1 : 0;
+}
+
+/**
+ * @return False if bytes don't come back the same from pack_texels and
+ * unpack_texels.
+ */
+bool round_trip_texels(u8 const *texels, u32 count)
+{
+    auto capacity = count + count / 128 + 1;
+    auto packed   = (u8 *)malloc(capacity);
+    auto unpacked = (u8 *)malloc(count ? count : 1);
+    defer(free(packed); free(unpacked));
+
+    auto size = pack_texels(texels, count, packed, capacity);
+    if (count > 0 && size == 0)
+        return false;
+
+    return unpack_texels(packed, size, unpacked, count) && memcmp(texels, unpacked, count) == 0;
+}
+
+/*
+ * Baked fonts against building them when the first key is shown.  The
+ * stroke font stands in for the default font, which needs GDI+ to
+ * build: it is built for every printable ASCII character the way
+ * shoki-bake does, packed, written out as source and unpacked again,
+ * which has to give back the same font.  The packer is also checked on
+ * runs around its limits and on noise.
+ */
+int bench_bake()
+{
+    constexpr i32 LOAD_ITERATIONS = 200;
+
+    static SdfFont built;
+    static SdfFont loaded;
+    defer(free_sdf_font(&built); free_sdf_font(&loaded));
+
+    u32 failures = 0;
+
+    // Runs and literals either side of 128, and nothing at all.
+    {
+        static u8 texels[1024];
+        auto random = BenchRandom{ 0x62616b65ull };
+
+        u32 const lengths[] = { 0, 1, 2, 3, 127, 128, 129, 130, 256, 257, 1024 };
+        for (auto length : lengths) {
+            memset(texels, 7, length);
+            failures += !round_trip_texels(texels, length);
+
+            for (u32 idx = 0; idx < length; ++idx)
+                texels[idx] = u8(idx & 1 ? 0 : 255);
+            failures += !round_trip_texels(texels, length);
+
+            for (u32 idx = 0; idx < length; ++idx)
+                texels[idx] = u8(random.next() % 3 ? random.next() : 0);
+            failures += !round_trip_texels(texels, length);
+        }
+
+        u8 const truncated[] = { 3, 1, 2 };
+        failures += unpack_texels(truncated, sizeof(truncated), texels, 4);
+
+        if (failures)
+            printf("bake: %u packer round trips failed\n", failures);
+    }
+
+    u32 codepoints[0x7F - 0x20];
+    u32 count = 0;
+    for (u32 ch = 0x20; ch < 0x7F; ++ch)
+        codepoints[count++] = ch;
+
+    auto start = BenchClock::now();
+    build_segment_sdf_font(&built, codepoints, count);
+    auto buildTime = seconds_since(start);
+
+    auto texelCount = u32(built.width) * u32(built.height);
+    auto capacity   = texelCount + texelCount / 128 + 1;
+    auto packed     = (u8 *)malloc(capacity);
+    defer(free(packed));
+
+    start = BenchClock::now();
+    auto packedSize = pack_texels(built.texels, texelCount, packed, capacity);
+    auto packTime   = seconds_since(start);
+
+    auto baked = BakedSdfFont{ L"segments",
+                               built.width,
+                               built.height,
+                               built.cellWidth,
+                               built.cellHeight,
+                               built.lineHeight,
+                               built.glyphCount,
+                               built.glyphs,
+                               packed,
+                               packedSize };
+
+    start = BenchClock::now();
+    for (i32 iter = 0; iter < LOAD_ITERATIONS; ++iter)
+        load_baked_sdf_font(baked, &loaded);
+    auto loadTime = seconds_since(start) / LOAD_ITERATIONS;
+
+    auto isSame = (loaded.texels &&
+                   loaded.width == built.width &&
+                   loaded.height == built.height &&
+                   loaded.cellWidth == built.cellWidth &&
+                   loaded.cellHeight == built.cellHeight &&
+                   loaded.lineHeight == built.lineHeight &&
+                   loaded.glyphCount == built.glyphCount &&
+                   memcmp(loaded.glyphs, built.glyphs, built.glyphCount * sizeof(SdfGlyph)) == 0 &&
+                   memcmp(loaded.texels, built.texels, texelCount) == 0);
+
+    if (!isSame) {
+        printf("bake: the unpacked font differs from the one built\n");
+        ++failures;
+    }
+
+    u32 const used[] = { 'A', 'C', 'L', 'R', 'S', 'T' };  // sorted, like collect_label_characters
+    u32 const missing[] = { 'A', 0xE9 };
+    if (!does_baked_font_cover(baked, used, COUNT_OF(used)) || does_baked_font_cover(baked, missing, COUNT_OF(missing))) {
+        printf("bake: wrong coverage\n");
+        ++failures;
+    }
+
+    // The source shoki-bake would write, without keeping it.
+    auto source = tmpfile();
+    auto sourceBytes = 0L;
+    if (!source || !write_baked_sdf_font(source, "BAKED_BENCH_FONT", L"segments", built)) {
+        printf("bake: can't write the font as source\n");
+        ++failures;
+    }
+    else {
+        sourceBytes = ftell(source);
+    }
+    if (source)
+        fclose(source);
+
+    printf("bake: %u glyphs, %u texels packed into %u bytes (%.1f%%) in %.2f ms, %ld bytes of source\n",
+           built.glyphCount,
+           texelCount,
+           packedSize,
+           100.0 * packedSize / texelCount,
+           packTime * 1e3,
+           sourceBytes);
+    printf("bake: building the font %.2f ms, unpacking it %.3f ms\n", buildTime * 1e3, loadTime * 1e3);
+
+    // The first frame from every source, best of a few runs, at the
+    // default size and at 150% DPI.  Fields give the same frame whether
+    // they're baked or built, and so does an atlas baked from them, but
+    // only at the scale it was baked at.
+    {
+        constexpr i32 RUNS     = 5;
+        constexpr f32 SCALES[] = { 1.0f, 1.5f };
+
+        static FirstFrame      frames[LabelSource_Count];
+        static KeyComboStack   combos;
+        static BenchBakedAtlas bakedAtlas;
+        defer(for (auto &frame : frames) free_first_frame(&frame));
+        defer(free(bakedAtlas.packed));
+
+        BenchSurface surfaces[LabelSource_Count] = { { 650, 150 }, { 650, 150 }, { 650, 150 }, { 650, 150 } };
+
+        auto place = Placement{ 20, 15, 650, 150, Justification_Center };
+        type_first_frame_keys(&combos);
+
+        printf("%-14s %6s %9s %9s %15s %12s\n", "first frame", "scale", "fonts ms", "atlas ms", "first frame ms", "baked bytes");
+
+        for (auto scale : SCALES) {
+            for (u32 source = 0; source < LabelSource_Count; ++source) {
+                if (source == LabelSource_BakedAtlas && scale != SCALES[0]) {
+                    printf("%-14s %5.0f%% %9s  none baked, so built fields or direct labels\n", LABEL_SOURCE_NAMES[source], scale * 100.0f, "-");
+                    continue;
+                }
+
+                auto best = FirstFrame{};
+                auto isOk = true;
+
+                for (i32 run = 0; run < RUNS; ++run) {
+                    auto &frame = frames[source];
+
+                    free_first_frame(&frame);
+                    isOk = isOk && draw_first_frame(LabelSource(source), baked, bakedAtlas, scale, &combos, place, &surfaces[source].surface, &frame);
+
+                    if (run == 0 || frame.frameSeconds < best.frameSeconds) {
+                        best.fontSeconds  = frame.fontSeconds;
+                        best.atlasSeconds = frame.atlasSeconds;
+                        best.frameSeconds = frame.frameSeconds;
+                    }
+                }
+
+                // The atlas to bake is the one the baked fields just drew.
+                if (source == LabelSource_BakedFields && scale == SCALES[0] && isOk) {
+                    auto &atlas    = frames[source].atlas;
+                    auto  bytes    = u32(atlas.width) * u32(atlas.height) * sizeof(u32);
+                    auto  capacity = bytes + bytes / 128 + 1;
+
+                    bakedAtlas.labels     = frames[source].labels;
+                    bakedAtlas.packed     = (u8 *)malloc(capacity);
+                    bakedAtlas.packedSize = bakedAtlas.packed ? pack_texels((u8 const *)atlas.pixels, bytes, bakedAtlas.packed, capacity) : 0;
+                    isOk = bakedAtlas.packedSize > 0;
+                }
+
+                auto bakedBytes = (source == LabelSource_BakedFields ? 2 * baked.packedSize :
+                                   source == LabelSource_BakedAtlas ? bakedAtlas.packedSize : 0);
+                auto isSame     = (source == LabelSource_DirectLabels ||
+                                   memcmp(surfaces[source].surface.pixels,
+                                          surfaces[LabelSource_BakedFields].surface.pixels,
+                                          650 * 150 * sizeof(u32)) == 0);
+
+                printf("%-14s %5.0f%% %9.2f %9.2f %15.2f %12u%s\n",
+                       LABEL_SOURCE_NAMES[source],
+                       scale * 100.0f,
+                       best.fontSeconds * 1e3,
+                       best.atlasSeconds * 1e3,
+                       best.frameSeconds * 1e3,
+                       bakedBytes,
+                       !isOk ? "  FAILED" : !isSame ? "  DIFFERS" : "");
+
+                failures += !isOk || !isSame;
+            }
+        }
+    }
+
+    if (failures == 0)
+        printf("bake: baked font matches\n");
+
+    return failures ? 1 : 0;
+}
+
+/*
+ * A snapshot that can tell when it's been freed or changed under a
+ * reader: every word is derived from the serial, and freeing it
+ * scribbles over them first.
+ */
+struct BenchSnapshot {
+    u64 serial;
+    u64 words[7];
+};
+
+/*
+ * The config parser against a file that sets everything and lines it
+ * has to turn down, then snapshots published through Rcu as fast as a
+ * writer can make them while reader threads check every one they see
+ * and pass through quiescent states as often as the UI thread's loop
+ * would at most.  A reader seeing a snapshot that was freed, or
+ * snapshots going backwards, is a failure.
+ */
+int bench_config()
+{
+    constexpr u32 PUBLICATIONS = 20000;
+    constexpr u32 READERS      = 3;
+
+    auto failures = 0;
+
+    char const *text =
+        "# every setting\n"
+        "font = Lucida Console\n"
+        "font-size = 32\n"
+        "text-color = #80FFCC00\n"
+        "box-color  = #202020\n"
+        "  hold = 500  \r\n"
+        "fade-out = 250\n"
+        "fade-curve = ease-out\n"
+        "combos = 6\n"
+        "offset-x = -4\n"
+        "offset-y = 30\n"
+        "justify = right\n"
+        "mouse = on\n"
+        "renderer = gdiplus\n";
+
+    auto config = default_config();
+    auto error  = ConfigError{};
+
+    if (!parse_config(text, strlen(text), &config, &error) ||
+        wcscmp(config.fontFamily, L"Lucida Console") != 0 ||
+        config.letterSize != 32.0f || config.modifierSize != 6.4f ||
+        config.textColor != 0x80FFCC00 || config.boxColor != 0xFF202020 ||
+        config.fade.holdMilliseconds != 500 || config.fade.fadeOutMilliseconds != 250 ||
+        config.fade.curve != FadeCurve_EaseOut || config.maxCombos != 6 ||
+        config.offset_x != -4 || config.offset_y != 30 ||
+        config.justification != Justification_Right || !config.showMouse ||
+        config.renderer != StripBackend_Gdiplus) {
+        printf("config: full file parsed wrong\n");
+        ++failures;
+    }
+
+    // Font names are UTF-8, limited in characters rather than bytes.
+    struct FontConfig {
+        char const    *text;
+        wchar_t const *family;
+    };
+
+    static FontConfig const FONT_CONFIGS[] = {
+        { "font = \xE6\xB8\xB8\xE3\x82\xB4\xE3\x82\xB7\xE3\x83\x83\xE3\x82\xAF\n", L"\u6E38\u30B4\u30B7\u30C3\u30AF" },
+        { "font = Caf\xC3\xA9 Mono\n", L"Caf\u00E9 Mono" },
+        { "font = \xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9"
+          "\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9"
+          "\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\n",
+          L"\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9"
+          L"\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9\u00E9" },
+    };
+
+    for (auto &font : FONT_CONFIGS) {
+        auto fontConfig = default_config();
+
+        if (!parse_config(font.text, strlen(font.text), &fontConfig, &error) ||
+            wcscmp(fontConfig.fontFamily, font.family) != 0) {
+            printf("config: \"%s\" decoded wrong\n", font.text);
+            ++failures;
+        }
+    }
+
+    struct BadConfig {
+        char const *text;
+        u32         line;
+    };
+
+    static BadConfig const BAD_CONFIGS[] = {
+        { "combos = 0\n", 1 },
+        { "combos = 4\njustify = middle\n", 2 },
+        { "\n\ntext-color = #12345\n", 3 },
+        { "volume = 11\n", 1 },
+        { "font-size 40\n", 1 },
+        { "# fine\nhold = 10ms\n", 2 },
+        { "mouse = yes\n", 1 },
+        { "renderer = direct2d\n", 1 },
+        { "font = Caf\xC3\n", 1 },
+        { "font = \xC0\xAF\n", 1 },
+        { "font = \xED\xA0\x80\n", 1 },
+        { "font = abcdefghijklmnopqrstuvwxyz\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\n", 1 },
+    };
+
+    for (auto &bad : BAD_CONFIGS) {
+        auto before = default_config();
+        auto after  = before;
+
+        if (parse_config(bad.text, strlen(bad.text), &after, &error) ||
+            error.line != bad.line ||
+            memcmp(&before, &after, sizeof(Config)) != 0) {
+            printf("config: \"%s\" wasn't turned down at line %u\n", bad.text, bad.line);
+            ++failures;
+        }
+    }
+
+    // Snapshots going through Rcu.
+    static Rcu<BenchSnapshot> rcu;
+
+    std::atomic<bool> isDone{ false };
+    std::atomic<u32>  bad{ 0 };
+    std::atomic<u64>  reads{ 0 };
+    std::atomic<u32>  freed{ 0 };
+
+    auto make = [](u64 serial) {
+        auto snapshot = (BenchSnapshot *)malloc(sizeof(BenchSnapshot));
+
+        snapshot->serial = serial;
+        for (u32 idx = 0; idx < COUNT_OF(snapshot->words); ++idx)
+            snapshot->words[idx] = serial * (idx + 3) + idx;
+
+        return snapshot;
+    };
+
+    auto release = [&](BenchSnapshot const *snapshot) {
+        memset((void *)snapshot, 0xDD, sizeof(BenchSnapshot));
+        free((void *)snapshot);
+        freed.fetch_add(1, std::memory_order_relaxed);
+    };
+
+    rcu.publish(make(0), release);
+
+    auto reader = [&]() {
+        auto id   = rcu.add_reader();
+        u64  last = 0;
+        u64  count = 0;
+
+        // Readers yield after every pass like the UI thread goes back
+        // to waiting, which lets the writer run on a single core.
+        while (!isDone.load(std::memory_order_relaxed)) {
+            rcu.quiescent(id);
+
+            // The first snapshot of a pass is held through all of it, the
+            // way a frame holds the config it started with.
+            auto held = rcu.read();
+            auto intact = [&](BenchSnapshot const *snapshot, u64 serial) {
+                bool isIntact = snapshot->serial == serial;
+                for (u32 idx = 0; idx < COUNT_OF(snapshot->words); ++idx)
+                    isIntact &= snapshot->words[idx] == serial * (idx + 3) + idx;
+                return isIntact;
+            };
+            auto heldSerial = held->serial;
+
+            for (u32 pass = 0; pass < 1024; ++pass, ++count) {
+                auto snapshot = rcu.read();
+                auto serial   = snapshot->serial;
+
+                if (serial < last || !intact(snapshot, serial) || !intact(held, heldSerial))
+                    bad.fetch_add(1, std::memory_order_relaxed);
+                last = serial;
+
+                // Readers get descheduled while they hold a snapshot.
+                if (pass == 512)
+                    std::this_thread::yield();
+            }
+
+            std::this_thread::yield();
+        }
+
+        reads.fetch_add(count, std::memory_order_relaxed);
+    };
+
+    std::thread threads[READERS];
+    for (auto &thread : threads)
+        thread = std::thread(reader);
+
+    // Let every reader register before anything is retired.
+    while (rcu.readerCount.load() < READERS)
+        std::this_thread::yield();
+
+    auto start = BenchClock::now();
+    u32  full  = 0;
+
+    for (u32 serial = 1; serial <= PUBLICATIONS; ++serial) {
+        auto snapshot = make(serial);
+
+        while (!rcu.publish(snapshot, release)) {
+            ++full;
+            std::this_thread::yield();
+        }
+
+        if (serial % 16 == 0)
+            std::this_thread::yield();
+    }
+
+    auto elapsed = seconds_since(start);
+
+    isDone.store(true);
+    for (auto &thread : threads)
+        thread.join();
+
+    rcu.free_all(release);
+
+    if (bad.load() || freed.load() != PUBLICATIONS + 1) {
+        printf("rcu: %u bad reads, %u of %u snapshots freed\n", bad.load(), freed.load(), PUBLICATIONS + 1);
+        ++failures;
+    }
+
+    printf("rcu: %u publications in %.1f ms, %u waits on a full retired list, %.1f M reads/s on %u readers\n",
+           PUBLICATIONS,
+           elapsed * 1e3,
+           full,
+           reads.load() / elapsed / 1e6,
+           READERS);
+
+    if (failures == 0)
+        printf("config: parser and rcu ok\n");
+
+    return failures ? 1 : 0;
+}
+
+/*
+ * Input from a mouse reporting rate times a second: a move in every
+ * report, two clicks a second, and a wheel spin a second that ticks in
+ * every report for up to half a second, in any direction.
+ *
+ * @return The number of inputs written to out.
+ */
+u32 synth_mouse(MouseInput *out, u32 capacity, u32 rate, u32 seconds, BenchRandom *random)
+{
+    constexpr u8 BUTTONS[] = { u8(KEY_LBUTTON), u8(KEY_RBUTTON), u8(KEY_MBUTTON), u8(KEY_XBUTTON1) };
+
+    auto period  = 1000000 / rate;
+    u32  count   = 0;
+    u32  spin    = 0;  // reports left in the wheel spin
+    auto action  = MouseAction_Wheel;
+    i16  delta   = 0;
+    u8   held    = 0;  // button waiting to come up
+    u32  upStamp = 0;
+
+    for (u32 report = 0; report < rate * seconds && count + 2 <= capacity; ++report) {
+        auto stamp = report * period;
+        auto time  = stamp / 1000;
+        auto roll  = random->next() % rate;  // per second odds
+
+        auto push = [&](MouseAction what, u8 vk, i16 amount) {
+            out[count++] = MouseInput{ what, vk, amount, time, stamp };
+        };
+
+        if (held && stamp >= upStamp) {
+            push(MouseAction_ButtonUp, held, 0);
+            held = 0;
+        }
+
+        if (spin > 0) {
+            push(action, 0, delta);
+            --spin;
+        }
+        else if (roll < 1) {
+            spin   = (50 + random->next() % 450) * rate / 1000;
+            action = random->next() % 4 ? MouseAction_Wheel : MouseAction_HWheel;
+            delta  = random->next() % 2 ? 120 : -120;
+        }
+        else if (roll < 3 && !held) {
+            held    = BUTTONS[random->next() % COUNT_OF(BUTTONS)];
+            upStamp = stamp + 40000 + random->next() % 80000;
+            push(MouseAction_ButtonDown, held, 0);
+        }
+        else {
+            push(MouseAction_Move, 0, 0);
+        }
+    }
+
+    return count;
+}
+
+/*
+ * The mouse hook's filter against synthetic input at gaming mouse
+ * rates.  Every button has to come through in order, no move may, and
+ * a wheel tick has to come through exactly when nothing in its
+ * direction did for a whole window before it.  The window is a frame
+ * of the scheduler, so it is checked at several refresh rates, and
+ * changed halfway through the input the way a move to another monitor
+ * changes it.  What comes through at 60 Hz is then replayed into a
+ * combo stack to count the combos it makes, and the filter is timed on
+ * its own.
+ */
+int bench_mouse()
+{
+    // Refresh rates the wheel is merged over, switching to another
+    // halfway through if there is one.  The last is reported on.
+    struct WheelRun {
+        u32 hertz;
+        u32 switchTo;
+    };
+
+    constexpr u32      RATES[]       = { 1000, 8000 };
+    constexpr WheelRun WHEEL_RUNS[]  = { { 144, 0 }, { 30, 0 }, { 144, 30 }, { 60, 0 } };
+    constexpr u32      SECONDS       = 60;
+    constexpr u32      WHEEL_WINDOW  = 1000000 / 60;
+    constexpr u32      TIMING_PASSES = 20;
+
+    auto capacity = 2 * RATES[COUNT_OF(RATES) - 1] * SECONDS;
+    auto inputs   = (MouseInput *)malloc(capacity * sizeof(MouseInput));
+    defer(free(inputs));
+
+    u32 failures = 0;
+
+    for (auto rate : RATES) {
+        auto random = BenchRandom{ 0x6d6f757365ull };
+        auto count  = synth_mouse(inputs, capacity, rate, SECONDS, &random);
+        auto filter = MouseFilter{};
+        auto combos = KeyComboStack{};
+
+        combos.set_max_combos(MAX_KEY_COMBOS);
+
+        u32 passed     = 0;
+        u32 comboCount = 0;
+        u32 wheels[COUNT_OF(WHEEL_RUNS)];
+
+        for (u32 run = 0; run < COUNT_OF(WHEEL_RUNS); ++run) {
+            auto &wheelRun = WHEEL_RUNS[run];
+            auto  window   = 1000000 / wheelRun.hertz;
+            auto  isLast   = run + 1 == COUNT_OF(WHEEL_RUNS);
+
+            u32  lastWheel[4];
+            bool hasWheel[4] = {};
+
+            filter = MouseFilter{};
+            filter.wheelWindow = window;
+            wheels[run]        = 0;
+
+            for (u32 idx = 0; idx < count; ++idx) {
+                auto &input = inputs[idx];
+
+                if (wheelRun.switchTo && idx == count / 2) {
+                    window             = 1000000 / wheelRun.switchTo;
+                    filter.wheelWindow = window;
+                }
+
+                auto event = KeyEvent{};
+                auto isOut = filter.filter(input, &event);
+
+                auto isWheel   = input.action == MouseAction_Wheel || input.action == MouseAction_HWheel;
+                auto direction = (input.action == MouseAction_Wheel ? 0 : 2) + (input.delta > 0 ? 0 : 1);
+                auto expected  = input.action != MouseAction_Move;
+
+                if (isWheel) {
+                    expected = !hasWheel[direction] || input.stamp - lastWheel[direction] >= window;
+                    if (expected) {
+                        lastWheel[direction] = input.stamp;
+                        hasWheel[direction]  = true;
+                    }
+                }
+
+                auto isRight = isOut == expected;
+                if (isOut && !isWheel) {
+                    auto isUp = input.action == MouseAction_ButtonUp;
+                    isRight = event.vk_key == input.vk_key && (event.flags & KEY_FLAG_UP) == (isUp ? KEY_FLAG_UP : 0);
+                }
+
+                if (isOut) {
+                    isRight &= (event.flags & KEY_FLAG_MOUSE) != 0 && event.stamp == input.stamp;
+                    wheels[run] += isWheel;
+
+                    if (isLast) {
+                        comboCount += combos.set_key(event);
+                        ++passed;
+                    }
+                }
+
+                if (!isRight) {
+                    if (failures < 10)
+                        printf("mouse %u Hz, %u us window: input %u (action %u at %u us) %s\n",
+                               rate, window, idx, u32(input.action), input.stamp, isOut ? "passed" : "dropped");
+                    ++failures;
+                }
+            }
+        }
+
+        printf("mouse %4u Hz: wheel events at 144 Hz %u, 30 Hz %u, 144 then 30 Hz %u, 60 Hz %u\n",
+               rate, wheels[0], wheels[1], wheels[2], wheels[3]);
+
+        auto start = BenchClock::now();
+        u32  kept  = 0;
+
+        for (u32 pass = 0; pass < TIMING_PASSES; ++pass) {
+            auto timed = MouseFilter{};
+            timed.wheelWindow = WHEEL_WINDOW;
+
+            for (u32 idx = 0; idx < count; ++idx) {
+                auto event = KeyEvent{};
+                kept += timed.filter(inputs[idx], &event);
+            }
+        }
+
+        auto elapsed = seconds_since(start);
+        printf("mouse %4u Hz: %u inputs, %u moves and %u wheel ticks dropped, %.1f events/s to the UI thread, %u combos, %.1f M inputs/s filtered (%.1f ns each)\n",
+               rate,
+               count,
+               filter.moves,
+               filter.mergedTicks,
+               f64(passed) / SECONDS,
+               comboCount,
+               f64(count) * TIMING_PASSES / elapsed / 1e6,
+               elapsed * 1e9 / (f64(count) * TIMING_PASSES));
+
+        if (kept != passed * TIMING_PASSES) {
+            printf("mouse %u Hz: timed passes kept %u events, expected %u\n", rate, kept, passed * TIMING_PASSES);
+            ++failures;
+        }
+    }
+
+    if (failures == 0)
+        printf("mouse: filter ok\n");
+
+    return failures ? 1 : 0;
+}
+
+/*
+ * Type keys written the way parse_chord_keys reads them into a combo
+ * stack, holding the modifiers of each around its key, and step a
+ * recognizer with every combo the stack takes.  With an up order, such
+ * as "102", every key goes down in turn with its modifiers held around
+ * that alone, and the keys come up in that order by index, so they're
+ * rolled over.
+ *
+ * @return How many toggle bindings matched, or ~0 if the keys don't
+ * parse.
+ */
+u32 type_chord_keys(char const *keys, char const *upOrder, KeyComboStack *combos, ChordRecognizer *chords, u32 *time)
+{
+    auto typed = ChordBinding{};
+    if (!parse_chord_keys(keys, &typed))
+        return ~0u;
+
+    u32 toggles = 0;
+
+    auto send = [&](u32 vk, bool isUp) {
+        *time += 20;
+
+        auto event = KeyEvent{ vk, isUp ? KEY_FLAG_UP : 0, *time, *time * 1000 };
+        if (!combos->set_key(event))
+            return;
+
+        auto match = chords->step(combos);
+        toggles += match && match->action == ChordAction_ToggleDisplay;
+    };
+
+    for (u32 step = 0; step < typed.stepCount; ++step) {
+        auto symbol    = typed.steps[step];
+        u32  held[3]   = {};
+        u32  heldCount = 0;
+
+        if (symbol & (1 << 8))  held[heldCount++] = KEY_LCONTROL;
+        if (symbol & (1 << 9))  held[heldCount++] = KEY_LMENU;
+        if (symbol & (1 << 10)) held[heldCount++] = KEY_LSHIFT;
+
+        for (u32 idx = 0; idx < heldCount; ++idx)
+            send(held[idx], false);
+
+        send(symbol & 0xFF, false);
+        if (!upOrder)
+            send(symbol & 0xFF, true);
+
+        for (u32 idx = 0; idx < heldCount; ++idx)
+            send(held[idx], true);
+    }
+
+    for (auto up = upOrder; up && *up; ++up) {
+        auto step = u32(*up - '0');
+        if (step >= typed.stepCount)
+            return ~0u;
+
+        send(typed.steps[step] & 0xFF, true);
+    }
+
+    return toggles;
+}
+
+/*
+ * A config's chords, keys typed with them and what the strip has to
+ * show afterwards.  A | in the keys resets the recognizer the way the
+ * overlay does when the strip fades out.  Keys with an up order are
+ * rolled over, as type_chord_keys does it.
+ */
+struct ChordCase {
+    char const *name;
+    char const *config;
+    u32         maxCombos;
+    char const *typed;
+    char const *strip;
+    u32         toggles;
+    char const *upOrder;
+};
+
+static ChordCase const CHORD_CASES[] = {
+    { "binding",       "chord = C-x C-f find-file\n", 4, "C-x C-f", "find-file", 0, nullptr },
+    { "prefix only",   "chord = C-x C-f find-file\n", 4, "C-x s", "CTRL+x s", 0, nullptr },
+    { "restart",       "chord = C-x C-f find-file\n", 4, "C-x C-x C-f", "CTRL+x find-file", 0, nullptr },
+    { "after keys",    "chord = C-x C-f find-file\n", 4, "a b C-x C-f", "a b find-file", 0, nullptr },
+    { "twice",         "chord = C-x C-f find-file\n", 4, "C-x C-f C-x C-f", "find-file find-file", 0, nullptr },
+    { "longest",       "chord = C-f forward\nchord = C-x C-f find-file\n", 4, "C-f C-x C-f", "forward find-file", 0, nullptr },
+    { "suffix",        "chord = a b c abc\nchord = b c bc\n", 4, "a b c b c", "abc bc", 0, nullptr },
+    { "no overlap",    "chord = a b c abc\nchord = c d cd\n", 4, "a b c d", "abc d", 0, nullptr },
+    { "later wins",    "chord = C-c C-c compile\nchord = C-c C-c send\n", 4, "C-c C-c", "send", 0, nullptr },
+    { "shared label",  "chord = M-x run\nchord = C-c r run\n", 4, "M-x C-c r", "run run", 0, nullptr },
+    { "modifiers",     "chord = C-x C-f find-file\n", 4, "C-x f", "CTRL+x f", 0, nullptr },
+    { "named keys",    "chord = S-TAB F5 back\nchord = HOME - top\n", 4, "S-TAB F5 HOME -", "back top", 0, nullptr },
+    { "short strip",   "chord = a b c abc\n", 2, "a b c", "abc", 0, nullptr },
+    { "reset",         "chord = C-x C-f find-file\n", 4, "C-x | C-f", "CTRL+x CTRL+f", 0, nullptr },
+    { "toggle",        "", 4, "C-M-S-F6", "CTRL+ALT+SHIFT+F6", 1, nullptr },
+    { "moved toggle",  "toggle = C-x t\n", 4, "C-M-S-F6 C-x t", "CTRL+ALT+SHIFT+F6 CTRL+x t", 1, nullptr },
+    { "toggle wins",   "chord = C-M-S-F6 hide\n", 4, "C-M-S-F6", "CTRL+ALT+SHIFT+F6", 1, nullptr },
+    { "stats",         "", 4, "C-M-S-F7 C-M-S-F6", "CTRL+ALT+SHIFT+F7 CTRL+ALT+SHIFT+F6", 1, nullptr },
+    { "rollover",      "chord = a c ac\n", 4, "a b c", "ac b", 0, "102" },
+    { "rolled in",     "chord = C-x C-f find-file\n", 4, "C-x a C-f", "find-file a", 0, "102" },
+    { "rolled out",    "chord = a b ab\n", 4, "x a b y", "x ab y", 0, "3012" },
+    { "rolled order",  "chord = b a ba\n", 4, "a b", "ba", 0, "10" },
+};
+
+/**
+ * @return The number of cases that failed.
+ */
+u32 check_chord_cases()
+{
+    static ChordTable table;
+    defer(free_chord_table(&table));
+
+    u32 failures = 0;
+
+    for (auto &test : CHORD_CASES) {
+        auto config = default_config();
+        auto error  = ConfigError{};
+
+        auto fail = [&](char const *what) {
+            printf("chords %s: %s\n", test.name, what);
+            ++failures;
+        };
+
+        if (!parse_config(test.config, strlen(test.config), &config, &error)) {
+            fail(error.message);
+            continue;
+        }
+        if (!compile_config_chords(config, &table)) {
+            fail("doesn't compile");
+            continue;
+        }
+        set_chord_table(&table);
+
+        auto combos  = KeyComboStack{};
+        auto chords  = ChordRecognizer{};
+        u32  time    = 0;
+        u32  toggles = 0;
+
+        chords.table = &table;
+        combos.set_max_combos(test.maxCombos);
+
+        char keys[64];
+        snprintf(keys, sizeof(keys), "%s", test.typed);
+
+        for (auto part = strtok(keys, "|"); part; part = strtok(nullptr, "|")) {
+            auto typed = type_chord_keys(part, test.upOrder, &combos, &chords, &time);
+            if (typed == ~0u) {
+                fail("typed keys don't parse");
+                break;
+            }
+
+            toggles += typed;
+            chords.reset();
+        }
+
+        static ComboLayout layout;
+        char strip[256];
+        strip_text(&combos, &layout, strip, sizeof(strip));
+
+        if (strcmp(strip, test.strip) != 0) {
+            char message[512];
+            snprintf(message, sizeof(message), "strip shows \"%s\", expected \"%s\"", strip, test.strip);
+            fail(message);
+        }
+        if (toggles != test.toggles)
+            fail("wrong number of toggles");
+    }
+
+    auto binding = ChordBinding{};
+    char const *badKeys[] = { "", "C-", "C-x nokey", "a b c d e f g h i", "X-a" };
+    for (auto keys : badKeys) {
+        if (parse_chord_keys(keys, &binding)) {
+            printf("chords: \"%s\" parsed\n", keys);
+            ++failures;
+        }
+    }
+
+    char const *badConfigs[] = {
+        "chord = C-x\n",
+        "chord = C-x C-f this-label-is-far-too-long\n",
+        "chord = C-x C-q caf\xc3\xa9\n",
+        "toggle = F13\n",
+        "stats = C-M-\n",
+    };
+    for (auto text : badConfigs) {
+        auto config = default_config();
+        auto error  = ConfigError{};
+
+        if (parse_config(text, strlen(text), &config, &error)) {
+            printf("chords: config \"%s\" parsed\n", text);
+            ++failures;
+        }
+    }
+
+    set_chord_table(nullptr);
+    return failures;
+}
+
+/*
+ * Random bindings of one to four combos drawn from letters and digits
+ * with any modifiers, labelled with MAX_CHORD_LABELS names in turn.
+ */
+void random_chords(ChordBinding *out, u32 count, BenchRandom *random)
+{
+    constexpr char KEYS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+
+    for (u32 idx = 0; idx < count; ++idx) {
+        auto &binding = out[idx];
+
+        binding = ChordBinding{};
+        binding.stepCount = 1 + random->next() % 4;
+        binding.action    = ChordAction_Label;
+        swprintf(binding.label, CHORD_LABEL_LENGTH, L"cmd-%u", idx % MAX_CHORD_LABELS);
+
+        for (u32 step = 0; step < binding.stepCount; ++step) {
+            auto vk   = u32(KEYS[random->next() % (COUNT_OF(KEYS) - 1)]);
+            auto mods = random->next() % 8;
+            binding.steps[step] = u16(chord_symbol(vk, mods & 1, mods & 2, mods & 4));
+        }
+    }
+}
+
+/**
+ * @return The longest binding that the last symbols of history end
+ * with, the latest one of the same keys, found by checking every
+ * binding.  One based, zero for none.
+ */
+u32 naive_chord_match(ChordBinding const *bindings, u32 count, u16 const *history, u32 length)
+{
+    u32 found   = 0;
+    u32 longest = 0;
+
+    for (u32 idx = 0; idx < count; ++idx) {
+        auto &binding = bindings[idx];
+        auto  steps   = binding.stepCount;
+
+        if (steps > length || steps < longest)
+            continue;
+        if (memcmp(binding.steps, history + length - steps, steps * sizeof(u16)) != 0)
+            continue;
+
+        found   = idx + 1;
+        longest = steps;
+    }
+
+    return found;
+}
+
+/*
+ * The recognizer against every binding checked one by one on a random
+ * stream of combos, then timed with thousands of bindings.  Combos are
+ * fed to the stack and recognizer directly, the way set_key would, so
+ * the time is the recognizer and the collapse alone.
+ */
+int bench_chords()
+{
+    constexpr u32 CHECK_BINDINGS  = 256;
+    constexpr u32 CHECK_COMBOS    = 50000;
+    constexpr u32 TIMED_COMBOS    = 2000000;
+    constexpr u32 BINDING_COUNTS[] = { 64, 1024, 4096, 16384 };
+
+    auto failures = check_chord_cases();
+    auto random   = BenchRandom{ 0x63686f726473ull };
+    auto maxCount = BINDING_COUNTS[COUNT_OF(BINDING_COUNTS) - 1];
+    auto bindings = (ChordBinding *)malloc(maxCount * sizeof(ChordBinding));
+    auto stream   = (KeyCombo *)malloc(TIMED_COMBOS * sizeof(KeyCombo));
+    defer(free(bindings));
+    defer(free(stream));
+
+    static ChordTable table;
+    defer(free_chord_table(&table));
+
+    // Mostly keys that start some binding, so matches are common.
+    auto random_stream = [&](u32 bindingCount) {
+        for (u32 idx = 0; idx < TIMED_COMBOS; ++idx) {
+            auto &binding = bindings[random.next() % bindingCount];
+            auto  symbol  = binding.steps[random.next() % binding.stepCount];
+
+            stream[idx] = KeyCombo{ symbol & 0xFFu, idx, (symbol & (1 << 9)) != 0, (symbol & (1 << 8)) != 0, (symbol & (1 << 10)) != 0, 0, 0 };
+        }
+    };
+
+    random_chords(bindings, CHECK_BINDINGS, &random);
+    compile_chords(bindings, CHECK_BINDINGS, &table);
+    random_stream(CHECK_BINDINGS);
+
+    {
+        auto combos = KeyComboStack{};
+        auto chords = ChordRecognizer{};
+        u16  history[MAX_CHORD_STEPS * 2];
+        u32  length = 0;
+        u32  wrong  = 0;
+
+        chords.table = &table;
+        combos.set_max_combos(MAX_KEY_COMBOS);
+
+        for (u32 idx = 0; idx < CHECK_COMBOS; ++idx) {
+            auto &combo = stream[idx];
+
+            if (length == COUNT_OF(history)) {
+                memmove(history, history + MAX_CHORD_STEPS, MAX_CHORD_STEPS * sizeof(u16));
+                length = MAX_CHORD_STEPS;
+            }
+            history[length++] = u16(chord_symbol(combo));
+
+            auto expected = naive_chord_match(bindings, CHECK_BINDINGS, history, length);
+            if (expected)
+                length = 0;
+
+            combos.add_combo(combo);
+
+            auto match = chords.step(&combos);
+            auto isRight = expected ? match == &table.bindings[expected - 1] : match == nullptr;
+
+            if (isRight && match)
+                isRight = combos.keyCombos.at_newest(0).chord == match->label;
+
+            if (!isRight) {
+                if (wrong < 10)
+                    printf("chords: combo %u matched binding %d, expected %u\n",
+                           idx, match ? i32(match - table.bindings) + 1 : 0, expected);
+                ++wrong;
+            }
+        }
+
+        failures += wrong;
+    }
+
+    for (auto count : BINDING_COUNTS) {
+        random_chords(bindings, count, &random);
+
+        auto start = BenchClock::now();
+        if (!compile_chords(bindings, count, &table)) {
+            printf("chords: %u bindings don't compile\n", count);
+            ++failures;
+            continue;
+        }
+        auto compiled = seconds_since(start);
+
+        random_stream(count);
+        set_chord_table(&table);
+
+        auto combos = KeyComboStack{};
+        auto chords = ChordRecognizer{};
+        chords.table = &table;
+        combos.set_max_combos(MAX_KEY_COMBOS);
+
+        auto allocations = heap_allocations();
+        start = BenchClock::now();
+
+        for (u32 idx = 0; idx < TIMED_COMBOS; ++idx) {
+            combos.add_combo(stream[idx]);
+            chords.step(&combos);
+        }
+
+        auto elapsed   = seconds_since(start);
+        auto allocated = heap_allocations() - allocations;
+        auto tableKb   = (size_t(table.stateCount) * table.classCount * sizeof(u32) + table.stateCount * sizeof(u32)) / 1024;
+
+        printf("chords %5u bindings: %6u states x %3u classes (%zu KB) compiled in %.2f ms, %.1f ns per combo, %u matches, %llu allocations\n",
+               count,
+               table.stateCount,
+               table.classCount,
+               tableKb,
+               compiled * 1000.0,
+               elapsed * 1e9 / TIMED_COMBOS,
+               chords.matchCount,
+               (unsigned long long)allocated);
+
+        if (allocated) {
+            printf("chords: stepping allocated\n");
+            ++failures;
+        }
+    }
+
+    set_chord_table(nullptr);
+
+    if (failures == 0)
+        printf("chords: %u cases and %u random combos ok\n", u32(COUNT_OF(CHORD_CASES)), CHECK_COMBOS);
+
+    return failures ? 1 : 0;
+}
+
+/*
+ * Typing for the statistics: words from a vocabulary with Zipf's law
+ * frequencies and letters about as frequent as in English, so pairs of
+ * keys are as lopsided as in real text, with a capital now and then and
+ * an editor shortcut between some words.  For a sketch with more to
+ * tell apart there are also combos of any key and modifiers, again with
+ * Zipf's law frequencies, which pair up in millions of ways.  Keys are
+ * evenly spaced.
+ */
+struct StatsTyping {
+    static constexpr u32 WORDS = 4000;
+
+    char        words[WORDS][9];
+    f64         cumulative[WORDS];  // of 1 / rank
+    u16         symbols[CHORD_SYMBOL_COUNT];
+    BenchRandom random;
+
+    void init(u64 seed) {
+        static char const LETTERS[] =
+            "eeeeeeeeeeeetttttttttaaaaaaaaooooooooiiiiiiinnnnnnnsssssshhhhhhrrrrrr"
+            "ddddllllcccuuummmwwffggyyppbbvkjxqz";
+
+        random = BenchRandom{ seed };
+
+        f64 sum = 0.0;
+        for (u32 word = 0; word < WORDS; ++word) {
+            auto length = 1 + random.next() % 8;
+            for (u32 idx = 0; idx < length; ++idx)
+                words[word][idx] = LETTERS[random.next() % (COUNT_OF(LETTERS) - 1)];
+            words[word][length] = 0;
+
+            sum += 1.0 / (word + 1);
+            cumulative[word] = sum;
+        }
+
+        // Ranks of every displayable key with every set of modifiers.
+        u32 count = 0;
+        for (u32 symbol = 0; symbol < CHORD_SYMBOL_COUNT; ++symbol) {
+            if (is_displayable_key(symbol & 0xFF))
+                symbols[count++] = u16(symbol);
+        }
+        for (u32 idx = count - 1; idx > 0; --idx) {
+            auto other = random.next() % (idx + 1);
+            auto swap  = symbols[idx];
+            symbols[idx]   = symbols[other];
+            symbols[other] = swap;
+        }
+    }
+
+    // A rank below count, the first ones most often.
+    u32 zipf(u32 count) {
+        auto pick = random.next() * (cumulative[count - 1] / 4294967296.0);
+        u32  lo   = 0;
+        u32  hi   = count - 1;
+
+        while (lo < hi) {
+            auto mid = (lo + hi) / 2;
+            if (cumulative[mid] < pick)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        return lo;
+    }
+
+    /**
+     * @return How many combos were written, up to capacity.
+     */
+    u32 type(KeyCombo *out, u32 capacity, u32 keysPerSecond, bool isWords) {
+        static u32 const SHORTCUTS[] = {
+            chord_symbol('S', true, false, false),
+            chord_symbol('Z', true, false, false),
+            chord_symbol('C', true, false, false),
+            chord_symbol('V', true, false, false),
+            chord_symbol(0x09, false, true, false),
+            chord_symbol('P', true, false, true),
+        };
+
+        u32 count = 0;
+        u32 time  = 0;
+
+        auto push = [&](u32 symbol) {
+            if (count < capacity) {
+                out[count++] = KeyCombo{ symbol & 0xFF, time, (symbol & (1 << 9)) != 0, (symbol & (1 << 8)) != 0, (symbol & (1 << 10)) != 0, 0, 0 };
+                time += 1000 / keysPerSecond;
+            }
+        };
+
+        while (count < capacity) {
+            if (!isWords) {
+                push(symbols[zipf(1000)]);
+                continue;
+            }
+
+            auto word      = words[zipf(WORDS)];
+            auto isCapital = random.next() % 10 == 0;
+
+            for (u32 idx = 0; word[idx]; ++idx)
+                push(chord_symbol(u32(word[idx] - 'a' + 'A'), false, false, isCapital && idx == 0));
+
+            push(chord_symbol(0x20, false, false, false));
+
+            if (random.next() % 20 == 0)
+                push(SHORTCUTS[random.next() % COUNT_OF(SHORTCUTS)]);
+        }
+
+        return count;
+    }
+};
+
+/*
+ * The typing statistics against exact counts of the same synthetic
+ * typing, at lengths from two days to a month of typing without a
+ * break, then timed per combo.  The keys typed and the rate are exact,
+ * so they have to match.  Pairs are estimates with a bound, which is
+ * checked for every pair that was typed.
+ */
+int bench_stats()
+{
+    constexpr u32 KEYS_PER_SECOND = 6;
+    constexpr u32 PASS_COMBOS     = 1 << 20;
+    constexpr u32 PAIR_KEYS       = CHORD_SYMBOL_COUNT * CHORD_SYMBOL_COUNT;
+    constexpr u32 PASSES[]        = { 1, 4, 16 };  // of PASS_COMBOS each
+
+    static StatsTyping typing;
+    typing.init(0x7374617473ull);
+
+    auto stream = (KeyCombo *)malloc(PASS_COMBOS * sizeof(KeyCombo));
+    auto exact  = (u32 *)malloc(PAIR_KEYS * sizeof(u32));
+    auto stats  = (TypingStats *)malloc(sizeof(TypingStats));
+    defer(free(stream));
+    defer(free(exact));
+    defer(free(stats));
+
+    u32  failures = 0;
+    auto passTime = PASS_COMBOS * (1000 / KEYS_PER_SECOND);
+
+    auto fail = [&](char const *what) {
+        printf("stats: %s\n", what);
+        ++failures;
+    };
+
+    // The summary writes keys the way the config reads them.
+    for (u32 symbol = 0; symbol < CHORD_SYMBOL_COUNT; ++symbol) {
+        if (US_KEY_TABLE.entries[symbol & 0xFF].labels[KeyLevel_Base].text[0] == 0)
+            continue;
+
+        char text[32];
+        auto binding = ChordBinding{};
+        write_chord_keys(symbol, text, sizeof(text));
+
+        if (!parse_chord_keys(text, &binding) || binding.stepCount != 1 || binding.steps[0] != symbol) {
+            printf("stats: %s doesn't read back\n", text);
+            ++failures;
+        }
+    }
+
+    for (u32 kind = 0; kind < 2; ++kind) {
+        auto isWords = kind == 0;
+        u32 keys[CHORD_SYMBOL_COUNT] = {};
+        u32 passes = 0;
+        u32 time   = 0xF0000000u;  // so the clock wraps on the way
+
+        *stats = TypingStats{};
+        memset(exact, 0, PAIR_KEYS * sizeof(u32));
+        typing.type(stream, PASS_COMBOS, KEYS_PER_SECOND, isWords);
+
+        // The rate's buckets start at the first character typed.
+        u32 firstTyped = time;
+        for (u32 idx = 0; idx < PASS_COMBOS; ++idx) {
+            auto &combo = stream[idx];
+            if (!combo.isCtrlDown && !combo.isAltDown && (KEY_TABLE->entries[combo.vk_key].doesShiftAffectKey || combo.vk_key == 0x20)) {
+                firstTyped = time + combo.time;
+                break;
+            }
+        }
+
+        for (auto passCount : PASSES) {
+            // The same typing again, later, for as long as the run is.
+            u64 allocations = heap_allocations();
+            f64 elapsed     = 0.0;
+            u32 timed       = 0;
+
+            for (; passes < passCount; ++passes, time += passTime) {
+                auto start = BenchClock::now();
+
+                for (u32 idx = 0; idx < PASS_COMBOS; ++idx) {
+                    auto combo = stream[idx];
+                    combo.time += time;
+                    stats->add(combo);
+                }
+
+                elapsed += seconds_since(start);
+                timed   += PASS_COMBOS;
+
+                for (u32 idx = 0; idx < PASS_COMBOS; ++idx) {
+                    auto symbol = chord_symbol(stream[idx]);
+                    ++keys[symbol];
+                    if (idx > 0 || passes > 0)
+                        ++exact[TypingStats::pair_key(chord_symbol(stream[idx > 0 ? idx - 1 : PASS_COMBOS - 1]), symbol)];
+                }
+            }
+
+            auto allocated = heap_allocations() - allocations;
+            auto combos    = u64(passCount) * PASS_COMBOS;
+            auto lastTime  = time - passTime + stream[PASS_COMBOS - 1].time;
+
+            if (memcmp(keys, stats->keys, sizeof(keys)) != 0)
+                fail("key counts aren't exact");
+
+            // Every character of the last minute, counted from the stream.
+            u32 typed = 0;
+            for (u32 idx = 0; idx < PASS_COMBOS; ++idx) {
+                auto &combo    = stream[idx];
+                auto  combined = time - passTime + combo.time;
+                auto  isTyped  = (!combo.isCtrlDown && !combo.isAltDown &&
+                                  (KEY_TABLE->entries[combo.vk_key].doesShiftAffectKey || combo.vk_key == 0x20));
+
+                if (isTyped && (lastTime - firstTyped) / 1000 - (combined - firstTyped) / 1000 < STATS_RATE_SECONDS)
+                    ++typed;
+            }
+
+            if (stats->typing.count_at(lastTime) != typed)
+                fail("typing rate is wrong");
+
+            // Every typed pair against its estimate.
+            auto total     = stats->pairs.total;
+            auto bound     = 2.7182818 * total / STATS_SKETCH_WIDTH;
+            auto threshold = total / STATS_HEAVY_HITTERS + bound;
+            u32  pairs     = 0;
+            u32  under     = 0;
+            u32  within    = 0;
+            u32  missing   = 0;
+            u64  over      = 0;
+            u32  maxOver   = 0;
+            u32  top[STATS_LISTED]       = {};
+            u32  topCounts[STATS_LISTED] = {};
+
+            for (u32 key = 0; key < PAIR_KEYS; ++key) {
+                auto count = exact[key];
+                if (count == 0)
+                    continue;
+
+                auto estimate = stats->pairs.estimate(key);
+                ++pairs;
+
+                if (estimate < count) {
+                    ++under;
+                    continue;
+                }
+
+                auto isKept = false;
+                for (u32 idx = 0; idx < stats->topPairs.count; ++idx)
+                    isKept |= stats->topPairs.keys[idx] == key;
+                missing += count > threshold && !isKept;
+
+                over    += estimate - count;
+                maxOver  = estimate - count > maxOver ? estimate - count : maxOver;
+                within  += estimate - count <= bound;
+
+                // The true top pairs, for how many of them are kept.
+                if (count > topCounts[STATS_LISTED - 1]) {
+                    u32 at = STATS_LISTED - 1;
+                    while (at > 0 && topCounts[at - 1] < count) {
+                        topCounts[at] = topCounts[at - 1];
+                        top[at]       = top[at - 1];
+                        --at;
+                    }
+                    topCounts[at] = count;
+                    top[at]       = key;
+                }
+            }
+
+            u32 found = 0;
+            for (u32 rank = 0; rank < STATS_LISTED; ++rank) {
+                for (u32 idx = 0; idx < stats->topPairs.count; ++idx)
+                    found += stats->topPairs.keys[idx] == top[rank];
+            }
+
+            if (under)
+                fail("a pair's estimate is under its count");
+            if (missing)
+                fail("a pair counted more than the heap's lowest can be isn't kept");
+            if (within < pairs * 0.98)
+                fail("too many pairs are further over than the bound");
+            if (allocated)
+                fail("counting allocated");
+
+            printf("stats %-6s %8u combos (%2u days): %7u pairs, %6.2f mean and %5u max over (bound %5.0f, %6.2f%% within), "
+                   "top %u %u kept, %2u wpm, %.1f ns per combo, %llu allocations\n",
+                   isWords ? "words" : "combos",
+                   u32(combos),
+                   u32(combos / KEYS_PER_SECOND / 86400),
+                   pairs,
+                   f64(over) / pairs,
+                   maxOver,
+                   bound,
+                   100.0 * within / pairs,
+                   STATS_LISTED,
+                   found,
+                   stats->words_per_minute(lastTime),
+                   elapsed * 1e9 / timed,
+                   (unsigned long long)allocated);
+        }
+
+        if (isWords && failures == 0) {
+            printf("stats: summary of the words\n");
+            print_typing_stats(stdout, *stats, time - passTime + stream[PASS_COMBOS - 1].time);
+        }
+    }
+
+    printf("stats: %zu bytes of statistics whatever the length\n", sizeof(TypingStats));
+
+    return failures ? 1 : 0;
+}
+
+/*
+ * Records for the seqlock ring stress, which say from their own words
+ * whether they were torn and how many records a reader skipped.
+ */
+struct BenchRecord {
+    u32 index;
+    u32 words[7];
+};
+
+BenchRecord make_bench_record(u32 index)
+{
+    auto record = BenchRecord{ index, {} };
+    for (u32 idx = 0; idx < COUNT_OF(record.words); ++idx)
+        record.words[idx] = index * (idx + 3) + idx;
+    return record;
+}
+
+bool is_intact(BenchRecord const &record)
+{
+    auto expected = make_bench_record(record.index);
+    return memcmp(&record, &expected, sizeof(BenchRecord)) == 0;
+}
+
+/*
+ * What a reader saw.  Everything written is either received or lost,
+ * and the records it skipped over are the ones it was told it lost.
+ */
+struct BenchReaderResult {
+    u32 received;
+    u32 lost;
+    u32 skipped;  // gaps in the indices received
+    u32 bad;      // torn, repeated or out of order
+};
+
+bool is_consistent(BenchReaderResult const &result, u32 total)
+{
+    return (result.bad == 0 &&
+            result.skipped == result.lost &&
+            result.received + result.lost == total);
+}
+
+/*
+ * One writer and readers at different speeds on a ring small enough
+ * that the slow ones get lapped.  Readers only stop once the writer is
+ * done and they have caught up.
+ */
+int check_seqlock_threads()
+{
+    constexpr u32 SLOTS   = 256;
+    constexpr u32 TOTAL   = 1 << 21;
+    constexpr u32 READERS = 4;
+    constexpr u32 BATCHES[READERS] = { 64, 64, 16, 4 };
+
+    using BenchRing = SeqlockRing<BenchRecord, SLOTS>;
+
+    auto ring = (BenchRing *)calloc(1, sizeof(BenchRing));
+    defer(free(ring));
+
+    std::atomic<bool> isDone{ false };
+    BenchReaderResult results[READERS] = {};
+
+    auto reader = [&](u32 id) {
+        auto &result = results[id];
+        auto  cursor = seqlock_cursor_at_oldest(*ring);
+        auto  next   = 0u;
+        BenchRecord batch[64];
+
+        for (;;) {
+            auto isFinished = isDone.load(std::memory_order_acquire);
+            auto count      = seqlock_read(*ring, &cursor, batch, BATCHES[id]);
+
+            for (u32 idx = 0; idx < count; ++idx) {
+                auto &record = batch[idx];
+
+                if (!is_intact(record) || record.index < next) {
+                    ++result.bad;
+                    continue;
+                }
+
+                result.skipped += record.index - next;
+                next = record.index + 1;
+            }
+
+            result.received += count;
+
+            if (isFinished && seqlock_lag(*ring, cursor) == 0)
+                break;
+
+            // Readers that have caught up give up the core, and the
+            // slower ones do so more often, the way a process that only
+            // polls now and then does.
+            if (count == 0)
+                std::this_thread::yield();
+            for (u32 pass = BATCHES[id]; pass < 64; pass *= 2)
+                std::this_thread::yield();
+        }
+
+        result.lost = cursor.lost;
+    };
+
+    std::thread threads[READERS];
+    for (u32 id = 0; id < READERS; ++id)
+        threads[id] = std::thread(reader, id);
+
+    auto start = BenchClock::now();
+
+    for (u32 index = 0; index < TOTAL; ++index) {
+        ring->publish(make_bench_record(index));
+
+        // Lets the readers run on a single core.
+        if (index % 64 == 63)
+            std::this_thread::yield();
+    }
+
+    auto elapsed = seconds_since(start);
+
+    isDone.store(true, std::memory_order_release);
+    for (auto &thread : threads)
+        thread.join();
+
+    u32 failures = 0;
+
+    for (u32 id = 0; id < READERS; ++id) {
+        auto &result = results[id];
+        auto  isOk   = is_consistent(result, TOTAL);
+
+        printf("seqlock reader %u (batch %2u) %8u received %8u lost %s\n",
+               id,
+               BATCHES[id],
+               result.received,
+               result.lost,
+               isOk ? "ok" : "FAILED");
+        failures += !isOk;
+    }
+
+    printf("seqlock %u records to %u readers, %.1f ns per record\n", TOTAL, READERS, elapsed * 1e9 / TOTAL);
+
+    return failures ? 1 : 0;
+}
+
+/*
+ * A reader that doesn't read while the writer goes round the ring three
+ * times is told it lost two rounds and gets the last one.
+ */
+int check_seqlock_lapped()
+{
+    constexpr u32 SLOTS = 64;
+
+    static SeqlockRing<BenchRecord, SLOTS> ring;
+
+    auto cursor = seqlock_cursor_at_newest(ring);
+    for (u32 index = 0; index < 3 * SLOTS; ++index)
+        ring.publish(make_bench_record(index));
+
+    auto lag = seqlock_lag(ring, cursor);
+    auto result = BenchReaderResult{};
+    auto next = 0u;
+    BenchRecord batch[SLOTS + 1];
+
+    u32 count = seqlock_read(ring, &cursor, batch, COUNT_OF(batch));
+    for (u32 idx = 0; idx < count; ++idx) {
+        result.bad     += !is_intact(batch[idx]) || batch[idx].index < next;
+        result.skipped += batch[idx].index - next;
+        next = batch[idx].index + 1;
+    }
+    result.received = count;
+    result.lost     = cursor.lost;
+
+    auto isOk = (lag == 3 * SLOTS &&
+                 count == SLOTS &&
+                 seqlock_lag(ring, cursor) == 0 &&
+                 is_consistent(result, 3 * SLOTS));
+
+    printf("seqlock lapped reader: lag %u, %u received %u lost %s\n", lag, count, cursor.lost, isOk ? "ok" : "FAILED");
+    return isOk ? 0 : 1;
+}
+
+/*
+ * A stream of combos with their time set to their index, so readers can
+ * tell which ones they missed.
+ */
+void make_broadcast_stream(KeyCombo *combos, u32 count)
+{
+    static u32 const KEYS[] = { 'A', 'E', 'S', 'T', 'Z', '1', '9', 0x20, 0x0D, 0x08, 0x25, 0x70, 0xBA };
+
+    auto random = BenchRandom{ 0x62636173ull };
+
+    for (u32 idx = 0; idx < count; ++idx) {
+        auto bits = random.next();
+
+        combos[idx]             = KeyCombo{};
+        combos[idx].vk_key      = KEYS[bits % COUNT_OF(KEYS)];
+        combos[idx].time        = idx;
+        combos[idx].isShiftDown = (bits >> 8) % 4 == 0;
+        combos[idx].isCtrlDown  = (bits >> 12) % 8 == 0;
+        combos[idx].isAltDown   = (bits >> 16) % 16 == 0;
+    }
+}
+
+#if defined(__linux__)
+
+/*
+ * Readers in other processes, following a broadcast in real shared
+ * memory the way shoki-offline listen does.  Each checks every combo it
+ * gets against the one written and sends back what it saw.
+ */
+int check_broadcast_processes(KeyCombo const *combos, u32 total)
+{
+    constexpr u32 READERS = 3;
+
+    char name[64];
+    snprintf(name, sizeof(name), "/shoki-bench-%d", int(getpid()));
+
+    auto broadcaster = KeyBroadcaster{};
+    if (!open_key_broadcast(&broadcaster, name)) {
+        printf("broadcast FAILED, can't create %s\n", name);
+        return 1;
+    }
+
+    int ready[2];
+    int results[2];
+    if (pipe(ready) != 0 || pipe(results) != 0) {
+        close_key_broadcast(&broadcaster);
+        return 1;
+    }
+
+    for (u32 id = 0; id < READERS; ++id) {
+        if (fork() != 0)
+            continue;
+
+        auto reader = KeyBroadcastReader{};
+        auto result = BenchReaderResult{};
+        auto isOpen = open_key_broadcast_reader(&reader, name, true);
+
+        if (write(ready[1], "r", 1) != 1 || !isOpen)
+            _exit(1);
+
+        auto next = 0u;
+        BroadcastCombo batch[64];
+
+        for (;;) {
+            auto isClosed = is_key_broadcast_closed(reader);
+            auto count    = read_key_broadcast(&reader, batch, COUNT_OF(batch) >> id);
+
+            for (u32 idx = 0; idx < count; ++idx) {
+                auto &combo = batch[idx];
+                auto  index = combo.time;
+
+                if (index >= total || index < next) {
+                    ++result.bad;
+                    continue;
+                }
+
+                auto expected = make_broadcast_combo(combos[index], 0);
+                result.bad     += memcmp(&combo, &expected, sizeof(BroadcastCombo)) != 0;
+                result.skipped += index - next;
+                next = index + 1;
+            }
+
+            result.received += count;
+
+            if (isClosed && key_broadcast_lag(reader) == 0)
+                break;
+            if (count == 0)
+                usleep(100 << id);
+        }
+
+        result.lost = reader.cursor.lost;
+        close_key_broadcast_reader(&reader);
+
+        auto isSent = write(results[1], &result, sizeof(result)) == ssize_t(sizeof(result));
+        _exit(isSent ? 0 : 1);
+    }
+
+    close(ready[1]);
+    close(results[1]);
+
+    // Every reader starts at the first combo.
+    char byte;
+    for (u32 id = 0; id < READERS; ++id) {
+        if (read(ready[0], &byte, 1) != 1)
+            break;
+    }
+    close(ready[0]);
+
+    auto allocations = heap_allocations();
+    auto start       = BenchClock::now();
+
+    for (u32 idx = 0; idx < total; ++idx) {
+        broadcast_combo(&broadcaster, combos[idx]);
+
+        if (idx % 256 == 255)
+            std::this_thread::yield();
+    }
+
+    auto elapsed = seconds_since(start);
+    allocations  = heap_allocations() - allocations;
+
+    close_key_broadcast(&broadcaster);
+
+    u32 failures = allocations != 0;
+    u32 reported = 0;
+
+    for (u32 id = 0; id < READERS; ++id) {
+        auto result = BenchReaderResult{};
+        if (read(results[0], &result, sizeof(result)) != ssize_t(sizeof(result)))
+            break;
+
+        auto isOk = is_consistent(result, total);
+        printf("broadcast process reader %7u received %7u lost %s\n", result.received, result.lost, isOk ? "ok" : "FAILED");
+
+        failures += !isOk;
+        ++reported;
+    }
+    close(results[0]);
+
+    for (u32 id = 0; id < READERS; ++id) {
+        auto status = 0;
+        if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            ++failures;
+    }
+
+    failures += reported != READERS;
+
+    printf("broadcast %u combos to %u processes, %.1f ns per combo, %llu allocations %s\n",
+           total,
+           READERS,
+           elapsed * 1e9 / total,
+           (unsigned long long)allocations,
+           failures ? "FAILED" : "ok");
+
+    return failures ? 1 : 0;
+}
+
+#endif
+
+int bench_broadcast()
+{
+    constexpr u32 COMBOS = 1 << 18;
+
+    auto combos = (KeyCombo *)malloc(COMBOS * sizeof(KeyCombo));
+    defer(free(combos));
+
+    make_broadcast_stream(combos, COMBOS);
+
+    auto result = check_seqlock_lapped();
+    result |= check_seqlock_threads();
+
+#if defined(__linux__)
+    result |= check_broadcast_processes(combos, COMBOS);
+#endif
+
+    return result;
+}
+
+#if defined(__linux__)
+
+/*
+ * Write a synthetic key stream as the input_event structs a keyboard
+ * would produce, with a SYN after every key and auto-repeat for keys
+ * that go down again while held.
+ */
+u32 encode_evdev_stream(SynthStream const &stream, EvdevEvent *out)
+{
+    u16  codes[256] = {};
+    bool isDown[256] = {};
+    u32  count = 0;
+
+    for (u32 code = EVDEV_KEY_COUNT; code-- > 1;) {
+        if (EVDEV_KEYMAP.vk[code])
+            codes[EVDEV_KEYMAP.vk[code]] = u16(code);
+    }
+
+    for (u32 idx = 0; idx < stream.count; ++idx) {
+        auto &event = stream.events[idx];
+        auto  vk    = event.vk_key & 0xFF;
+        auto  isUp  = (event.flags & KEY_FLAG_UP) != 0;
+        auto  time  = timeval{ time_t(event.time / 1000), suseconds_t(event.time % 1000 * 1000) };
+
+        out[count++] = EvdevEvent{ time, EVDEV_EV_KEY, codes[vk], isUp ? 0 : isDown[vk] ? 2 : 1 };
+        out[count++] = EvdevEvent{ time, 0, 0, 0 };
+        isDown[vk]   = !isUp;
+    }
+
+    return count;
+}
+
+/*
+ * Read an encoded stream back through the evdev backend and check that
+ * the key events and the combos they make match the stream's.  The
+ * stream goes through a regular file, which is read without epoll, and
+ * a pipe written in chunks that split events across reads.
+ */
+int check_evdev(SynthStream const &stream, EvdevEvent const *encoded, u32 encodedCount, bool isPipe)
+{
+    auto input = EvdevInput{};
+    auto bytes = encodedCount * u32(sizeof(EvdevEvent));
+    int  fds[2];
+
+    open_evdev_input(&input);
+    defer(close_evdev_input(&input));
+
+    if (isPipe) {
+        if (pipe(fds) != 0)
+            return 1;
+
+        if (fork() == 0) {
+            close(fds[0]);
+            for (u32 at = 0; at < bytes; at += 1000) {
+                auto chunk = bytes - at < 1000 ? bytes - at : 1000;
+                if (write(fds[1], (u8 const *)encoded + at, chunk) != ssize_t(chunk))
+                    _exit(1);
+            }
+            _exit(0);
+        }
+
+        close(fds[1]);
+        add_evdev_source(&input, fds[0]);
+    }
+    else {
+        auto file = tmpfile();
+        fwrite(encoded, 1, bytes, file);
+        fflush(file);
+        lseek(fileno(file), 0, SEEK_SET);
+        add_evdev_source(&input, dup(fileno(file)));
+        fclose(file);
+    }
+
+    auto direct = KeyComboStack{};
+    auto read   = KeyComboStack{};
+
+    direct.set_max_combos(4);
+    read.set_max_combos(4);
+
+    KeyEvent batch[256];
+    u32      index    = 0;
+    u32      failures = 0;
+
+    auto start = BenchClock::now();
+
+    while (input.openCount > 0) {
+        auto count = read_evdev_events(&input, -1, 0, batch, COUNT_OF(batch));
+
+        for (u32 idx = 0; idx < count; ++idx, ++index) {
+            auto &expected = stream.events[index];
+            auto &actual   = batch[idx];
+
+            if (index >= stream.count ||
+                actual.vk_key != expected.vk_key ||
+                actual.flags != expected.flags ||
+                actual.time != expected.time) {
+                ++failures;
+                break;
+            }
+
+            auto isCombo = direct.set_key(expected);
+            if (read.set_key(actual) != isCombo ||
+                (isCombo && (direct.lastCombo.vk_key != read.lastCombo.vk_key ||
+                             direct.lastCombo.time != read.lastCombo.time ||
+                             direct.lastCombo.isShiftDown != read.lastCombo.isShiftDown ||
+                             direct.lastCombo.isCtrlDown != read.lastCombo.isCtrlDown ||
+                             direct.lastCombo.isAltDown != read.lastCombo.isAltDown))) {
+                ++failures;
+                break;
+            }
+        }
+
+        if (failures)
+            break;
+    }
+
+    auto elapsed = seconds_since(start);
+
+    if (isPipe)
+        wait(nullptr);
+
+    if (!failures && index != stream.count)
+        ++failures;
+
+    if (failures) {
+        printf("evdev %-5s FAILED at key event %u of %u\n", isPipe ? "pipe" : "file", index, stream.count);
+        return 1;
+    }
+
+    printf("evdev %-5s %u key events ok, %.1f M events/s, %.1f events per read\n",
+           isPipe ? "pipe" : "file",
+           index,
+           input.events / elapsed / 1e6,
+           input.events / f64(input.reads));
+
+    return 0;
+}
+
+int bench_evdev()
+{
+    auto stream = make_synth_stream(1 << 20, 7);
+    defer(free_synth_stream(&stream));
+
+    synth_typing(&stream, 20000, 8);
+    synth_fast_typing(&stream, 20000, 60);
+    synth_repeat_storm(&stream, 200, 30, 33);
+    synth_chords(&stream, 5000);
+    synth_finish(&stream);
+
+    auto encoded = (EvdevEvent *)malloc(2 * stream.count * sizeof(EvdevEvent));
+    defer(free(encoded));
+
+    auto count  = encode_evdev_stream(stream, encoded);
+    auto result = check_evdev(stream, encoded, count, false);
+
+    result |= check_evdev(stream, encoded, count, true);
+
+    return result;
+}
+
+#endif
+
+int main(int argc, char **argv)
+{
+    char const *which = argc > 1 ? argv[1] : "all";
+    bool isAll = strcmp(which, "all") == 0;
+    int  result = 0;
+
+    if (isAll || strcmp(which, "composite") == 0)
+        result |= bench_composite();
+    if (isAll || strcmp(which, "replay") == 0)
+        result |= bench_replay();
+    if (isAll || strcmp(which, "ring") == 0)
+        result |= bench_ring();
+    if (isAll || strcmp(which, "spsc") == 0)
+        result |= bench_spsc();
+    if (isAll || strcmp(which, "golden") == 0)
+        result |= bench_golden(isAll || argc < 3 ? nullptr : argv[2]);
+    if (isAll || strcmp(which, "sdf") == 0)
+        result |= bench_sdf();
+    if (isAll || strcmp(which, "bake") == 0)
+        result |= bench_bake();
+    if (isAll || strcmp(which, "config") == 0)
+        result |= bench_config();
+    if (isAll || strcmp(which, "mouse") == 0)
+        result |= bench_mouse();
+    if (isAll || strcmp(which, "chords") == 0)
+        result |= bench_chords();
+    if (isAll || strcmp(which, "stats") == 0)
+        result |= bench_stats();
+    if (isAll || strcmp(which, "broadcast") == 0)
+        result |= bench_broadcast();
+#if defined(__linux__)
+    if (isAll || strcmp(which, "evdev") == 0)
+        result |= bench_evdev();
+#endif
+
+    return result;
+}
@@ -0,0 +1,322 @@
+#ifndef GUARD__MAPPED_FILE_H__
+#define GUARD__MAPPED_FILE_H__
+
+#include "bl_common.hpp"
+#include <cassert>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+#endif
+
+/*
+ * A whole file mapped into memory, either read only or writable.  A
+ * writable file is created empty and sized up front, and can be grown
+ * by remapping it, so writing into it is plain stores into the mapping.
+ * The disk space for it is reserved when it is sized, so running out
+ * of space fails the open or the grow rather than a store into it.
+ * What has been stored is in the page cache as soon as the store
+ * happens, so it reaches the file even if the process crashes, and
+ * other processes can map the file and read it while it is written.
+ */
+struct MappedFile {
+    u8  *data;
+    u64  size;
+    bool isOpen;
+    bool isWritable;
+
+#if defined(_WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+};
+
+#if defined(_WIN32)
+
+inline bool map_file_view(MappedFile *mapped, u64 size)
+{
+    auto protect = mapped->isWritable ? PAGE_READWRITE : PAGE_READONLY;
+    auto access  = mapped->isWritable ? FILE_MAP_WRITE : FILE_MAP_READ;
+
+    // Files can't be mapped while empty.
+    if (size == 0)
+        return true;
+
+    mapped->mapping = CreateFileMappingA(mapped->file, nullptr, protect, DWORD(size >> 32), DWORD(size), nullptr);
+    if (!mapped->mapping)
+        return false;
+
+    mapped->data = (u8 *)MapViewOfFile(mapped->mapping, access, 0, 0, size_t(size));
+    if (!mapped->data) {
+        CloseHandle(mapped->mapping);
+        mapped->mapping = nullptr;
+        return false;
+    }
+
+    mapped->size = size;
+    return true;
+}
+
+/**
+ * @return The bytes free on the disk a file at path would be written
+ *         to, or ~0 if that can't be told.
+ */
+inline u64 free_disk_space(char const *path)
+{
+    char directory[MAX_PATH] = ".\\";
+    auto length = strlen(path);
+
+    while (length > 0 && path[length - 1] != '\\' && path[length - 1] != '/')
+        --length;
+    if (length >= sizeof(directory))
+        return ~u64(0);
+
+    if (length > 0) {
+        memcpy(directory, path, length);
+        directory[length] = 0;
+    }
+
+    auto available = ULARGE_INTEGER{};
+    if (!GetDiskFreeSpaceExA(directory, &available, nullptr, nullptr))
+        return ~u64(0);
+
+    return u64(available.QuadPart);
+}
+
+inline void unmap_file_view(MappedFile *mapped)
+{
+    if (mapped->data)
+        UnmapViewOfFile(mapped->data);
+    if (mapped->mapping)
+        CloseHandle(mapped->mapping);
+
+    mapped->data    = nullptr;
+    mapped->mapping = nullptr;
+    mapped->size    = 0;
+}
+
+/**
+ * Map a file.  A writable file is created, or emptied if it exists, and
+ * then extended to size bytes of zeros.  A read only file is mapped at
+ * its current size and size is ignored.
+ *
+ * @return False if the file couldn't be opened or mapped.
+ */
+inline bool open_mapped_file(MappedFile *mapped, char const *path, bool isWritable, u64 size)
+{
+    *mapped = MappedFile{};
+    mapped->isWritable = isWritable;
+
+    mapped->file = CreateFileA(path,
+                               isWritable ? GENERIC_READ|GENERIC_WRITE : GENERIC_READ,
+                               FILE_SHARE_READ|FILE_SHARE_WRITE,
+                               nullptr,
+                               isWritable ? CREATE_ALWAYS : OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL,
+                               nullptr);
+    if (mapped->file == INVALID_HANDLE_VALUE) {
+        mapped->file = nullptr;
+        return false;
+    }
+
+    if (!isWritable) {
+        auto fileSize = LARGE_INTEGER{};
+        GetFileSizeEx(mapped->file, &fileSize);
+        size = u64(fileSize.QuadPart);
+    }
+
+    if (!map_file_view(mapped, size)) {
+        CloseHandle(mapped->file);
+        *mapped = MappedFile{};
+        return false;
+    }
+
+    mapped->isOpen = true;
+    return true;
+}
+
+/**
+ * Remap a writable file at a larger size.  Pointers into the old
+ * mapping are invalid afterwards.
+ */
+inline bool grow_mapped_file(MappedFile *mapped, u64 size)
+{
+    assert(mapped->isWritable && size >= mapped->size);
+
+    unmap_file_view(mapped);
+    return map_file_view(mapped, size);
+}
+
+/**
+ * Unmap and close a file.  A writable file is cut down to finalSize
+ * bytes, if that is less than its mapped size.
+ */
+inline void close_mapped_file(MappedFile *mapped, u64 finalSize = ~u64(0))
+{
+    auto isTruncated = mapped->isWritable && finalSize < mapped->size;
+
+    unmap_file_view(mapped);
+
+    if (mapped->isOpen) {
+        if (isTruncated) {
+            auto end = LARGE_INTEGER{};
+            end.QuadPart = LONGLONG(finalSize);
+            SetFilePointerEx(mapped->file, end, nullptr, FILE_BEGIN);
+            SetEndOfFile(mapped->file);
+        }
+        CloseHandle(mapped->file);
+    }
+
+    *mapped = MappedFile{};
+}
+
+#else
+
+inline bool map_file_view(MappedFile *mapped, u64 size)
+{
+    auto protect = mapped->isWritable ? PROT_READ|PROT_WRITE : PROT_READ;
+
+    if (size == 0)
+        return true;
+
+    // A file only sized with ftruncate is sparse, and a store into it
+    // with the disk full is a SIGBUS, so the blocks are reserved first.
+    // Where that isn't supported, such as on some network filesystems,
+    // it's sized without them.
+    if (mapped->isWritable) {
+        auto result = posix_fallocate(mapped->fd, 0, off_t(size));
+
+        if (result == EINVAL || result == EOPNOTSUPP)
+            result = ftruncate(mapped->fd, off_t(size)) == 0 ? 0 : errno;
+        if (result != 0) {
+            errno = result;
+            return false;
+        }
+    }
+
+    auto data = mmap(nullptr, size_t(size), protect, MAP_SHARED, mapped->fd, 0);
+    if (data == MAP_FAILED)
+        return false;
+
+    mapped->data = (u8 *)data;
+    mapped->size = size;
+    return true;
+}
+
+/**
+ * @return The bytes free on the disk a file at path would be written
+ *         to, or ~0 if that can't be told.
+ */
+inline u64 free_disk_space(char const *path)
+{
+    char directory[4096] = ".";
+    auto length = strlen(path);
+
+    while (length > 0 && path[length - 1] != '/')
+        --length;
+    if (length >= sizeof(directory))
+        return ~u64(0);
+
+    if (length > 0) {
+        memcpy(directory, path, length);
+        directory[length] = 0;
+    }
+
+    struct statvfs info;
+    if (statvfs(directory, &info) != 0)
+        return ~u64(0);
+
+    return u64(info.f_bavail) * u64(info.f_frsize);
+}
+
+inline void unmap_file_view(MappedFile *mapped)
+{
+    if (mapped->data)
+        munmap(mapped->data, size_t(mapped->size));
+
+    mapped->data = nullptr;
+    mapped->size = 0;
+}
+
+/**
+ * Map a file.  A writable file is created, or emptied if it exists, and
+ * then extended to size bytes of zeros.  A read only file is mapped at
+ * its current size and size is ignored.
+ *
+ * @return False if the file couldn't be opened or mapped.
+ */
+inline bool open_mapped_file(MappedFile *mapped, char const *path, bool isWritable, u64 size)
+{
+    *mapped = MappedFile{};
+    mapped->isWritable = isWritable;
+
+    mapped->fd = isWritable ? open(path, O_RDWR|O_CREAT|O_TRUNC, 0644) : open(path, O_RDONLY);
+    if (mapped->fd < 0)
+        return false;
+
+    if (!isWritable) {
+        struct stat info;
+        if (fstat(mapped->fd, &info) != 0) {
+            close(mapped->fd);
+            *mapped = MappedFile{};
+            return false;
+        }
+        size = u64(info.st_size);
+    }
+
+    if (!map_file_view(mapped, size)) {
+        close(mapped->fd);
+        *mapped = MappedFile{};
+        return false;
+    }
+
+    mapped->isOpen = true;
+    return true;
+}
+
+/**
+ * Remap a writable file at a larger size.  Pointers into the old
+ * mapping are invalid afterwards.
+ */
+inline bool grow_mapped_file(MappedFile *mapped, u64 size)
+{
+    assert(mapped->isWritable && size >= mapped->size);
+
+    unmap_file_view(mapped);
+    return map_file_view(mapped, size);
+}
+
+/**
+ * Unmap and close a file.  A writable file is cut down to finalSize
+ * bytes, if that is less than its mapped size.
+ */
+inline void close_mapped_file(MappedFile *mapped, u64 finalSize = ~u64(0))
+{
+    auto isTruncated = mapped->isWritable && finalSize < mapped->size;
+
+    unmap_file_view(mapped);
+
+    if (mapped->isOpen) {
+        // Failing to truncate only leaves zeros at the end of the file.
+        if (isTruncated) {
+            auto result = ftruncate(mapped->fd, off_t(finalSize));
+            (void)result;
+        }
+        close(mapped->fd);
+    }
+
+    *mapped = MappedFile{};
+}
+
+#endif
+
+#endif // GUARD__MAPPED_FILE_H__
@@ -0,0 +1,141 @@
+#ifndef GUARD__RCU_H__
+#define GUARD__RCU_H__
+
+#include "bl_common.hpp"
+#include <atomic>
+#include <cassert>
+
+/*
+ * Read-copy-update publication of an immutable snapshot.  Readers get
+ * the current snapshot with a single acquire load and never block or
+ * write anything shared while they use it.  A single writer builds a
+ * new snapshot off to the side and publishes it by swapping the
+ * pointer, then retires the old one, which is only handed back to be
+ * freed once every reader has passed a quiescent state since the swap
+ * and so can't still be holding it.
+ *
+ * Readers register once and call quiescent() at points where they hold
+ * no snapshot, such as the top of their event loop.  A reader that
+ * sleeps for a long time just holds up freeing, never publishing,
+ * until the retired list is full.  Epochs count publications, so a
+ * reader that has seen epoch e has let go of everything retired at or
+ * before e.
+ *
+ * Like the other bl_ containers there is no constructor, so it can live
+ * in zero initialized static storage, which holds no snapshot.
+ */
+template <typename T, u32 MAX_READERS = 4, u32 MAX_RETIRED = 8>
+struct Rcu {
+    struct alignas(64) Reader {
+        std::atomic<u64> seenEpoch;
+    };
+
+    alignas(64) std::atomic<T const *> current;
+    alignas(64) std::atomic<u64> epoch;
+    std::atomic<u32> readerCount;
+    Reader readers[MAX_READERS];
+
+    // Writer only.
+    T const *retired[MAX_RETIRED];
+    u64      retiredEpoch[MAX_RETIRED];
+    u32      retiredCount;
+
+    /**
+     * The current snapshot, which stays valid until this reader's next
+     * quiescent state.  Any thread.
+     */
+    T const *read() const {
+        return current.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @return An id for a reader thread to pass to quiescent.
+     */
+    u32 add_reader() {
+        // Until its epoch is stored the reader reads as having seen
+        // nothing, which only holds up freeing.
+        auto id = readerCount.fetch_add(1, std::memory_order_seq_cst);
+        assert(id < MAX_READERS);
+
+        readers[id].seenEpoch.store(epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        return id;
+    }
+
+    /**
+     * Say that a reader holds no snapshot it read before now.  Reader
+     * thread only.
+     */
+    void quiescent(u32 reader) {
+        readers[reader].seenEpoch.store(epoch.load(std::memory_order_seq_cst), std::memory_order_release);
+    }
+
+    /**
+     * Swap in a new snapshot and retire the old one, after freeing
+     * whatever retired snapshots no reader can hold any more with
+     * release(snapshot).  Writer thread only.
+     *
+     * @return False if the retired list is still full, in which case
+     * nothing is published.
+     */
+    template <typename Release>
+    bool publish(T const *next, Release release) {
+        reclaim(release);
+        if (retiredCount == MAX_RETIRED)
+            return false;
+
+        auto old  = current.exchange(next, std::memory_order_seq_cst);
+        auto when = epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+
+        if (old) {
+            retired[retiredCount]      = old;
+            retiredEpoch[retiredCount] = when;
+            ++retiredCount;
+        }
+
+        return true;
+    }
+
+    /**
+     * Free the retired snapshots every reader has let go of.  Writer
+     * thread only.
+     */
+    template <typename Release>
+    void reclaim(Release release) {
+        auto oldest = epoch.load(std::memory_order_seq_cst);
+        auto count  = readerCount.load(std::memory_order_seq_cst);
+
+        for (u32 idx = 0; idx < count; ++idx) {
+            auto seen = readers[idx].seenEpoch.load(std::memory_order_acquire);
+            oldest = seen < oldest ? seen : oldest;
+        }
+
+        u32 kept = 0;
+        for (u32 idx = 0; idx < retiredCount; ++idx) {
+            if (retiredEpoch[idx] <= oldest) {
+                release(retired[idx]);
+            }
+            else {
+                retired[kept]      = retired[idx];
+                retiredEpoch[kept] = retiredEpoch[idx];
+                ++kept;
+            }
+        }
+        retiredCount = kept;
+    }
+
+    /**
+     * Free every snapshot, current and retired.  Only once no thread
+     * reads any more.
+     */
+    template <typename Release>
+    void free_all(Release release) {
+        for (u32 idx = 0; idx < retiredCount; ++idx)
+            release(retired[idx]);
+        retiredCount = 0;
+
+        if (auto last = current.exchange(nullptr))
+            release(last);
+    }
+};
+
+#endif // GUARD__RCU_H__
@@ -0,0 +1,138 @@
+#ifndef GUARD__RING_H__
+#define GUARD__RING_H__
+
+#include "bl_common.hpp"
+#include <cassert>
+
+/*
+ * Fixed capacity ring that keeps the most recent items pushed into it.
+ * Storage is always N items, which must be a power of two, but the
+ * ring only holds on to the last depth items so the depth can be
+ * changed at runtime up to N.  The write position runs freely and is
+ * masked on access, so there is no wraparound logic anywhere.  Pushing
+ * into a full ring drops the oldest item.
+ *
+ * Items are reached by age, either newest or oldest first, through
+ * at_newest/at_oldest or the iterator ranges for range based for loops.
+ * The ring has no constructor so it can be zero initialized, which is
+ * an empty ring with a depth of zero.
+ */
+template <typename T, u32 N>
+struct Ring {
+    static_assert(N >= 1 && (N & (N - 1)) == 0, "Ring capacity must be a power of two");
+
+    static constexpr u32 CAPACITY = N;
+    static constexpr u32 MASK     = N - 1;
+
+    T   items[N];
+    u32 head;   // one past the newest item, free running
+    u32 count;
+    u32 depth;
+
+    struct Iterator {
+        T  *items;
+        u32 position;
+        u32 step;  // 1 going towards newer items, ~0 going towards older
+
+        T &operator*() const { return items[position & MASK]; }
+        T *operator->() const { return &items[position & MASK]; }
+
+        Iterator &operator++() {
+            position += step;
+            return *this;
+        }
+
+        bool operator==(Iterator const &other) const { return position == other.position; }
+        bool operator!=(Iterator const &other) const { return position != other.position; }
+    };
+
+    struct Range {
+        Iterator first;
+        Iterator last;
+
+        Iterator begin() const { return first; }
+        Iterator end() const { return last; }
+    };
+
+    /**
+     * Change how many items are kept, which empties the ring.
+     */
+    void set_depth(u32 newDepth) {
+        assert(newDepth >= 1 && newDepth <= N);
+        depth = newDepth;
+        clear();
+    }
+
+    void clear() { count = 0; }
+
+    u32  size() const { return count; }
+    bool is_empty() const { return count == 0; }
+    bool is_full() const { return count == depth; }
+
+    /**
+     * Add an item as the newest one in the ring.
+     *
+     * @return True if the oldest item was dropped to make room for it.
+     */
+    bool push(T const &item) {
+        assert(depth > 0);
+
+        items[head & MASK] = item;
+        ++head;
+
+        if (count < depth) {
+            ++count;
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * Take the newest item off the ring.  The items dropped to make
+     * room for it don't come back.
+     */
+    void pop_newest() {
+        assert(count > 0);
+        --head;
+        --count;
+    }
+
+    // The newest item is zero, the one pushed before it one and so on.
+    T &at_newest(u32 age) {
+        assert(age < count);
+        return items[(head - 1 - age) & MASK];
+    }
+
+    T const &at_newest(u32 age) const {
+        assert(age < count);
+        return items[(head - 1 - age) & MASK];
+    }
+
+    // The oldest item is zero and the newest is size() - 1.
+    T &at_oldest(u32 index) {
+        assert(index < count);
+        return items[(head - count + index) & MASK];
+    }
+
+    T const &at_oldest(u32 index) const {
+        assert(index < count);
+        return items[(head - count + index) & MASK];
+    }
+
+    Range newest_first() {
+        return Range {
+            Iterator { items, head - 1,         ~0u },
+            Iterator { items, head - 1 - count, ~0u },
+        };
+    }
+
+    Range oldest_first() {
+        return Range {
+            Iterator { items, head - count, 1 },
+            Iterator { items, head,         1 },
+        };
+    }
+};
+
+#endif // GUARD__RING_H__
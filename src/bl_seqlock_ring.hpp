@@ -0,0 +1,175 @@
+#ifndef GUARD__SEQLOCK_RING_H__
+#define GUARD__SEQLOCK_RING_H__
+
+#include "bl_common.hpp"
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+/*
+ * Bounded single-writer, many-reader broadcast ring.  The writer never
+ * waits for readers and readers never write anything, so they can map
+ * the ring read only from other processes and there can be any number
+ * of them.  A reader that falls more than N items behind loses the
+ * oldest of them, and is told how many.
+ *
+ * Every slot is guarded by its own sequence lock.  The writer makes the
+ * slot's sequence odd, stores the item and then stores the even
+ * sequence of the position it wrote.  A reader copies the item out
+ * between two loads of the sequence and keeps it only if both are the
+ * sequence it expected, otherwise the writer has lapped it.  Items are
+ * stored as 32-bit atomic words, so a copy racing with the writer is
+ * torn rather than undefined, and the sequence check throws it away.
+ *
+ * Positions count items from zero and wrap, so they are only compared
+ * by difference.  Like the other bl_ containers there is no
+ * constructor, and zeroed memory, such as a fresh shared memory
+ * mapping, is an empty ring.
+ */
+template <typename T, u32 N>
+struct SeqlockRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SeqlockRing capacity must be a power of two");
+    static_assert(sizeof(T) % sizeof(u32) == 0, "SeqlockRing items must be whole 32-bit words");
+    static_assert(std::is_trivially_copyable<T>::value, "SeqlockRing items are copied as words");
+
+    static constexpr u32 MASK  = N - 1;
+    static constexpr u32 WORDS = sizeof(T) / sizeof(u32);
+
+    struct Slot {
+        std::atomic<u32> sequence;  // 2*position + 2 once written, odd while writing
+        std::atomic<u32> words[WORDS];
+    };
+
+    alignas(64) std::atomic<u32> head;  // position of the next item written
+    alignas(64) Slot slots[N];
+
+    /**
+     * Append an item, overwriting the oldest once the ring is full.
+     * Writer only.
+     */
+    void publish(T const &item) {
+        auto  position = head.load(std::memory_order_relaxed);
+        auto &slot     = slots[position & MASK];
+
+        u32 words[WORDS];
+        memcpy(words, &item, sizeof(T));
+
+        // The odd sequence has to be seen before any of the new words.
+        slot.sequence.store(2*position + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (u32 idx = 0; idx < WORDS; ++idx)
+            slot.words[idx].store(words[idx], std::memory_order_relaxed);
+
+        slot.sequence.store(2*position + 2, std::memory_order_release);
+        head.store(position + 1, std::memory_order_release);
+    }
+
+    /**
+     * Copy the item at a position.
+     *
+     * @return False if the item isn't written yet or has been
+     * overwritten, before or during the copy.
+     */
+    bool read(u32 position, T *item) const {
+        auto &slot     = slots[position & MASK];
+        auto  expected = 2*position + 2;
+
+        if (slot.sequence.load(std::memory_order_acquire) != expected)
+            return false;
+
+        u32 words[WORDS];
+        for (u32 idx = 0; idx < WORDS; ++idx)
+            words[idx] = slot.words[idx].load(std::memory_order_relaxed);
+
+        // None of the words may be read after the sequence is checked.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != expected)
+            return false;
+
+        memcpy(item, words, sizeof(T));
+        return true;
+    }
+};
+
+/*
+ * Where a reader is in a ring.  Each reader keeps its own, in its own
+ * memory, so readers don't know about each other.
+ */
+struct SeqlockCursor {
+    u32 position;  // of the next item to read
+    u32 lost;      // items overwritten before they were read
+};
+
+/**
+ * @return A cursor that only sees items written from now on.
+ */
+template <typename T, u32 N>
+SeqlockCursor seqlock_cursor_at_newest(SeqlockRing<T, N> const &ring)
+{
+    return SeqlockCursor{ ring.head.load(std::memory_order_acquire), 0 };
+}
+
+/**
+ * @return A cursor that starts at the oldest item still in the ring.
+ */
+template <typename T, u32 N>
+SeqlockCursor seqlock_cursor_at_oldest(SeqlockRing<T, N> const &ring)
+{
+    auto head = ring.head.load(std::memory_order_acquire);
+    return SeqlockCursor{ head > N ? head - N : 0, 0 };
+}
+
+/**
+ * @return How many items have been written that a cursor hasn't read
+ * yet, which is more than N once the writer has lapped it.
+ */
+template <typename T, u32 N>
+u32 seqlock_lag(SeqlockRing<T, N> const &ring, SeqlockCursor const &cursor)
+{
+    return ring.head.load(std::memory_order_acquire) - cursor.position;
+}
+
+/**
+ * Copy up to capacity items after a cursor, oldest first, and move the
+ * cursor past them.  A reader the writer has lapped skips ahead to the
+ * oldest item still in the ring and adds what it skipped to lost.
+ *
+ * @return The number of items copied into out.
+ */
+template <typename T, u32 N>
+u32 seqlock_read(SeqlockRing<T, N> const &ring, SeqlockCursor *cursor, T *out, u32 capacity)
+{
+    u32 count = 0;
+
+    while (count < capacity) {
+        auto head = ring.head.load(std::memory_order_acquire);
+        auto lag  = head - cursor->position;
+
+        if (lag == 0)
+            break;
+
+        if (lag > N) {
+            cursor->lost     += lag - N;
+            cursor->position  = head - N;
+        }
+
+        if (ring.read(cursor->position, &out[count])) {
+            ++cursor->position;
+            ++count;
+            continue;
+        }
+
+        // A written item only fails to read once the writer has come
+        // round to its slot again, so it's gone.
+        if (ring.head.load(std::memory_order_acquire) - cursor->position < N)
+            break;
+
+        ++cursor->lost;
+        ++cursor->position;
+    }
+
+    return count;
+}
+
+#endif // GUARD__SEQLOCK_RING_H__
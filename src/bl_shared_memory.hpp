@@ -0,0 +1,201 @@
+#ifndef GUARD__SHARED_MEMORY_H__
+#define GUARD__SHARED_MEMORY_H__
+
+#include "bl_common.hpp"
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * A block of memory shared with other processes under a name.  One
+ * process creates it, zeroed, and any number of others open it by name
+ * to read it.  Names are a Windows kernel object name such as
+ * "Local\\shoki-keys" or a POSIX shared memory name such as
+ * "/shoki-keys".
+ *
+ * On Windows the block goes away once the last process lets go of it.
+ * A POSIX block lives until it is unlinked, which its creator does when
+ * it closes it, so one left behind by a process that died is taken
+ * over by the next one to create it.
+ */
+struct SharedMemory {
+    u8  *data;
+    u64  size;
+    bool isOpen;
+    bool isCreator;
+
+#if defined(_WIN32)
+    HANDLE mapping;
+#else
+    char name[64];
+#endif
+};
+
+#if defined(_WIN32)
+
+/**
+ * Create a block of zeros and map it writable.
+ *
+ * @return False if it couldn't be created or mapped, or another process
+ * already has a block with the name.
+ */
+inline bool create_shared_memory(SharedMemory *shared, char const *name, u64 size)
+{
+    *shared = SharedMemory{};
+
+    shared->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE,
+                                         nullptr,
+                                         PAGE_READWRITE,
+                                         DWORD(size >> 32),
+                                         DWORD(size),
+                                         name);
+    if (!shared->mapping)
+        return false;
+
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        CloseHandle(shared->mapping);
+        *shared = SharedMemory{};
+        return false;
+    }
+
+    shared->data = (u8 *)MapViewOfFile(shared->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size_t(size));
+    if (!shared->data) {
+        CloseHandle(shared->mapping);
+        *shared = SharedMemory{};
+        return false;
+    }
+
+    shared->size      = size;
+    shared->isOpen    = true;
+    shared->isCreator = true;
+    return true;
+}
+
+/**
+ * Map the first size bytes of a block another process created, read
+ * only.
+ *
+ * @return False if there is no block with the name.
+ */
+inline bool open_shared_memory(SharedMemory *shared, char const *name, u64 size)
+{
+    *shared = SharedMemory{};
+
+    shared->mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (!shared->mapping)
+        return false;
+
+    shared->data = (u8 *)MapViewOfFile(shared->mapping, FILE_MAP_READ, 0, 0, size_t(size));
+    if (!shared->data) {
+        CloseHandle(shared->mapping);
+        *shared = SharedMemory{};
+        return false;
+    }
+
+    shared->size   = size;
+    shared->isOpen = true;
+    return true;
+}
+
+inline void close_shared_memory(SharedMemory *shared)
+{
+    if (shared->data)
+        UnmapViewOfFile(shared->data);
+    if (shared->mapping)
+        CloseHandle(shared->mapping);
+
+    *shared = SharedMemory{};
+}
+
+#else
+
+/**
+ * Create a block of zeros and map it writable, replacing any block
+ * with the name.
+ *
+ * @return False if it couldn't be created or mapped.
+ */
+inline bool create_shared_memory(SharedMemory *shared, char const *name, u64 size)
+{
+    *shared = SharedMemory{};
+
+    if (strlen(name) >= sizeof(shared->name))
+        return false;
+
+    // Readers of a block left behind keep what they mapped, and new
+    // readers find the new one.
+    shm_unlink(name);
+
+    auto fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0644);
+    if (fd < 0)
+        return false;
+
+    auto data = ftruncate(fd, off_t(size)) == 0
+              ? mmap(nullptr, size_t(size), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)
+              : MAP_FAILED;
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        shm_unlink(name);
+        return false;
+    }
+
+    strcpy(shared->name, name);
+    shared->data      = (u8 *)data;
+    shared->size      = size;
+    shared->isOpen    = true;
+    shared->isCreator = true;
+    return true;
+}
+
+/**
+ * Map the first size bytes of a block another process created, read
+ * only.
+ *
+ * @return False if there is no block with the name or it is smaller
+ * than size.
+ */
+inline bool open_shared_memory(SharedMemory *shared, char const *name, u64 size)
+{
+    *shared = SharedMemory{};
+
+    auto fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    auto data = fstat(fd, &info) == 0 && u64(info.st_size) >= size
+              ? mmap(nullptr, size_t(size), PROT_READ, MAP_SHARED, fd, 0)
+              : MAP_FAILED;
+    close(fd);
+
+    if (data == MAP_FAILED)
+        return false;
+
+    shared->data   = (u8 *)data;
+    shared->size   = size;
+    shared->isOpen = true;
+    return true;
+}
+
+inline void close_shared_memory(SharedMemory *shared)
+{
+    if (shared->data)
+        munmap(shared->data, size_t(shared->size));
+    if (shared->isCreator)
+        shm_unlink(shared->name);
+
+    *shared = SharedMemory{};
+}
+
+#endif
+
+#endif // GUARD__SHARED_MEMORY_H__
@@ -0,0 +1,80 @@
+#ifndef GUARD__SPSC_QUEUE_H__
+#define GUARD__SPSC_QUEUE_H__
+
+#include "bl_common.hpp"
+#include <atomic>
+
+/*
+ * Bounded, lock-free, single-producer/single-consumer queue.  One
+ * thread may only ever push and one other thread may only ever pop.
+ * The head and tail counters run freely and are masked on access, so
+ * the capacity must be a power of two and a full queue holds exactly
+ * N items.  The queue has no constructor so it can live in zero
+ * initialized static storage.
+ */
+template <typename T, u32 N>
+struct SpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+    static constexpr u32 MASK = N - 1;
+
+    // Each counter is on its own cache line so the producer and
+    // consumer don't fight over the same line on every operation.
+    alignas(64) std::atomic<u32> head;  // next slot to pop, owned by consumer
+    alignas(64) std::atomic<u32> tail;  // next slot to push, owned by producer
+    alignas(64) T items[N];
+
+    /**
+     * Append an item to the queue.  Producer thread only.
+     *
+     * @return False if the queue is full and the item was not added.
+     */
+    bool push(T const &item) {
+        auto t = tail.load(std::memory_order_relaxed);
+        auto h = head.load(std::memory_order_acquire);
+
+        if (t - h == N)
+            return false;
+
+        items[t & MASK] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Remove the oldest item from the queue.  Consumer thread only.
+     *
+     * @return False if the queue is empty.
+     */
+    bool pop(T *item) {
+        return pop_batch(item, 1) == 1;
+    }
+
+    /**
+     * Remove up to maxCount of the oldest items from the queue in
+     * order and place them into out.  The consumer only publishes its
+     * new position once for the whole batch.  Consumer thread only.
+     *
+     * @return The number of items written to out.
+     */
+    u32 pop_batch(T *out, u32 maxCount) {
+        auto h     = head.load(std::memory_order_relaxed);
+        auto t     = tail.load(std::memory_order_acquire);
+        auto count = t - h;
+
+        if (count > maxCount)
+            count = maxCount;
+
+        for (u32 i = 0; i < count; ++i)
+            out[i] = items[(h + i) & MASK];
+
+        head.store(h + count, std::memory_order_release);
+        return count;
+    }
+
+    bool is_empty() {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+};
+
+#endif // GUARD__SPSC_QUEUE_H__
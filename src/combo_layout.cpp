@@ -0,0 +1,187 @@
+
+enum PlacementJustification {
+    Justification_Left,
+    Justification_Right,
+    Justification_Center
+};
+
+struct Placement {
+    i32 offset_x;
+    i32 offset_y;
+    i32 width;
+    i32 height;
+
+    PlacementJustification justification;
+};
+
+struct LabelSize {
+    f32 width;
+    f32 height;
+};
+
+/*
+ * The size of every label that get_key_info can return, and of every
+ * chord label, as measured with the letter font, along with the size
+ * of one line of the modifier stack as measured with the modifier
+ * font.  The set of labels is fixed so these only need to be measured
+ * once for each font configuration and set of chords.
+ */
+struct LabelMeasurements {
+    LabelSize keys[256][KeyLevel_Count];  // indexed by virtual key and level
+    LabelSize chords[MAX_CHORD_LABELS];   // indexed by chord label less one
+    LabelSize modifier;      // sized for "SHIFT", the widest modifier
+};
+
+enum : u8 {
+    Modifier_Ctrl  = 1 << 0,
+    Modifier_Alt   = 1 << 1,
+    Modifier_Shift = 1 << 2,
+};
+
+/**
+ * @return The Modifier_* bits shown with a key.  CTRL and ALT are how
+ * AltGr shows up, so when they picked the label they aren't shown as
+ * modifiers, and neither is SHIFT when it picked the character.
+ */
+inline u8 shown_modifiers(KeyCombo const &combo, KeyInfo const &keyInfo)
+{
+    u8 modifiers = 0;
+
+    if (combo.isCtrlDown && keyInfo.level != KeyLevel_AltGr)
+        modifiers |= Modifier_Ctrl;
+    if (combo.isAltDown && keyInfo.level != KeyLevel_AltGr)
+        modifiers |= Modifier_Alt;
+    if (combo.isShiftDown && !keyInfo.doesShiftAffectKey)
+        modifiers |= Modifier_Shift;
+
+    return modifiers;
+}
+
+/*
+ * Position of a single key press and its modifier stack relative to
+ * the top left corner of the combo box.
+ */
+struct KeyPressLayout {
+    wchar_t const *key;
+    u32            vk_key;
+    KeyLevel       level;
+    u8             modifiers;
+    u8             chord;  // label of a chord instead of a key
+
+    f32 key_x;
+    f32 key_y;
+    f32 key_wd;
+    f32 key_ht;
+
+    f32 mod_x;
+    f32 mod_y;
+    f32 mod_wd;
+    f32 mod_ht;
+};
+
+struct ComboLayout {
+    KeyPressLayout presses[MAX_KEY_COMBOS];  // oldest key press first
+    i32            pressCount;
+    f32            box_wd;
+    f32            box_ht;
+};
+
+constexpr f32 MOD_LETTER_SPACING = -8.0f; // pixels
+constexpr f32 MOD_LINE_SPACING   = 2.0f;
+constexpr f32 COMBO_SPACING      = 2.0f;
+constexpr f32 BOX_PADDING        = 2.0f;
+constexpr f32 BOX_CORNER_RADIUS  = 5.0f;
+
+/**
+ * Lay out the key combos currently in the stack using previously
+ * measured labels.  No text measurement happens here so this is cheap
+ * enough to run whenever the stack changes.
+ */
+void layout_combos(KeyComboStack *combos, LabelMeasurements const &labels, ComboLayout *layout)
+{
+    auto pressCount = i32(combos->keyCombos.size());
+    i32  idx        = 0;
+
+    f32 box_wd  = 2*BOX_PADDING;
+    f32 box_ht  = 0.0f;
+    f32 combo_x = BOX_PADDING;
+
+    layout->pressCount = pressCount;
+
+    for (auto &combo : combos->keyCombos.oldest_first()) {
+        auto &press = layout->presses[idx++];
+        auto  ltr   = LabelSize{};
+
+        press.modifiers = 0;
+        press.chord     = combo.chord;
+
+        if (combo.chord) {
+            press.key    = chord_label(combo.chord);
+            press.vk_key = 0;
+            press.level  = KeyLevel_Base;
+            ltr          = labels.chords[(combo.chord - 1) % MAX_CHORD_LABELS];
+        }
+        else {
+            auto isAltGr = combo.isCtrlDown && combo.isAltDown;
+            auto keyInfo = get_key_info(combo.vk_key, combo.isShiftDown, isAltGr);
+
+            ltr             = labels.keys[combo.vk_key & 0xFF][keyInfo.level];
+            press.key       = keyInfo.key;
+            press.vk_key    = combo.vk_key & 0xFF;
+            press.level     = keyInfo.level;
+            press.modifiers = shown_modifiers(combo, keyInfo);
+        }
+
+        press.key_wd = ltr.width;
+        press.key_ht = ltr.height;
+        press.mod_wd = 0.0f;
+        press.mod_ht = 0.0f;
+
+        box_wd += ltr.width;
+        box_ht  = ltr.height > box_ht ? ltr.height : box_ht;
+
+        if (press.modifiers) {
+            press.mod_wd = labels.modifier.width;
+            press.mod_ht = labels.modifier.height;
+            box_wd += press.mod_wd + MOD_LETTER_SPACING;
+        }
+
+        auto offset_y = (press.key_ht - (3.0f * press.mod_ht) - MOD_LINE_SPACING) / 2.0f;
+        auto offset_x = press.mod_wd > 0 ? press.mod_wd + MOD_LETTER_SPACING : 0.0f;
+
+        press.mod_x = combo_x;
+        press.mod_y = BOX_PADDING + offset_y;
+        press.key_x = press.mod_x + offset_x;
+        press.key_y = BOX_PADDING;
+
+        combo_x += COMBO_SPACING + press.key_wd + offset_x;
+    }
+
+    if (pressCount > 0)
+        box_wd += (pressCount - 1) * COMBO_SPACING;
+
+    layout->box_wd = box_wd;
+    layout->box_ht = box_ht + 2.0f*BOX_PADDING;
+}
+
+/**
+ * Find where the top left corner of the combo box goes within the
+ * window according to its placement.
+ */
+void place_combo_box(ComboLayout const &layout, Placement const &placement, f32 *start_x, f32 *start_y)
+{
+    *start_x = 0;
+    *start_y = placement.height - placement.offset_y - layout.box_ht;
+
+    switch (placement.justification) {
+    case Justification_Left:
+        *start_x = placement.offset_x;
+        break;
+    case Justification_Right:
+        *start_x = placement.width - placement.offset_x - layout.box_wd;
+        break;
+    case Justification_Center:
+        *start_x = (placement.width / 2.0f) - (layout.box_wd / 2.0f);
+        break;
+    }
+}
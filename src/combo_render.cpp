@@ -0,0 +1,159 @@
+/*
+ * Drawing the combo strip is split between the layout, which decides
+ * where the box and every sprite go, and a renderer, which only knows
+ * how to fill the box and copy sprites out of the glyph atlas.  The
+ * overlay and the headless tools render into memory, the overlay can
+ * draw with GDI+ instead (combo_render_gdiplus.cpp), and the strip's
+ * bounds are found, all from the same walk over the layout.
+ */
+struct StripRenderer {
+    // The rounded black box behind the key presses.
+    virtual void fill_box(f32 x, f32 y, f32 width, f32 height) = 0;
+
+    // A sprite of the glyph atlas with its top left corner at x, y.
+    virtual void draw_sprite(Sprite sprite, i32 x, i32 y) = 0;
+};
+
+/**
+ * Render the combo box and the sprites of its key presses where the
+ * layout and placement put them.  The layout and the atlas have to be
+ * up to date already.
+ */
+void render_combo_strip(StripRenderer *renderer,
+                        ComboLayout const &layout,
+                        GlyphAtlas const &atlas,
+                        Placement const &placement)
+{
+    if (layout.pressCount == 0)
+        return;
+
+    f32 start_x, start_y;
+    place_combo_box(layout, placement, &start_x, &start_y);
+
+    renderer->fill_box(start_x, start_y, layout.box_wd, layout.box_ht);
+
+    auto draw = [&](Sprite sprite, f32 x, f32 y) {
+        if (sprite.width > 0)
+            renderer->draw_sprite(sprite, i32(roundf(x)), i32(roundf(y)));
+    };
+
+    for (i32 idx = 0; idx < layout.pressCount; ++idx) {
+        auto &press = layout.presses[idx];
+
+        auto key = press.chord ? atlas.chords[(press.chord - 1) % MAX_CHORD_LABELS] : atlas.keys[press.vk_key][press.level];
+
+        draw(key, start_x + press.key_x, start_y + press.key_y);
+        draw(atlas.modifiers[press.modifiers], start_x + press.mod_x, start_y + press.mod_y);
+    }
+}
+
+// Premultiplied color of the box unless the config says otherwise.
+constexpr u32 BOX_COLOR = 0xFF000000;
+
+/*
+ * Renders into a surface in memory with the compositing kernels, so it
+ * needs nothing from the platform.  Display mode draws at full opacity
+ * and has the compositor fade the finished frame, while preview mode
+ * fades the box and sprites as they are drawn.
+ */
+struct SoftwareRenderer : StripRenderer {
+    Surface          *surface;
+    GlyphAtlas const *atlas;
+    u32               boxColor;  // premultiplied
+    u32               alpha;
+
+    SoftwareRenderer(Surface *surface, GlyphAtlas const *atlas, u32 boxColor = BOX_COLOR, u32 alpha = 255)
+        : surface(surface), atlas(atlas), boxColor(boxColor), alpha(alpha) {}
+
+    void fill_box(f32 x, f32 y, f32 width, f32 height) override {
+        fill_rounded_rect(surface, i32(x), i32(y), i32(width), i32(height), BOX_CORNER_RADIUS, scale_pixel(boxColor, alpha));
+    }
+
+    void draw_sprite(Sprite sprite, i32 x, i32 y) override {
+        if (!atlas->pixels)
+            return;
+
+        auto *src = atlas->pixels + size_t(sprite.y) * atlas->width + sprite.x;
+        blit_over(surface, src, atlas->width, x, y, sprite.width, sprite.height, alpha);
+    }
+};
+
+/**
+ * Composite the combo strip into a surface, at full opacity unless an
+ * alpha is given.
+ */
+void composite_combo_strip(Surface *surface,
+                           ComboLayout const &layout,
+                           GlyphAtlas const &atlas,
+                           Placement const &placement,
+                           u32 boxColor = BOX_COLOR,
+                           u32 alpha = 255)
+{
+    auto renderer = SoftwareRenderer(surface, &atlas, boxColor, alpha);
+    render_combo_strip(&renderer, layout, atlas, placement);
+}
+
+/*
+ * Pixels from x0, y0 up to but not including x1, y1.  Anything with no
+ * area is empty.
+ */
+struct PixelRect {
+    i32 x0;
+    i32 y0;
+    i32 x1;
+    i32 y1;
+
+    bool is_empty() const { return x1 <= x0 || y1 <= y0; }
+    u32  area() const { return is_empty() ? 0 : u32(x1 - x0) * u32(y1 - y0); }
+};
+
+inline PixelRect union_rects(PixelRect const &a, PixelRect const &b)
+{
+    if (a.is_empty())
+        return b;
+    if (b.is_empty())
+        return a;
+
+    return PixelRect{ a.x0 < b.x0 ? a.x0 : b.x0,
+                      a.y0 < b.y0 ? a.y0 : b.y0,
+                      a.x1 > b.x1 ? a.x1 : b.x1,
+                      a.y1 > b.y1 ? a.y1 : b.y1 };
+}
+
+/*
+ * Renders nothing and only keeps the bounds of everything it would
+ * have touched, rounding the same way SoftwareRenderer does.
+ */
+struct BoundsRenderer : StripRenderer {
+    PixelRect bounds;
+
+    BoundsRenderer() : bounds{} {}
+
+    void fill_box(f32 x, f32 y, f32 width, f32 height) override {
+        auto box = PixelRect{ i32(x), i32(y), i32(x) + i32(width), i32(y) + i32(height) };
+        bounds = union_rects(bounds, box);
+    }
+
+    void draw_sprite(Sprite sprite, i32 x, i32 y) override {
+        bounds = union_rects(bounds, PixelRect{ x, y, x + sprite.width, y + sprite.height });
+    }
+};
+
+/**
+ * @return The pixels of a placement's frame that rendering the combo
+ * strip touches, which is empty when there's nothing to draw.
+ */
+PixelRect combo_strip_bounds(ComboLayout const &layout, GlyphAtlas const &atlas, Placement const &placement)
+{
+    auto renderer = BoundsRenderer();
+    render_combo_strip(&renderer, layout, atlas, placement);
+
+    auto &bounds = renderer.bounds;
+
+    bounds.x0 = bounds.x0 < 0 ? 0 : bounds.x0;
+    bounds.y0 = bounds.y0 < 0 ? 0 : bounds.y0;
+    bounds.x1 = bounds.x1 > placement.width ? placement.width : bounds.x1;
+    bounds.y1 = bounds.y1 > placement.height ? placement.height : bounds.y1;
+
+    return bounds.is_empty() ? PixelRect{} : bounds;
+}
@@ -0,0 +1,188 @@
+
+/*
+ * The GDI+ backend of StripRenderer, drawing the strip the way shoki
+ * always used to, for comparing with the software renderer on a live
+ * desktop.  Every GDI+ object a frame draws with is created once and
+ * only has its color or geometry changed from frame to frame, since
+ * creating any of them allocates inside GDI+.  The surface and the
+ * glyph atlas are wrapped rather than copied, and only wrapped again
+ * when their pixels move or change size.
+ */
+struct GdiplusStrip {
+    gp::Bitmap          *target;          // wraps the surface drawn into
+    gp::Graphics        *graphics;        // draws into target
+    Surface              targetSurface;   // what target wraps
+    gp::Bitmap          *atlasImage;      // wraps the atlas pixels
+    u32 const           *atlasPixels;     // what atlasImage wraps
+    i32                  atlasWidth;
+    i32                  atlasHeight;
+    gp::SolidBrush      *boxBrush;
+    gp::GraphicsPath    *boxPath;
+    gp::Rect             boxPathRect;     // what boxPath was built for
+    gp::ImageAttributes *fadeAttributes;
+};
+
+// For when the pixels of the surface go away.
+void unwrap_gdiplus_target(GdiplusStrip *strip)
+{
+    delete strip->graphics;
+    delete strip->target;
+
+    strip->graphics      = nullptr;
+    strip->target        = nullptr;
+    strip->targetSurface = Surface{};
+}
+
+void free_gdiplus_strip(GdiplusStrip *strip)
+{
+    unwrap_gdiplus_target(strip);
+    delete strip->atlasImage;
+    delete strip->boxBrush;
+    delete strip->boxPath;
+    delete strip->fadeAttributes;
+
+    *strip = GdiplusStrip{};
+}
+
+/*
+ * Renders onto the graphics of a GdiplusStrip.  The atlas is text at
+ * full opacity, so fading only has to scale the alpha channel as the
+ * sprites are copied.
+ */
+struct GdiplusRenderer : StripRenderer {
+    GdiplusStrip        *strip;
+    gp::ImageAttributes *attributes;  // scales alpha, or null at full opacity
+    u32                  boxColor;    // straight ARGB
+    u8                   alpha;
+
+    GdiplusRenderer(GdiplusStrip *strip, gp::ImageAttributes *attributes, u32 boxColor, u8 alpha)
+        : strip(strip), attributes(attributes), boxColor(boxColor), alpha(alpha) {}
+
+    // The path is only rebuilt when the box moves or changes size,
+    // which a fading frame never does.
+    void fill_box(f32 x, f32 y, f32 width, f32 height) override {
+        // Arcs are sized by their bounding box, which is the diameter.
+        constexpr i32 DIAMETER = i32(2*BOX_CORNER_RADIUS);
+
+        auto rect = gp::Rect(i32(x), i32(y), i32(width), i32(height));
+        auto path = strip->boxPath;
+
+        if (!rect.Equals(strip->boxPathRect)) {
+            auto x2 = rect.X + rect.Width - DIAMETER;
+            auto y2 = rect.Y + rect.Height - DIAMETER;
+
+            path->Reset();
+            path->AddArc(rect.X, rect.Y, DIAMETER, DIAMETER, -180, 90);
+            path->AddArc(x2,     rect.Y, DIAMETER, DIAMETER,  -90, 90);
+            path->AddArc(x2,     y2,     DIAMETER, DIAMETER,    0, 90);
+            path->AddArc(rect.X, y2,     DIAMETER, DIAMETER,   90, 90);
+            strip->boxPathRect = rect;
+        }
+
+        strip->boxBrush->SetColor(gp::Color(BYTE(mul_div255(boxColor >> 24, alpha)),
+                                            BYTE(boxColor >> 16),
+                                            BYTE(boxColor >> 8),
+                                            BYTE(boxColor)));
+        strip->graphics->FillPath(strip->boxBrush, path);
+    }
+
+    void draw_sprite(Sprite sprite, i32 x, i32 y) override {
+        auto dst = gp::Rect(x, y, sprite.width, sprite.height);
+        strip->graphics->DrawImage(strip->atlasImage,
+                                   dst,
+                                   sprite.x,
+                                   sprite.y,
+                                   sprite.width,
+                                   sprite.height,
+                                   gp::UnitPixel,
+                                   attributes);
+    }
+};
+
+/**
+ * Draw the combo strip into a surface of premultiplied pixels with
+ * GDI+, which has to be started already.  The surface is flushed before
+ * this returns, so GDI can use it straight away.
+ *
+ * @param boxColor Straight ARGB.
+ * @return False if GDI+ couldn't draw into the surface or from the
+ * atlas.
+ */
+bool draw_gdiplus_strip(GdiplusStrip *strip,
+                        Surface *surface,
+                        ComboLayout const &layout,
+                        GlyphAtlas const &atlas,
+                        Placement const &placement,
+                        u32 boxColor,
+                        u8 alpha)
+{
+    if (!strip->boxBrush) {
+        strip->boxBrush       = new gp::SolidBrush(gp::Color(255, 0, 0, 0));
+        strip->boxPath        = new gp::GraphicsPath();
+        strip->boxPathRect    = gp::Rect();
+        strip->fadeAttributes = new gp::ImageAttributes();
+    }
+
+    auto &wrapped = strip->targetSurface;
+    if (!strip->graphics ||
+        wrapped.pixels != surface->pixels ||
+        wrapped.width != surface->width ||
+        wrapped.height != surface->height ||
+        wrapped.stride != surface->stride) {
+        unwrap_gdiplus_target(strip);
+
+        strip->target        = new gp::Bitmap(surface->width,
+                                              surface->height,
+                                              surface->stride * sizeof(u32),
+                                              PixelFormat32bppPARGB,
+                                              (BYTE *)surface->pixels);
+        strip->graphics      = new gp::Graphics(strip->target);
+        strip->targetSurface = *surface;
+
+        if (strip->graphics->GetLastStatus() != gp::Ok) {
+            free_gdiplus_strip(strip);
+            return false;
+        }
+
+        strip->graphics->SetSmoothingMode(gp::SmoothingModeHighQuality);
+    }
+
+    if (!atlas.pixels)
+        return false;
+
+    if (!strip->atlasImage ||
+        strip->atlasPixels != atlas.pixels ||
+        strip->atlasWidth != atlas.width ||
+        strip->atlasHeight != atlas.height) {
+        delete strip->atlasImage;
+
+        strip->atlasImage  = new gp::Bitmap(atlas.width,
+                                            atlas.height,
+                                            atlas.width * sizeof(u32),
+                                            PixelFormat32bppPARGB,
+                                            (BYTE *)atlas.pixels);
+        strip->atlasPixels = atlas.pixels;
+        strip->atlasWidth  = atlas.width;
+        strip->atlasHeight = atlas.height;
+    }
+
+    gp::ColorMatrix fade = {{
+        {1.0f, 0.0f, 0.0f, 0.0f,            0.0f},
+        {0.0f, 1.0f, 0.0f, 0.0f,            0.0f},
+        {0.0f, 0.0f, 1.0f, 0.0f,            0.0f},
+        {0.0f, 0.0f, 0.0f, alpha / 255.0f,  0.0f},
+        {0.0f, 0.0f, 0.0f, 0.0f,            1.0f},
+    }};
+    gp::ImageAttributes *attributes = nullptr;
+
+    if (alpha < 255) {
+        strip->fadeAttributes->SetColorMatrix(&fade);
+        attributes = strip->fadeAttributes;
+    }
+
+    auto renderer = GdiplusRenderer(strip, attributes, boxColor, alpha);
+    render_combo_strip(&renderer, layout, atlas, placement);
+
+    strip->graphics->Flush(gp::FlushIntentionSync);
+    return true;
+}
@@ -0,0 +1,503 @@
+
+/*
+ * Software compositing for the overlay.  Everything here works on
+ * premultiplied 32-bit pixels laid out as BGRA in memory (0xAARRGGBB
+ * as a u32), which is what both a DIB section and the glyph atlas use.
+ *
+ * Each kernel has a scalar, SSE2 and AVX2 version, picked at runtime
+ * from what the CPU supports.  All of them divide by 255 with the same
+ * exact rounding, so every version produces bit-identical pixels and
+ * the scalar one serves as the reference.
+ */
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define COMPOSITE_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+struct Surface {
+    u32 *pixels;
+    i32  width;
+    i32  height;
+    i32  stride;  // in pixels
+};
+
+enum CompositeLevel {
+    Composite_Scalar,
+    Composite_SSE2,
+    Composite_AVX2,
+    Composite_LevelCount
+};
+
+char const *COMPOSITE_LEVEL_NAMES[Composite_LevelCount] = { "scalar", "sse2", "avx2" };
+
+/*
+ * Kernels work on a single row of pixels.
+ *
+ * fill:  dst = color + dst*(255 - color.a)/255 for a premultiplied color
+ * blit:  dst = src' + dst*(255 - src'.a)/255 with src' = src*alpha/255
+ * scale: dst = dst*alpha/255 on every channel
+ */
+struct CompositeKernels {
+    void (*fill)(u32 *dst, i32 count, u32 color);
+    void (*blit)(u32 *dst, u32 const *src, i32 count, u32 alpha);
+    void (*scale)(u32 *dst, i32 count, u32 alpha);
+};
+
+/*
+ * x*a/255 rounded to nearest for x and a in [0, 255].  The intermediate
+ * values fit in 16 bits, which lets the SIMD versions do the same math
+ * in 16-bit lanes.
+ */
+inline u32 mul_div255(u32 x, u32 a)
+{
+    u32 t = x*a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+inline u32 scale_pixel(u32 pixel, u32 alpha)
+{
+    return ((mul_div255((pixel >> 24) & 0xFF, alpha) << 24) |
+            (mul_div255((pixel >> 16) & 0xFF, alpha) << 16) |
+            (mul_div255((pixel >>  8) & 0xFF, alpha) <<  8) |
+            (mul_div255((pixel >>  0) & 0xFF, alpha) <<  0));
+}
+
+/**
+ * @return A straight ARGB color premultiplied by its alpha.
+ */
+inline u32 premultiply_color(u32 color)
+{
+    auto alpha = color >> 24;
+    return (scale_pixel(color, alpha) & 0x00FFFFFF) | (alpha << 24);
+}
+
+inline u32 over_pixel(u32 src, u32 dst)
+{
+    u32 inv = 255 - (src >> 24);
+    u32 out = 0;
+
+    for (u32 shift = 0; shift < 32; shift += 8) {
+        u32 c = ((src >> shift) & 0xFF) + mul_div255((dst >> shift) & 0xFF, inv);
+        out  |= (c > 255 ? 255 : c) << shift;  // saturate like packus
+    }
+
+    return out;
+}
+
+void fill_row_scalar(u32 *dst, i32 count, u32 color)
+{
+    if ((color >> 24) == 255) {
+        for (i32 i = 0; i < count; ++i)
+            dst[i] = color;
+        return;
+    }
+
+    for (i32 i = 0; i < count; ++i)
+        dst[i] = over_pixel(color, dst[i]);
+}
+
+void blit_row_scalar(u32 *dst, u32 const *src, i32 count, u32 alpha)
+{
+    for (i32 i = 0; i < count; ++i) {
+        auto pixel = alpha == 255 ? src[i] : scale_pixel(src[i], alpha);
+        dst[i] = over_pixel(pixel, dst[i]);
+    }
+}
+
+void scale_row_scalar(u32 *dst, i32 count, u32 alpha)
+{
+    for (i32 i = 0; i < count; ++i)
+        dst[i] = scale_pixel(dst[i], alpha);
+}
+
+#if defined(COMPOSITE_X86)
+
+inline __m128i mul_div255_sse2(__m128i x, __m128i a)
+{
+    auto t = _mm_add_epi16(_mm_mullo_epi16(x, a), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+inline __m128i broadcast_alpha_sse2(__m128i px16)
+{
+    px16 = _mm_shufflelo_epi16(px16, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm_shufflehi_epi16(px16, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+// Composite two premultiplied pixels held in 16-bit lanes over two more.
+inline __m128i over_sse2(__m128i src16, __m128i dst16)
+{
+    auto inv = _mm_sub_epi16(_mm_set1_epi16(255), broadcast_alpha_sse2(src16));
+    return _mm_add_epi16(src16, mul_div255_sse2(dst16, inv));
+}
+
+void fill_row_sse2(u32 *dst, i32 count, u32 color)
+{
+    auto zero  = _mm_setzero_si128();
+    auto src16 = _mm_unpacklo_epi8(_mm_set1_epi32(i32(color)), zero);
+    i32  i     = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        auto d  = _mm_loadu_si128((__m128i *)(dst + i));
+        auto lo = over_sse2(src16, _mm_unpacklo_epi8(d, zero));
+        auto hi = over_sse2(src16, _mm_unpackhi_epi8(d, zero));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+
+    fill_row_scalar(dst + i, count - i, color);
+}
+
+void blit_row_sse2(u32 *dst, u32 const *src, i32 count, u32 alpha)
+{
+    auto zero    = _mm_setzero_si128();
+    auto alpha16 = _mm_set1_epi16(i16(alpha));
+    i32  i       = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        auto s    = _mm_loadu_si128((__m128i *)(src + i));
+        auto d    = _mm_loadu_si128((__m128i *)(dst + i));
+        auto s_lo = _mm_unpacklo_epi8(s, zero);
+        auto s_hi = _mm_unpackhi_epi8(s, zero);
+
+        if (alpha != 255) {
+            s_lo = mul_div255_sse2(s_lo, alpha16);
+            s_hi = mul_div255_sse2(s_hi, alpha16);
+        }
+
+        auto lo = over_sse2(s_lo, _mm_unpacklo_epi8(d, zero));
+        auto hi = over_sse2(s_hi, _mm_unpackhi_epi8(d, zero));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+
+    blit_row_scalar(dst + i, src + i, count - i, alpha);
+}
+
+void scale_row_sse2(u32 *dst, i32 count, u32 alpha)
+{
+    auto zero    = _mm_setzero_si128();
+    auto alpha16 = _mm_set1_epi16(i16(alpha));
+    i32  i       = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        auto d  = _mm_loadu_si128((__m128i *)(dst + i));
+        auto lo = mul_div255_sse2(_mm_unpacklo_epi8(d, zero), alpha16);
+        auto hi = mul_div255_sse2(_mm_unpackhi_epi8(d, zero), alpha16);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+
+    scale_row_scalar(dst + i, count - i, alpha);
+}
+
+/*
+ * The AVX2 versions mirror the SSE2 ones eight pixels at a time.  The
+ * unpack and pack instructions both work within 128-bit lanes so the
+ * pixel order survives the round trip.
+ */
+TARGET_AVX2 inline __m256i mul_div255_avx2(__m256i x, __m256i a)
+{
+    auto t = _mm256_add_epi16(_mm256_mullo_epi16(x, a), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+TARGET_AVX2 inline __m256i over_avx2(__m256i src16, __m256i dst16)
+{
+    auto a   = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(src16, _MM_SHUFFLE(3, 3, 3, 3)),
+                                      _MM_SHUFFLE(3, 3, 3, 3));
+    auto inv = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+    return _mm256_add_epi16(src16, mul_div255_avx2(dst16, inv));
+}
+
+TARGET_AVX2 void fill_row_avx2(u32 *dst, i32 count, u32 color)
+{
+    auto zero  = _mm256_setzero_si256();
+    auto src16 = _mm256_unpacklo_epi8(_mm256_set1_epi32(i32(color)), zero);
+    i32  i     = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        auto d  = _mm256_loadu_si256((__m256i *)(dst + i));
+        auto lo = over_avx2(src16, _mm256_unpacklo_epi8(d, zero));
+        auto hi = over_avx2(src16, _mm256_unpackhi_epi8(d, zero));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    fill_row_sse2(dst + i, count - i, color);
+}
+
+TARGET_AVX2 void blit_row_avx2(u32 *dst, u32 const *src, i32 count, u32 alpha)
+{
+    auto zero    = _mm256_setzero_si256();
+    auto alpha16 = _mm256_set1_epi16(i16(alpha));
+    i32  i       = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        auto s    = _mm256_loadu_si256((__m256i *)(src + i));
+        auto d    = _mm256_loadu_si256((__m256i *)(dst + i));
+        auto s_lo = _mm256_unpacklo_epi8(s, zero);
+        auto s_hi = _mm256_unpackhi_epi8(s, zero);
+
+        if (alpha != 255) {
+            s_lo = mul_div255_avx2(s_lo, alpha16);
+            s_hi = mul_div255_avx2(s_hi, alpha16);
+        }
+
+        auto lo = over_avx2(s_lo, _mm256_unpacklo_epi8(d, zero));
+        auto hi = over_avx2(s_hi, _mm256_unpackhi_epi8(d, zero));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    blit_row_sse2(dst + i, src + i, count - i, alpha);
+}
+
+TARGET_AVX2 void scale_row_avx2(u32 *dst, i32 count, u32 alpha)
+{
+    auto zero    = _mm256_setzero_si256();
+    auto alpha16 = _mm256_set1_epi16(i16(alpha));
+    i32  i       = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        auto d  = _mm256_loadu_si256((__m256i *)(dst + i));
+        auto lo = mul_div255_avx2(_mm256_unpacklo_epi8(d, zero), alpha16);
+        auto hi = mul_div255_avx2(_mm256_unpackhi_epi8(d, zero), alpha16);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    scale_row_sse2(dst + i, count - i, alpha);
+}
+
+/**
+ * Check whether the CPU, and the OS's saving of YMM registers, allow
+ * AVX2 code to run.
+ */
+bool cpu_has_avx2()
+{
+    u32 regs[4] = {};
+
+#if defined(_MSC_VER)
+    __cpuid((int *)regs, 0);
+    if (regs[0] < 7)
+        return false;
+
+    __cpuid((int *)regs, 1);
+    bool hasXSave = (regs[2] & (1u << 27)) != 0;
+    bool hasAvx   = (regs[2] & (1u << 28)) != 0;
+    if (!hasXSave || !hasAvx || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+
+    __cpuidex((int *)regs, 7, 0);
+#else
+    if (__get_cpuid_max(0, nullptr) < 7)
+        return false;
+
+    __get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]);
+    bool hasXSave = (regs[2] & (1u << 27)) != 0;
+    bool hasAvx   = (regs[2] & (1u << 28)) != 0;
+    if (!hasXSave || !hasAvx)
+        return false;
+
+    u32 xcr0_lo, xcr0_hi;
+    __asm__ volatile ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 0x6) != 0x6)
+        return false;
+
+    __get_cpuid_count(7, 0, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+
+    return (regs[1] & (1u << 5)) != 0;
+}
+
+#endif // COMPOSITE_X86
+
+CompositeKernels const COMPOSITE_KERNELS[Composite_LevelCount] = {
+    { fill_row_scalar, blit_row_scalar, scale_row_scalar },
+#if defined(COMPOSITE_X86)
+    { fill_row_sse2,   blit_row_sse2,   scale_row_sse2   },
+    { fill_row_avx2,   blit_row_avx2,   scale_row_avx2   },
+#else
+    { fill_row_scalar, blit_row_scalar, scale_row_scalar },
+    { fill_row_scalar, blit_row_scalar, scale_row_scalar },
+#endif
+};
+
+/**
+ * @return The best compositing level the CPU running the program
+ * supports.
+ */
+CompositeLevel detect_composite_level()
+{
+#if defined(COMPOSITE_X86)
+    // SSE2 is part of every x86-64 CPU and anything shoki targets.
+    return cpu_has_avx2() ? Composite_AVX2 : Composite_SSE2;
+#else
+    return Composite_Scalar;
+#endif
+}
+
+static CompositeKernels const *KERNELS = nullptr;
+
+/**
+ * Force the kernels used by the compositing functions to a level, which
+ * must be supported by the CPU.  Without a call to this the best level
+ * is detected on first use.
+ */
+void set_composite_level(CompositeLevel level)
+{
+    KERNELS = &COMPOSITE_KERNELS[level];
+}
+
+inline CompositeKernels const *kernels()
+{
+    if (!KERNELS)
+        set_composite_level(detect_composite_level());
+
+    return KERNELS;
+}
+
+/*
+ * Clip a rectangle to a surface.
+ *
+ * @return False if nothing of the rectangle is left.
+ */
+inline bool clip_to_surface(Surface const *surface, i32 *x, i32 *y, i32 *wd, i32 *ht, i32 *skip_x, i32 *skip_y)
+{
+    *skip_x = *x < 0 ? -*x : 0;
+    *skip_y = *y < 0 ? -*y : 0;
+    *x     += *skip_x;
+    *y     += *skip_y;
+    *wd    -= *skip_x;
+    *ht    -= *skip_y;
+
+    if (*x + *wd > surface->width)
+        *wd = surface->width - *x;
+    if (*y + *ht > surface->height)
+        *ht = surface->height - *y;
+
+    return *wd > 0 && *ht > 0;
+}
+
+/**
+ * Composite a premultiplied color over an anti-aliased rounded
+ * rectangle of a surface.  Only the corner pixels need a coverage
+ * value; every other pixel of a row is part of a solid span that goes
+ * through the fill kernel.  The radius is cut down to half the shorter
+ * side, so a small rectangle becomes a pill or a circle.
+ */
+void fill_rounded_rect(Surface *surface, i32 x, i32 y, i32 wd, i32 ht, f32 radius, u32 color)
+{
+    auto fill = kernels()->fill;
+
+    if (radius > 0.5f*wd) radius = 0.5f*wd;
+    if (radius > 0.5f*ht) radius = 0.5f*ht;
+    if (radius < 0.0f)    radius = 0.0f;
+
+    // Pixels past the corner circle centres are covered whole, so only
+    // the columns and rows up to them are corners.
+    auto r = i32(ceilf(radius));
+    if (r * 2 > wd) r = wd / 2;
+    if (r * 2 > ht) r = ht / 2;
+
+    for (i32 row = 0; row < ht; ++row) {
+        auto py = y + row;
+        if (py < 0 || py >= surface->height)
+            continue;
+
+        auto *line = surface->pixels + size_t(py) * surface->stride;
+
+        // Distance from the pixel centre to the corner circle centres
+        // along y, which are radius in from the edges, or zero when the
+        // row is between them.
+        f32 dy = 0.0f;
+        if (row < r)
+            dy = radius - (f32(row) + 0.5f);
+        else if (row >= ht - r)
+            dy = (f32(row) + 0.5f) - (f32(ht) - radius);
+        if (dy < 0.0f)
+            dy = 0.0f;
+
+        auto corner = (row < r || row >= ht - r) ? r : 0;
+
+        for (i32 col = 0; col < corner; ++col) {
+            f32 dx       = radius - (f32(col) + 0.5f);
+            dx           = dx > 0.0f ? dx : 0.0f;
+            f32 coverage = radius + 0.5f - sqrtf(dx*dx + dy*dy);
+
+            if (coverage <= 0.0f)
+                continue;
+
+            auto alpha = coverage >= 1.0f ? 255u : u32(coverage * 255.0f + 0.5f);
+            auto pixel = scale_pixel(color, alpha);
+            auto left  = x + col;
+            auto right = x + wd - 1 - col;
+
+            if (left >= 0 && left < surface->width)
+                line[left] = over_pixel(pixel, line[left]);
+            if (right >= 0 && right < surface->width)
+                line[right] = over_pixel(pixel, line[right]);
+        }
+
+        auto span_x  = x + corner;
+        auto span_wd = wd - 2*corner;
+
+        if (span_x < 0) {
+            span_wd += span_x;
+            span_x   = 0;
+        }
+        if (span_x + span_wd > surface->width)
+            span_wd = surface->width - span_x;
+        if (span_wd > 0)
+            fill(line + span_x, span_wd, color);
+    }
+}
+
+/**
+ * Composite a rectangle of premultiplied source pixels over a surface
+ * with an extra global alpha applied to the source.
+ */
+void blit_over(Surface *surface, u32 const *src, i32 src_stride, i32 x, i32 y, i32 wd, i32 ht, u32 alpha)
+{
+    i32 skip_x, skip_y;
+
+    if (alpha == 0 || !clip_to_surface(surface, &x, &y, &wd, &ht, &skip_x, &skip_y))
+        return;
+
+    auto blit = kernels()->blit;
+    src += size_t(skip_y) * src_stride + skip_x;
+
+    for (i32 row = 0; row < ht; ++row) {
+        auto *line = surface->pixels + size_t(y + row) * surface->stride + x;
+        blit(line, src + size_t(row) * src_stride, wd, alpha);
+    }
+}
+
+/**
+ * Set a rectangle of a surface to transparent black.
+ */
+void clear_rect(Surface *surface, i32 x, i32 y, i32 wd, i32 ht)
+{
+    i32 skip_x, skip_y;
+
+    if (!clip_to_surface(surface, &x, &y, &wd, &ht, &skip_x, &skip_y))
+        return;
+
+    for (i32 row = 0; row < ht; ++row)
+        memset(surface->pixels + size_t(y + row) * surface->stride + x, 0, size_t(wd) * sizeof(u32));
+}
+
+/**
+ * Multiply every channel of every pixel of a surface by an alpha.
+ */
+void scale_alpha(Surface *surface, u32 alpha)
+{
+    auto scale = kernels()->scale;
+
+    for (i32 row = 0; row < surface->height; ++row)
+        scale(surface->pixels + size_t(row) * surface->stride, surface->width, alpha);
+}
@@ -0,0 +1,440 @@
+
+/*
+ * Settings read from a config file of "name = value" lines, with blank
+ * lines and lines starting with # ignored:
+ *
+ *     font          = Consolas
+ *     font-size     = 40          pixels at 96 DPI
+ *     modifier-size = 8           a fifth of font-size, at least 4, unless given
+ *     text-color    = #FFFFFF     #RRGGBB or #AARRGGBB
+ *     box-color     = #000000
+ *     hold          = 300         milliseconds at full opacity
+ *     fade-out      = 400         milliseconds to fade away
+ *     fade-curve    = linear      linear, ease-in, ease-out, smooth-step
+ *     combos        = 4
+ *     offset-x      = 20
+ *     offset-y      = 15
+ *     justify       = center      left, right or center
+ *     mouse         = off         on shows clicks and scrolling too
+ *     renderer      = software    or gdiplus to draw the strip with GDI+
+ *     toggle        = C-M-S-F6    keys that switch display mode
+ *     stats         = C-M-S-F7    keys that write out typing statistics
+ *     chord         = C-x C-f find-file
+ *
+ * Keys are written as parse_chord_keys reads them.  Every chord line
+ * adds a binding that shows its keys as the label after them, which is
+ * printable ASCII without spaces.
+ *
+ * A file is parsed on top of a base config, so anything it leaves out
+ * keeps the base's value and its chords are added to the base's.  A
+ * config is never changed once it's been handed out; a new one is
+ * parsed and published in its place.
+ */
+
+constexpr u32 CONFIG_FONT_LENGTH = 32;  // LF_FACESIZE
+constexpr u32 MAX_CONFIG_CHORDS  = MAX_CHORD_LABELS;
+constexpr f32 MIN_MODIFIER_SIZE  = 4.0f;  // pixels at 96 DPI
+
+enum StripBackend {
+    StripBackend_Software,
+    StripBackend_Gdiplus
+};
+
+struct Config {
+    wchar_t                fontFamily[CONFIG_FONT_LENGTH];
+    f32                    letterSize;    // pixels at 96 DPI
+    f32                    modifierSize;
+    u32                    textColor;     // straight ARGB
+    u32                    boxColor;
+    FadeConfig             fade;
+    u32                    maxCombos;
+    i32                    offset_x;
+    i32                    offset_y;
+    PlacementJustification justification;
+    bool                   showMouse;
+    StripBackend           renderer;
+    ChordBinding           toggle;
+    ChordBinding           stats;
+    ChordBinding           chords[MAX_CONFIG_CHORDS];
+    u32                    chordCount;
+};
+
+struct ConfigError {
+    u32  line;
+    char message[96];
+};
+
+Config default_config()
+{
+    auto config = Config{};
+
+    wcscpy(config.fontFamily, L"Consolas");
+    config.letterSize    = 40.0f;
+    config.modifierSize  = 8.0f;
+    config.textColor     = 0xFFFFFFFF;
+    config.boxColor      = 0xFF000000;
+    config.fade          = FadeConfig{ 300, 400, FadeCurve_Linear };
+    config.maxCombos     = 4;
+    config.offset_x      = 20;
+    config.offset_y      = 15;
+    config.justification = Justification_Center;
+    config.showMouse     = false;
+    config.renderer      = StripBackend_Software;
+
+    config.toggle.steps[0]  = u16(chord_symbol(KEY_F6, true, true, true));
+    config.toggle.stepCount = 1;
+    config.toggle.action    = ChordAction_ToggleDisplay;
+
+    config.stats.steps[0]  = u16(chord_symbol(KEY_F7, true, true, true));
+    config.stats.stepCount = 1;
+    config.stats.action    = ChordAction_WriteStats;
+
+    return config;
+}
+
+/**
+ * @return The modifier size that goes with a font size when it isn't
+ * given, a fifth of it but no smaller than modifier-size can be set.
+ */
+inline f32 default_modifier_size(f32 letterSize)
+{
+    auto size = letterSize / 5.0f;
+    return size > MIN_MODIFIER_SIZE ? size : MIN_MODIFIER_SIZE;
+}
+
+inline bool is_same_chord(ChordBinding const &a, ChordBinding const &b)
+{
+    return (a.stepCount == b.stepCount &&
+            a.action == b.action &&
+            memcmp(a.steps, b.steps, a.stepCount * sizeof(a.steps[0])) == 0 &&
+            wcscmp(a.label, b.label) == 0);
+}
+
+/**
+ * @return Whether two configs bind the same chords.
+ */
+bool is_same_chords(Config const &a, Config const &b)
+{
+    if (a.chordCount != b.chordCount || !is_same_chord(a.toggle, b.toggle) || !is_same_chord(a.stats, b.stats))
+        return false;
+
+    for (u32 idx = 0; idx < a.chordCount; ++idx) {
+        if (!is_same_chord(a.chords[idx], b.chords[idx]))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Compile every chord of a config, with the hotkeys last so no chord
+ * can take their keys.
+ */
+bool compile_config_chords(Config const &config, ChordTable *table)
+{
+    ChordBinding bindings[MAX_CONFIG_CHORDS + 2];
+
+    memcpy(bindings, config.chords, config.chordCount * sizeof(bindings[0]));
+    bindings[config.chordCount]     = config.stats;
+    bindings[config.chordCount + 1] = config.toggle;
+
+    return compile_chords(bindings, config.chordCount + 2, table);
+}
+
+/**
+ * Decode UTF-8 into wide characters with a terminator, as UTF-16 where
+ * wchar_t is 16 bits.
+ *
+ * @return The wide characters written, not counting the terminator, or
+ * -1 if the text isn't valid UTF-8 or doesn't fit.
+ */
+i32 decode_utf8(wchar_t *out, u32 capacity, char const *text, u32 length)
+{
+#if defined(_WIN32)
+    auto count = 0;
+
+    if (length > 0) {
+        count = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, text, int(length), out, int(capacity - 1));
+        if (count == 0)
+            return -1;
+    }
+
+    out[count] = 0;
+    return count;
+#else
+    u32 count = 0;
+
+    for (u32 idx = 0; idx < length; ) {
+        auto lead = u8(text[idx]);
+        u32  codepoint;
+        u32  extra;
+
+        if (lead < 0x80)                  { codepoint = lead;        extra = 0; }
+        else if ((lead & 0xE0) == 0xC0)   { codepoint = lead & 0x1F; extra = 1; }
+        else if ((lead & 0xF0) == 0xE0)   { codepoint = lead & 0x0F; extra = 2; }
+        else if ((lead & 0xF8) == 0xF0)   { codepoint = lead & 0x07; extra = 3; }
+        else                              return -1;
+
+        if (idx + extra >= length)
+            return -1;
+
+        for (u32 next = 1; next <= extra; ++next) {
+            auto byte = u8(text[idx + next]);
+            if ((byte & 0xC0) != 0x80)
+                return -1;
+            codepoint = (codepoint << 6) | (byte & 0x3F);
+        }
+
+        // Overlong forms, surrogates and anything past Unicode.
+        static u32 const SMALLEST[] = { 0, 0x80, 0x800, 0x10000 };
+        if (codepoint < SMALLEST[extra] || (codepoint >= 0xD800 && codepoint < 0xE000) || codepoint > 0x10FFFF)
+            return -1;
+
+        idx += extra + 1;
+
+        if (sizeof(wchar_t) == 2 && codepoint >= 0x10000) {
+            if (count + 2 >= capacity)
+                return -1;
+
+            out[count++] = wchar_t(0xD800 + ((codepoint - 0x10000) >> 10));
+            out[count++] = wchar_t(0xDC00 + ((codepoint - 0x10000) & 0x3FF));
+        }
+        else {
+            if (count + 1 >= capacity)
+                return -1;
+
+            out[count++] = wchar_t(codepoint);
+        }
+    }
+
+    out[count] = 0;
+    return i32(count);
+#endif
+}
+
+/**
+ * Parse a config file on top of whatever config already holds.  Parsing
+ * stops at the first line that can't be used.
+ *
+ * @return False with the line and what's wrong with it in error.
+ */
+bool parse_config(char const *text, size_t length, Config *config, ConfigError *error)
+{
+    auto parsed           = *config;
+    auto hasModifierSize  = false;
+    auto hasFontSize      = false;
+    u32  line             = 0;
+    auto at               = text;
+    auto end              = text + length;
+
+    auto fail = [&](char const *message) {
+        error->line = line;
+        snprintf(error->message, sizeof(error->message), "%s", message);
+        return false;
+    };
+
+    auto is_space = [](char ch) { return ch == ' ' || ch == '\t' || ch == '\r'; };
+
+    while (at < end) {
+        ++line;
+
+        auto lineEnd = at;
+        while (lineEnd < end && *lineEnd != '\n')
+            ++lineEnd;
+
+        auto first = at;
+        auto last  = lineEnd;
+        at = lineEnd + 1;
+
+        while (first < last && is_space(*first))
+            ++first;
+        while (last > first && is_space(last[-1]))
+            --last;
+        if (first == last || *first == '#')
+            continue;
+
+        auto equals = first;
+        while (equals < last && *equals != '=')
+            ++equals;
+        if (equals == last)
+            return fail("expected name = value");
+
+        auto nameEnd = equals;
+        while (nameEnd > first && is_space(nameEnd[-1]))
+            --nameEnd;
+
+        auto valueStart = equals + 1;
+        while (valueStart < last && is_space(*valueStart))
+            ++valueStart;
+
+        char name[32];
+        char value[128];  // a font name can take 3 bytes a character
+        auto nameLength  = size_t(nameEnd - first);
+        auto valueLength = size_t(last - valueStart);
+
+        if (nameLength >= sizeof(name) || valueLength >= sizeof(value))
+            return fail("line is too long");
+
+        memcpy(name, first, nameLength);
+        memcpy(value, valueStart, valueLength);
+        name[nameLength]   = 0;
+        value[valueLength] = 0;
+
+        auto is = [&](char const *option) { return strcmp(name, option) == 0; };
+
+        auto number = [&](i32 min, i32 max, i32 *out) {
+            char *rest;
+            auto  parsedNumber = strtol(value, &rest, 10);
+
+            if (rest == value || *rest || parsedNumber < min || parsedNumber > max)
+                return false;
+
+            *out = i32(parsedNumber);
+            return true;
+        };
+
+        auto color = [&](u32 *out) {
+            char *rest;
+            auto  digits = strlen(value) - 1;
+            auto  parsedColor = value[0] == '#' ? strtoul(value + 1, &rest, 16) : 0;
+
+            if (value[0] != '#' || *rest || (digits != 6 && digits != 8))
+                return false;
+
+            *out = digits == 6 ? u32(parsedColor) | 0xFF000000 : u32(parsedColor);
+            return true;
+        };
+
+        i32 n;
+
+        if (is("font")) {
+            wchar_t family[CONFIG_FONT_LENGTH];
+            auto    familyLength = decode_utf8(family, CONFIG_FONT_LENGTH, value, u32(valueLength));
+
+            if (familyLength <= 0)
+                return fail("font has to be a family name in UTF-8 shorter than 32 characters");
+
+            memcpy(parsed.fontFamily, family, sizeof(family));
+        }
+        else if (is("font-size")) {
+            if (!number(8, 200, &n))
+                return fail("font-size has to be from 8 to 200");
+
+            parsed.letterSize = f32(n);
+            hasFontSize = true;
+        }
+        else if (is("modifier-size")) {
+            if (!number(4, 100, &n))
+                return fail("modifier-size has to be from 4 to 100");
+
+            parsed.modifierSize = f32(n);
+            hasModifierSize = true;
+        }
+        else if (is("text-color")) {
+            if (!color(&parsed.textColor))
+                return fail("text-color has to be #RRGGBB or #AARRGGBB");
+        }
+        else if (is("box-color")) {
+            if (!color(&parsed.boxColor))
+                return fail("box-color has to be #RRGGBB or #AARRGGBB");
+        }
+        else if (is("hold")) {
+            if (!number(0, 60000, &n))
+                return fail("hold has to be from 0 to 60000 milliseconds");
+
+            parsed.fade.holdMilliseconds = u32(n);
+        }
+        else if (is("fade-out")) {
+            if (!number(1, 60000, &n))
+                return fail("fade-out has to be from 1 to 60000 milliseconds");
+
+            parsed.fade.fadeOutMilliseconds = u32(n);
+        }
+        else if (is("fade-curve")) {
+            if (strcmp(value, "linear") == 0)           parsed.fade.curve = FadeCurve_Linear;
+            else if (strcmp(value, "ease-in") == 0)     parsed.fade.curve = FadeCurve_EaseIn;
+            else if (strcmp(value, "ease-out") == 0)    parsed.fade.curve = FadeCurve_EaseOut;
+            else if (strcmp(value, "smooth-step") == 0) parsed.fade.curve = FadeCurve_SmoothStep;
+            else return fail("fade-curve has to be linear, ease-in, ease-out or smooth-step");
+        }
+        else if (is("combos")) {
+            if (!number(1, i32(MAX_KEY_COMBOS), &n))
+                return fail("combos has to be from 1 to 64");
+
+            parsed.maxCombos = u32(n);
+        }
+        else if (is("offset-x") || is("offset-y")) {
+            if (!number(-10000, 10000, &n))
+                return fail("offsets have to be from -10000 to 10000");
+
+            (is("offset-x") ? parsed.offset_x : parsed.offset_y) = n;
+        }
+        else if (is("justify")) {
+            if (strcmp(value, "left") == 0)        parsed.justification = Justification_Left;
+            else if (strcmp(value, "right") == 0)  parsed.justification = Justification_Right;
+            else if (strcmp(value, "center") == 0) parsed.justification = Justification_Center;
+            else return fail("justify has to be left, right or center");
+        }
+        else if (is("mouse")) {
+            if (strcmp(value, "on") == 0)       parsed.showMouse = true;
+            else if (strcmp(value, "off") == 0) parsed.showMouse = false;
+            else return fail("mouse has to be on or off");
+        }
+        else if (is("renderer")) {
+            if (strcmp(value, "software") == 0)     parsed.renderer = StripBackend_Software;
+            else if (strcmp(value, "gdiplus") == 0) parsed.renderer = StripBackend_Gdiplus;
+            else return fail("renderer has to be software or gdiplus");
+        }
+        else if (is("toggle")) {
+            auto toggle = ChordBinding{};
+            toggle.action = ChordAction_ToggleDisplay;
+
+            if (!parse_chord_keys(value, &toggle))
+                return fail("toggle has to be up to 8 keys such as C-M-S-F6");
+
+            parsed.toggle = toggle;
+        }
+        else if (is("stats")) {
+            auto stats = ChordBinding{};
+            stats.action = ChordAction_WriteStats;
+
+            if (!parse_chord_keys(value, &stats))
+                return fail("stats has to be up to 8 keys such as C-M-S-F7");
+
+            parsed.stats = stats;
+        }
+        else if (is("chord")) {
+            auto chord     = ChordBinding{};
+            auto separator = strrchr(value, ' ');
+            auto label     = separator ? separator + 1 : value;
+            auto length    = strlen(label);
+
+            if (!separator || length == 0 || length >= CHORD_LABEL_LENGTH)
+                return fail("chord has to be keys and a label shorter than 24 characters");
+
+            for (u32 idx = 0; idx < length; ++idx) {
+                if (label[idx] <= ' ' || label[idx] > '~')
+                    return fail("chord labels have to be printable ASCII");
+                chord.label[idx] = wchar_t(label[idx]);
+            }
+
+            *separator = 0;
+            if (!parse_chord_keys(value, &chord))
+                return fail("chord keys have to be up to 8 keys such as C-x C-f");
+
+            if (parsed.chordCount == MAX_CONFIG_CHORDS)
+                return fail("there can't be more than 64 chords");
+
+            parsed.chords[parsed.chordCount++] = chord;
+        }
+        else {
+            return fail("unknown setting");
+        }
+    }
+
+    if (hasFontSize && !hasModifierSize)
+        parsed.modifierSize = default_modifier_size(parsed.letterSize);
+
+    *config = parsed;
+    return true;
+}
@@ -0,0 +1,370 @@
+
+/*
+ * Keyboard input on Linux, read straight from evdev devices the way the
+ * low level hook reads it on Windows.  Every keyboard is a source on one
+ * epoll set and ready sources are drained with as few reads as possible,
+ * each one pulling in as many events as fit in the caller's batch.  Key
+ * codes are translated to the virtual keys the rest of shoki uses, so
+ * what comes out is the same KeyEvent stream the hook produces.
+ *
+ * A source can also be a file or pipe of recorded input_event structs,
+ * such as the output of evtest --grab or a capture of a device, which
+ * needs no devices or root.  Regular files can't be waited on with
+ * epoll so they are read whenever events are asked for until they run
+ * out.
+ *
+ * linux/input.h isn't included because its KEY_* macros collide with
+ * the virtual key names in key_info.cpp, so the parts of it used here
+ * are spelled out.
+ */
+
+// struct input_event on the same ABI.
+struct EvdevEvent {
+    timeval time;
+    u16     type;
+    u16     code;
+    i32     value;  // 0 released, 1 pressed, 2 auto-repeat
+};
+
+constexpr u16 EVDEV_EV_KEY = 0x01;
+
+constexpr u32 EVDEV_KEY_COUNT   = 256;  // key codes past this aren't keyboard keys
+constexpr u32 EVDEV_BATCH       = 64;   // events read at a time
+constexpr u32 MAX_EVDEV_SOURCES = 32;
+
+#define EVDEV_IOC_GET_KEY_BITS(size) _IOC(_IOC_READ, 'E', 0x20 + EVDEV_EV_KEY, size)
+#define EVDEV_IOC_GET_NAME(size)     _IOC(_IOC_READ, 'E', 0x06, size)
+#define EVDEV_IOC_SET_CLOCK          _IOW('E', 0xA0, int)
+
+struct EvdevKeymap {
+    u8 vk[EVDEV_KEY_COUNT];
+};
+
+constexpr void set_evdev_keys(EvdevKeymap &keymap, u32 firstCode, char const *vks, u32 count)
+{
+    for (u32 idx = 0; idx < count; ++idx)
+        keymap.vk[firstCode + idx] = u8(vks[idx]);
+}
+
+/*
+ * Evdev codes follow the positions of keys on a U.S. keyboard, which is
+ * what the virtual keys of key_info.cpp name as well.
+ */
+constexpr EvdevKeymap make_evdev_keymap()
+{
+    EvdevKeymap keymap = {};
+
+    keymap.vk[1]  = 0x1B;  // ESC
+    set_evdev_keys(keymap, 2, "1234567890", 10);
+    keymap.vk[12] = 0xBD;  // MINUS
+    keymap.vk[13] = 0xBB;  // EQUAL
+    keymap.vk[14] = 0x08;  // BACKSPACE
+    keymap.vk[15] = 0x09;  // TAB
+    set_evdev_keys(keymap, 16, "QWERTYUIOP", 10);
+    keymap.vk[26] = 0xDB;  // LEFTBRACE
+    keymap.vk[27] = 0xDD;  // RIGHTBRACE
+    keymap.vk[28] = 0x0D;  // ENTER
+    keymap.vk[29] = u8(KEY_LCONTROL);
+    set_evdev_keys(keymap, 30, "ASDFGHJKL", 9);
+    keymap.vk[39] = 0xBA;  // SEMICOLON
+    keymap.vk[40] = 0xDE;  // APOSTROPHE
+    keymap.vk[41] = 0xC0;  // GRAVE
+    keymap.vk[42] = u8(KEY_LSHIFT);
+    keymap.vk[43] = 0xDC;  // BACKSLASH
+    set_evdev_keys(keymap, 44, "ZXCVBNM", 7);
+    keymap.vk[51] = 0xBC;  // COMMA
+    keymap.vk[52] = 0xBE;  // DOT
+    keymap.vk[53] = 0xBF;  // SLASH
+    keymap.vk[54] = u8(KEY_RSHIFT);
+    keymap.vk[55] = 0x6A;  // KPASTERISK
+    keymap.vk[56] = u8(KEY_LMENU);
+    keymap.vk[57] = 0x20;  // SPACE
+    keymap.vk[58] = 0x14;  // CAPSLOCK
+
+    for (u32 idx = 0; idx < 10; ++idx)
+        keymap.vk[59 + idx] = u8(0x70 + idx);  // F1 to F10
+
+    keymap.vk[69] = 0x90;  // NUMLOCK
+    keymap.vk[70] = 0x91;  // SCROLLLOCK
+
+    // Keypad 7 8 9 - 4 5 6 + 1 2 3 0 .
+    constexpr u8 KEYPAD[] = { 0x67, 0x68, 0x69, 0x6D, 0x64, 0x65, 0x66, 0x6B, 0x61, 0x62, 0x63, 0x60, 0x6E };
+    for (u32 idx = 0; idx < COUNT_OF(KEYPAD); ++idx)
+        keymap.vk[71 + idx] = KEYPAD[idx];
+
+    keymap.vk[86]  = 0xE2;  // 102ND
+    keymap.vk[87]  = 0x7A;  // F11
+    keymap.vk[88]  = 0x7B;  // F12
+    keymap.vk[96]  = 0x0D;  // KPENTER
+    keymap.vk[97]  = u8(KEY_RCONTROL);
+    keymap.vk[98]  = 0x6F;  // KPSLASH
+    keymap.vk[99]  = 0x2C;  // SYSRQ
+    keymap.vk[100] = u8(KEY_RMENU);
+    keymap.vk[102] = 0x24;  // HOME
+    keymap.vk[103] = 0x26;  // UP
+    keymap.vk[104] = 0x21;  // PAGEUP
+    keymap.vk[105] = 0x25;  // LEFT
+    keymap.vk[106] = 0x27;  // RIGHT
+    keymap.vk[107] = 0x23;  // END
+    keymap.vk[108] = 0x28;  // DOWN
+    keymap.vk[109] = 0x22;  // PAGEDOWN
+    keymap.vk[110] = 0x2D;  // INSERT
+    keymap.vk[111] = 0x2E;  // DELETE
+    keymap.vk[119] = 0x13;  // PAUSE
+    keymap.vk[125] = 0x5B;  // LEFTMETA
+    keymap.vk[126] = 0x5C;  // RIGHTMETA
+    keymap.vk[127] = 0x5D;  // COMPOSE
+
+    return keymap;
+}
+
+constexpr EvdevKeymap EVDEV_KEYMAP = make_evdev_keymap();
+
+/**
+ * Translate an evdev event into a key event.
+ *
+ * @return False if the event isn't a key shoki knows about.
+ */
+inline bool evdev_key_event(EvdevEvent const &in, u32 stamp, KeyEvent *out)
+{
+    if (in.type != EVDEV_EV_KEY || in.code >= EVDEV_KEY_COUNT)
+        return false;
+
+    auto vk = EVDEV_KEYMAP.vk[in.code];
+    if (vk == 0)
+        return false;
+
+    // Auto-repeat is another key down, as the hook sees it.
+    out->vk_key = vk;
+    out->flags  = in.value == 0 ? KEY_FLAG_UP : 0;
+    out->time   = u32(u64(in.time.tv_sec) * 1000 + u64(in.time.tv_usec) / 1000);
+    out->stamp  = stamp;
+
+    return true;
+}
+
+struct EvdevSource {
+    int  fd;
+    bool isOpen;
+    bool isPolled;  // on the epoll set, which regular files can't be
+    u32  pendingBytes;
+    u8   pending[sizeof(EvdevEvent)];  // an event split across reads of a pipe
+};
+
+struct EvdevInput {
+    int         epoll;
+    EvdevSource sources[MAX_EVDEV_SOURCES];
+    u32         sourceCount;
+    u32         openCount;  // sources that haven't ended
+
+    u32 reads;   // read calls that returned data
+    u32 events;  // events read, key or not
+};
+
+bool open_evdev_input(EvdevInput *input)
+{
+    *input = EvdevInput{};
+
+    input->epoll = epoll_create1(EPOLL_CLOEXEC);
+    return input->epoll >= 0;
+}
+
+void close_evdev_source(EvdevInput *input, EvdevSource *source)
+{
+    if (!source->isOpen)
+        return;
+
+    if (source->isPolled)
+        epoll_ctl(input->epoll, EPOLL_CTL_DEL, source->fd, nullptr);
+    close(source->fd);
+
+    source->isOpen = false;
+    --input->openCount;
+}
+
+void close_evdev_input(EvdevInput *input)
+{
+    for (u32 idx = 0; idx < input->sourceCount; ++idx)
+        close_evdev_source(input, &input->sources[idx]);
+
+    if (input->epoll >= 0)
+        close(input->epoll);
+
+    *input = EvdevInput{};
+}
+
+/**
+ * Read events from an open file descriptor, which is closed along with
+ * the input.
+ */
+bool add_evdev_source(EvdevInput *input, int fd)
+{
+    if (input->sourceCount == MAX_EVDEV_SOURCES) {
+        close(fd);
+        return false;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    auto index  = input->sourceCount;
+    auto source = &input->sources[index];
+    auto ready  = epoll_event{};
+
+    ready.events   = EPOLLIN;
+    ready.data.u32 = index;
+
+    *source = EvdevSource{};
+    source->fd       = fd;
+    source->isOpen   = true;
+    source->isPolled = epoll_ctl(input->epoll, EPOLL_CTL_ADD, fd, &ready) == 0;
+
+    // Anything else that can't be polled is an error.
+    if (!source->isPolled && errno != EPERM) {
+        close(fd);
+        return false;
+    }
+
+    ++input->sourceCount;
+    ++input->openCount;
+    return true;
+}
+
+/**
+ * Add a device if it is a keyboard, which here means it has letter keys
+ * and a space bar.  Event times are switched to the monotonic clock.
+ */
+bool add_evdev_device(EvdevInput *input, char const *path)
+{
+    auto fd = open(path, O_RDONLY|O_NONBLOCK|O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    u8 keys[EVDEV_KEY_COUNT / 8] = {};
+    auto has_key = [&](u32 code) { return (keys[code / 8] >> (code % 8)) & 1; };
+
+    if (ioctl(fd, EVDEV_IOC_GET_KEY_BITS(sizeof(keys)), keys) < 0 ||
+        !has_key(16) || !has_key(30) || !has_key(44) || !has_key(57)) {
+        close(fd);
+        return false;
+    }
+
+    int clock = CLOCK_MONOTONIC;
+    ioctl(fd, EVDEV_IOC_SET_CLOCK, &clock);
+
+#if defined(DEBUG)
+    char name[128] = {};
+    ioctl(fd, EVDEV_IOC_GET_NAME(sizeof(name) - 1), name);
+    printf("keyboard %s: %s\n", path, name);
+#endif
+
+    return add_evdev_source(input, fd);
+}
+
+/**
+ * Add every keyboard in /dev/input, which needs read access to the
+ * devices, usually through the input group.
+ *
+ * @return The number of keyboards added.
+ */
+u32 add_evdev_keyboards(EvdevInput *input)
+{
+    u32  count = 0;
+    char path[64];
+
+    for (u32 idx = 0; idx < 64; ++idx) {
+        snprintf(path, sizeof(path), "/dev/input/event%u", idx);
+        if (add_evdev_device(input, path))
+            ++count;
+    }
+
+    return count;
+}
+
+/*
+ * Drain a source into out.  Reads never ask for more events than there
+ * is room left for, and stop at a short read since that means the
+ * device's queue is empty, which saves the read that would only fail.
+ */
+u32 read_evdev_source(EvdevInput *input, EvdevSource *source, u32 stamp, KeyEvent *out, u32 capacity)
+{
+    u8  buffer[EVDEV_BATCH * sizeof(EvdevEvent)];
+    u32 count = 0;
+
+    while (source->isOpen && count < capacity) {
+        auto room = (capacity - count < EVDEV_BATCH ? capacity - count : EVDEV_BATCH) * u32(sizeof(EvdevEvent));
+        auto want = room - source->pendingBytes;
+
+        memcpy(buffer, source->pending, source->pendingBytes);
+
+        auto got = read(source->fd, buffer + source->pendingBytes, want);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+
+        // The end of a file or pipe, or a device that was unplugged.
+        if (got <= 0) {
+            close_evdev_source(input, source);
+            break;
+        }
+
+        ++input->reads;
+
+        auto bytes  = source->pendingBytes + u32(got);
+        auto events = (EvdevEvent const *)buffer;
+        auto whole  = bytes / u32(sizeof(EvdevEvent));
+
+        for (u32 idx = 0; idx < whole; ++idx) {
+            if (evdev_key_event(events[idx], stamp, &out[count]))
+                ++count;
+        }
+
+        input->events       += whole;
+        source->pendingBytes = bytes % u32(sizeof(EvdevEvent));
+        memcpy(source->pending, buffer + whole * sizeof(EvdevEvent), source->pendingBytes);
+
+        if (u32(got) < want)
+            break;
+    }
+
+    return count;
+}
+
+/**
+ * Wait up to timeout milliseconds, or forever if it is negative, for
+ * key events and read as many as are ready into batch.  Events left
+ * over once the batch is full are read by the next call.
+ *
+ * @param stamp Stamp given to every event read, in microseconds.
+ *
+ * @return The number of events read, which is zero on a timeout or
+ * once every source has ended.
+ */
+u32 read_evdev_events(EvdevInput *input, i32 timeout, u32 stamp, KeyEvent *batch, u32 capacity)
+{
+    u32 count = 0;
+
+    for (u32 idx = 0; idx < input->sourceCount; ++idx) {
+        auto source = &input->sources[idx];
+
+        // Files are always ready, so there is no waiting while one is open.
+        if (source->isOpen && !source->isPolled) {
+            count  += read_evdev_source(input, source, stamp, batch + count, capacity - count);
+            timeout = 0;
+        }
+    }
+
+    if (input->openCount == 0 || count == capacity)
+        return count;
+
+    epoll_event ready[MAX_EVDEV_SOURCES];
+
+    auto readyCount = epoll_wait(input->epoll, ready, MAX_EVDEV_SOURCES, count > 0 ? 0 : timeout);
+
+    for (i32 idx = 0; idx < readyCount && count < capacity; ++idx) {
+        auto source = &input->sources[ready[idx].data.u32];
+        count += read_evdev_source(input, source, stamp, batch + count, capacity - count);
+    }
+
+    return count;
+}
@@ -0,0 +1,72 @@
+
+enum FadeCurve {
+    FadeCurve_Linear,
+    FadeCurve_EaseIn,     // starts fading slowly
+    FadeCurve_EaseOut,    // starts fading quickly
+    FadeCurve_SmoothStep
+};
+
+struct FadeConfig {
+    u32       holdMilliseconds;     // time at full opacity after a key press
+    u32       fadeOutMilliseconds;  // time to go from full opacity to invisible
+    FadeCurve curve;
+};
+
+constexpr u32 FADE_TABLE_STEPS = 256;
+
+/*
+ * The fade curve sampled at evenly spaced points from fully opaque at
+ * the first entry to invisible at the last, so the curve is evaluated
+ * once when the config changes instead of on every frame.
+ */
+struct FadeTable {
+    FadeConfig config;
+    u8         alpha[FADE_TABLE_STEPS + 1];
+};
+
+void build_fade_table(FadeTable *table, FadeConfig const &config)
+{
+    table->config = config;
+
+    for (u32 step = 0; step <= FADE_TABLE_STEPS; ++step) {
+        f32 t       = f32(step) / f32(FADE_TABLE_STEPS);
+        f32 opacity = 1.0f - t;
+
+        switch (config.curve) {
+        case FadeCurve_Linear:
+            break;
+        case FadeCurve_EaseIn:
+            opacity = 1.0f - t*t;
+            break;
+        case FadeCurve_EaseOut:
+            opacity = (1.0f - t) * (1.0f - t);
+            break;
+        case FadeCurve_SmoothStep:
+            opacity = 1.0f - t*t*(3.0f - 2.0f*t);
+            break;
+        }
+
+        table->alpha[step] = u8(opacity * 255.0f + 0.5f);
+    }
+}
+
+/**
+ * Look up the opacity of the key press box a number of milliseconds
+ * after the last key press.
+ *
+ * @return The alpha to present the box with, zero once fully faded.
+ */
+u8 fade_alpha(FadeTable const &table, u32 elapsed)
+{
+    auto &config = table.config;
+
+    if (elapsed < config.holdMilliseconds)
+        return 255;
+
+    elapsed -= config.holdMilliseconds;
+    if (elapsed >= config.fadeOutMilliseconds)
+        return 0;
+
+    auto step = u64(elapsed) * FADE_TABLE_STEPS / config.fadeOutMilliseconds;
+    return table.alpha[step];
+}
@@ -0,0 +1,88 @@
+
+/*
+ * Monotonic time for the frame scheduler.  The platform layer provides
+ * a real clock and anything replaying input can drive a fake one.
+ */
+struct Clock {
+    virtual u64 now_microseconds() = 0;
+};
+
+constexpr u64 NO_FRAME_DUE = ~u64(0);
+
+/*
+ * Decides when frames are drawn.  Any number of requests between two
+ * display refreshes turn into a single frame, frames never come closer
+ * together than one refresh interval, and once nothing has changed and
+ * nothing is animating there is no frame due at all, so the caller can
+ * sleep until the next input arrives.
+ *
+ * The caller's loop asks how long it may sleep, sleeps, and then calls
+ * begin_frame after every wake up to find out whether to draw.
+ */
+struct FrameScheduler {
+    Clock *clock;
+    u64    frameInterval;  // microseconds between display refreshes
+    u64    lastFrameTime;
+    bool   hasFramed;
+    bool   isFrameRequested;
+    bool   isAnimating;
+
+    u32 wakeups;  // calls to begin_frame
+    u32 frames;   // calls to begin_frame that drew a frame
+
+    // Something changed that needs to be drawn once.
+    void request_frame() { isFrameRequested = true; }
+
+    // Draw every refresh for as long as an animation runs.
+    void set_animating(bool animating) { isAnimating = animating; }
+
+    bool is_idle() { return !isFrameRequested && !isAnimating; }
+
+    /**
+     * @return When the next frame is due, or NO_FRAME_DUE if nothing
+     * needs to be drawn.
+     */
+    u64 next_frame_time() {
+        if (is_idle())
+            return NO_FRAME_DUE;
+
+        return hasFramed ? lastFrameTime + frameInterval : 0;
+    }
+
+    /**
+     * @return How long the caller can sleep before the next frame is
+     * due, or NO_FRAME_DUE if it can sleep until something happens.
+     */
+    u64 wait_microseconds() {
+        auto due = next_frame_time();
+        if (due == NO_FRAME_DUE)
+            return NO_FRAME_DUE;
+
+        auto now = clock->now_microseconds();
+        return due > now ? due - now : 0;
+    }
+
+    /**
+     * @return True if a frame is due and the caller has to draw it now.
+     */
+    bool begin_frame() {
+        ++wakeups;
+
+        auto due = next_frame_time();
+        if (due == NO_FRAME_DUE)
+            return false;
+
+        auto now = clock->now_microseconds();
+        if (now < due)
+            return false;
+
+        // Stay on the refresh grid unless a whole frame was missed, in
+        // which case the grid restarts from now.
+        lastFrameTime    = (hasFramed && now - due < frameInterval) ? due : now;
+        hasFramed        = true;
+        isFrameRequested = false;
+        ++frames;
+
+        return true;
+    }
+};
@@ -0,0 +1,130 @@
+
+/*
+ * Location of a pre-rasterized label within the atlas pixels.  An
+ * empty sprite has a width and height of zero.
+ */
+struct Sprite {
+    u16 x;
+    u16 y;
+    u16 width;
+    u16 height;
+};
+
+/*
+ * Premultiplied ARGB sprites of every label that get_key_info can
+ * return, of every chord label and of every modifier stack that can
+ * appear beside a key.
+ * Rasterizing text is the most expensive part of drawing a frame, and
+ * the set of labels is fixed, so the labels are drawn once into the
+ * atlas whenever the font changes and frames copy them from here.
+ */
+struct GlyphAtlas {
+    u32   *pixels;
+    i32    width;
+    i32    height;
+    Sprite keys[256][KeyLevel_Count];  // indexed by virtual key and level
+    Sprite chords[MAX_CHORD_LABELS];   // indexed by chord label less one
+    Sprite modifiers[8];  // indexed by Modifier_* bits, 0 is always empty
+};
+
+constexpr i32 GLYPH_ATLAS_WIDTH   = 1024;
+constexpr i32 GLYPH_ATLAS_PADDING = 1;
+
+void free_glyph_atlas(GlyphAtlas *atlas)
+{
+    free(atlas->pixels);
+    *atlas = GlyphAtlas{};
+}
+
+/**
+ * Pack a sprite for every measured label into rows of the atlas and
+ * allocate cleared pixels for it.  The sprites are left for the caller
+ * to rasterize since only the platform layer knows how to draw text.
+ *
+ * @return False if the atlas pixels could not be allocated.
+ */
+bool layout_glyph_atlas(GlyphAtlas *atlas, LabelMeasurements const &labels)
+{
+    free_glyph_atlas(atlas);
+
+    i32 x     = 0;
+    i32 y     = 0;
+    i32 row_h = 0;
+
+    auto place = [&](LabelSize size) {
+        auto wd = i32(ceilf(size.width));
+        auto ht = i32(ceilf(size.height));
+
+        if (wd <= 0 || ht <= 0)
+            return Sprite{};
+
+        if (x + wd > GLYPH_ATLAS_WIDTH) {
+            x     = 0;
+            y    += row_h + GLYPH_ATLAS_PADDING;
+            row_h = 0;
+        }
+
+        auto sprite = Sprite{ u16(x), u16(y), u16(wd), u16(ht) };
+
+        x    += wd + GLYPH_ATLAS_PADDING;
+        row_h = ht > row_h ? ht : row_h;
+
+        return sprite;
+    };
+
+    for (u32 vk = 0; vk < COUNT_OF(atlas->keys); ++vk) {
+        for (u32 level = 0; level < KeyLevel_Count; ++level)
+            atlas->keys[vk][level] = place(labels.keys[vk][level]);
+    }
+
+    for (u32 idx = 0; idx < COUNT_OF(atlas->chords); ++idx)
+        atlas->chords[idx] = place(labels.chords[idx]);
+
+    auto stack = LabelSize{ labels.modifier.width, 3.0f * labels.modifier.height };
+    for (u32 mods = 1; mods < COUNT_OF(atlas->modifiers); ++mods)
+        atlas->modifiers[mods] = place(stack);
+
+    atlas->width  = GLYPH_ATLAS_WIDTH;
+    atlas->height = y + row_h;
+    atlas->pixels = (u32 *)calloc(size_t(atlas->width) * atlas->height, sizeof(u32));
+
+    return atlas->pixels != nullptr;
+}
+
+/*
+ * Without a font system the labels are sized like the default 40px
+ * Consolas and the atlas is filled with partially covered pixels, which
+ * costs the same to composite as real glyphs.  Used by the headless
+ * tools.
+ */
+void make_placeholder_atlas(LabelMeasurements *labels, GlyphAtlas *atlas)
+{
+    constexpr f32 LETTER_WD = 22.0f;
+    constexpr f32 LETTER_HT = 47.0f;
+
+    *labels = LabelMeasurements{};
+
+    for (u32 vk = 0; vk < COUNT_OF(labels->keys); ++vk) {
+        for (u32 level = 0; level < KeyLevel_Count; ++level) {
+            auto length = wcslen(key_label(vk, KeyLevel(level)));
+            if (length > 0)
+                labels->keys[vk][level] = LabelSize{ length*LETTER_WD + 8.0f, LETTER_HT };
+        }
+    }
+
+    for (u32 idx = 0; idx < COUNT_OF(labels->chords); ++idx) {
+        auto length = wcslen(chord_label(idx + 1));
+        if (length > 0)
+            labels->chords[idx] = LabelSize{ length*LETTER_WD + 8.0f, LETTER_HT };
+    }
+
+    labels->modifier = LabelSize{ 26.0f, 9.5f };
+    layout_glyph_atlas(atlas, *labels);
+
+    for (i32 y = 0; y < atlas->height; ++y) {
+        for (i32 x = 0; x < atlas->width; ++x) {
+            u32 a = (x*7 + y*13) & 0xFF;
+            atlas->pixels[y*atlas->width + x] = (a << 24) | (a << 16) | (a << 8) | a;
+        }
+    }
+}
@@ -0,0 +1,206 @@
+
+/*
+ * Every combo shoki shows, broadcast to other processes on the same
+ * machine, so a caption tool or a streaming script can follow the keys
+ * without installing a keyboard hook of its own.  Every hook on the
+ * system is called for every key, so one hook feeding any number of
+ * readers keeps typing as responsive as shoki alone.
+ *
+ * The combos go into a SeqlockRing in named shared memory.  shoki is
+ * the only writer and never waits for a reader.  Readers map the block
+ * read only, copy combos straight out of it and poll for more at
+ * whatever rate suits them.  A reader that polls too seldom is lapped
+ * and told how many combos it missed.
+ *
+ * The layout is only made of 32-bit fields, so 32 and 64-bit readers
+ * see the same thing.  A reader has to check the version and sizes in
+ * the header before anything else.
+ */
+
+#if defined(_WIN32)
+constexpr char KEY_BROADCAST_NAME[] = "Local\\shoki-keys";
+#else
+constexpr char KEY_BROADCAST_NAME[] = "/shoki-keys";
+#endif
+
+constexpr u32 KEY_BROADCAST_VERSION  = 1;
+constexpr u32 KEY_BROADCAST_SLOTS    = 1024;  // a few minutes of fast typing
+constexpr u32 BROADCAST_LABEL_LENGTH = 24;    // UTF-8 bytes and a terminator
+
+/*
+ * A combo the way the strip shows it.  A chord comes after the combos
+ * that typed it and replaces them, the way the strip collapses them.
+ */
+struct BroadcastCombo {
+    u32  time;       // when the key went down, in milliseconds on the KeyEvent clock
+    u8   vk_key;     // zero for a chord
+    u8   modifiers;  // Modifier_* bits shown with the label
+    u8   chord;      // one based label of a chord, zero for a key
+    u8   replaces;   // combos before this one that a chord replaces
+    char label[BROADCAST_LABEL_LENGTH];
+};
+
+static_assert(sizeof(BroadcastCombo) == 32, "BroadcastCombo layout changed");
+
+struct KeyBroadcast {
+    std::atomic<u32> version;   // stored last, so zero until the rest is set
+    u32              size;      // of KeyBroadcast
+    u32              comboSize;
+    u32              slotCount;
+    std::atomic<u32> isClosed;  // the writer has gone away
+
+    SeqlockRing<BroadcastCombo, KEY_BROADCAST_SLOTS> ring;
+};
+
+/**
+ * @return A combo as the strip would show it, with the label from the
+ * key table in use.
+ *
+ * @param replaces How many combos before it a chord replaces.
+ */
+BroadcastCombo make_broadcast_combo(KeyCombo const &combo, u32 replaces)
+{
+    auto record = BroadcastCombo{};
+    auto label  = L"";
+
+    record.time = combo.time;
+
+    if (combo.chord) {
+        label           = chord_label(combo.chord);
+        record.chord    = combo.chord;
+        record.replaces = u8(replaces);
+    }
+    else {
+        auto keyInfo = get_key_info(combo.vk_key, combo.isShiftDown, combo.isCtrlDown && combo.isAltDown);
+
+        label            = keyInfo.key;
+        record.vk_key    = u8(combo.vk_key);
+        record.modifiers = shown_modifiers(combo, keyInfo);
+    }
+
+    auto length = append_text(record.label, 0, BROADCAST_LABEL_LENGTH, label);
+    record.label[length] = 0;
+
+    return record;
+}
+
+/*
+ * The writing end, which the overlay owns.  Broadcasting to a block
+ * that couldn't be created does nothing.
+ */
+struct KeyBroadcaster {
+    SharedMemory  memory;
+    KeyBroadcast *broadcast;
+};
+
+/**
+ * @return False if the block couldn't be created, such as when another
+ * shoki on Windows already broadcasts under the name.
+ */
+bool open_key_broadcast(KeyBroadcaster *broadcaster, char const *name)
+{
+    *broadcaster = KeyBroadcaster{};
+
+    if (!create_shared_memory(&broadcaster->memory, name, sizeof(KeyBroadcast)))
+        return false;
+
+    auto broadcast = (KeyBroadcast *)broadcaster->memory.data;
+
+    broadcast->size      = sizeof(KeyBroadcast);
+    broadcast->comboSize = sizeof(BroadcastCombo);
+    broadcast->slotCount = KEY_BROADCAST_SLOTS;
+    broadcast->version.store(KEY_BROADCAST_VERSION, std::memory_order_release);
+
+    broadcaster->broadcast = broadcast;
+    return true;
+}
+
+void broadcast_combo(KeyBroadcaster *broadcaster, KeyCombo const &combo, u32 replaces = 0)
+{
+    if (broadcaster->broadcast)
+        broadcaster->broadcast->ring.publish(make_broadcast_combo(combo, replaces));
+}
+
+void close_key_broadcast(KeyBroadcaster *broadcaster)
+{
+    if (broadcaster->broadcast)
+        broadcaster->broadcast->isClosed.store(1, std::memory_order_release);
+
+    close_shared_memory(&broadcaster->memory);
+    *broadcaster = KeyBroadcaster{};
+}
+
+/*
+ * A reading end, for any process that wants the keys.  The cursor is
+ * the reader's own, so readers never affect each other or the writer.
+ */
+struct KeyBroadcastReader {
+    SharedMemory        memory;
+    KeyBroadcast const *broadcast;
+    SeqlockCursor       cursor;
+};
+
+/**
+ * Start reading a broadcast, from the oldest combo still in it or only
+ * combos broadcast from now on.
+ *
+ * @return False if nothing broadcasts under the name or it is another
+ * version.
+ */
+bool open_key_broadcast_reader(KeyBroadcastReader *reader, char const *name, bool isFromOldest)
+{
+    *reader = KeyBroadcastReader{};
+
+    if (!open_shared_memory(&reader->memory, name, sizeof(KeyBroadcast)))
+        return false;
+
+    auto broadcast = (KeyBroadcast const *)reader->memory.data;
+
+    if (broadcast->version.load(std::memory_order_acquire) != KEY_BROADCAST_VERSION ||
+        broadcast->size != sizeof(KeyBroadcast) ||
+        broadcast->comboSize != sizeof(BroadcastCombo) ||
+        broadcast->slotCount != KEY_BROADCAST_SLOTS) {
+        close_shared_memory(&reader->memory);
+        *reader = KeyBroadcastReader{};
+        return false;
+    }
+
+    reader->broadcast = broadcast;
+    reader->cursor    = isFromOldest ? seqlock_cursor_at_oldest(broadcast->ring) : seqlock_cursor_at_newest(broadcast->ring);
+    return true;
+}
+
+/**
+ * Copy the combos broadcast since the last read, oldest first.  Combos
+ * the reader was lapped on are added to reader->cursor.lost.
+ *
+ * @return How many were copied, up to capacity.
+ */
+u32 read_key_broadcast(KeyBroadcastReader *reader, BroadcastCombo *out, u32 capacity)
+{
+    return seqlock_read(reader->broadcast->ring, &reader->cursor, out, capacity);
+}
+
+/**
+ * @return How many combos the reader is behind.  Past
+ * KEY_BROADCAST_SLOTS the oldest of them are already lost.
+ */
+u32 key_broadcast_lag(KeyBroadcastReader const &reader)
+{
+    return seqlock_lag(reader.broadcast->ring, reader.cursor);
+}
+
+/**
+ * @return True once the writer has closed the broadcast, after which
+ * nothing more arrives.  A writer that dies can't say so.
+ */
+bool is_key_broadcast_closed(KeyBroadcastReader const &reader)
+{
+    return reader.broadcast->isClosed.load(std::memory_order_acquire) != 0;
+}
+
+void close_key_broadcast_reader(KeyBroadcastReader *reader)
+{
+    close_shared_memory(&reader->memory);
+    *reader = KeyBroadcastReader{};
+}
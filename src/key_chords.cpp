@@ -0,0 +1,399 @@
+
+/*
+ * Sequences of key combos bound to a name, such as C-x C-f to
+ * find-file, so an editor demo shows the command rather than the keys
+ * that ran it.  A match replaces the combos that typed it on the strip
+ * with a single combo showing the name.  A binding can run an action
+ * instead, which is how the display mode and statistics hotkeys work.
+ *
+ * The bindings are compiled once, when they're loaded, into an
+ * Aho-Corasick automaton with every transition filled in, so it is a
+ * DFA that finds a binding ending at any combo whatever came before it.
+ * Stepping it is two table loads per combo and never allocates.  Only
+ * combos that appear in some binding get a column in the table; every
+ * other combo shares the column that goes back to the start.
+ */
+
+constexpr u32 MAX_CHORD_STEPS    = 8;
+constexpr u32 MAX_CHORD_LABELS   = 64;
+constexpr u32 MAX_CHORD_BINDINGS = 1 << 16;
+constexpr u32 CHORD_LABEL_LENGTH = 24;
+constexpr u32 CHORD_SYMBOL_COUNT = 1 << 11;  // virtual key and three modifiers
+
+enum ChordAction : u8 {
+    ChordAction_Label,          // show the label in place of the keys
+    ChordAction_ToggleDisplay,  // switch between preview and display mode
+    ChordAction_WriteStats,     // write out the typing statistics
+};
+
+/*
+ * A binding as it is written, before it is compiled.  Each step is a
+ * chord_symbol.
+ */
+struct ChordBinding {
+    u16         steps[MAX_CHORD_STEPS];
+    u32         stepCount;
+    ChordAction action;
+    wchar_t     label[CHORD_LABEL_LENGTH];
+};
+
+/**
+ * @return The combo of a virtual key with modifiers as a single number
+ * below CHORD_SYMBOL_COUNT.
+ */
+inline u32 chord_symbol(u32 vk, bool isCtrlDown, bool isAltDown, bool isShiftDown)
+{
+    return (vk & 0xFF) | (u32(isCtrlDown) << 8) | (u32(isAltDown) << 9) | (u32(isShiftDown) << 10);
+}
+
+inline u32 chord_symbol(KeyCombo const &combo)
+{
+    return chord_symbol(combo.vk_key, combo.isCtrlDown, combo.isAltDown, combo.isShiftDown);
+}
+
+/*
+ * What a state of the automaton matched, which is the longest binding
+ * ending there.
+ */
+struct ChordMatch {
+    u8          stepCount;
+    ChordAction action;
+    u8          label;  // one based, zero for none
+};
+
+struct ChordLabelText {
+    wchar_t text[CHORD_LABEL_LENGTH];
+};
+
+/*
+ * The compiled bindings.  State zero is the start, and next holds the
+ * state after every state and symbol class, classCount to a state.
+ */
+struct ChordTable {
+    u16             classes[CHORD_SYMBOL_COUNT];  // zero for symbols in no binding
+    u32             classCount;
+    u32             stateCount;
+    u32            *next;
+    u32            *matches;   // one based index into bindings, zero for none
+    ChordMatch     *bindings;
+    u32             bindingCount;
+    ChordLabelText  labels[MAX_CHORD_LABELS];
+    u32             labelCount;
+};
+
+void free_chord_table(ChordTable *table)
+{
+    free(table->next);
+    free(table->matches);
+    free(table->bindings);
+    *table = ChordTable{};
+}
+
+/**
+ * Compile bindings into a table, replacing whatever it held.  A later
+ * binding of the same keys replaces an earlier one, and bindings with
+ * the same label share it.
+ *
+ * @return False if a binding has no steps or too many, there are more
+ * than MAX_CHORD_LABELS labels or the table couldn't be allocated, which
+ * leaves the table empty.
+ */
+bool compile_chords(ChordBinding const *bindings, u32 count, ChordTable *table)
+{
+    free_chord_table(table);
+
+    if (count > MAX_CHORD_BINDINGS)
+        return false;
+
+    u32 maxStates = 1;
+    table->classCount = 1;
+
+    for (u32 idx = 0; idx < count; ++idx) {
+        auto &binding = bindings[idx];
+        if (binding.stepCount == 0 || binding.stepCount > MAX_CHORD_STEPS)
+            return false;
+
+        for (u32 step = 0; step < binding.stepCount; ++step) {
+            auto symbol = binding.steps[step] % CHORD_SYMBOL_COUNT;
+            if (!table->classes[symbol])
+                table->classes[symbol] = u16(table->classCount++);
+        }
+
+        maxStates += binding.stepCount;
+    }
+
+    constexpr u32 NO_STATE = ~0u;
+
+    auto classCount = table->classCount;
+    auto fail       = (u32 *)malloc(maxStates * sizeof(u32));
+    auto queue      = (u32 *)malloc(maxStates * sizeof(u32));
+    defer(free(fail));
+    defer(free(queue));
+
+    table->next     = (u32 *)malloc(size_t(maxStates) * classCount * sizeof(u32));
+    table->matches  = (u32 *)calloc(maxStates, sizeof(u32));
+    table->bindings = (ChordMatch *)calloc(count ? count : 1, sizeof(ChordMatch));
+
+    if (!fail || !queue || !table->next || !table->matches || !table->bindings) {
+        free_chord_table(table);
+        return false;
+    }
+
+    memset(table->next, 0xFF, size_t(maxStates) * classCount * sizeof(u32));
+    table->stateCount   = 1;
+    table->bindingCount = count;
+
+    // The trie of every binding.
+    for (u32 idx = 0; idx < count; ++idx) {
+        auto &binding = bindings[idx];
+        auto &match   = table->bindings[idx];
+        u32   state   = 0;
+
+        for (u32 step = 0; step < binding.stepCount; ++step) {
+            auto &to = table->next[state * classCount + table->classes[binding.steps[step] % CHORD_SYMBOL_COUNT]];
+            if (to == NO_STATE)
+                to = table->stateCount++;
+            state = to;
+        }
+
+        table->matches[state] = idx + 1;
+        match.stepCount = u8(binding.stepCount);
+        match.action    = binding.action;
+
+        if (binding.action != ChordAction_Label)
+            continue;
+
+        u32 label = 0;
+        while (label < table->labelCount && wcscmp(table->labels[label].text, binding.label) != 0)
+            ++label;
+
+        if (label == table->labelCount) {
+            if (label == MAX_CHORD_LABELS) {
+                free_chord_table(table);
+                return false;
+            }
+
+            wcsncpy(table->labels[label].text, binding.label, CHORD_LABEL_LENGTH - 1);
+            ++table->labelCount;
+        }
+
+        match.label = u8(label + 1);
+    }
+
+    // Fill in the missing transitions breadth first from those of the
+    // state for the longest suffix that is also in the trie, which is
+    // always shallower and so already filled in.  That state's match is
+    // the longest binding ending at a state without one of its own.
+    u32 head = 0;
+    u32 tail = 0;
+
+    for (u32 cls = 0; cls < classCount; ++cls) {
+        auto &to = table->next[cls];
+        if (to == NO_STATE) {
+            to = 0;
+        }
+        else {
+            fail[to]      = 0;
+            queue[tail++] = to;
+        }
+    }
+
+    while (head < tail) {
+        auto state = queue[head++];
+        auto row   = table->next + size_t(state) * classCount;
+        auto back  = table->next + size_t(fail[state]) * classCount;
+
+        for (u32 cls = 0; cls < classCount; ++cls) {
+            if (row[cls] == NO_STATE) {
+                row[cls] = back[cls];
+                continue;
+            }
+
+            auto child = row[cls];
+            fail[child] = back[cls];
+            if (!table->matches[child])
+                table->matches[child] = table->matches[fail[child]];
+
+            queue[tail++] = child;
+        }
+    }
+
+    return true;
+}
+
+static ChordTable const *CHORD_TABLE;
+
+/**
+ * Use the labels of a table for chord combos, which has to stay alive
+ * for as long as it is in use.
+ */
+void set_chord_table(ChordTable const *table)
+{
+    CHORD_TABLE = table;
+}
+
+/**
+ * @return The label of a chord combo, one based like KeyCombo::chord,
+ * which is empty when there isn't one.
+ */
+inline wchar_t const *chord_label(u32 chord)
+{
+    if (!CHORD_TABLE || chord == 0 || chord > CHORD_TABLE->labelCount)
+        return L"";
+
+    return CHORD_TABLE->labels[chord - 1].text;
+}
+
+/*
+ * Steps a table with every combo added to the stack and collapses the
+ * combos of a labelled binding when it matches.  The state is only an
+ * index, so a recognizer can be reset or pointed at a new table at any
+ * time.
+ *
+ * Combos are stepped in the order their keys came up, while the stack
+ * keeps them in the order they went down, so with keys rolled over the
+ * combos of a match aren't always the newest ones in the stack.  The
+ * serials of the last combos stepped say which ones to collapse.
+ */
+struct ChordRecognizer {
+    ChordTable const *table;
+    u32               state;
+    u32               matchCount;
+    u32               serials[MAX_CHORD_STEPS];  // by stepped % MAX_CHORD_STEPS
+    u32               stepped;
+
+    void reset() { state = 0; }
+
+    /**
+     * Step with combos->lastCombo, which set_key just added.
+     *
+     * @return The binding that matched, or null.
+     */
+    ChordMatch const *step(KeyComboStack *combos) {
+        if (!table || !table->next)
+            return nullptr;
+
+        auto symbol = chord_symbol(combos->lastCombo);
+
+        serials[stepped++ % MAX_CHORD_STEPS] = combos->lastCombo.serial;
+        state = table->next[state * table->classCount + table->classes[symbol]];
+
+        auto found = table->matches[state];
+        if (!found)
+            return nullptr;
+
+        auto &match = table->bindings[found - 1];
+
+        // A binding never overlaps the one after it.
+        state = 0;
+        ++matchCount;
+
+        if (match.label) {
+            u32 matched[MAX_CHORD_STEPS];
+            for (u32 idx = 0; idx < match.stepCount; ++idx)
+                matched[idx] = serials[(stepped - 1 - idx) % MAX_CHORD_STEPS];
+
+            auto combo = KeyCombo{};
+            combo.chord = match.label;
+            combos->replace_combos(matched, match.stepCount, combo);
+        }
+
+        return &match;
+    }
+};
+
+/**
+ * Parse keys written the way Emacs writes them, such as "C-x C-f" or
+ * "C-M-S-F6": combos separated by spaces, each a key name from the U.S.
+ * table after any of C- for CTRL, M- for ALT and S- for SHIFT.  Names
+ * are matched ignoring case.
+ *
+ * @return False if a key isn't known or there are too many of them.
+ */
+bool parse_chord_keys(char const *text, ChordBinding *binding)
+{
+    auto at = text;
+
+    binding->stepCount = 0;
+
+    while (*at) {
+        while (*at == ' ')
+            ++at;
+        if (!*at)
+            break;
+
+        auto end = at;
+        while (*end && *end != ' ')
+            ++end;
+
+        bool isCtrlDown  = false;
+        bool isAltDown   = false;
+        bool isShiftDown = false;
+
+        // A lone "-" is the minus key, so only a dash with a key after
+        // it ends a modifier.
+        while (end - at > 2 && at[1] == '-') {
+            if (*at == 'C')      isCtrlDown  = true;
+            else if (*at == 'M') isAltDown   = true;
+            else if (*at == 'S') isShiftDown = true;
+            else break;
+            at += 2;
+        }
+
+        auto upper  = [](u32 ch) { return ch >= 'a' && ch <= 'z' ? ch - 'a' + 'A' : ch; };
+        auto length = size_t(end - at);
+        u32  vk     = 0;
+
+        for (u32 key = 1; key < 256 && !vk; ++key) {
+            auto name = US_KEY_TABLE.entries[key].labels[KeyLevel_Base].text;
+            auto idx  = size_t(0);
+
+            while (idx < length && name[idx] && upper(u8(at[idx])) == upper(u32(name[idx])))
+                ++idx;
+
+            if (idx == length && name[idx] == 0)
+                vk = key;
+        }
+
+        if (!vk || binding->stepCount == MAX_CHORD_STEPS)
+            return false;
+
+        binding->steps[binding->stepCount++] = u16(chord_symbol(vk, isCtrlDown, isAltDown, isShiftDown));
+        at = end;
+    }
+
+    return binding->stepCount > 0;
+}
+
+/**
+ * Write a combo the way parse_chord_keys reads it, such as "C-S-f",
+ * with the key's name from the U.S. table.  Keys without a name are
+ * written as their virtual key in hex, which can't be read back.
+ *
+ * @return The length written, not counting the terminator.
+ */
+u32 write_chord_keys(u32 symbol, char *out, u32 capacity)
+{
+    auto vk   = symbol & 0xFF;
+    auto name = US_KEY_TABLE.entries[vk].labels[KeyLevel_Base].text;
+
+    char key[KEY_LABEL_LENGTH];
+    u32  length = 0;
+
+    while (name[length] && length + 1 < KEY_LABEL_LENGTH) {
+        key[length] = char(name[length]);
+        ++length;
+    }
+    key[length] = 0;
+
+    if (length == 0)
+        snprintf(key, sizeof(key), "0x%02X", vk);
+
+    auto written = snprintf(out, capacity, "%s%s%s%s",
+                            symbol & (1 << 8)  ? "C-" : "",
+                            symbol & (1 << 9)  ? "M-" : "",
+                            symbol & (1 << 10) ? "S-" : "",
+                            key);
+
+    return written < 0 ? 0 : u32(written) < capacity ? u32(written) : capacity - 1;
+}
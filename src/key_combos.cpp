@@ -0,0 +1,285 @@
+
+/*
+ * Virtual key codes needed by the portable parts of shoki.  These
+ * match the VK_* values from windows.h, which are macros and can't be
+ * reused as names here.
+ */
+constexpr u32 KEY_SHIFT    = 0x10;
+constexpr u32 KEY_CONTROL  = 0x11;
+constexpr u32 KEY_MENU     = 0x12;
+constexpr u32 KEY_F6       = 0x75;
+constexpr u32 KEY_F7       = 0x76;
+constexpr u32 KEY_LSHIFT   = 0xA0;
+constexpr u32 KEY_RSHIFT   = 0xA1;
+constexpr u32 KEY_LCONTROL = 0xA2;
+constexpr u32 KEY_RCONTROL = 0xA3;
+constexpr u32 KEY_LMENU    = 0xA4;
+constexpr u32 KEY_RMENU    = 0xA5;
+
+/*
+ * Mouse buttons and the wheel are shown on the strip like keys.  The
+ * buttons use their Windows virtual key codes and the wheel, which has
+ * none, uses codes Windows leaves unassigned, one per direction, so a
+ * click or a scroll goes through the combo stack, layout and atlas the
+ * same way a key does and picks up whatever modifiers are held.
+ */
+constexpr u32 KEY_LBUTTON     = 0x01;
+constexpr u32 KEY_RBUTTON     = 0x02;
+constexpr u32 KEY_MBUTTON     = 0x04;
+constexpr u32 KEY_XBUTTON1    = 0x05;
+constexpr u32 KEY_XBUTTON2    = 0x06;
+constexpr u32 KEY_WHEEL_UP    = 0x0A;
+constexpr u32 KEY_WHEEL_DOWN  = 0x0B;
+constexpr u32 KEY_WHEEL_LEFT  = 0x0E;
+constexpr u32 KEY_WHEEL_RIGHT = 0x0F;
+
+inline bool is_wheel_key(u32 vk)
+{
+    return vk == KEY_WHEEL_UP || vk == KEY_WHEEL_DOWN || vk == KEY_WHEEL_LEFT || vk == KEY_WHEEL_RIGHT;
+}
+
+/*
+ * A key going down or up as stamped by the low level keyboard hook, or
+ * a mouse button or wheel as one, tagged with KEY_FLAG_MOUSE.  The
+ * flags and time are straight from KBDLLHOOKSTRUCT.  The stamp is when
+ * the hook saw the event, taken from a microsecond clock and left to
+ * wrap, so only differences between stamps mean anything.
+ */
+struct KeyEvent {
+    u32 vk_key;
+    u32 flags;
+    u32 time;   // milliseconds
+    u32 stamp;  // microseconds
+};
+
+constexpr u32 KEY_FLAG_EXTENDED = 0x01;  // LLKHF_EXTENDED
+constexpr u32 KEY_FLAG_INJECTED = 0x10;  // LLKHF_INJECTED
+constexpr u32 KEY_FLAG_UP       = 0x80;  // LLKHF_UP
+constexpr u32 KEY_FLAG_MOUSE    = 0x100; // from the mouse hook, no LLKHF_ flag
+
+/*
+ * Each physical modifier key is tracked on its own so that letting go
+ * of one side doesn't clear the modifier while the other is held.
+ */
+enum : u8 {
+    ModifierKey_LShift = 1 << 0,
+    ModifierKey_RShift = 1 << 1,
+    ModifierKey_LCtrl  = 1 << 2,
+    ModifierKey_RCtrl  = 1 << 3,
+    ModifierKey_LAlt   = 1 << 4,
+    ModifierKey_RAlt   = 1 << 5,
+
+    ModifierKey_Shift = ModifierKey_LShift|ModifierKey_RShift,
+    ModifierKey_Ctrl  = ModifierKey_LCtrl|ModifierKey_RCtrl,
+    ModifierKey_Alt   = ModifierKey_LAlt|ModifierKey_RAlt,
+};
+
+/**
+ * @return The ModifierKey_* bit of a modifier key or zero for any other
+ * key.  Injected input sometimes uses the generic VK_SHIFT, VK_CONTROL
+ * and VK_MENU codes, where the extended flag marks the right hand key.
+ */
+inline u8 modifier_key_bit(u32 vk, u32 flags)
+{
+    auto isRight = (flags & KEY_FLAG_EXTENDED) != 0;
+
+    switch (vk) {
+    case KEY_LSHIFT:   return ModifierKey_LShift;
+    case KEY_RSHIFT:   return ModifierKey_RShift;
+    case KEY_LCONTROL: return ModifierKey_LCtrl;
+    case KEY_RCONTROL: return ModifierKey_RCtrl;
+    case KEY_LMENU:    return ModifierKey_LAlt;
+    case KEY_RMENU:    return ModifierKey_RAlt;
+    case KEY_SHIFT:    return ModifierKey_LShift;
+    case KEY_CONTROL:  return isRight ? ModifierKey_RCtrl : ModifierKey_LCtrl;
+    case KEY_MENU:     return isRight ? ModifierKey_RAlt : ModifierKey_LAlt;
+    }
+
+    return 0;
+}
+
+struct KeyCombo {
+    u32  vk_key;
+    u32  time;  // when the key went down, in milliseconds
+    bool isAltDown;
+    bool isCtrlDown;
+    bool isShiftDown;
+    u8   chord;   // one based label of a chord shown in place of keys
+    u32  serial;  // numbers the combos added to a stack, in that order
+};
+
+constexpr u32 MAX_KEY_COMBOS = 64;
+
+/*
+ * Key combos will be maintained in a stack.  When there are no
+ * more key presses over a short period of time the stack will be
+ * emptied (i.e. the key press rectangle fades out of view).  If
+ * the user is typing quickly and fills the stack the oldest combo is
+ * dropped for every new one.  How many combos are kept is configured
+ * with set_max_combos.
+ *
+ * The generation is bumped every time the contents of the stack
+ * change so anything derived from the stack, such as its layout, can
+ * tell when it is stale.
+ */
+struct KeyComboStack {
+    Ring<KeyCombo, MAX_KEY_COMBOS> keyCombos;
+
+    u32 generation;
+    u32 overwrittenCombos;  // combos pushed off the end of the ring
+    u32 addedCombos;        // the serial of the last combo added
+
+    /*
+     * The modifiers that apply to a key are the ones held when it went
+     * down, not when it comes back up.  Typing quickly often lets go of
+     * a modifier before the key it modifies, so the modifiers are saved
+     * for every key as it goes down.  Auto-repeat sends more key downs
+     * for a held key, which keep the first press's modifiers.
+     */
+    u8   heldModifiers;
+    bool isKeyDown[256];
+    u8   downModifiers[256];
+    u32  downTime[256];
+
+    KeyCombo lastCombo;  // as it was added, serial and all
+
+    /**
+     * Track a key going down or up and add a combo for every displayable
+     * key that is released.
+     *
+     * @return True if a combo was added, which is then lastCombo.
+     */
+    bool set_key(KeyEvent const &event) {
+        auto vk       = event.vk_key & 0xFF;
+        auto isDown   = (event.flags & KEY_FLAG_UP) == 0;
+        auto modifier = modifier_key_bit(vk, event.flags);
+
+        if (modifier) {
+            if (isDown)
+                heldModifiers |= modifier;
+            else
+                heldModifiers &= ~modifier;
+            return false;
+        }
+
+        if (isDown) {
+            if (!isKeyDown[vk]) {
+                isKeyDown[vk]     = true;
+                downModifiers[vk] = heldModifiers;
+                downTime[vk]      = event.time;
+            }
+            return false;
+        }
+
+        // A key that went down before shoki started falls back to what
+        // is held right now.
+        auto modifiers = isKeyDown[vk] ? downModifiers[vk] : heldModifiers;
+        auto time      = isKeyDown[vk] ? downTime[vk] : event.time;
+
+        isKeyDown[vk] = false;
+
+        if (!is_displayable_key(vk))
+            return false;
+
+        auto combo = KeyCombo{};
+
+        combo.vk_key      = vk;
+        combo.time        = time;
+        combo.isAltDown   = (modifiers & ModifierKey_Alt) != 0;
+        combo.isCtrlDown  = (modifiers & ModifierKey_Ctrl) != 0;
+        combo.isShiftDown = (modifiers & ModifierKey_Shift) != 0;
+
+        // A scroll that keeps going in one direction stays one combo
+        // rather than filling the strip with a combo a notch.
+        if (is_wheel_key(vk) && !keyCombos.is_empty()) {
+            auto &newest = keyCombos.at_newest(0);
+
+            if (newest.vk_key == vk &&
+                newest.isAltDown == combo.isAltDown &&
+                newest.isCtrlDown == combo.isCtrlDown &&
+                newest.isShiftDown == combo.isShiftDown) {
+                newest.time = time;
+                return false;
+            }
+        }
+
+        add_combo(combo);
+        return true;
+    }
+
+    bool is_empty() { return keyCombos.is_empty(); }
+
+    /*
+     * Combos are added when keys come up, which isn't always the order
+     * they went down in when keys overlap.  The new combo is moved back
+     * past any combo whose key went down after its own so the stack
+     * stays in the order the keys were typed.
+     */
+    void add_combo(KeyCombo combo) {
+        combo.serial = ++addedCombos;
+        lastCombo    = combo;
+
+        if (keyCombos.push(combo))
+            ++overwrittenCombos;
+
+        ++generation;
+
+        for (u32 age = 0; age + 1 < keyCombos.size(); ++age) {
+            auto &newer = keyCombos.at_newest(age);
+            auto &older = keyCombos.at_newest(age + 1);
+
+            // Times wrap after 49 days so compare them by difference.
+            if (i32(older.time - newer.time) <= 0)
+                break;
+
+            auto swap = older;
+            older     = newer;
+            newer     = swap;
+        }
+    }
+
+    /**
+     * Replace the combos with the given serials with one that keeps the
+     * time the earliest of them went down, such as the name of a chord
+     * they typed.  They were added last but, with keys rolled over, not
+     * always the newest in the stack, so everything newer than them is
+     * put back as it was.  Any that have been pushed off the end are
+     * already gone.
+     */
+    void replace_combos(u32 const *serials, u32 count, KeyCombo combo) {
+        KeyCombo kept[MAX_KEY_COMBOS];
+        u32      keptCount = 0;
+        u32      replaced  = 0;
+
+        while (replaced < count && !keyCombos.is_empty()) {
+            auto newest = keyCombos.at_newest(0);
+            auto isOurs = false;
+
+            for (u32 idx = 0; idx < count && !isOurs; ++idx)
+                isOurs = newest.serial == serials[idx];
+
+            if (!isOurs)
+                kept[keptCount++] = newest;
+            else if (replaced++ == 0 || i32(newest.time - combo.time) < 0)
+                combo.time = newest.time;
+
+            keyCombos.pop_newest();
+        }
+
+        while (keptCount > 0)
+            keyCombos.push(kept[--keptCount]);
+
+        add_combo(combo);
+    }
+
+    void reset_combos() {
+        keyCombos.clear();
+        ++generation;
+    }
+
+    void set_max_combos(u32 maxCombos) {
+        assert(maxCombos >= 1 && maxCombos <= MAX_KEY_COMBOS);
+        keyCombos.set_depth(maxCombos);
+        ++generation;
+    }
+};
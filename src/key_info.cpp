@@ -1,92 +1,165 @@
 
+/*
+ * Labels shown for keys come from a 256 entry table indexed by virtual
+ * key.  Each entry has the label typed without modifiers, with shift
+ * and with AltGr, so turning a key into a label is a single indexed
+ * load.  The US table is built at compile time and tables for other
+ * keyboard layouts are built by the platform layer (see key_layout.cpp).
+ */
+
+enum KeyLevel {
+    KeyLevel_Base,
+    KeyLevel_Shift,
+    KeyLevel_AltGr,
+    KeyLevel_Count
+};
+
+constexpr u32 KEY_LABEL_LENGTH = 8;  // "PG_DOWN" and a terminator
+
+struct KeyLabel {
+    wchar_t text[KEY_LABEL_LENGTH];
+};
+
+struct KeyTableEntry {
+    KeyLabel labels[KeyLevel_Count];
+    bool     isDisplayable;
+    bool     doesShiftAffectKey;
+};
+
+struct KeyTable {
+    KeyTableEntry entries[256];
+};
+
+constexpr void set_label(KeyLabel &label, wchar_t const *text)
+{
+    for (u32 idx = 0; idx < KEY_LABEL_LENGTH - 1 && text[idx]; ++idx)
+        label.text[idx] = text[idx];
+}
+
+// A key with a name, such as ENTER, that reads the same with shift held.
+constexpr void set_named_key(KeyTable &table, u32 vk, wchar_t const *name)
+{
+    auto &entry = table.entries[vk];
+
+    set_label(entry.labels[KeyLevel_Base], name);
+    set_label(entry.labels[KeyLevel_Shift], name);
+    entry.isDisplayable = true;
+}
+
+// A key that types a character, and a different one with shift held.
+constexpr void set_char_key(KeyTable &table, u32 vk, wchar_t base, wchar_t shifted)
+{
+    auto &entry = table.entries[vk];
+
+    entry.labels[KeyLevel_Base].text[0]  = base;
+    entry.labels[KeyLevel_Shift].text[0] = shifted;
+    entry.isDisplayable      = true;
+    entry.doesShiftAffectKey = true;
+}
+
+constexpr KeyTable make_us_key_table()
+{
+    KeyTable table = {};
+
+    set_named_key(table, 0x01, L"L_CLICK");
+    set_named_key(table, 0x02, L"R_CLICK");
+    set_named_key(table, 0x04, L"M_CLICK");
+    set_named_key(table, 0x05, L"M_BACK");
+    set_named_key(table, 0x06, L"M_FWD");
+    set_named_key(table, 0x0A, L"W_UP");
+    set_named_key(table, 0x0B, L"W_DOWN");
+    set_named_key(table, 0x0E, L"W_LEFT");
+    set_named_key(table, 0x0F, L"W_RIGHT");
+    set_named_key(table, 0x08, L"BSPC");
+    set_named_key(table, 0x09, L"TAB");
+    set_named_key(table, 0x0D, L"ENTER");
+    set_named_key(table, 0x14, L"CAPS");
+    set_named_key(table, 0x20, L"SPC");
+    set_named_key(table, 0x21, L"PG_UP");
+    set_named_key(table, 0x22, L"PG_DOWN");
+    set_named_key(table, 0x23, L"END");
+    set_named_key(table, 0x24, L"HOME");
+    set_named_key(table, 0x25, L"LEFT");
+    set_named_key(table, 0x26, L"UP");
+    set_named_key(table, 0x27, L"RIGHT");
+    set_named_key(table, 0x28, L"DOWN");
+    set_named_key(table, 0x2D, L"INS");
+    set_named_key(table, 0x2E, L"DEL");
+
+    wchar_t const *digitsShifted = L")!@#$%^&*(";
+    for (u32 idx = 0; idx < 10; ++idx)
+        set_char_key(table, 0x30 + idx, wchar_t(L'0' + idx), digitsShifted[idx]);
+
+    for (u32 idx = 0; idx < 26; ++idx)
+        set_char_key(table, 0x41 + idx, wchar_t(L'a' + idx), wchar_t(L'A' + idx));
+
+    set_char_key(table, 0xBA, L';',  L':');
+    set_char_key(table, 0xBB, L'=',  L'+');
+    set_char_key(table, 0xBC, L',',  L'<');
+    set_char_key(table, 0xBD, L'-',  L'_');
+    set_char_key(table, 0xBE, L'.',  L'>');
+    set_char_key(table, 0xBF, L'/',  L'?');
+    set_char_key(table, 0xC0, L'`',  L'~');
+    set_char_key(table, 0xDB, L'[',  L'{');
+    set_char_key(table, 0xDC, L'\\', L'|');
+    set_char_key(table, 0xDD, L']',  L'}');
+    set_char_key(table, 0xDE, L'\'', L'"');
+
+    wchar_t const *functionKeys[] = {
+        L"F1", L"F2", L"F3", L"F4", L"F5",  L"F6",
+        L"F7", L"F8", L"F9", L"F10", L"F11", L"F12",
+    };
+    for (u32 idx = 0; idx < 12; ++idx)
+        set_named_key(table, 0x70 + idx, functionKeys[idx]);
+
+    return table;
+}
+
+constexpr KeyTable US_KEY_TABLE = make_us_key_table();
+
+static KeyTable const *KEY_TABLE = &US_KEY_TABLE;
+
+/**
+ * Switch the labels of every key to another table, which has to stay
+ * alive for as long as it is in use.
+ */
+void set_key_table(KeyTable const *table)
+{
+    KEY_TABLE = table;
+}
+
+inline bool is_displayable_key(u32 vk_key)
+{
+    return KEY_TABLE->entries[vk_key & 0xFF].isDisplayable;
+}
+
+/**
+ * @return The label of a key at a level, which is empty when the key
+ * isn't displayed at that level.
+ */
+inline wchar_t const *key_label(u32 vk_key, KeyLevel level)
+{
+    return KEY_TABLE->entries[vk_key & 0xFF].labels[level].text;
+}
+
 struct KeyInfo {
     wchar_t const *key;
     bool doesShiftAffectKey;
+    KeyLevel level;
 };
 
-KeyInfo get_key_info(u32 vk_key, bool isShiftDown)
+/**
+ * Find the label to show for a key.  AltGr, which Windows reports as
+ * CTRL and ALT held together, only changes the label for keys that
+ * type something with it on the current layout.
+ */
+KeyInfo get_key_info(u32 vk_key, bool isShiftDown, bool isAltGrDown = false)
 {
-#define KEY_INFO(key, doesAffect) KeyInfo { key, doesAffect }
-
-    switch (vk_key) {
-    case 0x08: return KEY_INFO(L"BSPC",    false);
-    case 0x09: return KEY_INFO(L"TAB",     false);
-    case 0x0D: return KEY_INFO(L"ENTER",   false);
-    case 0x14: return KEY_INFO(L"CAPS",    false);
-    case 0x20: return KEY_INFO(L"SPC",     false);
-    case 0x21: return KEY_INFO(L"PG_UP",   false);
-    case 0x22: return KEY_INFO(L"PG_DOWN", false);
-    case 0x23: return KEY_INFO(L"END",     false);
-    case 0x24: return KEY_INFO(L"HOME",    false);
-    case 0x25: return KEY_INFO(L"LEFT",    false);
-    case 0x26: return KEY_INFO(L"UP",      false);
-    case 0x27: return KEY_INFO(L"RIGHT",   false);
-    case 0x28: return KEY_INFO(L"DOWN",    false);
-    case 0x2D: return KEY_INFO(L"INS",     false);
-    case 0x2E: return KEY_INFO(L"DEL",     false);
-    case 0x30: return KEY_INFO(isShiftDown ? L")" : L"0", true);
-    case 0x31: return KEY_INFO(isShiftDown ? L"!" : L"1", true);
-    case 0x32: return KEY_INFO(isShiftDown ? L"@" : L"2", true);
-    case 0x33: return KEY_INFO(isShiftDown ? L"#" : L"3", true);
-    case 0x34: return KEY_INFO(isShiftDown ? L"$" : L"4", true);
-    case 0x35: return KEY_INFO(isShiftDown ? L"%" : L"5", true);
-    case 0x36: return KEY_INFO(isShiftDown ? L"^" : L"6", true);
-    case 0x37: return KEY_INFO(isShiftDown ? L"&" : L"7", true);
-    case 0x38: return KEY_INFO(isShiftDown ? L"*" : L"8", true);
-    case 0x39: return KEY_INFO(isShiftDown ? L"(" : L"9", true);
-    case 0x41: return KEY_INFO(isShiftDown ? L"A" : L"a", true);
-    case 0x42: return KEY_INFO(isShiftDown ? L"B" : L"b", true);
-    case 0x43: return KEY_INFO(isShiftDown ? L"C" : L"c", true);
-    case 0x44: return KEY_INFO(isShiftDown ? L"D" : L"d", true);
-    case 0x45: return KEY_INFO(isShiftDown ? L"E" : L"e", true);
-    case 0x46: return KEY_INFO(isShiftDown ? L"F" : L"f", true);
-    case 0x47: return KEY_INFO(isShiftDown ? L"G" : L"g", true);
-    case 0x48: return KEY_INFO(isShiftDown ? L"H" : L"h", true);
-    case 0x49: return KEY_INFO(isShiftDown ? L"I" : L"i", true);
-    case 0x4A: return KEY_INFO(isShiftDown ? L"J" : L"j", true);
-    case 0x4B: return KEY_INFO(isShiftDown ? L"K" : L"k", true);
-    case 0x4C: return KEY_INFO(isShiftDown ? L"L" : L"l", true);
-    case 0x4D: return KEY_INFO(isShiftDown ? L"M" : L"m", true);
-    case 0x4E: return KEY_INFO(isShiftDown ? L"N" : L"n", true);
-    case 0x4F: return KEY_INFO(isShiftDown ? L"O" : L"o", true);
-    case 0x50: return KEY_INFO(isShiftDown ? L"P" : L"p", true);
-    case 0x51: return KEY_INFO(isShiftDown ? L"Q" : L"q", true);
-    case 0x52: return KEY_INFO(isShiftDown ? L"R" : L"r", true);
-    case 0x53: return KEY_INFO(isShiftDown ? L"S" : L"s", true);
-    case 0x54: return KEY_INFO(isShiftDown ? L"T" : L"t", true);
-    case 0x55: return KEY_INFO(isShiftDown ? L"U" : L"u", true);
-    case 0x56: return KEY_INFO(isShiftDown ? L"V" : L"v", true);
-    case 0x57: return KEY_INFO(isShiftDown ? L"W" : L"w", true);
-    case 0x58: return KEY_INFO(isShiftDown ? L"X" : L"x", true);
-    case 0x59: return KEY_INFO(isShiftDown ? L"Y" : L"y", true);
-    case 0x5A: return KEY_INFO(isShiftDown ? L"Z" : L"z", true);
-
-    case 0xBA: return KEY_INFO(isShiftDown ? L":" : L";",  true);
-    case 0xBB: return KEY_INFO(isShiftDown ? L"+" : L"=",  true);
-    case 0xBC: return KEY_INFO(isShiftDown ? L"<" : L",",  true);
-    case 0xBD: return KEY_INFO(isShiftDown ? L"_" : L"-",  true);
-    case 0xBE: return KEY_INFO(isShiftDown ? L">" : L".",  true);
-    case 0xBF: return KEY_INFO(isShiftDown ? L"?" : L"/",  true);
-    case 0xC0: return KEY_INFO(isShiftDown ? L"~" : L"`",  true);
-    case 0xDB: return KEY_INFO(isShiftDown ? L"{" : L"[",  true);
-    case 0xDC: return KEY_INFO(isShiftDown ? L"|" : L"\\", true);
-    case 0xDD: return KEY_INFO(isShiftDown ? L"}" : L"]",  true);
-    case 0xDE: return KEY_INFO(isShiftDown ? L"\"" : L"'", true);
-
-    case 0x70: return KEY_INFO(L"F1",  false);
-    case 0x71: return KEY_INFO(L"F2",  false);
-    case 0x72: return KEY_INFO(L"F3",  false);
-    case 0x73: return KEY_INFO(L"F4",  false);
-    case 0x74: return KEY_INFO(L"F5",  false);
-    case 0x75: return KEY_INFO(L"F6",  false);
-    case 0x76: return KEY_INFO(L"F7",  false);
-    case 0x77: return KEY_INFO(L"F8",  false);
-    case 0x78: return KEY_INFO(L"F9",  false);
-    case 0x79: return KEY_INFO(L"F10", false);
-    case 0x7A: return KEY_INFO(L"F11", false);
-    case 0x7B: return KEY_INFO(L"F12", false);
-
-    default: return KEY_INFO(L"", false);
-    } // switch
-#undef KEY_INFO
+    auto &entry = KEY_TABLE->entries[vk_key & 0xFF];
+    auto  level = isShiftDown ? KeyLevel_Shift : KeyLevel_Base;
+
+    if (isAltGrDown && entry.labels[KeyLevel_AltGr].text[0])
+        level = KeyLevel_AltGr;
+
+    return KeyInfo { entry.labels[level].text, entry.doesShiftAffectKey, level };
 }
@@ -0,0 +1,129 @@
+
+/*
+ * Key tables for the keyboard layouts of the foreground window.  A
+ * table is built the first time a layout is seen by asking Windows what
+ * each key types, and is then kept for as long as shoki runs since
+ * people only switch between a handful of layouts.
+ */
+
+constexpr u32 MAX_KEY_LAYOUTS = 8;
+
+struct KeyLayoutCache {
+    HKL       active;
+    HKL       layouts[MAX_KEY_LAYOUTS];
+    KeyTable *tables[MAX_KEY_LAYOUTS];
+    u32       count;
+};
+
+/*
+ * What a key types at a level of a layout, or an empty label if it
+ * types nothing printable.  Flag 0x4 keeps ToUnicodeEx from changing the
+ * keyboard state, so dead keys aren't left pending for the user's
+ * next key press.
+ */
+void translate_key(HKL layout, u32 vk, BYTE const *keyState, KeyLabel *label)
+{
+    auto scanCode = MapVirtualKeyEx(vk, MAPVK_VK_TO_VSC, layout);
+    WCHAR text[KEY_LABEL_LENGTH] = {};
+
+    auto length = ToUnicodeEx(vk, scanCode, keyState, text, KEY_LABEL_LENGTH - 1, 0x4, layout);
+
+    // A dead key reports -1 but still writes the accent it adds.
+    if (length < 0)
+        length = 1;
+
+    *label = KeyLabel{};
+    for (i32 idx = 0; idx < length && idx < i32(KEY_LABEL_LENGTH - 1); ++idx) {
+        if (text[idx] < 0x20)
+            return;  // a control character, nothing worth showing
+        label->text[idx] = text[idx];
+    }
+}
+
+void build_key_table(HKL layout, KeyTable *table)
+{
+    // Keys with names, like ENTER and F1, are the same on every layout.
+    *table = US_KEY_TABLE;
+
+    BYTE base[256]    = {};
+    BYTE shifted[256] = {};
+    BYTE altGr[256]   = {};
+
+    shifted[VK_SHIFT]  = 0x80;
+    altGr[VK_CONTROL]  = 0x80;
+    altGr[VK_MENU]     = 0x80;
+
+    for (u32 vk = 0; vk < COUNT_OF(table->entries); ++vk) {
+        auto &entry = table->entries[vk];
+
+        if (entry.isDisplayable && !entry.doesShiftAffectKey)
+            continue;
+
+        translate_key(layout, vk, base, &entry.labels[KeyLevel_Base]);
+        translate_key(layout, vk, shifted, &entry.labels[KeyLevel_Shift]);
+        translate_key(layout, vk, altGr, &entry.labels[KeyLevel_AltGr]);
+
+        auto &label = entry.labels;
+
+        entry.isDisplayable      = label[KeyLevel_Base].text[0] != 0;
+        entry.doesShiftAffectKey = wcscmp(label[KeyLevel_Base].text, label[KeyLevel_Shift].text) != 0;
+    }
+}
+
+/**
+ * Switch the key table to the layout of the foreground window if it
+ * changed since the last call.
+ *
+ * @return True if the key table changed.
+ */
+bool update_key_layout(KeyLayoutCache *cache)
+{
+    constexpr u32 US_ENGLISH = 0x0409;
+
+    auto foreground = GetForegroundWindow();
+    auto layout     = GetKeyboardLayout(GetWindowThreadProcessId(foreground, nullptr));
+
+    if (layout == cache->active || layout == nullptr)
+        return false;
+
+    cache->active = layout;
+
+    if ((uintptr_t(layout) & 0xFFFFFFFF) == ((US_ENGLISH << 16) | US_ENGLISH)) {
+        set_key_table(&US_KEY_TABLE);
+        return true;
+    }
+
+    for (u32 idx = 0; idx < cache->count; ++idx) {
+        if (cache->layouts[idx] == layout) {
+            set_key_table(cache->tables[idx]);
+            return true;
+        }
+    }
+
+    auto slot = cache->count < MAX_KEY_LAYOUTS ? cache->count++ : MAX_KEY_LAYOUTS - 1;
+    if (!cache->tables[slot])
+        cache->tables[slot] = (KeyTable *)malloc(sizeof(KeyTable));
+
+    if (!cache->tables[slot]) {
+        set_key_table(&US_KEY_TABLE);
+        return true;
+    }
+
+    // The atlas may still point at the table in the slot being
+    // reused, but it is rebuilt before the next frame is drawn.
+    build_key_table(layout, cache->tables[slot]);
+    cache->layouts[slot] = layout;
+    set_key_table(cache->tables[slot]);
+
+    return true;
+}
+
+void free_key_layouts(KeyLayoutCache *cache)
+{
+    set_key_table(&US_KEY_TABLE);
+
+    for (u32 idx = 0; idx < MAX_KEY_LAYOUTS; ++idx)
+        free(cache->tables[idx]);
+
+    *cache = KeyLayoutCache{};
+}
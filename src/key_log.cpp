@@ -0,0 +1,300 @@
+
+/*
+ * Recording of what the key strip showed, for rebuilding captions and
+ * video of it later.  The log is a header followed by fixed size
+ * records, one for every key that comes up: the combo it added to the
+ * strip, or a bare key up for keys that only restart the fade.  Times
+ * are delta encoded in milliseconds from the previous record, and the
+ * first record's from when recording started.
+ *
+ * The header also keeps how the strip looked when recording started,
+ * its placement, font sizes and colors, so it can be rendered again the
+ * way it was on screen.  Logs from before that was kept are read with
+ * the overlay's defaults.
+ *
+ * The log is written through a file mapping that is sized ahead of the
+ * writes, so an append is a few stores into memory.  Every record ends
+ * with a check value derived from its contents and position, stored
+ * after everything else and never zero, so a reader stops cleanly at
+ * the zeros past the last record or at a record that was half written
+ * when the process died.
+ */
+
+constexpr u8  KEY_LOG_MAGIC[8]  = { 'S', 'H', 'O', 'K', 'I', 'L', 'O', 'G' };
+constexpr u32 KEY_LOG_VERSION   = 2;
+constexpr u32 KEY_LOG_KEY_UP    = 0;        // vk of records without a combo
+constexpr u64 KEY_LOG_GROW_SIZE = 1 << 20;  // bytes added to the file at a time
+
+// How the strip looked on screen when recording started.
+struct KeyLogStyle {
+    i32 offset_x;
+    i32 offset_y;
+    u32 justification;  // PlacementJustification
+    f32 letterSize;     // pixels at 96 DPI
+    f32 modifierSize;
+    u32 textColor;      // straight ARGB
+    u32 boxColor;
+    u32 reserved;
+};
+
+// How the overlay looks unless it's configured otherwise.
+constexpr KeyLogStyle DEFAULT_KEY_LOG_STYLE = { 20, 15, Justification_Center, 40.0f, 8.0f, 0xFFFFFFFF, 0xFF000000, 0 };
+
+struct KeyLogHeader {
+    u8  magic[8];
+    u32 version;
+    u32 headerSize;
+    u32 recordSize;
+    u32 maxCombos;  // depth of the strip
+    u32 holdMilliseconds;
+    u32 fadeOutMilliseconds;
+    u32 fadeCurve;
+    u32 reserved;
+
+    KeyLogStyle style;  // since version 2
+};
+
+constexpr u32 KEY_LOG_VERSION_1_HEADER_SIZE = 40;
+
+struct KeyLogRecord {
+    u32 delta;      // milliseconds since the previous record
+    u16 heldFor;    // milliseconds the key was down, saturated
+    u8  vk_key;
+    u8  modifiers;  // Modifier_* bits held when the key went down
+    u32 check;
+};
+
+static_assert(sizeof(KeyLogHeader) == 72, "KeyLogHeader layout changed");
+static_assert(sizeof(KeyLogRecord) == 12, "KeyLogRecord layout changed");
+
+// FNV-1a over the record and its index, moved off zero.
+inline u32 key_log_check(KeyLogRecord const &record, u32 index)
+{
+    u32 words[3] = {
+        record.delta,
+        u32(record.heldFor) | u32(record.vk_key) << 16 | u32(record.modifiers) << 24,
+        index,
+    };
+
+    u32 hash = 2166136261u;
+    for (auto word : words) {
+        for (u32 byte = 0; byte < 4; ++byte) {
+            hash ^= (word >> (8*byte)) & 0xFF;
+            hash *= 16777619u;
+        }
+    }
+
+    return hash ? hash : 1;
+}
+
+KeyLogHeader make_key_log_header(u32 maxCombos, FadeConfig const &fade, KeyLogStyle const &style)
+{
+    auto header = KeyLogHeader{};
+
+    memcpy(header.magic, KEY_LOG_MAGIC, sizeof(header.magic));
+    header.version             = KEY_LOG_VERSION;
+    header.headerSize          = sizeof(KeyLogHeader);
+    header.recordSize          = sizeof(KeyLogRecord);
+    header.maxCombos           = maxCombos;
+    header.holdMilliseconds    = fade.holdMilliseconds;
+    header.fadeOutMilliseconds = fade.fadeOutMilliseconds;
+    header.fadeCurve           = u32(fade.curve);
+    header.style               = style;
+
+    return header;
+}
+
+FadeConfig key_log_fade(KeyLogHeader const &header)
+{
+    return FadeConfig { header.holdMilliseconds, header.fadeOutMilliseconds, FadeCurve(header.fadeCurve) };
+}
+
+struct KeyLogWriter {
+    MappedFile file;
+    u32        count;
+    u32        capacity;  // records the mapping has room for
+    u32        lastTime;
+    bool       isOpen;
+};
+
+inline KeyLogRecord *key_log_records(MappedFile const &file)
+{
+    return (KeyLogRecord *)(file.data + sizeof(KeyLogHeader));
+}
+
+inline u32 key_log_capacity(MappedFile const &file)
+{
+    return u32((file.size - sizeof(KeyLogHeader)) / sizeof(KeyLogRecord));
+}
+
+/**
+ * Start a new log at path, replacing any file already there.
+ *
+ * @param startTime Time recording starts, on the clock of KeyEvent.
+ */
+bool open_key_log(KeyLogWriter *log, char const *path, KeyLogHeader const &header, u32 startTime)
+{
+    *log = KeyLogWriter{};
+
+    if (!open_mapped_file(&log->file, path, true, KEY_LOG_GROW_SIZE))
+        return false;
+
+    memcpy(log->file.data, &header, sizeof(header));
+
+    log->capacity = key_log_capacity(log->file);
+    log->lastTime = startTime;
+    log->isOpen   = true;
+
+    return true;
+}
+
+/**
+ * Append a key coming up at time, with the combo it added to the strip
+ * if it added one.
+ */
+void append_key_log(KeyLogWriter *log, u32 time, KeyCombo const *combo)
+{
+    if (!log->isOpen)
+        return;
+
+    // Growing remaps the file, which happens once every 87k records.
+    if (log->count == log->capacity) {
+        if (!grow_mapped_file(&log->file, log->file.size + KEY_LOG_GROW_SIZE)) {
+            log->isOpen = false;
+            return;
+        }
+        log->capacity = key_log_capacity(log->file);
+    }
+
+    auto record = KeyLogRecord{};
+    record.delta = time - log->lastTime;
+
+    if (combo) {
+        auto heldFor = time - combo->time;
+
+        record.heldFor   = u16(heldFor < 0xFFFF ? heldFor : 0xFFFF);
+        record.vk_key    = u8(combo->vk_key);
+        record.modifiers = u8((combo->isCtrlDown  ? Modifier_Ctrl  : 0) |
+                              (combo->isAltDown   ? Modifier_Alt   : 0) |
+                              (combo->isShiftDown ? Modifier_Shift : 0));
+    }
+
+    auto &slot = key_log_records(log->file)[log->count];
+
+    slot.delta     = record.delta;
+    slot.heldFor   = record.heldFor;
+    slot.vk_key    = record.vk_key;
+    slot.modifiers = record.modifiers;
+
+    // The check is what marks the record as written, so it must not be
+    // stored before the rest of it.
+    std::atomic_signal_fence(std::memory_order_release);
+    slot.check = key_log_check(record, log->count);
+
+    log->lastTime = time;
+    ++log->count;
+}
+
+void close_key_log(KeyLogWriter *log)
+{
+    if (log->file.isOpen)
+        close_mapped_file(&log->file, sizeof(KeyLogHeader) + u64(log->count) * sizeof(KeyLogRecord));
+
+    *log = KeyLogWriter{};
+}
+
+/*
+ * A record read back, with its time in milliseconds since recording
+ * started and the combo rebuilt the way the strip had it.
+ */
+struct KeyLogEntry {
+    u32      time;
+    bool     isCombo;
+    KeyCombo combo;
+};
+
+struct KeyLogReader {
+    KeyLogHeader        header;
+    KeyLogRecord const *records;
+    u32                 available;  // records that fit in the file
+    u32                 index;
+    u32                 time;
+};
+
+/**
+ * @return False if data doesn't start with a log header this version
+ * can read.  A version 1 header is read with the default style.
+ */
+bool open_key_log_reader(KeyLogReader *reader, u8 const *data, u64 size)
+{
+    *reader = KeyLogReader{};
+
+    if (size < KEY_LOG_VERSION_1_HEADER_SIZE)
+        return false;
+
+    memcpy(&reader->header, data, KEY_LOG_VERSION_1_HEADER_SIZE);
+
+    auto &header     = reader->header;
+    auto  headerSize = header.version == 1 ? KEY_LOG_VERSION_1_HEADER_SIZE : u32(sizeof(KeyLogHeader));
+
+    if (memcmp(header.magic, KEY_LOG_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version < 1 ||
+        header.version > KEY_LOG_VERSION ||
+        header.headerSize != headerSize ||
+        header.recordSize != sizeof(KeyLogRecord) ||
+        header.maxCombos < 1 ||
+        header.maxCombos > MAX_KEY_COMBOS ||
+        header.fadeCurve > FadeCurve_SmoothStep ||
+        size < headerSize) {
+        return false;
+    }
+
+    header.style = DEFAULT_KEY_LOG_STYLE;
+    if (header.version > 1)
+        memcpy(&header.style, data + KEY_LOG_VERSION_1_HEADER_SIZE, sizeof(header.style));
+
+    auto &style = header.style;
+    if (style.justification > Justification_Center ||
+        !(style.letterSize >= 1.0f && style.letterSize <= 1000.0f) ||
+        !(style.modifierSize >= 1.0f && style.modifierSize <= 1000.0f)) {
+        return false;
+    }
+
+    reader->records   = (KeyLogRecord const *)(data + headerSize);
+    reader->available = u32((size - headerSize) / sizeof(KeyLogRecord));
+
+    return true;
+}
+
+/**
+ * Read the next record.
+ *
+ * @return False at the end of the log, which is the first record that
+ * doesn't check out.
+ */
+bool next_key_log_entry(KeyLogReader *reader, KeyLogEntry *entry)
+{
+    if (reader->index == reader->available)
+        return false;
+
+    auto record = reader->records[reader->index];
+    if (record.check != key_log_check(record, reader->index))
+        return false;
+
+    reader->time += record.delta;
+    ++reader->index;
+
+    *entry = KeyLogEntry{};
+    entry->time    = reader->time;
+    entry->isCombo = record.vk_key != KEY_LOG_KEY_UP;
+
+    if (entry->isCombo) {
+        entry->combo.vk_key      = record.vk_key;
+        entry->combo.time        = reader->time - record.heldFor;
+        entry->combo.isCtrlDown  = (record.modifiers & Modifier_Ctrl) != 0;
+        entry->combo.isAltDown   = (record.modifiers & Modifier_Alt) != 0;
+        entry->combo.isShiftDown = (record.modifiers & Modifier_Shift) != 0;
+    }
+
+    return true;
+}
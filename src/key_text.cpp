@@ -0,0 +1,91 @@
+
+/*
+ * The key strip as UTF-8 text, for the tools and frontends that have no
+ * overlay to draw it in.
+ */
+
+u32 append_utf8(char *out, u32 at, u32 capacity, u32 codepoint)
+{
+    char bytes[4];
+    u32  count;
+
+    if (codepoint < 0x80) {
+        bytes[0] = char(codepoint);
+        count    = 1;
+    }
+    else if (codepoint < 0x800) {
+        bytes[0] = char(0xC0 | (codepoint >> 6));
+        bytes[1] = char(0x80 | (codepoint & 0x3F));
+        count    = 2;
+    }
+    else if (codepoint < 0x10000) {
+        bytes[0] = char(0xE0 | (codepoint >> 12));
+        bytes[1] = char(0x80 | ((codepoint >> 6) & 0x3F));
+        bytes[2] = char(0x80 | (codepoint & 0x3F));
+        count    = 3;
+    }
+    else {
+        bytes[0] = char(0xF0 | (codepoint >> 18));
+        bytes[1] = char(0x80 | ((codepoint >> 12) & 0x3F));
+        bytes[2] = char(0x80 | ((codepoint >> 6) & 0x3F));
+        bytes[3] = char(0x80 | (codepoint & 0x3F));
+        count    = 4;
+    }
+
+    if (at + count >= capacity)
+        return at;
+
+    memcpy(out + at, bytes, count);
+    return at + count;
+}
+
+u32 append_text(char *out, u32 at, u32 capacity, wchar_t const *text)
+{
+    for (u32 idx = 0; text[idx]; ++idx) {
+        auto codepoint = u32(text[idx]);
+
+        // Labels are UTF-16 where wchar_t is 16 bits.
+        if (codepoint >= 0xD800 && codepoint < 0xDC00 && text[idx + 1]) {
+            codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (u32(text[idx + 1]) - 0xDC00);
+            ++idx;
+        }
+
+        at = append_utf8(out, at, capacity, codepoint);
+    }
+
+    return at;
+}
+
+/**
+ * Write what the strip shows as UTF-8 text, oldest combo first, with
+ * the modifiers the strip would show in front of each key.  Labels come
+ * from the U.S. table since the log only has virtual keys.
+ *
+ * @return The length of the text.
+ */
+u32 strip_text(KeyComboStack *combos, ComboLayout *layout, char *out, u32 capacity)
+{
+    static LabelMeasurements const NO_MEASUREMENTS = {};
+
+    layout_combos(combos, NO_MEASUREMENTS, layout);
+
+    u32 at = 0;
+
+    for (i32 idx = 0; idx < layout->pressCount; ++idx) {
+        auto &press = layout->presses[idx];
+
+        if (idx > 0)
+            at = append_text(out, at, capacity, L" ");
+        if (press.modifiers & Modifier_Ctrl)
+            at = append_text(out, at, capacity, L"CTRL+");
+        if (press.modifiers & Modifier_Alt)
+            at = append_text(out, at, capacity, L"ALT+");
+        if (press.modifiers & Modifier_Shift)
+            at = append_text(out, at, capacity, L"SHIFT+");
+
+        at = append_text(out, at, capacity, press.key);
+    }
+
+    out[at] = 0;
+    return at;
+}
@@ -0,0 +1,372 @@
+/*
+ * shoki on Linux.  Keyboards are read through evdev and key presses go
+ * through the same combo stack, fade, metrics and recording as on
+ * Windows.  There is no overlay window yet, so the key strip is shown
+ * on the terminal, redrawn in place on the display's frame schedule.
+ *
+ *     shoki-linux [--combos N] [--record <log>] [--stats <file>] [device...]
+ *     shoki-linux [--combos N] [--stats <file>] --replay <file>
+ *
+ * Without devices every keyboard in /dev/input is read.  --replay reads
+ * recorded input_event structs from a file, or from stdin with "-", and
+ * prints the strip after every key with the time of the key in
+ * milliseconds since the first one.  Replays run as fast as the events
+ * can be read, with the fade worked out from the events' own times.
+ *
+ * --stats writes typing statistics to a file when shoki exits and
+ * whenever it gets SIGUSR1.
+ *
+ * Live combos are broadcast in shared memory under /shoki-keys, where
+ * shoki-offline listen or any other reader can follow them.
+ */
+#include "bl_common.hpp"
+#include "bl_ring.hpp"
+#include "bl_mapped_file.hpp"
+#include "bl_shared_memory.hpp"
+#include "bl_seqlock_ring.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <cmath>
+#include <cassert>
+#include <atomic>
+#include <csignal>
+#include <cerrno>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+
+#include "key_info.cpp"
+#include "key_combos.cpp"
+#include "key_chords.cpp"
+#include "typing_stats.cpp"
+#include "combo_layout.cpp"
+#include "fade.cpp"
+#include "frame_scheduler.cpp"
+#include "metrics.cpp"
+#include "key_log.cpp"
+#include "key_text.cpp"
+#include "key_broadcast.cpp"
+#include "evdev_input.cpp"
+
+constexpr u32 KEY_EVENT_BATCH = 256;
+
+struct PosixClock : Clock {
+    u64 now_microseconds() override {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return u64(now.tv_sec) * 1000000 + u64(now.tv_nsec) / 1000;
+    }
+};
+
+static PosixClock CLOCK;
+
+static volatile sig_atomic_t IS_QUITTING;
+static volatile sig_atomic_t IS_STATS_WANTED;
+
+struct AppState {
+    EvdevInput input;
+    bool       isReplay;
+    bool       isTerminal;
+    u32        firstTime;  // of the first event, for replay times
+    bool       hasFirstTime;
+
+    /*
+     * The fade runs on the clock while live and frames are paced by the
+     * scheduler.  Replayed events come as fast as they can be read, so
+     * whether the box had faded before a key is also worked out from
+     * the event times, which is the same thing for live input.
+     */
+    FadeTable      fade;
+    u64            fadeStartTime;  // microseconds on CLOCK
+    u32            lastKeyUp;      // event time
+    bool           isVisible;
+    FrameScheduler scheduler;
+
+    KeyComboStack combos;
+    ComboLayout   layout;
+    u32           shownGeneration;
+    char          text[4096];
+
+    Metrics         metrics;
+    MetricsRecorder recorder;
+    KeyLogWriter    keyLog;
+    KeyBroadcaster  broadcast;
+
+    TypingStats  stats;
+    char const  *statsPath;
+};
+
+void show_strip(AppState *state, bool isVisible)
+{
+    auto length = 0u;
+
+    if (isVisible)
+        length = strip_text(&state->combos, &state->layout, state->text, sizeof(state->text));
+
+    if (state->isTerminal) {
+        printf("\r\x1b[K%s", isVisible ? state->text : "");
+        fflush(stdout);
+    }
+    else if (length > 0) {
+        puts(state->text);
+    }
+
+    state->shownGeneration = state->combos.generation;
+}
+
+/**
+ * @return True if the key came up, which shows the strip and restarts
+ * its fade.
+ */
+bool process_key_event(AppState *state, KeyEvent const &event)
+{
+    auto visibleFor = state->fade.config.holdMilliseconds + state->fade.config.fadeOutMilliseconds;
+
+    if (state->isVisible && event.time - state->lastKeyUp >= visibleFor) {
+        state->combos.reset_combos();
+        state->isVisible = false;
+    }
+
+    auto isDown  = (event.flags & KEY_FLAG_UP) == 0;
+    auto isCombo = state->combos.set_key(event);
+    auto combo   = state->combos.lastCombo;
+
+    if (isCombo) {
+        broadcast_combo(&state->broadcast, combo);
+        state->stats.add(combo);
+    }
+
+    state->recorder.event_processed(event,
+                                    u32(CLOCK.now_microseconds()),
+                                    isCombo,
+                                    state->combos.overwrittenCombos);
+
+    if (isDown)
+        return false;
+
+    state->recorder.frame_requested(event.stamp);
+    append_key_log(&state->keyLog, event.time, isCombo ? &combo : nullptr);
+
+    state->lastKeyUp = event.time;
+    state->isVisible = true;
+
+    return true;
+}
+
+void process_key_events(AppState *state, KeyEvent const *batch, u32 count)
+{
+    bool doRedraw = false;
+
+    for (u32 idx = 0; idx < count; ++idx) {
+        auto &event = batch[idx];
+
+        // A replay's times are from when it was captured, and recording
+        // it starts from its first event rather than from now.
+        if (!state->hasFirstTime) {
+            state->firstTime    = event.time;
+            state->hasFirstTime = true;
+
+            if (state->isReplay)
+                state->keyLog.lastTime = event.time;
+        }
+
+        // Devices stamp events on the monotonic clock, to the millisecond
+        // like the hook's own times.
+        if (!state->isReplay) {
+            bump(&state->metrics.events);
+            state->metrics.latency[MetricStage_Hook].add((u32(CLOCK.now_microseconds() / 1000) - event.time) * 1000);
+        }
+
+        auto didChange = process_key_event(state, event);
+
+        if (didChange && state->isReplay && state->combos.generation != state->shownGeneration) {
+            printf("%10u ", event.time - state->firstTime);
+            show_strip(state, true);
+        }
+
+        doRedraw |= didChange;
+    }
+
+    if (doRedraw) {
+        state->fadeStartTime = CLOCK.now_microseconds();
+        state->scheduler.request_frame();
+        state->scheduler.set_animating(true);
+    }
+}
+
+void present_frame(AppState *state)
+{
+    auto now     = CLOCK.now_microseconds();
+    auto elapsed = u32((now - state->fadeStartTime) / 1000);
+    auto alpha   = fade_alpha(state->fade, elapsed);
+
+    state->recorder.render_started(u32(now));
+    state->scheduler.set_animating(alpha > 0);
+
+    // A terminal can't fade, so only changes to the strip are drawn.
+    if (alpha == 0 || state->combos.generation != state->shownGeneration)
+        show_strip(state, alpha > 0);
+
+    // Nothing is handed to a compositor, so no bytes are presented.
+    state->recorder.frame_presented(u32(CLOCK.now_microseconds()), alpha, 0);
+
+    if (alpha == 0) {
+        state->combos.reset_combos();
+        state->isVisible       = false;
+        state->shownGeneration = state->combos.generation;
+    }
+}
+
+void quit(int)
+{
+    IS_QUITTING = 1;
+}
+
+void want_stats(int)
+{
+    IS_STATS_WANTED = 1;
+}
+
+/**
+ * Write the typing statistics over what was last written.  Replays
+ * stamp the rate with the last event rather than the clock.
+ */
+bool write_stats_file(AppState *state)
+{
+    auto out = fopen(state->statsPath, "w");
+    if (!out)
+        return false;
+
+    auto time = state->isReplay ? state->lastKeyUp : u32(CLOCK.now_microseconds() / 1000);
+    print_typing_stats(out, state->stats, time);
+
+    return fclose(out) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    static AppState state;
+
+    auto maxCombos  = 4u;
+    auto recordPath = (char const *)nullptr;
+    auto replayPath = (char const *)nullptr;
+
+    if (!open_evdev_input(&state.input)) {
+        perror("epoll");
+        return 1;
+    }
+    defer(close_evdev_input(&state.input));
+
+    for (int idx = 1; idx < argc; ++idx) {
+        auto arg = argv[idx];
+
+        if (strcmp(arg, "--combos") == 0 && idx + 1 < argc) {
+            maxCombos = u32(strtoul(argv[++idx], nullptr, 10));
+            if (maxCombos < 1 || maxCombos > MAX_KEY_COMBOS) {
+                fprintf(stderr, "--combos has to be from 1 to %u\n", MAX_KEY_COMBOS);
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "--record") == 0 && idx + 1 < argc) {
+            recordPath = argv[++idx];
+        }
+        else if (strcmp(arg, "--replay") == 0 && idx + 1 < argc) {
+            replayPath = argv[++idx];
+        }
+        else if (strcmp(arg, "--stats") == 0 && idx + 1 < argc) {
+            state.statsPath = argv[++idx];
+        }
+        else if (arg[0] == '-') {
+            fputs("usage: shoki-linux [--combos N] [--record <log>] [--stats <file>] [device...]\n"
+                  "       shoki-linux [--combos N] [--stats <file>] --replay <file>\n", stderr);
+            return 1;
+        }
+        else if (!add_evdev_device(&state.input, arg)) {
+            fprintf(stderr, "%s isn't a keyboard shoki can read\n", arg);
+            return 1;
+        }
+    }
+
+    if (replayPath) {
+        auto fd = strcmp(replayPath, "-") == 0 ? dup(STDIN_FILENO) : open(replayPath, O_RDONLY|O_CLOEXEC);
+        if (fd < 0 || !add_evdev_source(&state.input, fd)) {
+            fprintf(stderr, "can't read %s\n", replayPath);
+            return 1;
+        }
+        state.isReplay = true;
+    }
+    else if (state.input.sourceCount == 0 && add_evdev_keyboards(&state.input) == 0) {
+        fputs("no keyboards found, reading /dev/input usually needs the input group\n", stderr);
+        return 1;
+    }
+
+    state.isTerminal              = !state.isReplay && isatty(STDOUT_FILENO);
+    state.scheduler.clock         = &CLOCK;
+    state.scheduler.frameInterval = 1000000 / 60;
+    state.combos.set_max_combos(maxCombos);
+    state.shownGeneration = state.combos.generation;
+
+    build_fade_table(&state.fade, FadeConfig{ 300, 400, FadeCurve_Linear });
+
+    init_metrics(&state.metrics);
+    state.recorder.metrics = &state.metrics;
+
+    if (recordPath) {
+        auto header = make_key_log_header(maxCombos, state.fade.config, DEFAULT_KEY_LOG_STYLE);
+        auto now    = u32(CLOCK.now_microseconds() / 1000);
+
+        if (!open_key_log(&state.keyLog, recordPath, header, now)) {
+            fprintf(stderr, "can't write %s\n", recordPath);
+            return 1;
+        }
+    }
+    defer(close_key_log(&state.keyLog));
+
+    if (!state.isReplay && !open_key_broadcast(&state.broadcast, KEY_BROADCAST_NAME))
+        fprintf(stderr, "can't broadcast keys as %s\n", KEY_BROADCAST_NAME);
+    defer(close_key_broadcast(&state.broadcast));
+
+    signal(SIGINT, quit);
+    signal(SIGTERM, quit);
+    signal(SIGUSR1, want_stats);
+
+    KeyEvent batch[KEY_EVENT_BATCH];
+
+    while (!IS_QUITTING && state.input.openCount > 0) {
+        auto wait    = state.isReplay ? NO_FRAME_DUE : state.scheduler.wait_microseconds();
+        auto timeout = wait == NO_FRAME_DUE ? -1 : i32((wait + 999) / 1000);
+        auto stamp   = u32(CLOCK.now_microseconds());
+        auto count   = read_evdev_events(&state.input, timeout, stamp, batch, KEY_EVENT_BATCH);
+
+        process_key_events(&state, batch, count);
+
+        if (!state.isReplay && state.scheduler.begin_frame())
+            present_frame(&state);
+
+        if (IS_STATS_WANTED && state.statsPath) {
+            IS_STATS_WANTED = 0;
+            if (!write_stats_file(&state))
+                fprintf(stderr, "\ncan't write %s\n", state.statsPath);
+        }
+    }
+
+    if (state.isTerminal)
+        puts("");
+
+    fprintf(stderr, "%u events in %u reads\n", state.input.events, state.input.reads);
+    print_metrics(stderr, state.metrics);
+
+    if (state.statsPath && !write_stats_file(&state)) {
+        fprintf(stderr, "can't write %s\n", state.statsPath);
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,120 +1,279 @@
 #include "bl_common.hpp"
 #include "bl_winhelp.cpp"
-#include "key_info.cpp"
+#include "bl_spsc_queue.hpp"
+#include "bl_ring.hpp"
+#include "bl_mapped_file.hpp"
+#include "bl_rcu.hpp"
+#include "bl_shared_memory.hpp"
+#include "bl_seqlock_ring.hpp"
 
 #include <gdiplus.h>
 #include <cstring>
+#include <cstdlib>
+#include <cmath>
 #include <cassert>
 
+#include "key_info.cpp"
+#include "key_layout.cpp"
+#include "key_combos.cpp"
+#include "key_chords.cpp"
+#include "typing_stats.cpp"
+#include "combo_layout.cpp"
+#include "key_text.cpp"
+#include "key_broadcast.cpp"
+#include "glyph_atlas.cpp"
+#include "fade.cpp"
+#include "frame_scheduler.cpp"
+#include "metrics.cpp"
+#include "composite.cpp"
+#include "combo_render.cpp"
+#include "mouse_input.cpp"
+#include "sdf_atlas.cpp"
+#include "sdf_bake.cpp"
+#include "config.cpp"
+#include "key_log.cpp"
+
 namespace gp {
 using namespace Gdiplus;
 }
 
+#include "sdf_gdiplus.cpp"
+#include "combo_render_gdiplus.cpp"
+
+/*
+ * The default font's labels as distance fields, written by shoki-bake
+ * when the build runs it first.  Without them the default font is
+ * rasterized with GDI+ the first time a key is shown, like any other.
+ */
+#if defined(__has_include)
+#if __has_include("baked_fonts.inc")
+#include "baked_fonts.inc"
+#define HAS_BAKED_FONTS 1
+#endif
+#endif
+
+#ifndef WM_DPICHANGED
+#define WM_DPICHANGED 0x02E0
+#endif
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
 static HWND WINDOW;
 
-struct KeyCombo {
-    u32  vk_key;
-    bool isAltDown;
-    bool isCtrlDown;
-    bool isShiftDown;
+constexpr u32  MAX_KEY_EVENTS    = 4096;
+constexpr u32  KEY_EVENT_BATCH   = 64;
+constexpr UINT WM_APP_KEY_EVENTS = WM_APP + 1;
+constexpr UINT WM_APP_CONFIG     = WM_APP + 2;
+constexpr UINT WM_APP_MOUSE_HOOK = WM_APP + 3;  // to the hook thread
+
+static SpscQueue<KeyEvent, MAX_KEY_EVENTS> KEY_EVENTS;
+static std::atomic<bool>                   KEY_EVENTS_POSTED;
+
+/*
+ * The mouse hook is only installed while the config asks for clicks to
+ * be shown, since every mouse move on the system waits on it.  The UI
+ * thread sets MOUSE_HOOK_WANTED and wakes the hook thread, which owns
+ * the hook and the filter.  Wheel ticks are merged over one frame of
+ * the scheduler, which the UI thread keeps in MOUSE_WHEEL_WINDOW
+ * whenever the refresh rate changes.
+ */
+static std::atomic<bool> MOUSE_HOOK_WANTED;
+static std::atomic<u32>  MOUSE_WHEEL_WINDOW{ 1000000 / 60 };  // microseconds
+static MouseFilter       MOUSE_FILTER;
+
+/*
+ * The config is parsed on the config thread whenever its file changes
+ * and published as a new snapshot.  The UI thread reads it with a single
+ * load wherever it needs it and never waits on the config thread; it
+ * only has to pass through the top of its loop for old snapshots to be
+ * freed.
+ */
+constexpr DWORD CONFIG_POLL_MILLISECONDS = 500;
+
+static Rcu<Config> CONFIG;
+
+/*
+ * Metrics are kept in a named shared memory block so that other
+ * processes can map it and read them while shoki runs.  When the block
+ * can't be created they are kept in process memory instead.
+ */
+constexpr char const *METRICS_NAME = "Local\\shoki-metrics";
+
+static Metrics  LOCAL_METRICS;
+static Metrics *METRICS = &LOCAL_METRICS;
+
+struct FontConfig {
+    wchar_t family[CONFIG_FONT_LENGTH];
+    f32     letterSize;
+    f32     modifierSize;
+};
+
+bool is_same_font(FontConfig const &a, FontConfig const &b)
+{
+    return (a.letterSize == b.letterSize &&
+            a.modifierSize == b.modifierSize &&
+            wcscmp(a.family, b.family) == 0);
+}
+
+/*
+ * Counters for the work done in a single frame.  These are printed to
+ * the debug console after every frame so the cost of a frame can be
+ * checked without a profiler.
+ */
+struct FrameStats {
+    u32 measureCalls;
+    u32 gdiObjects;         // GDI objects owned by the process after the frame
+    i32 gdiObjectsCreated;  // GDI objects created and not freed by the frame
+    f32 setupMicroseconds;  // time spent readying the back buffer
+    u32 presentedBytes;     // pixels handed to the compositor
 };
 
-struct KeyComboIter {
-    i32  index;
-    bool hasWrapped;
+u64 performance_frequency()
+{
+    auto frequency = LARGE_INTEGER{};
+    QueryPerformanceFrequency(&frequency);
+    return u64(frequency.QuadPart);
+}
+
+/*
+ * Monotonic clock on the performance counter.  GetTickCount only moves
+ * every 10 to 16 ms, which is as long as a whole frame.  It is used by
+ * both the UI and hook threads.
+ */
+struct Win32Clock : Clock {
+    u64 now_microseconds() override {
+        static u64 const frequency = performance_frequency();
+
+        auto now   = LARGE_INTEGER{};
+        QueryPerformanceCounter(&now);
+
+        auto ticks = u64(now.QuadPart);
+        return ticks / frequency * 1000000 + ticks % frequency * 1000000 / frequency;
+    }
 };
 
-constexpr u32 MAX_KEY_COMBOS = 8;
+static Win32Clock CLOCK;
 
 struct AppState {
-    HHOOK     kb_hook;
+    HANDLE    hookThread;
+    DWORD     hookThreadID;
     HINSTANCE hInstance;
+    u64       startTime;     // WinMain, microseconds on CLOCK
+    bool      hasPresented;  // a frame has been on screen
     bool      hideWindow;
     bool      hasError;
-    UINT_PTR  timerID;
     f32       opacity;
-    UINT      fadeOutMilliseconds;
-    DWORD     lastTime;
-    DWORD     timerStartTime;
+    u8        fadeAlpha;
+    u64       fadeStartTime;  // microseconds on CLOCK
+    FadeTable fade;
 
     /*
-     * Key combos will be maintained in a stack.  When there are no
-     * more key presses over a short period of time the stack will be
-     * emptied (i.e. the key press rectangle fades out of view).  If
-     * the user is typing quickly and overflows the stack buffer then
-     * turns into a ring buffer.  A keyComboIndex of -1 indicates
-     * there are no stored key combos.
+     * Frames are drawn from the main loop when the scheduler has one
+     * due, at most once per display refresh.  The frame timer wakes the
+     * loop for the next frame while the box is visible and is left
+     * unarmed once it has faded out.
      */
-    KeyCombo keyCombos[MAX_KEY_COMBOS];
-    u32      maxUserConfigCombos;
-    i32      keyComboIndex;
-    bool     isOverflowed;
-
-    KeyCombo possibleCombo;
+    FrameScheduler  scheduler;
+    HANDLE          frameTimer;
+    MetricsRecorder recorder;
 
-    void set_key(DWORD vk, bool isDownState) {
-        if (vk == VK_LCONTROL || vk == VK_RCONTROL) {
-            possibleCombo.isCtrlDown = isDownState;
-        }
-        else if (vk == VK_LMENU || vk == VK_RMENU) {
-            possibleCombo.isAltDown = isDownState;
-        }
-        else if (vk == VK_LSHIFT || vk == VK_RSHIFT) {
-            possibleCombo.isShiftDown = isDownState;
-        }
-        else if (!isDownState && get_key_info(vk, false).key != L"") {
-            possibleCombo.vk_key = vk;
-            add_combo();
-        }
-    }
+    /*
+     * In display mode a frame is only drawn when the combo strip or the
+     * window size changes.  It is drawn at full opacity into a bitmap
+     * that is kept around so fading only has to present the same bitmap
+     * again with a lower constant alpha.  The bitmap is a top-down
+     * 32-bit DIB section so its premultiplied pixels can be written
+     * directly, and it is only reallocated when the window size or DPI
+     * changes.  Only the part of it the strip covered in the last frame
+     * and covers now is redrawn and handed to the compositor, unless
+     * the window needs all of it again.
+     */
+    HDC       frameDC;
+    HBITMAP   frameBitmap;
+    u32      *framePixels;
+    i32       frameWidth;
+    i32       frameHeight;
+    u32       presentedGeneration;
+    PixelRect presentedBounds;    // of the strip in the window's bitmap
+    bool      isFrameStale;
+    bool      isWholeFrameStale;  // new bitmap, new mode or drawn over
 
-    bool is_empty() { return keyComboIndex == -1; }
+    /*
+     * Preview frames are drawn into the frame bitmap the same way and
+     * copied to the window.  Frames are composited in software unless
+     * the config picks the GDI+ renderer, so GDI+ is only started for
+     * that or to rasterize a font the baked fonts don't cover, which
+     * takes longer than everything else before the first frame.
+     */
+    ULONG_PTR    gdiplusToken;  // zero until GDI+ is started
+    GdiplusStrip gdiplusStrip;
 
-    KeyComboIter begin() {
-        return KeyComboIter { keyComboIndex, false };
-    }
+    KeyComboStack combos;
 
-    bool at_end(KeyComboIter iter) {
-        if (isOverflowed && iter.hasWrapped)
-            return iter.index == keyComboIndex;
+    /*
+     * Chords from the config are compiled whenever they change and the
+     * recognizer is stepped with every combo the stack takes.
+     */
+    ChordTable      chordTable;
+    ChordRecognizer chords;
 
-        return iter.index == -1;
-    }
+    /*
+     * Label measurements only depend on the font so they are measured
+     * once per font configuration.  The layout of the combo strip only
+     * depends on the label measurements and the contents of the combo
+     * stack, so it is only redone when the stack's generation moves on
+     * or the labels are re-measured.
+     */
+    FontConfig        font;
+    FontConfig        measuredFont;
+    bool              hasMeasurements;
+    LabelMeasurements labels;
+    ComboLayout       layout;
+    u32               layoutGeneration;
+    bool              isLayoutStale;
+    GlyphAtlas        atlas;
+    bool              isAtlasStale;  // only the text color changed
 
-    void incr(KeyComboIter *iter) {
-        iter->index = iter->index - 1;
+    /*
+     * The glyphs of every label character as distance fields, built
+     * once for a font family and the characters the key table has, so
+     * a change of size or DPI only redraws the atlas from them.
+     */
+    SdfFont    letterSdf;
+    SdfFont    modifierSdf;
+    wchar_t    sdfFamily[LF_FACESIZE];
+    u32        sdfCodepoints[MAX_SDF_GLYPHS];
+    u32        sdfCodepointCount;
 
-        if (isOverflowed && iter->index == -1) {
-            iter->hasWrapped = true;
-            iter->index      = maxUserConfigCombos - 1;
-        }
-    }
+    KeyLayoutCache keyLayouts;
 
-    KeyCombo get_combo(KeyComboIter iter) {
-        assert(iter.index > -1 && iter.index < maxUserConfigCombos);
-        return keyCombos[iter.index];
-    }
+    /*
+     * The config everything derived from it was last brought up to date
+     * with, kept by value since snapshots are freed once they've been
+     * replaced.  Font sizes in the config are at 96 DPI and are scaled
+     * by dpiScale.
+     */
+    Config applied;
+    f32    dpiScale;
+    u32    configReader;
+    Config baseConfig;  // defaults and command line, under the file
+    char   configPath[MAX_PATH];
+    HANDLE configThread;
+    HANDLE configStop;
 
-    void add_combo() {
-        ++keyComboIndex;
-        if (keyComboIndex == maxUserConfigCombos) {
-            isOverflowed  = true;
-            keyComboIndex = 0;
-        }
+    // Every key up is appended to the log when recording.
+    KeyLogWriter keyLog;
 
-        keyCombos[keyComboIndex] = possibleCombo;
-    }
+    // Every combo goes out to other processes as the strip shows it.
+    KeyBroadcaster broadcast;
 
-    void reset_combos() {
-        keyComboIndex = -1;
-        isOverflowed  = false;
-    }
+    // Every combo is counted, and the stats hotkey writes them out.
+    TypingStats *stats;
+    char         statsPath[MAX_PATH];
 
-    void set_max_combos(u32 maxCombos) {
-        assert(maxCombos >= 1 && maxCombos <= MAX_KEY_COMBOS);
-        maxUserConfigCombos = maxCombos;
-        reset_combos();
-    }
+    FrameStats frameStats;
 
     void check_status(gp::Status status) {
         if (status != gp::Ok && !hasError) {
@@ -124,21 +283,6 @@ struct AppState {
     }
 };
 
-enum PlacementJustification {
-    Justification_Left,
-    Justification_Right,
-    Justification_Center
-};
-
-struct Placement {
-    i32 offset_x;
-    i32 offset_y;
-    i32 width;
-    i32 height;
-
-    PlacementJustification justification;
-};
-
 inline void log(char const *msg)
 {
 #if defined(DEBUG)
@@ -146,175 +290,241 @@ inline void log(char const *msg)
 #endif
 }
 
-void draw_rectangle(gp::Graphics *graphics,
-                    i32 x1,
-                    i32 y1,
-                    i32 width,
-                    i32 height,
-                    gp::Color color)
+/**
+ * Start GDI+ the first time it's needed.
+ *
+ * @return False if it couldn't be started.
+ */
+bool start_gdiplus(AppState *state)
 {
-    constexpr i32 CORNER_RADIUS = 10;
-    auto x2 = x1 + width - CORNER_RADIUS;
-    auto y2 = y1 + height - CORNER_RADIUS;
+    if (state->gdiplusToken)
+        return true;
+
+    auto input = gp::GdiplusStartupInput{};
 
-    gp::GraphicsPath path;
-    gp::SolidBrush   brush(color);
+    if (gp::GdiplusStartup(&state->gdiplusToken, &input, nullptr) != gp::Ok) {
+        state->gdiplusToken = 0;
+        return false;
+    }
 
-    path.AddArc(x1, y1, CORNER_RADIUS, CORNER_RADIUS, -180, 90);
-    path.AddArc(x2, y1, CORNER_RADIUS, CORNER_RADIUS,  -90, 90);
-    path.AddArc(x2, y2, CORNER_RADIUS, CORNER_RADIUS,    0, 90);
-    path.AddArc(x1, y2, CORNER_RADIUS, CORNER_RADIUS,   90, 90);
-    graphics->FillPath(&brush, &path);
+    return true;
 }
 
-void draw_keypresses(HWND hwnd, gp::Graphics *graphics, f32 opacity, Placement const &placement)
+/*
+ * Build the distance field fonts again if the font family or the set
+ * of characters the labels need has changed.  The key table changes
+ * with the keyboard layout, which mostly brings the same characters.
+ * The default font is unpacked from the baked fonts when they have
+ * every character.
+ */
+void update_sdf_fonts(AppState *state)
 {
-    auto state = (AppState *)GetWindowLongPtr(hwnd, GWLP_USERDATA);
+    u32  codepoints[MAX_SDF_GLYPHS];
+    auto count = collect_label_characters(*KEY_TABLE, codepoints, COUNT_OF(codepoints));
 
-    if (state->is_empty())
+    if (wcscmp(state->sdfFamily, state->font.family) == 0 &&
+        count == state->sdfCodepointCount &&
+        memcmp(codepoints, state->sdfCodepoints, count * sizeof(u32)) == 0)
         return;
 
-    struct KeyPress {
-        gp::RectF ltrDim;
-        gp::RectF modDim;
-        wchar_t const *key;
-        wchar_t const *ctrl;
-        wchar_t const *alt;
-        wchar_t const *shift;
-    };
-
-    gp::Font letter(L"Consolas", 40, gp::FontStyleBold, gp::UnitPixel);
-    gp::Font modifier(L"Consolas", 8, gp::FontStyleRegular, gp::UnitPixel);
-    KeyPress keypresses[MAX_KEY_COMBOS];
-
-    // Ensures that modifier text stack are left aligned.
-    gp::StringFormat format;
-    format.SetAlignment(gp::StringAlignmentNear);
-
-    constexpr f32 MOD_LETTER_SPACING = -8.0f; // pixels
-    constexpr f32 MOD_LINE_SPACING   = 2.0f;
-    constexpr f32 COMBO_SPACING      = 2.0f;
-    constexpr f32 BOX_PADDING        = 2.0f;
-
-    f32 box_wd     = 2*BOX_PADDING;
-    f32 box_ht     = 0.0f;
-    i32 pressCount = 0;
-
-    for (auto iter = state->begin(); !state->at_end(iter); state->incr(&iter)) {
-        auto  combo   = state->get_combo(iter);
-        auto  keyInfo = get_key_info(combo.vk_key, combo.isShiftDown);
-        auto &press   = keypresses[pressCount];
-
-        press.key   = keyInfo.key;
-        press.ctrl  = combo.isCtrlDown ? L"CTRL" : L"";
-        press.alt   = combo.isAltDown  ? L"ALT"  : L"";
-        press.shift = L"";
-
-        if (combo.isShiftDown && !keyInfo.doesShiftAffectKey)
-            press.shift = L"SHIFT";
-
-        gp::PointF pt;
-        auto &ltr = press.ltrDim;
-        auto &mod = press.modDim;
-
-        graphics->MeasureString(press.key, -1, &letter, pt, &format, &ltr);
-        box_wd += ltr.Width;
-        box_ht  = ltr.Height > box_ht ? ltr.Height : box_ht;
-
-        auto isAnyModDown = (combo.isCtrlDown || combo.isAltDown ||
-                             (combo.isShiftDown && !keyInfo.doesShiftAffectKey));
-
-        if (isAnyModDown) {
-            graphics->MeasureString(L"SHIFT", -1, &modifier, pt, &format, &mod);
-            box_wd += mod.Width + MOD_LETTER_SPACING;
-        }
-        ++pressCount;
+    memcpy(state->sdfCodepoints, codepoints, count * sizeof(u32));
+    state->sdfCodepointCount = count;
+    wcsncpy(state->sdfFamily, state->font.family, COUNT_OF(state->sdfFamily) - 1);
+
+    auto start = CLOCK.now_microseconds();
+    defer(METRICS->labelFontMicroseconds.store(u32(CLOCK.now_microseconds() - start), std::memory_order_relaxed));
+
+#if defined(HAS_BAKED_FONTS)
+    if (wcscmp(state->font.family, BAKED_LETTER_FONT.family) == 0 &&
+        does_baked_font_cover(BAKED_LETTER_FONT, codepoints, count) &&
+        does_baked_font_cover(BAKED_MODIFIER_FONT, codepoints, count) &&
+        load_baked_sdf_font(BAKED_LETTER_FONT, &state->letterSdf) &&
+        load_baked_sdf_font(BAKED_MODIFIER_FONT, &state->modifierSdf))
+        return;
+#endif
+
+    auto calls = &state->frameStats.measureCalls;
+
+    if (!start_gdiplus(state)) {
+        log("Failed to start GDI+");
+        return;
     }
 
-    // The state->empty() check earlier should make this true.
-    assert(pressCount > 0);
+    if (!build_sdf_font_gdiplus(&state->letterSdf, state->font.family, gp::FontStyleBold, codepoints, count, calls) ||
+        !build_sdf_font_gdiplus(&state->modifierSdf, state->font.family, gp::FontStyleRegular, codepoints, count, calls))
+        log("Failed to build distance field fonts");
+}
 
-    u8 alpha = u8(opacity * 255);
-    gp::SolidBrush white(gp::Color(alpha, 255, 255, 255));
-    gp::Color      black(alpha, 0, 0, 0);
+void measure_labels(AppState *state)
+{
+    auto &font = state->font;
+
+    measure_sdf_labels(&state->labels, state->letterSdf, state->modifierSdf, font.letterSize, font.modifierSize);
 
-    box_wd += (pressCount - 1) * COMBO_SPACING;
-    box_ht += 2.0f*BOX_PADDING;
+    state->measuredFont    = font;
+    state->hasMeasurements = true;
+    state->isLayoutStale   = true;
+}
 
-    f32 start_x = 0;
-    f32 start_y = placement.height - placement.offset_y - box_ht;
+/*
+ * Draw every label and modifier stack into the glyph atlas from the
+ * distance fields, at the sizes the combo layout was measured with.
+ */
+void build_glyph_atlas(AppState *state)
+{
+    auto &atlas  = state->atlas;
+    auto &font   = state->font;
+    auto &labels = state->labels;
 
-    switch (placement.justification) {
-    case Justification_Left:
-        start_x = placement.offset_x;
-        break;
-    case Justification_Right:
-        start_x = placement.width - placement.offset_x - box_wd;
-        break;
-    case Justification_Center:
-        start_x = (placement.width / 2.0f) - (box_wd / 2.0f);
-        break;
+    if (!layout_glyph_atlas(&atlas, labels)) {
+        log("Failed to allocate glyph atlas");
+        return;
     }
 
-    // This text rendering mode needs to be applied; otherwise, the alpha
-    // value of the text color won't be properly applied.
-    graphics->SetTextRenderingHint(gp::TextRenderingHintAntiAliasGridFit);
-    graphics->SetSmoothingMode(gp::SmoothingModeHighQuality);
-    draw_rectangle(graphics, start_x, start_y, box_wd, box_ht, black);
+    draw_sdf_labels(&atlas,
+                    labels,
+                    state->letterSdf,
+                    state->modifierSdf,
+                    font.letterSize,
+                    font.modifierSize,
+                    premultiply_color(state->applied.textColor));
 
-    f32 combo_x = BOX_PADDING + start_x;
+    state->isAtlasStale = false;
+}
 
-    for (i32 idx = pressCount - 1; idx >= 0; --idx) {
-        auto &press    = keypresses[idx];
-        auto &ltr      = press.ltrDim;
-        auto &mod      = press.modDim;
-        auto  offset_y = (ltr.Height - (3.0f * mod.Height) - 2.0f) / 2.0f;
-        auto  offset_x = mod.Width > 0 ? mod.Width + MOD_LETTER_SPACING : 0.0f;
+/*
+ * Bring the label measurements, glyph atlas and combo layout up to date
+ * with the font and combo stack.  Most frames find nothing to do here.
+ */
+void update_combo_layout(AppState *state)
+{
+    if (!state->hasMeasurements || !is_same_font(state->font, state->measuredFont)) {
+        update_sdf_fonts(state);
+        measure_labels(state);
+        build_glyph_atlas(state);
+    }
+    else if (state->isAtlasStale) {
+        build_glyph_atlas(state);
+    }
 
-        mod.Y = BOX_PADDING + offset_y + start_y;
-        ltr.Y = BOX_PADDING + start_y;
-        mod.X = combo_x;
-        ltr.X = mod.X + offset_x;
+    if (state->isLayoutStale || state->layoutGeneration != state->combos.generation) {
+        layout_combos(&state->combos, state->labels, &state->layout);
+        state->layoutGeneration = state->combos.generation;
+        state->isLayoutStale    = false;
+    }
+}
 
-        combo_x += COMBO_SPACING + ltr.Width + offset_x;
+/*
+ * Draw the combo box and its sprites into the pixels of a surface with
+ * the renderer the config picks, with the alpha applied to both.  The
+ * software renderer composites straight into the pixels and uses no
+ * GDI+ at all.  If GDI+ can't be started or can't draw, the frame is
+ * composited in software instead.
+ */
+void draw_keypresses(AppState *state, Surface *surface, Placement const &placement, Config const &config, u8 alpha = 255)
+{
+    if (state->combos.is_empty())
+        return;
 
-        graphics->DrawString(press.key, -1, &letter, ltr, &format, &white);
-        graphics->DrawString(press.ctrl, -1, &modifier, mod, &format, &white);
+    update_combo_layout(state);
 
-        mod.Y += mod.Height;
-        graphics->DrawString(press.alt, -1, &modifier, mod, &format, &white);
+    if (config.renderer == StripBackend_Gdiplus) {
+        if (start_gdiplus(state) &&
+            draw_gdiplus_strip(&state->gdiplusStrip, surface, state->layout, state->atlas, placement, config.boxColor, alpha))
+            return;
 
-        mod.Y += mod.Height;
-        graphics->DrawString(press.shift, -1, &modifier, mod, &format, &white);
+        log("Failed to draw with GDI+");
     }
+
+    composite_combo_strip(surface, state->layout, state->atlas, placement, premultiply_color(config.boxColor), alpha);
 }
 
-void update_opacity(AppState *state, DWORD currentTime)
+void update_opacity(AppState *state, u64 currentTime)
 {
-    constexpr DWORD milliseconds = 1;
-    auto elapsed  = currentTime - state->timerStartTime;
-    auto interval = currentTime - state->lastTime;
+    auto elapsed = u32((currentTime - state->fadeStartTime) / 1000);
 
-    state->lastTime = currentTime;
+    state->fadeAlpha = fade_alpha(state->fade, elapsed);
+    state->opacity   = state->fadeAlpha / 255.0f;
 
-    if (elapsed >= 300*milliseconds) {
-        f32 fade  = f32(2 * state->fadeOutMilliseconds);
-        f32 delta = interval / fade;
+    // No more frames are scheduled once the box has faded out.
+    state->scheduler.set_animating(state->fadeAlpha > 0);
+}
 
-        state->opacity -= delta;
-        if (state->opacity <= 0.0f) {
-            state->opacity = 0.0f;
-            KillTimer(WINDOW, state->timerID);
-        }
+void free_frame_bitmap(AppState *state)
+{
+    unwrap_gdiplus_target(&state->gdiplusStrip);
+
+    if (state->frameDC)
+        DeleteDC(state->frameDC);
+    if (state->frameBitmap)
+        DeleteObject(state->frameBitmap);
+
+    state->frameDC     = nullptr;
+    state->frameBitmap = nullptr;
+    state->framePixels = nullptr;
+    state->frameWidth  = 0;
+    state->frameHeight = 0;
+}
+
+bool resize_frame_bitmap(AppState *state, HDC screen, i32 width, i32 height)
+{
+    if (state->frameDC && state->frameWidth == width && state->frameHeight == height)
+        return true;
+
+    free_frame_bitmap(state);
+
+    auto info = BITMAPINFO{};
+
+    info.bmiHeader.biSize        = sizeof(info.bmiHeader);
+    info.bmiHeader.biWidth       = width;
+    info.bmiHeader.biHeight      = -height;  // negative for a top-down bitmap
+    info.bmiHeader.biPlanes      = 1;
+    info.bmiHeader.biBitCount    = 32;
+    info.bmiHeader.biCompression = BI_RGB;
+
+    void *pixels = nullptr;
+
+    state->frameDC     = CreateCompatibleDC(screen);
+    state->frameBitmap = CreateDIBSection(screen, &info, DIB_RGB_COLORS, &pixels, nullptr, 0);
+
+    if (!state->frameDC || !state->frameBitmap) {
+        log("Failed to create frame bitmap");
+        free_frame_bitmap(state);
+        return false;
     }
+
+    SelectObject(state->frameDC, state->frameBitmap);
+    state->framePixels       = (u32 *)pixels;
+    state->frameWidth        = width;
+    state->frameHeight       = height;
+    state->isWholeFrameStale = true;
+
+    return true;
+}
+
+f32 microseconds_since(LARGE_INTEGER start)
+{
+    static LARGE_INTEGER frequency;
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+
+    auto now = LARGE_INTEGER{};
+    QueryPerformanceCounter(&now);
+
+    return f32(f64(now.QuadPart - start.QuadPart) * 1000000.0 / f64(frequency.QuadPart));
 }
 
 void render(HWND hwnd)
 {
-    constexpr i32 OFFSET_X = 20;
-    constexpr i32 OFFSET_Y = 15;
+    auto state  = (AppState *)GetWindowLongPtr(hwnd, GWLP_USERDATA);
+    auto config = CONFIG.read();
 
-    auto state = (AppState *)GetWindowLongPtr(hwnd, GWLP_USERDATA);
+    auto gdiObjects = GetGuiResources(GetCurrentProcess(), GR_GDIOBJECTS);
+
+    state->frameStats = FrameStats{};
+    state->recorder.render_started(u32(CLOCK.now_microseconds()));
+
+    update_opacity(state, CLOCK.now_microseconds());
 
     if (state->hideWindow) {
         auto wndDim = RECT{};
@@ -324,49 +534,97 @@ void render(HWND hwnd)
 
         place.width         = wndDim.right - wndDim.left;
         place.height        = wndDim.bottom - wndDim.top;
-        place.offset_x      = OFFSET_X;
-        place.offset_y      = OFFSET_Y;
-        place.justification = Justification_Center;
+        place.offset_x      = config->offset_x;
+        place.offset_y      = config->offset_y;
+        place.justification = config->justification;
 
-        auto screen  = GetDC(nullptr);
-        auto hdc     = CreateCompatibleDC(screen);
-        auto bmap    = CreateCompatibleBitmap(screen, place.width, place.height);
+        auto blend = BLENDFUNCTION{};
 
-        defer(DeleteObject(bmap));
-        defer(DeleteDC(hdc));
-        defer(ReleaseDC(hwnd, screen));
+        blend.BlendOp             = AC_SRC_OVER;
+        blend.BlendFlags          = 0;
+        blend.AlphaFormat         = AC_SRC_ALPHA;
+        blend.SourceConstantAlpha = state->fadeAlpha;
 
-        SelectObject(hdc, bmap);
+        auto isFrameStale = (state->isFrameStale ||
+                             state->presentedGeneration != state->combos.generation ||
+                             state->frameWidth != place.width ||
+                             state->frameHeight != place.height);
 
-        gp::Graphics graphics(hdc);
+        if (!isFrameStale) {
+            // Nothing but the opacity has changed, so the bitmap the
+            // window already has is presented again with the new alpha.
+            UpdateLayeredWindow(hwnd, nullptr, nullptr, nullptr, nullptr, nullptr, 0, &blend, ULW_ALPHA);
+        }
+        else {
+            auto setupStart = LARGE_INTEGER{};
+            QueryPerformanceCounter(&setupStart);
 
-#if DEBUG
-        gp::Pen blackPen(gp::Color(255, 0, 0, 0), 5);
-        graphics.DrawRectangle(&blackPen, 0, 0, i32(place.width), i32(place.height));
-#endif
+            auto screen = GetDC(nullptr);
+            defer(ReleaseDC(nullptr, screen));
 
-        update_opacity(state, GetTickCount());
-        draw_keypresses(hwnd, &graphics, state->opacity, place);
+            if (!resize_frame_bitmap(state, screen, place.width, place.height))
+                return;
 
-        auto dstPt = POINT{wndDim.left, wndDim.top};
-        auto srcPt = POINT{0, 0};
-        auto wndSz = SIZE{place.width, place.height};
-        auto blend = BLENDFUNCTION{};
+            // Only the strip as it was and as it is now have to be
+            // cleared, drawn and handed to the compositor.  Everything
+            // else in the bitmap is already transparent.
+            auto whole  = PixelRect{ 0, 0, place.width, place.height };
+            auto bounds = PixelRect{};
 
-        blend.BlendOp             = AC_SRC_OVER;
-        blend.BlendFlags          = 0;
-        blend.AlphaFormat         = AC_SRC_ALPHA;
-        blend.SourceConstantAlpha = 255;
-
-        UpdateLayeredWindow(hwnd,
-                            screen,
-                            &dstPt,
-                            &wndSz,
-                            hdc,
-                            &srcPt,
-                            RGB(0, 0, 0),
-                            &blend,
-                            ULW_ALPHA);
+            if (!state->combos.is_empty()) {
+                update_combo_layout(state);
+                bounds = combo_strip_bounds(state->layout, state->atlas, place);
+            }
+
+            auto dirty = state->isWholeFrameStale ? whole : union_rects(bounds, state->presentedBounds);
+
+            // GDI may still be batching work against the DIB section
+            // so it has to be flushed before the pixels are touched.
+            GdiFlush();
+
+            auto surface = Surface{ state->framePixels, place.width, place.height, place.width };
+            clear_rect(&surface, dirty.x0, dirty.y0, dirty.x1 - dirty.x0, dirty.y1 - dirty.y0);
+
+            state->frameStats.setupMicroseconds = microseconds_since(setupStart);
+
+#if DEBUG
+            fill_rounded_rect(&surface, 0, 0, place.width, 3, 0.0f, 0xFF000000);
+            fill_rounded_rect(&surface, 0, place.height - 3, place.width, 3, 0.0f, 0xFF000000);
+            fill_rounded_rect(&surface, 0, 0, 3, place.height, 0.0f, 0xFF000000);
+            fill_rounded_rect(&surface, place.width - 3, 0, 3, place.height, 0.0f, 0xFF000000);
+#endif
+
+            draw_keypresses(state, &surface, place, *config);
+
+            auto dstPt   = POINT{wndDim.left, wndDim.top};
+            auto srcPt   = POINT{0, 0};
+            auto wndSz   = SIZE{place.width, place.height};
+            auto dirtyRc = RECT{dirty.x0, dirty.y0, dirty.x1, dirty.y1};
+            auto update  = UPDATELAYEREDWINDOWINFO{};
+
+            update.cbSize   = sizeof(update);
+            update.hdcDst   = screen;
+            update.pptDst   = &dstPt;
+            update.psize    = &wndSz;
+            update.hdcSrc   = state->frameDC;
+            update.pptSrc   = &srcPt;
+            update.crKey    = RGB(0, 0, 0);
+            update.pblend   = &blend;
+            update.dwFlags  = ULW_ALPHA;
+            update.prcDirty = &dirtyRc;
+
+            if (!dirty.is_empty())
+                UpdateLayeredWindowIndirect(hwnd, &update);
+            else
+                UpdateLayeredWindow(hwnd, nullptr, nullptr, nullptr, nullptr, nullptr, 0, &blend, ULW_ALPHA);
+
+            state->frameStats.presentedBytes = dirty.area() * sizeof(u32);
+
+            state->presentedGeneration = state->combos.generation;
+            state->presentedBounds     = bounds;
+            state->isFrameStale        = false;
+            state->isWholeFrameStale   = false;
+        }
     }
     else {
         auto rect  = RECT{};
@@ -379,20 +637,30 @@ void render(HWND hwnd)
 
         place.width         = rect.right - rect.left - 1;
         place.height        = rect.bottom - rect.top - 1;
-        place.offset_x      = OFFSET_X;
-        place.offset_y      = OFFSET_Y;
-        place.justification = Justification_Center;
+        place.offset_x      = config->offset_x;
+        place.offset_y      = config->offset_y;
+        place.justification = config->justification;
 
-        gp::Graphics   graphics(hdc);
-        gp::SolidBrush white(gp::Color(255, 255, 255, 255));
-        gp::SolidBrush magenta(gp::Color(255, 255, 0, 255));
+        // The preview is drawn into the frame bitmap and copied to the
+        // window in one go, which means that bitmap no longer holds the
+        // display mode frame.
+        if (place.width <= 0 || place.height <= 0 || !resize_frame_bitmap(state, hdc, place.width + 1, place.height + 1))
+            return;
 
-        auto top    = f32(place.height) * 0.2;
-        auto bottom = f32(place.height) * 0.8;
+        state->isFrameStale      = true;
+        state->isWholeFrameStale = true;
+
+        auto width   = place.width + 1;
+        auto height  = place.height + 1;
+        auto top     = i32(f32(place.height) * 0.2f);
+        auto surface = Surface{ state->framePixels, width, height, width };
 
         SetLayeredWindowAttributes(hwnd, RGB(255, 0, 255), 255, LWA_COLORKEY);
-        graphics.FillRectangle(&white, 0, 0, place.width, top);
-        graphics.FillRectangle(&magenta, 0, top, place.width + 1, bottom + 1);
+
+        // Everything under the white title is the color key.
+        GdiFlush();
+        fill_rounded_rect(&surface, 0, 0, width, top, 0.0f, 0xFFFFFFFF);
+        fill_rounded_rect(&surface, 0, top, width, height - top, 0.0f, 0xFFFF00FF);
 
         auto textRect = RECT{};
 
@@ -401,124 +669,518 @@ void render(HWND hwnd)
         textRect.right  = LONG(place.width);
         textRect.bottom = LONG(top);
 
-        DrawTextEx(hdc,
+        DrawTextEx(state->frameDC,
                    "Preview Mode:  Press CTRL + ALT + SHIFT + F6 to toggle window.",
                    -1,
                    &textRect,
                    DT_SINGLELINE|DT_VCENTER|DT_LEFT|DT_WORD_ELLIPSIS,
                    nullptr);
+        GdiFlush();
+
+        draw_keypresses(state, &surface, place, *config, state->fadeAlpha);
+
+        BitBlt(hdc, 0, 0, width, height, state->frameDC, 0, 0, SRCCOPY);
+    }
+
+    state->recorder.frame_presented(u32(CLOCK.now_microseconds()), state->fadeAlpha, state->frameStats.presentedBytes);
+
+    if (!state->hasPresented) {
+        METRICS->startupMicroseconds.store(u32(CLOCK.now_microseconds() - state->startTime), std::memory_order_relaxed);
+        state->hasPresented = true;
+    }
 
-        draw_keypresses(hwnd, &graphics, state->opacity, place);
+    if (state->opacity == 0.0f) {
+        state->combos.reset_combos();
+        state->chords.reset();
     }
 
-    if (state->opacity == 0.0f)
-        state->reset_combos();
+    auto &stats = state->frameStats;
+
+    stats.gdiObjects        = GetGuiResources(GetCurrentProcess(), GR_GDIOBJECTS);
+    stats.gdiObjectsCreated = i32(stats.gdiObjects) - i32(gdiObjects);
+
+#if defined(DEBUG)
+    printf("frame: %u measure calls, %u gdi objects (%+d), %.1f us setup, %u bytes presented\n",
+           stats.measureCalls,
+           stats.gdiObjects,
+           stats.gdiObjectsCreated,
+           stats.setupMicroseconds,
+           stats.presentedBytes);
+#endif
 }
 
-VOID CALLBACK fade_out(HWND hwnd, UINT, UINT_PTR, DWORD dwTime)
+/*
+ * Draw the frame the scheduler has due.  Display mode presents straight
+ * from here, while preview mode paints in WM_PAINT so the window is
+ * invalidated and painted before this returns.
+ */
+void present_frame(AppState *state)
 {
-    auto state = (AppState *)GetWindowLongPtr(hwnd, GWLP_USERDATA);
-    auto flags = RDW_ERASE|RDW_INVALIDATE|RDW_FRAME|RDW_ALLCHILDREN;
+    if (state->hideWindow)
+        render(WINDOW);
+    else
+        RedrawWindow(WINDOW, nullptr, nullptr, RDW_ERASE|RDW_INVALIDATE|RDW_FRAME|RDW_ALLCHILDREN|RDW_UPDATENOW);
+}
 
-    /*
-     * When the window is set to WS_EX_LAYERED mode, that is everything
-     * but the key presses will be transparent, then this callback
-     * passed to SetTimer will never be called.  In fact, the WM_TIMER
-     * message is never passed to the window procedure either.  Instead,
-     * Windows appears to put the window on an separate animation loop
-     * when the WS_EX_LAYERED is set, which may explain why the documentation
-     * states that the window should be as small as possible when this
-     * is the case for system performance reasons.  Due to this, we have
-     * hoist out the opacity manipulation into a separate function so it
-     * can be also called when the window is being rendered while the
-     * app is set to transparent/hidden mode.
-     */
-    update_opacity(state, dwTime);
-    RedrawWindow(hwnd, nullptr, nullptr, flags);
+/*
+ * Frames are paced to the refresh rate of the monitor the window is on.
+ */
+void update_refresh_interval(AppState *state, HWND hwnd)
+{
+    auto monitor = MonitorFromWindow(hwnd, MONITOR_DEFAULTTONEAREST);
+    auto info    = MONITORINFOEX{};
+    auto mode    = DEVMODE{};
+    u32  hertz   = 60;
+
+    info.cbSize = sizeof(info);
+    mode.dmSize = sizeof(mode);
+
+    // A frequency of 0 or 1 means the hardware default, which is unknown.
+    if (GetMonitorInfo(monitor, &info) &&
+        EnumDisplaySettings(info.szDevice, ENUM_CURRENT_SETTINGS, &mode) &&
+        mode.dmDisplayFrequency > 1) {
+        hertz = mode.dmDisplayFrequency;
+    }
+
+    state->scheduler.frameInterval = 1000000 / hertz;
+    MOUSE_WHEEL_WINDOW.store(u32(state->scheduler.frameInterval), std::memory_order_relaxed);
 }
 
-LRESULT CALLBACK keyboard_hook(int code, WPARAM wParam, LPARAM lParam)
+/*
+ * Write the typing statistics over whatever the stats hotkey wrote last
+ * time.  It is only pressed now and then, so writing from the UI thread
+ * holds up at most one frame.
+ */
+void write_stats_file(AppState *state, u32 time)
 {
-    auto state = (AppState *)GetWindowLongPtr(WINDOW, GWLP_USERDATA);
-    
-    if (code >= 0) {
-        bool doRedraw = false;
-        
-        switch (wParam) {
-        case WM_KEYDOWN: {
-            auto kb = (KBDLLHOOKSTRUCT *)lParam;
-            state->set_key(kb->vkCode, true);
-        } break;
-
-        case WM_KEYUP: {
-            auto kb = (KBDLLHOOKSTRUCT *)lParam;
-            auto vk = kb->vkCode;
-
-            state->set_key(vk, false);
-            doRedraw = true;
-
-            auto toggleWindow = (vk == VK_F6 &&
-                                 state->possibleCombo.isShiftDown &&
-                                 state->possibleCombo.isCtrlDown &&
-                                 state->possibleCombo.isAltDown);
-
-            if (toggleWindow) {
-                /*
-                 * MSDN documentation on layered windows state that when switching
-                 * between UpdateLayeredWindow and SetLayeredWindowAttributes, which
-                 * occurs when we hide or show the window, that the WS_EX_LAYERED
-                 * attribute must be reset.
-                 */
-                auto current = GetWindowLong(WINDOW, GWL_EXSTYLE);
-                auto cleared = current & ~WS_EX_LAYERED;
-
-                state->hideWindow = !state->hideWindow;
-                SetWindowLong(WINDOW, GWL_EXSTYLE, cleared);
-                SetWindowLong(WINDOW, GWL_EXSTYLE, cleared | WS_EX_LAYERED);
-            }
-        } break;
+    if (!state->stats)
+        return;
 
+    auto out = fopen(state->statsPath, "w");
+    if (!out) {
+        log("Failed to write the stats file");
+        return;
+    }
+
+    print_typing_stats(out, *state->stats, time);
+    fclose(out);
+}
+
+/**
+ * Apply a single key event from the hook thread to the app state.
+ *
+ * The ALT key turns the key messages into WM_SYSKEYDOWN/WM_SYSKEYUP and,
+ * while it is held, changes which of those the shift and control keys
+ * send.  The hook flags say whether a key went down or up regardless of
+ * the message so none of that matters here.
+ *
+ * @return True if the key press should cause the window to redraw.
+ */
+bool process_key_event(AppState *state, KeyEvent const &event)
+{
+    auto isDown  = (event.flags & KEY_FLAG_UP) == 0;
+    auto isCombo = state->combos.set_key(event);
+    auto combo   = state->combos.lastCombo;
+    auto chord   = isCombo ? state->chords.step(&state->combos) : nullptr;
+
+    if (isCombo) {
+        broadcast_combo(&state->broadcast, combo);
+        if (chord && chord->label)
+            broadcast_combo(&state->broadcast, state->combos.lastCombo, chord->stepCount);
+    }
+
+    if (isCombo && state->stats) {
+        state->stats->add(combo);
+        if (chord && chord->label)
+            state->stats->add_chord(chord->label);
+    }
+
+    state->recorder.event_processed(event,
+                                    u32(CLOCK.now_microseconds()),
+                                    isCombo,
+                                    state->combos.overwrittenCombos);
+
+    if (isDown)
+        return false;
+
+    state->recorder.frame_requested(event.stamp);
+    append_key_log(&state->keyLog, event.time, isCombo ? &combo : nullptr);
+
+    if (chord && chord->action == ChordAction_ToggleDisplay) {
         /*
-         * The ALT key is treated differently as a system key.  So you have to
-         * listen to this message, along with any of its letter combinations to see
-         * that you have hit ALT + H or something similiar.  Furthermore, to make
-         * matters worse, the contol and shift keys send different messages when
-         * the ALT key is held down.  The shift key is only recognized as SYSKEYDOWN
-         * while control is still a regular KEYDOWN when ALT is held and both shift
-         * and control are recognized as SYSKEYUP if they are released before releasing
-         * the ALT key.
+         * MSDN documentation on layered windows state that when switching
+         * between UpdateLayeredWindow and SetLayeredWindowAttributes, which
+         * occurs when we hide or show the window, that the WS_EX_LAYERED
+         * attribute must be reset.
          */
-        case WM_SYSKEYDOWN: {
-            auto kb = (KBDLLHOOKSTRUCT *)lParam;
-            state->set_key(kb->vkCode, true);
-        } break;
+        auto current = GetWindowLong(WINDOW, GWL_EXSTYLE);
+        auto cleared = current & ~WS_EX_LAYERED;
+
+        state->hideWindow        = !state->hideWindow;
+        state->isFrameStale      = true;
+        state->isWholeFrameStale = true;
+        SetWindowLong(WINDOW, GWL_EXSTYLE, cleared);
+        SetWindowLong(WINDOW, GWL_EXSTYLE, cleared | WS_EX_LAYERED);
+    }
 
-        case WM_SYSKEYUP: {
-            auto kb = (KBDLLHOOKSTRUCT *)lParam;
-            state->set_key(kb->vkCode, false);
-            doRedraw = true;
-        } break;
+    if (chord && chord->action == ChordAction_WriteStats)
+        write_stats_file(state, event.time);
 
-        } // end switch
+    return true;
+}
 
-        if (doRedraw) {
-            constexpr UINT milliseconds = 1;
+/*
+ * Drain everything the hook thread has queued up in batches and ask for
+ * a frame.  However many batches arrive before the next display refresh
+ * they are drawn in one frame.
+ */
+void process_key_events(AppState *state)
+{
+    // Clear the flag before draining so that an event pushed after the
+    // queue is found empty always posts a new wake up message.
+    KEY_EVENTS_POSTED.store(false);
+
+    // Labels come from the foreground window's keyboard layout.  It is
+    // checked once per batch so the per-key work stays a table lookup.
+    if (update_key_layout(&state->keyLayouts))
+        state->hasMeasurements = false;
+
+    KeyEvent batch[KEY_EVENT_BATCH];
+    bool     doRedraw = false;
+    u32      count;
+
+    while ((count = KEY_EVENTS.pop_batch(batch, KEY_EVENT_BATCH)) > 0) {
+        for (u32 idx = 0; idx < count; ++idx)
+            doRedraw |= process_key_event(state, batch[idx]);
+    }
+
+#if defined(DEBUG)
+    static u32 reportedDrops;
+    auto dropped = METRICS->droppedEvents.load(std::memory_order_relaxed);
+    if (dropped != reportedDrops) {
+        printf("dropped %u key events\n", dropped - reportedDrops);
+        reportedDrops = dropped;
+    }
+#endif
 
-            state->opacity        = 1.0f;
-            state->timerStartTime = GetTickCount();
-            state->lastTime       = state->timerStartTime;
+    if (doRedraw) {
+        state->opacity       = 1.0f;
+        state->fadeAlpha     = 255;
+        state->fadeStartTime = CLOCK.now_microseconds();
 
-            if (!SetTimer(WINDOW, state->timerID, 17*milliseconds, fade_out))
-                log("failed to create window timer");
+        state->scheduler.request_frame();
+        state->scheduler.set_animating(true);
+    }
+}
+
+/*
+ * Runs on the hook thread.  Windows will silently remove a low level
+ * hook that takes longer than LowLevelHooksTimeout to return, and every
+ * key press on the system waits on it, so the hook only stamps the
+ * event into the queue and wakes the UI thread if it isn't already
+ * awake.
+ */
+void queue_key_event(KeyEvent const &event)
+{
+    bump(&METRICS->events);
+    METRICS->latency[MetricStage_Hook].add((GetTickCount() - event.time) * 1000);
 
-            auto flags = RDW_ERASE|RDW_INVALIDATE|RDW_FRAME|RDW_ALLCHILDREN;
-            RedrawWindow(WINDOW, nullptr, nullptr, flags);
+    if (!KEY_EVENTS.push(event))
+        bump(&METRICS->droppedEvents);
+    else if (!KEY_EVENTS_POSTED.exchange(true))
+        PostMessage(WINDOW, WM_APP_KEY_EVENTS, 0, 0);
+}
+
+LRESULT CALLBACK keyboard_hook(int code, WPARAM wParam, LPARAM lParam)
+{
+    if (code >= 0) {
+        auto kb = (KBDLLHOOKSTRUCT *)lParam;
+        queue_key_event(KeyEvent{ kb->vkCode, kb->flags, kb->time, u32(CLOCK.now_microseconds()) });
+    }
+
+    return CallNextHookEx(nullptr, code, wParam, lParam);
+}
+
+/*
+ * Runs on the hook thread like the keyboard hook, but for a mouse that
+ * may report thousands of times a second, so everything the strip
+ * doesn't show is filtered out here and never reaches the queue.
+ */
+LRESULT CALLBACK mouse_hook(int code, WPARAM wParam, LPARAM lParam)
+{
+    if (code >= 0) {
+        auto ms    = (MSLLHOOKSTRUCT *)lParam;
+        auto input = MouseInput{ MouseAction_Move, 0, 0, ms->time, 0 };
+
+        switch (wParam) {
+        case WM_LBUTTONDOWN: input.action = MouseAction_ButtonDown; input.vk_key = VK_LBUTTON; break;
+        case WM_LBUTTONUP:   input.action = MouseAction_ButtonUp;   input.vk_key = VK_LBUTTON; break;
+        case WM_RBUTTONDOWN: input.action = MouseAction_ButtonDown; input.vk_key = VK_RBUTTON; break;
+        case WM_RBUTTONUP:   input.action = MouseAction_ButtonUp;   input.vk_key = VK_RBUTTON; break;
+        case WM_MBUTTONDOWN: input.action = MouseAction_ButtonDown; input.vk_key = VK_MBUTTON; break;
+        case WM_MBUTTONUP:   input.action = MouseAction_ButtonUp;   input.vk_key = VK_MBUTTON; break;
+
+        case WM_XBUTTONDOWN:
+        case WM_XBUTTONUP:
+            input.action = wParam == WM_XBUTTONDOWN ? MouseAction_ButtonDown : MouseAction_ButtonUp;
+            input.vk_key = HIWORD(ms->mouseData) == XBUTTON1 ? VK_XBUTTON1 : VK_XBUTTON2;
+            break;
+
+        case WM_MOUSEWHEEL:
+        case WM_MOUSEHWHEEL:
+            input.action = wParam == WM_MOUSEWHEEL ? MouseAction_Wheel : MouseAction_HWheel;
+            input.delta  = i16(HIWORD(ms->mouseData));
+            break;
         }
+
+        // Moves don't need the clock read at all, nor the frame.
+        if (input.action != MouseAction_Move) {
+            input.stamp              = u32(CLOCK.now_microseconds());
+            MOUSE_FILTER.wheelWindow = MOUSE_WHEEL_WINDOW.load(std::memory_order_relaxed);
+        }
+
+        auto event = KeyEvent{};
+        if (MOUSE_FILTER.filter(input, &event))
+            queue_key_event(event);
+        else
+            bump(&METRICS->filteredMouseInputs);
     }
 
     return CallNextHookEx(nullptr, code, wParam, lParam);
 }
 
+/*
+ * Install or remove the mouse hook to match MOUSE_HOOK_WANTED.  Hook
+ * thread only.
+ */
+void sync_mouse_hook(AppState *state, HHOOK *hook)
+{
+    auto isWanted = MOUSE_HOOK_WANTED.load();
+
+    if (isWanted && !*hook) {
+        MOUSE_FILTER = MouseFilter{};
+        MOUSE_FILTER.wheelWindow = MOUSE_WHEEL_WINDOW.load(std::memory_order_relaxed);
+
+        *hook = SetWindowsHookEx(WH_MOUSE_LL, &mouse_hook, state->hInstance, 0);
+        if (*hook == nullptr)
+            log("Failed to set mouse hook");
+    }
+    else if (!isWanted && *hook) {
+        UnhookWindowsHookEx(*hook);
+        *hook = nullptr;
+    }
+}
+
+/*
+ * The low level hook is called on the thread that installed it, which
+ * needs its own message loop for that to happen.  The thread is given
+ * a high priority so key delivery for the whole system is never held
+ * up behind the overlay's painting.
+ */
+DWORD WINAPI hook_thread(LPVOID param)
+{
+    auto state = (AppState *)param;
+
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+
+    auto hook = SetWindowsHookEx(WH_KEYBOARD_LL, &keyboard_hook, state->hInstance, 0);
+    if (hook == nullptr) {
+        log("Failed to set keyboard hook");
+        return 1;
+    }
+    defer(UnhookWindowsHookEx(hook));
+
+    // The thread has a message queue now, so a change the UI thread
+    // makes after this is always followed by a WM_APP_MOUSE_HOOK.
+    HHOOK mouseHook = nullptr;
+    sync_mouse_hook(state, &mouseHook);
+    defer(if (mouseHook) UnhookWindowsHookEx(mouseHook));
+
+    auto msg = MSG{};
+    while (GetMessage(&msg, nullptr, 0, 0) > 0) {
+        if (msg.message == WM_APP_MOUSE_HOOK) {
+            sync_mouse_hook(state, &mouseHook);
+            continue;
+        }
+
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+    }
+
+    return 0;
+}
+
+/*
+ * The label font is the config's scaled to the window's DPI.  Anything
+ * built from the font catches up on the next frame.
+ */
+void update_font(AppState *state)
+{
+    auto &config = state->applied;
+    auto &font   = state->font;
+
+    wcscpy(font.family, config.fontFamily);
+    font.letterSize   = config.letterSize * state->dpiScale;
+    font.modifierSize = config.modifierSize * state->dpiScale;
+}
+
+/*
+ * Bring everything derived from the config up to date with the current
+ * snapshot, rebuilding only what depends on settings that changed.
+ * Placement and the box color are read straight from the snapshot
+ * when a frame is drawn, so they only need the frame redrawn.
+ */
+void apply_config(AppState *state)
+{
+    auto  config  = CONFIG.read();
+    auto &applied = state->applied;
+
+    auto isNewFade = (config->fade.holdMilliseconds != applied.fade.holdMilliseconds ||
+                      config->fade.fadeOutMilliseconds != applied.fade.fadeOutMilliseconds ||
+                      config->fade.curve != applied.fade.curve);
+
+    if (isNewFade)
+        build_fade_table(&state->fade, config->fade);
+
+    if (config->maxCombos != applied.maxCombos)
+        state->combos.set_max_combos(config->maxCombos);
+
+    if (config->textColor != applied.textColor)
+        state->isAtlasStale = true;
+
+    if (config->renderer != applied.renderer)
+        state->isWholeFrameStale = true;
+
+    // Combos on the strip refer to labels of the old table, so they go
+    // with it.
+    if (!state->chordTable.next || !is_same_chords(*config, applied)) {
+        if (!compile_config_chords(*config, &state->chordTable))
+            log("Failed to compile chords");
+
+        set_chord_table(&state->chordTable);
+        state->chords       = ChordRecognizer{};
+        state->chords.table = &state->chordTable;
+        state->combos.reset_combos();
+        state->hasMeasurements = false;
+    }
+
+    if (config->showMouse != MOUSE_HOOK_WANTED.load()) {
+        MOUSE_HOOK_WANTED.store(config->showMouse);
+        if (state->hookThread)
+            PostThreadMessage(state->hookThreadID, WM_APP_MOUSE_HOOK, 0, 0);
+    }
+
+    applied = *config;
+    update_font(state);
+
+    state->isFrameStale = true;
+    state->scheduler.request_frame();
+}
+
+/**
+ * Read and parse a config file on top of a base config.
+ *
+ * @return A new snapshot to publish, or null if the file can't be read
+ * or has a mistake in it.
+ */
+Config *load_config_file(char const *path, Config const &base)
+{
+    constexpr u32 MAX_CONFIG_BYTES = 16 * 1024;
+
+    auto file = fopen(path, "rb");
+    if (!file)
+        return nullptr;
+
+    char text[MAX_CONFIG_BYTES];
+    auto length = fread(text, 1, sizeof(text), file);
+    fclose(file);
+
+    auto config = (Config *)malloc(sizeof(Config));
+    auto error  = ConfigError{};
+
+    *config = base;
+    if (!parse_config(text, length, config, &error)) {
+#if defined(DEBUG)
+        printf("%s:%u: %s\n", path, error.line, error.message);
+#endif
+        free(config);
+        return nullptr;
+    }
+
+    return config;
+}
+
+inline u64 last_write_time(char const *path)
+{
+    auto data = WIN32_FILE_ATTRIBUTE_DATA{};
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data))
+        return 0;
+
+    return u64(data.ftLastWriteTime.dwHighDateTime) << 32 | data.ftLastWriteTime.dwLowDateTime;
+}
+
+/*
+ * Runs on the config thread.  The directory of the config file is
+ * watched, but editors save in several steps and other files in the
+ * directory change too, so the file's write time decides whether it's
+ * read again.  The write time is also checked on a timer, which covers
+ * directories that can't be watched and a save that was still going
+ * on when the file was read.  Parsing happens here and only a good
+ * config is published.
+ */
+DWORD WINAPI config_thread(LPVOID param)
+{
+    auto state = (AppState *)param;
+
+    char directory[MAX_PATH];
+    strcpy(directory, state->configPath);
+
+    auto slash = strrchr(directory, '\\');
+    if (slash)
+        *slash = 0;
+    else
+        strcpy(directory, ".");
+
+    auto change  = FindFirstChangeNotificationA(directory, FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE|FILE_NOTIFY_CHANGE_FILE_NAME);
+    auto loaded  = last_write_time(state->configPath);
+    auto release = [](Config const *config) { free((void *)config); };
+
+    HANDLE handles[] = { state->configStop, change };
+    auto   count     = change == INVALID_HANDLE_VALUE ? 1u : 2u;
+
+    for (;;) {
+        auto woke = WaitForMultipleObjects(count, handles, FALSE, CONFIG_POLL_MILLISECONDS);
+
+        if (woke == WAIT_OBJECT_0)
+            break;
+        if (woke == WAIT_OBJECT_0 + 1)
+            FindNextChangeNotification(change);
+
+        CONFIG.reclaim(release);
+
+        auto written = last_write_time(state->configPath);
+        if (written == 0 || written == loaded)
+            continue;
+
+        auto config = load_config_file(state->configPath, state->baseConfig);
+        if (!config)
+            continue;
+
+        if (!CONFIG.publish(config, release)) {
+            free(config);
+            continue;
+        }
+
+        loaded = written;
+        PostMessage(WINDOW, WM_APP_CONFIG, 0, 0);
+    }
+
+    if (change != INVALID_HANDLE_VALUE)
+        FindCloseChangeNotification(change);
+
+    return 0;
+}
+
 LRESULT CALLBACK win_proc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
     auto state = (AppState *)GetWindowLongPtr(hwnd, GWLP_USERDATA);
@@ -531,12 +1193,13 @@ LRESULT CALLBACK win_proc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         state = (AppState *)data->lpCreateParams;
         SetWindowLongPtr(hwnd, GWLP_USERDATA, LONG_PTR(state));
 
-        state->kb_hook = SetWindowsHookEx(WH_KEYBOARD_LL,
-                                          &keyboard_hook,
-                                          state->hInstance,
-                                          0);
-        if (state->kb_hook == nullptr)
-            log("Failed to set keyboard hook");
+        // The hook thread posts to WINDOW as soon as it sees a key, so
+        // it has to be valid before the thread starts.
+        WINDOW = hwnd;
+
+        state->hookThread = CreateThread(nullptr, 0, &hook_thread, state, 0, &state->hookThreadID);
+        if (state->hookThread == nullptr)
+            log("Failed to create hook thread");
 
         return 0;
     } break;
@@ -545,14 +1208,69 @@ LRESULT CALLBACK win_proc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         render(hwnd);
     } break;
 
+    case WM_APP_KEY_EVENTS: {
+        process_key_events(state);
+        return 0;
+    } break;
+
+    case WM_APP_CONFIG: {
+        apply_config(state);
+        return 0;
+    } break;
+
+    case WM_DPICHANGED: {
+        // The back buffer is sized in device pixels so it has to be
+        // reallocated at the new DPI.
+        auto suggested = (RECT *)lParam;
+
+        // Labels are redrawn at the new size from the distance fields
+        // on the next frame.
+        state->dpiScale = f32(HIWORD(wParam)) / 96.0f;
+        update_font(state);
+
+        free_frame_bitmap(state);
+        state->isFrameStale = true;
+        update_refresh_interval(state, hwnd);
+
+        SetWindowPos(hwnd,
+                     nullptr,
+                     suggested->left,
+                     suggested->top,
+                     suggested->right - suggested->left,
+                     suggested->bottom - suggested->top,
+                     SWP_NOZORDER|SWP_NOACTIVATE);
+        return 0;
+    } break;
+
+    case WM_DISPLAYCHANGE: {
+        update_refresh_interval(state, hwnd);
+    } break;
+
     case WM_SYSCOMMAND: {
         if (wParam == SC_KEYMENU)
             return 0;
     } break;
 
     case WM_DESTROY: {
-        if (!UnhookWindowsHookEx(state->kb_hook))
-            log("Failed to unkook keyboard hook");
+        if (state->configThread) {
+            SetEvent(state->configStop);
+            WaitForSingleObject(state->configThread, INFINITE);
+            CloseHandle(state->configThread);
+            CloseHandle(state->configStop);
+        }
+
+        free_glyph_atlas(&state->atlas);
+        free_chord_table(&state->chordTable);
+        free_sdf_font(&state->letterSdf);
+        free_sdf_font(&state->modifierSdf);
+        free_frame_bitmap(state);
+        free_key_layouts(&state->keyLayouts);
+
+        if (state->hookThread) {
+            PostThreadMessage(state->hookThreadID, WM_QUIT, 0, 0);
+            WaitForSingleObject(state->hookThread, INFINITE);
+            CloseHandle(state->hookThread);
+        }
 
         PostQuitMessage(0);
 
@@ -564,7 +1282,137 @@ LRESULT CALLBACK win_proc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
     return DefWindowProc(hwnd, uMsg, wParam, lParam);
 }
 
-int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE, LPSTR, int)
+/**
+ * Move the metrics into the shared memory block.
+ *
+ * @return The mapping, which has to stay open while shoki runs.
+ */
+HANDLE open_shared_metrics()
+{
+    auto mapping = CreateFileMappingA(INVALID_HANDLE_VALUE,
+                                      nullptr,
+                                      PAGE_READWRITE,
+                                      0,
+                                      sizeof(Metrics),
+                                      METRICS_NAME);
+    if (!mapping) {
+        log("Failed to create shared metrics");
+        return nullptr;
+    }
+
+    // Another instance is already publishing under the name.
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        CloseHandle(mapping);
+        return nullptr;
+    }
+
+    auto view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(Metrics));
+    if (!view) {
+        log("Failed to map shared metrics");
+        CloseHandle(mapping);
+        return nullptr;
+    }
+
+    METRICS = (Metrics *)view;
+    return mapping;
+}
+
+/**
+ * Find the value of an option on the command line, such as the 6 in
+ * "--combos 6".  Values with spaces in them can be quoted.
+ *
+ * @return False if the option isn't on the command line.
+ */
+bool get_option(char const *cmdLine, char const *name, char *value, u32 size)
+{
+    auto option = strstr(cmdLine, name);
+    if (!option || size == 0)
+        return false;
+
+    auto at = option + strlen(name);
+    while (*at == ' ')
+        ++at;
+
+    auto end = ' ';
+    if (*at == '"') {
+        end = '"';
+        ++at;
+    }
+
+    u32 length = 0;
+    while (at[length] && at[length] != end && length + 1 < size) {
+        value[length] = at[length];
+        ++length;
+    }
+
+    value[length] = 0;
+    return true;
+}
+
+/**
+ * Read how many key combos to show from a command line such as
+ * "--combos 6".
+ *
+ * @return The number of combos, or fallback if none was given or it is
+ * out of range.
+ */
+u32 parse_combo_count(char const *cmdLine, u32 fallback)
+{
+    char value[16];
+    if (!get_option(cmdLine, "--combos", value, sizeof(value)))
+        return fallback;
+
+    auto count = strtoul(value, nullptr, 10);
+    if (count < 1 || count > MAX_KEY_COMBOS) {
+        log("--combos is out of range");
+        return fallback;
+    }
+
+    return u32(count);
+}
+
+/**
+ * Read the size of key labels in pixels at 96 DPI from a command line
+ * such as "--font-size 32".  Modifiers are a fifth of the size, or as
+ * small as they can be set if that's smaller.
+ */
+void parse_font_size(char const *cmdLine, Config *config)
+{
+    char value[16];
+    if (!get_option(cmdLine, "--font-size", value, sizeof(value)))
+        return;
+
+    auto size = f32(strtod(value, nullptr));
+    if (size < 8.0f || size > 200.0f) {
+        log("--font-size is out of range");
+        return;
+    }
+
+    config->letterSize   = size;
+    config->modifierSize = default_modifier_size(size);
+}
+
+/*
+ * A file is the one given with an option, such as --config, or one
+ * with a fixed name next to the executable, such as shoki.cfg.
+ */
+void find_file_path(char const *cmdLine, char const *option, char const *name, char *path, u32 size)
+{
+    if (get_option(cmdLine, option, path, size))
+        return;
+
+    auto length = GetModuleFileNameA(nullptr, path, size);
+    auto slash  = strrchr(path, '\\');
+
+    if (length == 0 || length >= size || !slash || u32(slash - path) + strlen(name) + 2 > size) {
+        snprintf(path, size, "%s", name);
+        return;
+    }
+
+    strcpy(slash + 1, name);
+}
+
+int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE, LPSTR cmdLine, int)
 {
 #if defined(DEBUG)
     if (!bl::w32::allocate_console())
@@ -573,18 +1421,83 @@ int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE, LPSTR, int)
     
     auto wndClass = WNDCLASSEX{};
     auto state    = AppState{};
-    auto gpInput  = gp::GdiplusStartupInput{};
-    auto gpToken  = ULONG_PTR{};
 
-    gp::GdiplusStartup(&gpToken, &gpInput, nullptr);
-    defer(gp::GdiplusShutdown(gpToken));
+    state.startTime = CLOCK.now_microseconds();
+
+    // Only started if a font has to be rasterized or the config picks
+    // the GDI+ renderer, and shut down after everything else is gone.
+    defer(if (state.gdiplusToken) gp::GdiplusShutdown(state.gdiplusToken));
+    defer(free_gdiplus_strip(&state.gdiplusStrip));
 
     state.hInstance           = hinstance;
     state.opacity             = 1.0f;
-    state.timerID             = 1;
-    state.fadeOutMilliseconds = 200;
-    state.lastTime            = 0;
-    state.set_max_combos(4);
+    state.fadeAlpha           = 255;
+    state.dpiScale            = 1.0f;
+    state.scheduler.clock     = &CLOCK;
+
+    // The command line changes the defaults and the config file changes
+    // the result.  Without a file the base is used as it is.
+    state.baseConfig           = default_config();
+    state.baseConfig.maxCombos = parse_combo_count(cmdLine, state.baseConfig.maxCombos);
+    parse_font_size(cmdLine, &state.baseConfig);
+    find_file_path(cmdLine, "--config", "shoki.cfg", state.configPath, sizeof(state.configPath));
+    find_file_path(cmdLine, "--stats", "shoki-stats.txt", state.statsPath, sizeof(state.statsPath));
+
+    auto config = load_config_file(state.configPath, state.baseConfig);
+    if (!config) {
+        config  = (Config *)malloc(sizeof(Config));
+        *config = state.baseConfig;
+    }
+
+    CONFIG.publish(config, [](Config const *) {});
+    defer(CONFIG.free_all([](Config const *snapshot) { free((void *)snapshot); }));
+
+    state.configReader = CONFIG.add_reader();
+    apply_config(&state);
+
+    // High resolution waitable timers need Windows 10 1803 or later and
+    // older versions round the due time up to the 15.6 ms system tick.
+    state.frameTimer = CreateWaitableTimerEx(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!state.frameTimer)
+        state.frameTimer = CreateWaitableTimerEx(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+    if (!state.frameTimer)
+        log("Failed to create frame timer");
+    defer(if (state.frameTimer) CloseHandle(state.frameTimer));
+
+    // The hook thread starts recording as soon as the window exists.
+    auto metricsMapping = open_shared_metrics();
+    defer(if (metricsMapping) {
+        UnmapViewOfFile(METRICS);
+        CloseHandle(metricsMapping);
+    });
+
+    init_metrics(METRICS);
+    state.recorder.metrics = METRICS;
+
+    if (!open_key_broadcast(&state.broadcast, KEY_BROADCAST_NAME))
+        log("Failed to create the key broadcast");
+    defer(close_key_broadcast(&state.broadcast));
+
+    char recordPath[MAX_PATH];
+    if (get_option(cmdLine, "--record", recordPath, sizeof(recordPath))) {
+        auto style  = KeyLogStyle{ config->offset_x,
+                                   config->offset_y,
+                                   u32(config->justification),
+                                   config->letterSize,
+                                   config->modifierSize,
+                                   config->textColor,
+                                   config->boxColor,
+                                   0 };
+        auto header = make_key_log_header(state.combos.keyCombos.depth, state.fade.config, style);
+
+        if (!open_key_log(&state.keyLog, recordPath, header, GetTickCount()))
+            log("Failed to open key log");
+    }
+    defer(close_key_log(&state.keyLog));
+
+    // Kept off the stack, which the rest of the state already fills.
+    state.stats = (TypingStats *)calloc(1, sizeof(TypingStats));
+    defer(free(state.stats));
 
     wndClass.cbSize        = sizeof(wndClass);
     wndClass.style         = CS_VREDRAW|CS_HREDRAW;
@@ -618,14 +1531,55 @@ int WINAPI WinMain(HINSTANCE hinstance, HINSTANCE, LPSTR, int)
     }
     else WINDOW = hwnd;
  
+    state.configStop   = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    state.configThread = CreateThread(nullptr, 0, &config_thread, &state, 0, nullptr);
+    if (!state.configThread)
+        log("Failed to create config thread");
+
+    update_refresh_interval(&state, hwnd);
     ShowWindow(hwnd, SW_SHOW); 
     render(hwnd);
 
+    /*
+     * Sleep until a message arrives or the frame timer fires for the
+     * frame the scheduler has due.  With nothing due the timer isn't
+     * waited on, so a faded out overlay doesn't wake up again until the
+     * hook thread posts the next key.
+     */
     auto msg = MSG{};
-    while (GetMessage(&msg, nullptr, 0, 0)) {
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
-    }
+    for (;;) {
+        // Nothing read from the config is held from one pass to the next.
+        CONFIG.quiescent(state.configReader);
 
-    return 0;
+        auto wait = state.scheduler.wait_microseconds();
+
+        if (wait > 0) {
+            DWORD handles = 0;
+            DWORD timeout = INFINITE;
+
+            if (wait != NO_FRAME_DUE && state.frameTimer) {
+                auto due = LARGE_INTEGER{};
+                due.QuadPart = -LONGLONG(wait * 10);  // relative, in 100 ns units
+
+                SetWaitableTimer(state.frameTimer, &due, 0, nullptr, nullptr, FALSE);
+                handles = 1;
+            }
+            else if (wait != NO_FRAME_DUE) {
+                timeout = DWORD((wait + 999) / 1000);
+            }
+
+            MsgWaitForMultipleObjectsEx(handles, &state.frameTimer, timeout, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+        }
+
+        while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
+            if (msg.message == WM_QUIT)
+                return 0;
+
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+
+        if (state.scheduler.begin_frame())
+            present_frame(&state);
+    }
 }
@@ -0,0 +1,247 @@
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/*
+ * Pipeline metrics that are cheap enough to leave on all the time.
+ * Everything is a 32-bit counter that only one thread ever writes, so
+ * updates are a relaxed load and store with no locked instructions,
+ * and the whole block can live in memory shared with other processes
+ * that take snapshots of it while shoki runs.
+ *
+ * Latencies go into histograms with fixed power of two buckets.  Bucket
+ * zero counts values of zero and bucket n counts values in
+ * [2^(n-1), 2^n), with the last bucket also counting everything above.
+ */
+
+constexpr u32 METRICS_VERSION   = 4;
+constexpr u32 HISTOGRAM_BUCKETS = 24;  // the last bucket starts at 4.2 s
+
+inline void bump(std::atomic<u32> *counter, u32 amount = 1)
+{
+    counter->store(counter->load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+inline u32 histogram_bucket(u32 value)
+{
+    if (value == 0)
+        return 0;
+
+#if defined(_MSC_VER)
+    unsigned long highest;
+    _BitScanReverse(&highest, value);
+#else
+    u32 highest = 31 - __builtin_clz(value);
+#endif
+
+    return highest + 1 < HISTOGRAM_BUCKETS ? highest + 1 : HISTOGRAM_BUCKETS - 1;
+}
+
+struct Histogram {
+    std::atomic<u32> buckets[HISTOGRAM_BUCKETS];
+    std::atomic<u32> max;
+
+    void add(u32 value) {
+        bump(&buckets[histogram_bucket(value)]);
+
+        if (value > max.load(std::memory_order_relaxed))
+            max.store(value, std::memory_order_relaxed);
+    }
+
+    u32 count() const {
+        u32 total = 0;
+        for (auto &bucket : buckets)
+            total += bucket.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    /**
+     * @return The upper bound of the bucket the percentile falls in, or
+     * the largest value seen if that is lower.
+     */
+    u32 percentile(f64 percentile) const {
+        auto total   = count();
+        auto largest = max.load(std::memory_order_relaxed);
+        if (total == 0)
+            return 0;
+
+        auto rank = u32(percentile / 100.0 * (total - 1) + 0.5) + 1;
+        u32  seen = 0;
+
+        for (u32 idx = 0; idx < HISTOGRAM_BUCKETS - 1; ++idx) {
+            seen += buckets[idx].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                auto bound = idx == 0 ? 0 : (1u << idx) - 1;
+                return bound < largest ? bound : largest;
+            }
+        }
+
+        return largest;
+    }
+};
+
+/*
+ * Latencies are all measured from when the hook saw a key, in
+ * microseconds, except the hook's own which is how long after the key
+ * was stamped by Windows the hook was called.  That stamp only has
+ * millisecond resolution.
+ */
+enum MetricStage {
+    MetricStage_Hook,     // hook entry
+    MetricStage_Combo,    // set_key and add_combo done
+    MetricStage_Render,   // render start for the first frame showing the key
+    MetricStage_Present,  // UpdateLayeredWindow returned for that frame
+    MetricStage_Count
+};
+
+char const *METRIC_STAGE_NAMES[] = { "hook", "combo", "render", "present" };
+
+/*
+ * The layout shared with readers.  Readers should check the version and
+ * size before looking at anything else.
+ */
+struct Metrics {
+    u32 version;
+    u32 size;
+
+    Histogram latency[MetricStage_Count];
+    Histogram framesPerFade;
+    Histogram presentedBytes;  // pixels handed to the compositor per frame
+
+    // Written by the hook thread.
+    std::atomic<u32> events;
+    std::atomic<u32> droppedEvents;
+    std::atomic<u32> filteredMouseInputs;  // moves and merged wheel ticks
+
+    // Written by the UI thread.
+    std::atomic<u32> processedEvents;
+    std::atomic<u32> eventsPerSecond;      // over the last whole second
+    std::atomic<u32> peakEventsPerSecond;
+    std::atomic<u32> combos;
+    std::atomic<u32> overwrittenCombos;
+    std::atomic<u32> frames;
+    std::atomic<u32> fades;
+    std::atomic<u32> startupMicroseconds;    // from WinMain to the first frame on screen
+    std::atomic<u32> labelFontMicroseconds;  // building or unpacking the label fonts, last time
+};
+
+void init_metrics(Metrics *metrics)
+{
+    metrics->version = METRICS_VERSION;
+    metrics->size    = sizeof(Metrics);
+}
+
+/*
+ * The UI thread's side of recording, which keeps the state needed to
+ * turn its events into metrics.  Times are microseconds on the same
+ * wrapping clock as KeyEvent::stamp.
+ */
+struct MetricsRecorder {
+    Metrics *metrics;
+
+    u32  second;         // start of the second being counted
+    u32  secondEvents;
+    u32  fadeFrames;     // frames presented since the box appeared
+    u32  pendingStamp;   // oldest key not shown yet
+    bool hasPending;
+    bool isRendering;    // a frame showing the pending key has started
+
+    void event_processed(KeyEvent const &event, u32 now, bool isCombo, u32 overwrittenCombos) {
+        bump(&metrics->processedEvents);
+        metrics->latency[MetricStage_Combo].add(now - event.stamp);
+
+        if (isCombo)
+            bump(&metrics->combos);
+        metrics->overwrittenCombos.store(overwrittenCombos, std::memory_order_relaxed);
+
+        if (now - second >= 1000000) {
+            // A gap of more than a second means the last second was empty.
+            auto perSecond = now - second < 2000000 ? secondEvents : 0;
+
+            metrics->eventsPerSecond.store(perSecond, std::memory_order_relaxed);
+            if (perSecond > metrics->peakEventsPerSecond.load(std::memory_order_relaxed))
+                metrics->peakEventsPerSecond.store(perSecond, std::memory_order_relaxed);
+
+            second       = now;
+            secondEvents = 0;
+        }
+
+        ++secondEvents;
+    }
+
+    // A key that has to be shown, which waits for the next frame.
+    void frame_requested(u32 stamp) {
+        if (!hasPending) {
+            pendingStamp = stamp;
+            hasPending   = true;
+        }
+    }
+
+    void render_started(u32 now) {
+        if (hasPending && !isRendering) {
+            metrics->latency[MetricStage_Render].add(now - pendingStamp);
+            isRendering = true;
+        }
+    }
+
+    void frame_presented(u32 now, u8 alpha, u32 bytes) {
+        if (isRendering) {
+            metrics->latency[MetricStage_Present].add(now - pendingStamp);
+            hasPending  = false;
+            isRendering = false;
+        }
+
+        bump(&metrics->frames);
+        metrics->presentedBytes.add(bytes);
+
+        // A frame at zero alpha with nothing shown before it isn't a fade.
+        if (alpha > 0 || fadeFrames > 0)
+            ++fadeFrames;
+
+        if (alpha == 0 && fadeFrames > 0) {
+            metrics->framesPerFade.add(fadeFrames);
+            bump(&metrics->fades);
+            fadeFrames = 0;
+        }
+    }
+};
+
+void print_metrics(FILE *out, Metrics const &metrics)
+{
+    fprintf(out, "%-14s %8s %9s %9s %9s %9s %9s  (microseconds, frames or bytes, bucket bounds)\n",
+            "stage", "count", "p50", "p90", "p99", "p99.9", "max");
+
+    auto print_histogram = [&](char const *name, Histogram const &histogram) {
+        fprintf(out, "%-14s %8u %9u %9u %9u %9u %9u\n",
+                name,
+                histogram.count(),
+                histogram.percentile(50.0),
+                histogram.percentile(90.0),
+                histogram.percentile(99.0),
+                histogram.percentile(99.9),
+                histogram.max.load(std::memory_order_relaxed));
+    };
+
+    for (u32 stage = 0; stage < MetricStage_Count; ++stage)
+        print_histogram(METRIC_STAGE_NAMES[stage], metrics.latency[stage]);
+    print_histogram("frames/fade", metrics.framesPerFade);
+    print_histogram("bytes/frame", metrics.presentedBytes);
+
+    fprintf(out,
+            "events %u (%u dropped, %u processed), %u/s now, %u/s peak, %u mouse inputs filtered\n"
+            "combos %u (%u overwritten), frames %u, fades %u\n"
+            "startup %u us to the first frame, label fonts %u us\n",
+            metrics.events.load(std::memory_order_relaxed),
+            metrics.droppedEvents.load(std::memory_order_relaxed),
+            metrics.processedEvents.load(std::memory_order_relaxed),
+            metrics.eventsPerSecond.load(std::memory_order_relaxed),
+            metrics.peakEventsPerSecond.load(std::memory_order_relaxed),
+            metrics.filteredMouseInputs.load(std::memory_order_relaxed),
+            metrics.combos.load(std::memory_order_relaxed),
+            metrics.overwrittenCombos.load(std::memory_order_relaxed),
+            metrics.frames.load(std::memory_order_relaxed),
+            metrics.fades.load(std::memory_order_relaxed),
+            metrics.startupMicroseconds.load(std::memory_order_relaxed),
+            metrics.labelFontMicroseconds.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,94 @@
+
+
+/*
+ * Mouse input from the low level mouse hook, turned into key events for
+ * the buttons and the wheel (see KEY_LBUTTON and friends).
+ */
+
+enum MouseAction : u8 {
+    MouseAction_Move,
+    MouseAction_ButtonDown,
+    MouseAction_ButtonUp,
+    MouseAction_Wheel,   // positive deltas scroll up
+    MouseAction_HWheel,  // positive deltas scroll right
+};
+
+/*
+ * What the low level mouse hook reports, boiled down to what the filter
+ * needs.  Times are the same as KeyEvent's.
+ */
+struct MouseInput {
+    MouseAction action;
+    u8          vk_key;  // KEY_*BUTTON* of a button
+    i16         delta;   // wheel movement, 120 to a notch
+    u32         time;    // milliseconds
+    u32         stamp;   // microseconds
+};
+
+/*
+ * Runs in the mouse hook, so that the flood of input a mouse sends
+ * never reaches the queue or wakes the UI thread.  Moves are dropped
+ * outright.  Wheel ticks in one direction are merged over a window as
+ * long as a frame, so a wheel spinning at any rate adds at most one
+ * event a frame for each direction, and the strip shows a scroll once
+ * however many notches it took.  Button presses all go through.
+ *
+ * Hook thread only, apart from the counters, which are only read once
+ * the hook has stopped.
+ */
+struct MouseFilter {
+    u32  wheelWindow;        // microseconds wheel ticks are merged over
+    u32  wheelStamp[4];      // when each direction last went through
+    bool hasWheel[4];
+
+    u32 moves;               // dropped
+    u32 mergedTicks;         // wheel ticks folded into an earlier event
+    u32 passed;              // events handed on
+
+    /**
+     * @return True with the event to queue in out, or false if the
+     * input is dropped.
+     */
+    bool filter(MouseInput const &input, KeyEvent *out) {
+        switch (input.action) {
+        case MouseAction_Move:
+            ++moves;
+            return false;
+
+        case MouseAction_ButtonDown:
+        case MouseAction_ButtonUp: {
+            auto isUp = input.action == MouseAction_ButtonUp;
+
+            *out = KeyEvent{ input.vk_key, KEY_FLAG_MOUSE | (isUp ? KEY_FLAG_UP : 0), input.time, input.stamp };
+            ++passed;
+            return true;
+        }
+
+        case MouseAction_Wheel:
+        case MouseAction_HWheel: {
+            if (input.delta == 0)
+                return false;
+
+            auto isVertical = input.action == MouseAction_Wheel;
+            auto direction  = (isVertical ? 0 : 2) + (input.delta > 0 ? 0 : 1);
+
+            if (hasWheel[direction] && input.stamp - wheelStamp[direction] < wheelWindow) {
+                ++mergedTicks;
+                return false;
+            }
+
+            constexpr u32 WHEEL_KEYS[] = { KEY_WHEEL_UP, KEY_WHEEL_DOWN, KEY_WHEEL_RIGHT, KEY_WHEEL_LEFT };
+
+            // A wheel has no down, so it's only ever a key coming up.
+            *out = KeyEvent{ WHEEL_KEYS[direction], KEY_FLAG_MOUSE | KEY_FLAG_UP, input.time, input.stamp };
+
+            wheelStamp[direction] = input.stamp;
+            hasWheel[direction]   = true;
+            ++passed;
+            return true;
+        }
+        }
+
+        return false;
+    }
+};
@@ -0,0 +1,651 @@
+/*
+ * Offline tools for key logs recorded with shoki --record.  These build
+ * and run without Windows.
+ *
+ *     shoki-offline srt <log> [out]   captions as SubRip
+ *     shoki-offline vtt <log> [out]   captions as WebVTT
+ *     shoki-offline frames <log> <out> [fps] [width] [height]
+ *                                     video frames of the key strip
+ *     shoki-offline synth <log>       write a log of synthetic typing
+ *     shoki-offline listen [name]     print the combos a running shoki
+ *                                     broadcasts until it exits
+ */
+#include "bl_common.hpp"
+#include "bl_ring.hpp"
+#include "bl_mapped_file.hpp"
+#include "bl_shared_memory.hpp"
+#include "bl_seqlock_ring.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <cmath>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "key_info.cpp"
+#include "key_combos.cpp"
+#include "key_chords.cpp"
+#include "combo_layout.cpp"
+#include "glyph_atlas.cpp"
+#include "fade.cpp"
+#include "composite.cpp"
+#include "combo_render.cpp"
+#include "key_log.cpp"
+#include "key_text.cpp"
+#include "key_broadcast.cpp"
+#include "png_writer.cpp"
+#include "synth_input.cpp"
+#include "sdf_atlas.cpp"
+#include "segment_font.cpp"
+
+typedef std::chrono::steady_clock BenchClock;
+
+/*
+ * Replays log entries through the combo stack with the timing of the
+ * strip on screen.  Every key up shows the box and restarts its fade,
+ * and once it has faded out the stack is emptied.
+ */
+struct StripReplay {
+    KeyComboStack combos;
+    u32           visibleFor;  // hold and fade time after the last key up
+    u32           lastKeyUp;
+    bool          isVisible;
+
+    void start(KeyLogHeader const &header) {
+        combos.set_max_combos(header.maxCombos);
+        visibleFor = header.holdMilliseconds + header.fadeOutMilliseconds;
+        isVisible  = false;
+    }
+
+    u32 hidden_at() { return lastKeyUp + visibleFor; }
+
+    /**
+     * Catch up with the fade at time.
+     *
+     * @return True if the box faded out since the last key up.
+     */
+    bool advance(u32 time) {
+        if (!isVisible || i32(time - hidden_at()) < 0)
+            return false;
+
+        combos.reset_combos();
+        isVisible = false;
+        return true;
+    }
+
+    void apply(KeyLogEntry const &entry) {
+        if (entry.isCombo)
+            combos.add_combo(entry.combo);
+
+        lastKeyUp = entry.time;
+        isVisible = true;
+    }
+};
+
+enum CaptionFormat {
+    CaptionFormat_Srt,
+    CaptionFormat_Vtt
+};
+
+struct CaptionWriter {
+    FILE         *out;
+    CaptionFormat format;
+    u32           cueCount;
+
+    void begin() {
+        if (format == CaptionFormat_Vtt)
+            fputs("WEBVTT\n\n", out);
+    }
+
+    void timestamp(u32 milliseconds) {
+        auto separator = format == CaptionFormat_Srt ? ',' : '.';
+
+        fprintf(out, "%02u:%02u:%02u%c%03u",
+                milliseconds / 3600000,
+                milliseconds / 60000 % 60,
+                milliseconds / 1000 % 60,
+                separator,
+                milliseconds % 1000);
+    }
+
+    void cue(u32 start, u32 end, char const *text) {
+        if (end <= start || text[0] == 0)
+            return;
+
+        ++cueCount;
+        if (format == CaptionFormat_Srt)
+            fprintf(out, "%u\n", cueCount);
+
+        timestamp(start);
+        fputs(" --> ", out);
+        timestamp(end);
+        fputc('\n', out);
+
+        // WebVTT reads cue text as markup.
+        for (auto ch = text; *ch; ++ch) {
+            if (format == CaptionFormat_Vtt && *ch == '&')
+                fputs("&amp;", out);
+            else if (format == CaptionFormat_Vtt && *ch == '<')
+                fputs("&lt;", out);
+            else if (format == CaptionFormat_Vtt && *ch == '>')
+                fputs("&gt;", out);
+            else
+                fputc(*ch, out);
+        }
+
+        fputs("\n\n", out);
+    }
+};
+
+bool open_log(MappedFile *file, KeyLogReader *reader, char const *path)
+{
+    if (!open_mapped_file(file, path, false, 0)) {
+        fprintf(stderr, "can't open %s\n", path);
+        return false;
+    }
+
+    if (!open_key_log_reader(reader, file->data, file->size)) {
+        fprintf(stderr, "%s isn't a key log\n", path);
+        close_mapped_file(file);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Every change to the strip starts a new cue showing all of it, the way
+ * it looked on screen, and the last cue before the box fades out runs
+ * until it is gone.
+ */
+int write_captions(char const *logPath, char const *outPath, CaptionFormat format)
+{
+    auto file   = MappedFile{};
+    auto reader = KeyLogReader{};
+
+    if (!open_log(&file, &reader, logPath))
+        return 1;
+    defer(close_mapped_file(&file));
+
+    auto out = outPath ? fopen(outPath, "wb") : stdout;
+    if (!out) {
+        fprintf(stderr, "can't write %s\n", outPath);
+        return 1;
+    }
+    defer(if (out != stdout) fclose(out));
+
+    static StripReplay strip;
+    static ComboLayout layout;
+    static char        text[4096];
+
+    auto captions = CaptionWriter{ out, format, 0 };
+    auto entry    = KeyLogEntry{};
+    u32  cueStart = 0;
+
+    strip.start(reader.header);
+    captions.begin();
+
+    while (next_key_log_entry(&reader, &entry)) {
+        auto hiddenAt = strip.hidden_at();
+
+        if (strip.advance(entry.time)) {
+            captions.cue(cueStart, hiddenAt, text);
+            text[0] = 0;
+        }
+
+        if (entry.isCombo) {
+            captions.cue(cueStart, entry.time, text);
+            strip.apply(entry);
+            strip_text(&strip.combos, &layout, text, sizeof(text));
+            cueStart = entry.time;
+        }
+        else {
+            strip.apply(entry);
+        }
+    }
+
+    if (strip.isVisible)
+        captions.cue(cueStart, strip.hidden_at(), text);
+
+    fprintf(stderr, "%u records, %u cues\n", reader.index, captions.cueCount);
+    return 0;
+}
+
+/*
+ * A log of synthetic typing and chords, recorded the way shoki records
+ * keys: every key up after it has gone through the combo stack.
+ */
+int write_synth_log(char const *logPath)
+{
+    constexpr u32 MAX_COMBOS = 4;
+    constexpr FadeConfig FADE = { 300, 400, FadeCurve_Linear };
+
+    auto stream = make_synth_stream(1 << 20, 7);
+    defer(free_synth_stream(&stream));
+
+    synth_typing(&stream, 20000, 8);
+    synth_chords(&stream, 5000);
+    synth_fast_typing(&stream, 20000, 50);
+    synth_finish(&stream);
+
+    auto log = KeyLogWriter{};
+    if (!open_key_log(&log, logPath, make_key_log_header(MAX_COMBOS, FADE, DEFAULT_KEY_LOG_STYLE), 0)) {
+        fprintf(stderr, "can't write %s\n", logPath);
+        return 1;
+    }
+
+    static KeyComboStack combos;
+    combos.set_max_combos(MAX_COMBOS);
+
+    for (u32 idx = 0; idx < stream.count; ++idx) {
+        auto &event   = stream.events[idx];
+        auto  isCombo = combos.set_key(event);
+
+        if (event.flags & KEY_FLAG_UP)
+            append_key_log(&log, event.time, isCombo ? &combos.lastCombo : nullptr);
+    }
+
+    fprintf(stderr, "%u records\n", log.count);
+    close_key_log(&log);
+
+    return 0;
+}
+
+/*
+ * Follow a running shoki's key broadcast and print every combo as it
+ * arrives, the way a caption tool would read it.  Chords are printed
+ * with how many of the combos before them they replace.
+ */
+int listen_broadcast(char const *name)
+{
+    constexpr u32 POLL_MILLISECONDS = 10;
+
+    auto reader = KeyBroadcastReader{};
+    if (!open_key_broadcast_reader(&reader, name, false)) {
+        fprintf(stderr, "nothing broadcasts keys as %s\n", name);
+        return 1;
+    }
+    defer(close_key_broadcast_reader(&reader));
+
+    BroadcastCombo combos[64];
+    u32 received = 0;
+    u32 lost     = 0;
+
+    for (;;) {
+        // Checked before reading, so the last combos before it closed
+        // are read too.
+        auto isClosed = is_key_broadcast_closed(reader);
+        auto count    = read_key_broadcast(&reader, combos, COUNT_OF(combos));
+
+        for (u32 idx = 0; idx < count; ++idx) {
+            auto &combo = combos[idx];
+
+            printf("%10u  %s%s%s%s",
+                   combo.time,
+                   combo.modifiers & Modifier_Ctrl ? "CTRL+" : "",
+                   combo.modifiers & Modifier_Alt ? "ALT+" : "",
+                   combo.modifiers & Modifier_Shift ? "SHIFT+" : "",
+                   combo.label);
+
+            if (combo.chord)
+                printf("  (replaces %u)", combo.replaces);
+            putchar('\n');
+        }
+
+        if (reader.cursor.lost != lost) {
+            fprintf(stderr, "missed %u combos\n", reader.cursor.lost - lost);
+            lost = reader.cursor.lost;
+        }
+
+        received += count;
+        fflush(stdout);
+
+        // Only sleep once caught up, so a burst is drained at once.
+        if (key_broadcast_lag(reader) == 0) {
+            if (isClosed)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(POLL_MILLISECONDS));
+        }
+    }
+
+    fprintf(stderr, "%u combos, %u missed\n", received, lost);
+    return 0;
+}
+
+/*
+ * Where rendered frames go.  A raw file holds every frame back to back
+ * as premultiplied RGBA and is written through a mapping, so threads
+ * can fill in their own frames anywhere in it and frames that are
+ * fully transparent are never touched.  A PNG sequence is one file per
+ * frame named with the prefix and frame number, stored with straight
+ * alpha since that is what PNG means by RGBA.
+ */
+struct FrameOutput {
+    char const *path;
+    bool        isPng;
+    MappedFile  raw;
+    i32         width;
+    i32         height;
+    u32         fps;
+    u32         frameCount;
+
+    u64 frame_bytes() const { return u64(width) * height * 4; }
+
+    // Milliseconds since recording started of a frame.
+    u32 frame_time(u32 frame) const { return u32(u64(frame) * 1000 / fps); }
+};
+
+/*
+ * A range of frames rendered on one thread.  Each thread replays the
+ * log from the start on its own, which is far cheaper than rendering,
+ * so ranges need nothing from each other.
+ */
+struct FrameJob {
+    FrameOutput        *output;
+    KeyLogReader        reader;
+    LabelMeasurements const *labels;
+    GlyphAtlas const   *atlas;
+    FadeTable const    *fade;
+    u32                 firstFrame;
+    u32                 endFrame;
+
+    u32 rendered;  // frames composited
+    u32 repeated;  // frames that were the same as the one before
+    u32 empty;     // frames with nothing showing
+    bool failed;
+};
+
+bool write_file(char const *path, u8 const *bytes, u32 count)
+{
+    auto file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    auto written = fwrite(bytes, 1, count, file);
+    return fclose(file) == 0 && written == count;
+}
+
+void render_frames(FrameJob *job)
+{
+    auto &output   = *job->output;
+    auto &style    = job->reader.header.style;
+    auto  place    = Placement{ style.offset_x, style.offset_y, output.width, output.height, PlacementJustification(style.justification) };
+    auto  boxColor = premultiply_color(style.boxColor);
+    auto  count    = u32(output.width) * u32(output.height);
+
+    auto pixels  = (u32 *)malloc(count * sizeof(u32));
+    auto rgba    = (u8 *)malloc(count * 4);
+    auto encoder = PngEncoder{};
+    defer(free(pixels); free(rgba); free_png_encoder(&encoder));
+
+    auto surface = Surface{ pixels, output.width, output.height, output.width };
+    auto strip   = (StripReplay *)calloc(1, sizeof(StripReplay));
+    auto layout  = (ComboLayout *)calloc(1, sizeof(ComboLayout));
+    defer(free(strip); free(layout));
+
+    auto entry    = KeyLogEntry{};
+    auto hasEntry = next_key_log_entry(&job->reader, &entry);
+
+    // What the previous frame showed, so repeats can be spotted.
+    u32  shownGeneration = 0;
+    u8   shownAlpha      = 0;
+    bool hasShown        = false;
+    u32  layoutGeneration = 0;
+
+    strip->start(job->reader.header);
+    layoutGeneration = strip->combos.generation - 1;
+
+    char path[1024];
+
+    for (u32 frame = job->firstFrame; frame < job->endFrame; ++frame) {
+        auto time = output.frame_time(frame);
+
+        while (hasEntry && i32(entry.time - time) <= 0) {
+            strip->advance(entry.time);
+            strip->apply(entry);
+            hasEntry = next_key_log_entry(&job->reader, &entry);
+        }
+
+        strip->advance(time);
+
+        u8 alpha = 0;
+        if (strip->isVisible && !strip->combos.is_empty())
+            alpha = fade_alpha(*job->fade, time - strip->lastKeyUp);
+
+        // Every transparent frame is the same, whatever the strip holds.
+        auto generation = alpha ? strip->combos.generation : 0;
+        auto isRepeat   = hasShown && generation == shownGeneration && alpha == shownAlpha;
+
+        if (!isRepeat) {
+            if (alpha == 0) {
+                memset(rgba, 0, count * 4);
+                ++job->empty;
+            }
+            else {
+                if (layoutGeneration != strip->combos.generation) {
+                    layout_combos(&strip->combos, *job->labels, layout);
+                    layoutGeneration = strip->combos.generation;
+                }
+
+                memset(pixels, 0, count * sizeof(u32));
+                composite_combo_strip(&surface, *layout, *job->atlas, place, boxColor);
+                scale_alpha(&surface, alpha);
+                convert_frame(pixels, count, rgba, output.isPng);
+                ++job->rendered;
+            }
+
+            if (output.isPng)
+                encode_png(&encoder, rgba, output.width, output.height);
+
+            shownGeneration = generation;
+            shownAlpha      = alpha;
+            hasShown        = true;
+        }
+        else {
+            ++job->repeated;
+        }
+
+        if (output.isPng) {
+            snprintf(path, sizeof(path), "%s%06u.png", output.path, frame);
+            if (!write_file(path, encoder.png.bytes, encoder.png.count)) {
+                fprintf(stderr, "can't write %s\n", path);
+                job->failed = true;
+                return;
+            }
+        }
+        else if (alpha > 0) {
+            // The file starts out as zeros so empty frames are skipped.
+            memcpy(output.raw.data + u64(frame) * output.frame_bytes(), rgba, size_t(output.frame_bytes()));
+        }
+    }
+}
+
+/*
+ * Render the strip as it looked at a fixed frame rate, for compositing
+ * over a screen recording.  The frames are split into one range per
+ * core.  Identical frames in a row, which is most of them, are only
+ * composited once.
+ */
+int write_frames(int argc, char **argv)
+{
+    if (argc < 4) {
+        fputs("usage: shoki-offline frames <log> <out.rgba|png-prefix> [fps] [width] [height]\n", stderr);
+        return 1;
+    }
+
+    auto logPath = argv[2];
+    auto output  = FrameOutput{};
+
+    output.path   = argv[3];
+    output.fps    = argc > 4 ? u32(strtoul(argv[4], nullptr, 10)) : 60;
+    output.width  = argc > 5 ? i32(strtol(argv[5], nullptr, 10)) : 650;
+    output.height = argc > 6 ? i32(strtol(argv[6], nullptr, 10)) : 150;
+
+    auto pathLength = strlen(output.path);
+    output.isPng = pathLength < 5 || strcmp(output.path + pathLength - 5, ".rgba") != 0;
+
+    if (output.fps < 1 || output.fps > 1000 || output.width < 1 || output.height < 1) {
+        fputs("fps, width and height must be positive\n", stderr);
+        return 1;
+    }
+
+    auto file   = MappedFile{};
+    auto reader = KeyLogReader{};
+
+    if (!open_log(&file, &reader, logPath))
+        return 1;
+    defer(close_mapped_file(&file));
+
+    // The video runs until the box has faded out after the last key.
+    auto scan  = reader;
+    auto entry = KeyLogEntry{};
+    u32  end   = 0;
+
+    while (next_key_log_entry(&scan, &entry))
+        end = entry.time;
+    end += reader.header.holdMilliseconds + reader.header.fadeOutMilliseconds;
+
+    output.frameCount = u32(u64(end) * output.fps / 1000) + 1;
+
+    // Raw frames take all their space up front, so they are checked
+    // against the space left before any is written.  The space is then
+    // reserved when the file is opened, in case something else uses it
+    // up in the meantime.
+    if (!output.isPng) {
+        auto size      = output.frame_bytes() * output.frameCount;
+        auto available = free_disk_space(output.path);
+
+        if (size > available) {
+            fprintf(stderr,
+                    "%u frames at %dx%d take %.1f GB, but there are only %.1f GB free for %s\n",
+                    output.frameCount,
+                    output.width,
+                    output.height,
+                    size / 1e9,
+                    available / 1e9,
+                    output.path);
+            return 1;
+        }
+
+        if (!open_mapped_file(&output.raw, output.path, true, size)) {
+            fprintf(stderr, "can't write %.1f GB of frames to %s\n", size / 1e9, output.path);
+            remove(output.path);
+            return 1;
+        }
+    }
+    defer(if (!output.isPng) close_mapped_file(&output.raw));
+
+    static u32               codepoints[MAX_SDF_GLYPHS];
+    static SdfFont           font;
+    static LabelMeasurements labels;
+    static GlyphAtlas        atlas;
+    static FadeTable         fade;
+
+    // Labels in the stroke font at the sizes and color the strip had
+    // when recording started.
+    auto &style = reader.header.style;
+    auto  count = collect_label_characters(*KEY_TABLE, codepoints, COUNT_OF(codepoints));
+
+    build_segment_sdf_font(&font, codepoints, count);
+    measure_sdf_labels(&labels, font, font, style.letterSize, style.modifierSize);
+    layout_glyph_atlas(&atlas, labels);
+    draw_sdf_labels(&atlas, labels, font, font, style.letterSize, style.modifierSize, premultiply_color(style.textColor));
+    defer(free_glyph_atlas(&atlas); free_sdf_font(&font));
+    build_fade_table(&fade, key_log_fade(reader.header));
+
+    // Pick the kernels before any thread asks for them.
+    set_composite_level(detect_composite_level());
+
+    auto threadCount = std::thread::hardware_concurrency();
+    if (threadCount < 1)
+        threadCount = 1;
+    if (threadCount > output.frameCount)
+        threadCount = output.frameCount;
+
+    auto jobs    = new FrameJob[threadCount];
+    auto threads = new std::thread[threadCount];
+    defer(delete[] jobs; delete[] threads);
+
+    auto start = BenchClock::now();
+
+    for (u32 idx = 0; idx < threadCount; ++idx) {
+        auto &job = jobs[idx];
+
+        job            = FrameJob{};
+        job.output     = &output;
+        job.reader     = reader;
+        job.labels     = &labels;
+        job.atlas      = &atlas;
+        job.fade       = &fade;
+        job.firstFrame = u32(u64(output.frameCount) * idx / threadCount);
+        job.endFrame   = u32(u64(output.frameCount) * (idx + 1) / threadCount);
+
+        threads[idx] = std::thread(render_frames, &job);
+    }
+
+    u32  rendered = 0;
+    u32  repeated = 0;
+    u32  empty    = 0;
+    bool failed   = false;
+
+    for (u32 idx = 0; idx < threadCount; ++idx) {
+        threads[idx].join();
+
+        rendered += jobs[idx].rendered;
+        repeated += jobs[idx].repeated;
+        empty    += jobs[idx].empty;
+        failed   |= jobs[idx].failed;
+    }
+
+    auto elapsed = std::chrono::duration<f64>(BenchClock::now() - start).count();
+
+    fprintf(stderr,
+            "%u frames (%.1f minutes at %u fps) on %u threads in %.2f s: "
+            "%u rendered, %u empty, %u repeated\n",
+            output.frameCount,
+            output.frameCount / f64(output.fps) / 60.0,
+            output.fps,
+            threadCount,
+            elapsed,
+            rendered,
+            empty,
+            repeated);
+
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    char const *usage = "usage: shoki-offline srt|vtt <log> [out]\n"
+                        "       shoki-offline frames <log> <out.rgba|png-prefix> [fps] [width] [height]\n"
+                        "       shoki-offline synth <log>\n"
+                        "       shoki-offline listen [name]\n";
+
+    if (argc >= 2 && strcmp(argv[1], "listen") == 0)
+        return listen_broadcast(argc > 2 ? argv[2] : KEY_BROADCAST_NAME);
+
+    if (argc < 3) {
+        fputs(usage, stderr);
+        return 1;
+    }
+
+    char const *which   = argv[1];
+    char const *logPath = argv[2];
+    char const *outPath = argc > 3 ? argv[3] : nullptr;
+
+    if (strcmp(which, "srt") == 0)
+        return write_captions(logPath, outPath, CaptionFormat_Srt);
+    if (strcmp(which, "vtt") == 0)
+        return write_captions(logPath, outPath, CaptionFormat_Vtt);
+    if (strcmp(which, "frames") == 0)
+        return write_frames(argc, argv);
+    if (strcmp(which, "synth") == 0)
+        return write_synth_log(logPath);
+
+    fputs(usage, stderr);
+    return 1;
+}
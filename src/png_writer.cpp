@@ -0,0 +1,296 @@
+
+/*
+ * Minimal PNG encoder for RGBA frames.  Overlay frames are mostly fully
+ * transparent, so instead of a general compressor the image data is
+ * deflated with the fixed Huffman codes and runs of a repeated byte
+ * become distance one matches.  That gets the transparent area down to
+ * a few bits per 258 bytes and leaves the glyphs as literals, at a cost
+ * close to copying the pixels.
+ */
+
+struct PngBuffer {
+    u8  *bytes;
+    u32  count;
+    u32  capacity;
+
+    void reserve(u32 extra) {
+        if (count + extra <= capacity)
+            return;
+
+        while (count + extra > capacity)
+            capacity = capacity ? 2*capacity : 64*1024;
+        bytes = (u8 *)realloc(bytes, capacity);
+    }
+
+    void put(u8 byte) {
+        reserve(1);
+        bytes[count++] = byte;
+    }
+
+    void put_u32_be(u32 value) {
+        put(u8(value >> 24));
+        put(u8(value >> 16));
+        put(u8(value >> 8));
+        put(u8(value));
+    }
+};
+
+void free_png_buffer(PngBuffer *buffer)
+{
+    free(buffer->bytes);
+    *buffer = PngBuffer{};
+}
+
+struct Crc32Table {
+    u32 entries[256];
+};
+
+constexpr Crc32Table make_crc32_table()
+{
+    Crc32Table table = {};
+
+    for (u32 n = 0; n < 256; ++n) {
+        u32 c = n;
+        for (u32 k = 0; k < 8; ++k)
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        table.entries[n] = c;
+    }
+
+    return table;
+}
+
+constexpr Crc32Table CRC32_TABLE = make_crc32_table();
+
+u32 crc32(u32 crc, u8 const *bytes, u32 count)
+{
+    crc = ~crc;
+    for (u32 idx = 0; idx < count; ++idx)
+        crc = CRC32_TABLE.entries[(crc ^ bytes[idx]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+/*
+ * Deflate output, which packs codes starting from the least significant
+ * bit.  Huffman codes are defined most significant bit first so they go
+ * through put_code, which reverses them.
+ */
+struct DeflateBits {
+    PngBuffer *out;
+    u32        bits;
+    u32        bitCount;
+
+    void put_bits(u32 value, u32 count) {
+        bits     |= value << bitCount;
+        bitCount += count;
+
+        while (bitCount >= 8) {
+            out->put(u8(bits));
+            bits    >>= 8;
+            bitCount -= 8;
+        }
+    }
+
+    void put_code(u32 code, u32 length) {
+        u32 reversed = 0;
+        for (u32 idx = 0; idx < length; ++idx)
+            reversed |= ((code >> idx) & 1) << (length - 1 - idx);
+        put_bits(reversed, length);
+    }
+
+    void flush() {
+        if (bitCount > 0)
+            out->put(u8(bits));
+        bits     = 0;
+        bitCount = 0;
+    }
+
+    // Fixed Huffman code of a literal or length symbol.
+    void put_symbol(u32 symbol) {
+        if (symbol < 144)
+            put_code(0x30 + symbol, 8);
+        else if (symbol < 256)
+            put_code(0x190 + symbol - 144, 9);
+        else if (symbol < 280)
+            put_code(symbol - 256, 7);
+        else
+            put_code(0xC0 + symbol - 280, 8);
+    }
+
+    void put_match(u32 length) {
+        constexpr u16 BASE[]  = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        constexpr u8  EXTRA[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+        u32 code = COUNT_OF(BASE) - 1;
+        while (BASE[code] > length)
+            --code;
+
+        put_symbol(257 + code);
+        put_bits(length - BASE[code], EXTRA[code]);
+        put_code(0, 5);  // distance code 0 is a distance of one
+    }
+};
+
+void deflate_runs(PngBuffer *out, u8 const *data, u32 size)
+{
+    auto bits = DeflateBits{ out, 0, 0 };
+
+    out->reserve(size / 8 + 64);
+
+    bits.put_bits(1, 1);  // final block
+    bits.put_bits(1, 2);  // fixed Huffman codes
+
+    for (u32 idx = 0; idx < size;) {
+        u32 run = 0;
+
+        if (idx > 0) {
+            while (run < 258 && idx + run < size && data[idx + run] == data[idx - 1])
+                ++run;
+        }
+
+        if (run >= 3) {
+            bits.put_match(run);
+            idx += run;
+        }
+        else {
+            bits.put_symbol(data[idx]);
+            ++idx;
+        }
+    }
+
+    bits.put_symbol(256);
+    bits.flush();
+}
+
+u32 adler32(u8 const *bytes, u32 count)
+{
+    u32 a = 1;
+    u32 b = 0;
+
+    while (count > 0) {
+        // The largest block that can't overflow before the modulo.
+        u32 block = count < 5552 ? count : 5552;
+        count -= block;
+
+        while (block-- > 0) {
+            a += *bytes++;
+            b += a;
+        }
+
+        a %= 65521;
+        b %= 65521;
+    }
+
+    return (b << 16) | a;
+}
+
+void put_png_chunk(PngBuffer *out, char const *type, u8 const *data, u32 size)
+{
+    out->put_u32_be(size);
+
+    auto start = out->count;
+    for (u32 idx = 0; idx < 4; ++idx)
+        out->put(u8(type[idx]));
+
+    out->reserve(size);
+    if (size > 0)
+        memcpy(out->bytes + out->count, data, size);
+    out->count += size;
+
+    out->put_u32_be(crc32(0, out->bytes + start, size + 4));
+}
+
+/*
+ * Buffers for encoding, kept from one image to the next so a sequence
+ * of frames doesn't allocate once they have grown to size.
+ */
+struct PngEncoder {
+    PngBuffer filtered;
+    PngBuffer deflated;
+    PngBuffer png;  // the last image encoded
+};
+
+void free_png_encoder(PngEncoder *encoder)
+{
+    free_png_buffer(&encoder->filtered);
+    free_png_buffer(&encoder->deflated);
+    free_png_buffer(&encoder->png);
+}
+
+/**
+ * Encode a straight alpha RGBA image as a PNG into encoder->png.
+ */
+void encode_png(PngEncoder *encoder, u8 const *rgba, i32 width, i32 height)
+{
+    auto rowBytes = u32(width) * 4;
+    auto rawSize  = (rowBytes + 1) * u32(height);
+    auto raw      = &encoder->filtered;
+    auto zlib     = &encoder->deflated;
+    auto out      = &encoder->png;
+
+    // Every row starts with filter type 0, which leaves it as it is.
+    raw->count = 0;
+    raw->reserve(rawSize);
+    for (i32 row = 0; row < height; ++row) {
+        raw->bytes[raw->count++] = 0;
+        memcpy(raw->bytes + raw->count, rgba + size_t(row) * rowBytes, rowBytes);
+        raw->count += rowBytes;
+    }
+
+    zlib->count = 0;
+    zlib->put(0x78);  // deflate with a 32K window
+    zlib->put(0x01);  // no dictionary, fastest
+    deflate_runs(zlib, raw->bytes, rawSize);
+    zlib->put_u32_be(adler32(raw->bytes, rawSize));
+
+    u8 header[13] = {};
+    header[0]  = u8(width >> 24);
+    header[1]  = u8(width >> 16);
+    header[2]  = u8(width >> 8);
+    header[3]  = u8(width);
+    header[4]  = u8(height >> 24);
+    header[5]  = u8(height >> 16);
+    header[6]  = u8(height >> 8);
+    header[7]  = u8(height);
+    header[8]  = 8;  // bits per channel
+    header[9]  = 6;  // RGBA
+
+    static u8 const SIGNATURE[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    out->count = 0;
+    out->reserve(sizeof(SIGNATURE));
+    memcpy(out->bytes, SIGNATURE, sizeof(SIGNATURE));
+    out->count = sizeof(SIGNATURE);
+
+    put_png_chunk(out, "IHDR", header, sizeof(header));
+    put_png_chunk(out, "IDAT", zlib->bytes, zlib->count);
+    put_png_chunk(out, "IEND", nullptr, 0);
+}
+
+/**
+ * Convert surface pixels, which are premultiplied BGRA in memory, to
+ * RGBA bytes, either still premultiplied or with straight alpha the
+ * way PNG stores it.
+ */
+void convert_frame(u32 const *pixels, u32 count, u8 *rgba, bool isStraightAlpha)
+{
+    for (u32 idx = 0; idx < count; ++idx) {
+        auto pixel = pixels[idx];
+        u32  a     = pixel >> 24;
+        u32  r     = (pixel >> 16) & 0xFF;
+        u32  g     = (pixel >> 8) & 0xFF;
+        u32  b     = pixel & 0xFF;
+
+        if (isStraightAlpha && a > 0 && a < 255) {
+            r = (r * 255 + a/2) / a;
+            g = (g * 255 + a/2) / a;
+            b = (b * 255 + a/2) / a;
+        }
+
+        rgba[4*idx + 0] = u8(r);
+        rgba[4*idx + 1] = u8(g);
+        rgba[4*idx + 2] = u8(b);
+        rgba[4*idx + 3] = u8(a);
+    }
+}
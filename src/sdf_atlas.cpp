@@ -0,0 +1,774 @@
+
+/*
+ * Key labels drawn from signed distance fields, so they can be drawn at
+ * any size without rasterizing the font again.  Every character a label
+ * can contain is rasterized once, large, by whatever draws text on the
+ * platform, and turned into a small field holding the distance from
+ * each texel to the glyph's outline.  Drawing text at some size samples
+ * the field with bilinear filtering and turns the distance, scaled to
+ * destination pixels, into the coverage of that pixel.  Edges come out
+ * anti-aliased and about a pixel wide whether the field is scaled up or
+ * down, so a change of font size or DPI only redraws the glyph atlas
+ * from the fields.
+ *
+ * Fields are 8 bits per texel with the outline at 128, positive inside,
+ * and only hold distances up to SDF_SPREAD texels from an outline.  Each
+ * glyph has a cell the size of the widest advance and the line height
+ * with SDF_PADDING texels around it so the falloff outside the outline
+ * fits.
+ */
+
+constexpr i32 SDF_EM         = 48;    // texels per em
+constexpr f32 SDF_SPREAD     = 6.0f;  // texels of distance either side of an outline
+constexpr i32 SDF_PADDING    = 6;     // texels around a cell's line box
+constexpr i32 SDF_OVERSAMPLE = 4;     // resolution of glyph coverage relative to the field
+constexpr u32 MAX_SDF_GLYPHS = 256;
+constexpr i32 SDF_ATLAS_WIDTH = 512;
+
+// Pixels per em below which text is drawn from four samples a pixel.
+constexpr f32 SDF_SUPERSAMPLE_SIZE = 20.0f;
+
+// Space left and right of a label, in em, like GDI+ leaves when it
+// measures and draws a string.
+constexpr f32 SDF_LABEL_MARGIN = 1.0f / 6.0f;
+
+struct SdfGlyph {
+    u32 codepoint;
+    f32 advance;  // em
+    u16 x;        // cell in the field, in texels
+    u16 y;
+};
+
+struct SdfFont {
+    u8      *texels;
+    i32      width;
+    i32      height;
+    i32      cellWidth;   // texels, the widest advance and padding
+    i32      cellHeight;  // texels, the line height and padding
+    f32      lineHeight;  // em
+    u32      glyphCount;
+    SdfGlyph glyphs[MAX_SDF_GLYPHS];  // sorted by codepoint
+};
+
+void free_sdf_font(SdfFont *font)
+{
+    free(font->texels);
+    *font = SdfFont{};
+}
+
+/**
+ * @return The glyph of a character, or null if the font doesn't have
+ * it.
+ */
+SdfGlyph const *find_sdf_glyph(SdfFont const &font, u32 codepoint)
+{
+    u32 lo = 0;
+    u32 hi = font.glyphCount;
+
+    while (lo < hi) {
+        auto mid = (lo + hi) / 2;
+
+        if (font.glyphs[mid].codepoint < codepoint)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo < font.glyphCount && font.glyphs[lo].codepoint == codepoint ? &font.glyphs[lo] : nullptr;
+}
+
+/**
+ * Collect the characters of every label in a key table, of the chord
+ * labels and of the modifier names, which are what a font for the
+ * labels needs.
+ *
+ * @return The number of characters, sorted and without duplicates.
+ */
+u32 collect_label_characters(KeyTable const &table, u32 *out, u32 capacity)
+{
+    u32  count = 0;
+    bool seen[0x10000] = {};
+
+    auto add = [&](wchar_t const *text) {
+        for (u32 idx = 0; text[idx]; ++idx) {
+            auto ch = u32(text[idx]) & 0xFFFF;
+            if (!seen[ch] && count < capacity) {
+                seen[ch]     = true;
+                out[count++] = ch;
+            }
+        }
+    };
+
+    for (auto &entry : table.entries) {
+        for (auto &label : entry.labels)
+            add(label.text);
+    }
+    for (u32 chord = 1; chord <= MAX_CHORD_LABELS; ++chord)
+        add(chord_label(chord));
+    add(L"CTRLALTSHIFT");
+
+    // Counting sort by way of the seen table.
+    count = 0;
+    for (u32 ch = 0; ch < 0x10000 && count < capacity; ++ch) {
+        if (seen[ch])
+            out[count++] = ch;
+    }
+
+    return count;
+}
+
+/**
+ * Lay out a cell for every glyph of a font and allocate its field.  The
+ * glyphs are filled in afterwards with set_sdf_glyph.
+ *
+ * @param codepoints Sorted characters of the font.
+ * @param maxAdvance The widest advance of any glyph, in em.
+ * @param lineHeight In em.
+ */
+bool begin_sdf_font(SdfFont *font, u32 const *codepoints, u32 count, f32 maxAdvance, f32 lineHeight)
+{
+    free_sdf_font(font);
+
+    if (count > MAX_SDF_GLYPHS)
+        count = MAX_SDF_GLYPHS;
+
+    font->cellWidth  = i32(ceilf(maxAdvance * SDF_EM)) + 2*SDF_PADDING;
+    font->cellHeight = i32(ceilf(lineHeight * SDF_EM)) + 2*SDF_PADDING;
+    font->lineHeight = lineHeight;
+    font->glyphCount = count;
+
+    auto perRow = SDF_ATLAS_WIDTH / font->cellWidth;
+    auto rows   = (i32(count) + perRow - 1) / perRow;
+
+    for (u32 idx = 0; idx < count; ++idx) {
+        auto &glyph = font->glyphs[idx];
+
+        glyph.codepoint = codepoints[idx];
+        glyph.advance   = maxAdvance;
+        glyph.x         = u16(i32(idx) % perRow * font->cellWidth);
+        glyph.y         = u16(i32(idx) / perRow * font->cellHeight);
+    }
+
+    font->width  = SDF_ATLAS_WIDTH;
+    font->height = rows * font->cellHeight;
+    font->texels = (u8 *)calloc(size_t(font->width) * font->height, 1);
+
+    return font->texels != nullptr;
+}
+
+/**
+ * Size of the coverage set_sdf_glyph takes for a glyph, which covers
+ * the whole cell at SDF_OVERSAMPLE times the field's resolution.  The
+ * line box starts sdf_source_origin() pixels in from the top left and
+ * an em is SDF_EM * SDF_OVERSAMPLE pixels.
+ */
+void sdf_source_size(SdfFont const &font, i32 *width, i32 *height)
+{
+    *width  = font.cellWidth * SDF_OVERSAMPLE;
+    *height = font.cellHeight * SDF_OVERSAMPLE;
+}
+
+constexpr i32 sdf_source_origin() { return SDF_PADDING * SDF_OVERSAMPLE; }
+
+/*
+ * Squared distance transform of a row, from Felzenszwalb and
+ * Huttenlocher's "Distance Transforms of Sampled Functions": the lower
+ * envelope of the parabolas rooted at every sample.  nearest gets the
+ * sample each distance was measured to.
+ */
+void distance_transform_1d(f32 const *f, i32 n, f32 *d, i32 *nearest, i32 *v, f32 *z)
+{
+    constexpr f32 INF = 1e20f;
+
+    i32 k = 0;
+    v[0] = 0;
+    z[0] = -INF;
+    z[1] = INF;
+
+    for (i32 q = 1; q < n; ++q) {
+        f32 s;
+
+        for (;;) {
+            auto r = v[k];
+            s = ((f[q] + f32(q*q)) - (f[r] + f32(r*r))) / f32(2*q - 2*r);
+            if (s > z[k] || k == 0)
+                break;
+            --k;
+        }
+
+        // The parabola at q hides everything from z[k] on.
+        if (s <= z[k]) {
+            v[k] = q;
+            z[k + 1] = INF;
+            continue;
+        }
+
+        ++k;
+        v[k]     = q;
+        z[k]     = s;
+        z[k + 1] = INF;
+    }
+
+    k = 0;
+    for (i32 q = 0; q < n; ++q) {
+        while (z[k + 1] < f32(q))
+            ++k;
+
+        auto r = v[k];
+        d[q]       = f32((q - r) * (q - r)) + f[r];
+        nearest[q] = r;
+    }
+}
+
+/*
+ * Find the pixel of a grid nearest every pixel among those where grid
+ * is zero, done a column at a time and then a row at a time.  grid is
+ * left holding squared distances and nearest the index of the pixel
+ * each was measured to.  The scratch buffers hold the longer side plus
+ * one.
+ */
+void distance_transform_2d(f32 *grid, i32 *nearest, i32 width, i32 height, f32 *f, f32 *d, i32 *r, i32 *v, f32 *z)
+{
+    // Rows of the nearest pixel in each column first.
+    for (i32 x = 0; x < width; ++x) {
+        for (i32 y = 0; y < height; ++y)
+            f[y] = grid[y*width + x];
+
+        distance_transform_1d(f, height, d, r, v, z);
+
+        for (i32 y = 0; y < height; ++y) {
+            grid[y*width + x]    = d[y];
+            nearest[y*width + x] = r[y];
+        }
+    }
+
+    for (i32 y = 0; y < height; ++y) {
+        auto *line = nearest + y*width;
+
+        memcpy(f, grid + y*width, width * sizeof(f32));
+        distance_transform_1d(f, width, grid + y*width, r, v, z);
+
+        // The pixel in the nearest column, in the row nearest in it.
+        for (i32 x = 0; x < width; ++x)
+            d[x] = f32(line[r[x]] * width + r[x]);
+        for (i32 x = 0; x < width; ++x)
+            line[x] = i32(d[x]);
+    }
+}
+
+/**
+ * Turn the coverage of a glyph into its field.  The pixels the outline
+ * crosses are partly covered ones and covered ones next to empty ones.
+ * The outline is taken to cross each of them as a straight line facing
+ * the way its coverage rises, as far from its centre as its coverage is
+ * from a half.  A texel's distance is to that line in the pixel nearest
+ * it, or to the point on it nearest the pixel's centre where the line
+ * doesn't pass by the texel, such as off the end of a stroke.  Edges so
+ * land where the coverage put them rather than on pixel centres.
+ *
+ * @param coverage sdf_source_size pixels of 8 bit coverage.
+ * @param advance The glyph's advance in em.
+ */
+void set_sdf_glyph(SdfFont *font, u32 index, f32 advance, u8 const *coverage, i32 stride)
+{
+    constexpr f32 INF = 1e20f;
+
+    i32 width, height;
+    sdf_source_size(*font, &width, &height);
+
+    auto longest = width > height ? width : height;
+    auto pixels  = size_t(width) * height;
+    auto grid    = (f32 *)malloc(pixels * sizeof(f32));
+    auto nearest = (i32 *)malloc(pixels * sizeof(i32));
+    auto f       = (f32 *)malloc((longest + 1) * sizeof(f32));
+    auto d       = (f32 *)malloc((longest + 1) * sizeof(f32));
+    auto z       = (f32 *)malloc((longest + 1) * sizeof(f32));
+    auto r       = (i32 *)malloc((longest + 1) * sizeof(i32));
+    auto v       = (i32 *)malloc((longest + 1) * sizeof(i32));
+    defer(free(grid); free(nearest); free(f); free(d); free(z); free(r); free(v));
+
+    // Coverage from 0 to 1, and nothing outside the cell.
+    auto cover = [&](i32 x, i32 y) {
+        if (x < 0 || y < 0 || x >= width || y >= height)
+            return 0.0f;
+        return f32(coverage[size_t(y) * stride + x]) / 255.0f;
+    };
+
+    auto hasEdge = false;
+
+    for (i32 y = 0; y < height; ++y) {
+        for (i32 x = 0; x < width; ++x) {
+            auto alpha  = coverage[size_t(y) * stride + x];
+            auto isEdge = alpha > 0 && alpha < 255;
+
+            if (alpha == 255) {
+                isEdge = (cover(x - 1, y) == 0.0f || cover(x + 1, y) == 0.0f ||
+                          cover(x, y - 1) == 0.0f || cover(x, y + 1) == 0.0f);
+            }
+
+            grid[y*width + x] = isEdge ? 0.0f : INF;
+            hasEdge |= isEdge;
+        }
+    }
+
+    distance_transform_2d(grid, nearest, width, height, f, d, r, v, z);
+
+    /**
+     * @return The signed distance in pixels from a point to the outline
+     * where it crosses an edge pixel, positive inside.
+     */
+    auto edge_distance = [&](i32 pixel, f32 qx, f32 qy, bool isInside, f32 *away) {
+        auto x = pixel % width;
+        auto y = pixel / width;
+
+        // Sobel, towards more coverage.
+        auto gx = (cover(x + 1, y - 1) + 2.0f*cover(x + 1, y) + cover(x + 1, y + 1) -
+                   cover(x - 1, y - 1) - 2.0f*cover(x - 1, y) - cover(x - 1, y + 1));
+        auto gy = (cover(x - 1, y + 1) + 2.0f*cover(x, y + 1) + cover(x + 1, y + 1) -
+                   cover(x - 1, y - 1) - 2.0f*cover(x, y - 1) - cover(x + 1, y - 1));
+        auto length = sqrtf(gx*gx + gy*gy);
+
+        auto nx = length > 0.0f ? gx / length : 0.0f;
+        auto ny = length > 0.0f ? gy / length : 0.0f;
+        auto offset = 0.5f - cover(x, y);
+
+        auto dx = qx - (f32(x) + 0.5f + nx * offset);
+        auto dy = qy - (f32(y) + 0.5f + ny * offset);
+        auto along    = dx*nx + dy*ny;
+        auto distance = sqrtf(dx*dx + dy*dy);
+
+        *away = distance;
+
+        // Within a pixel of the line's own stretch, the line is the
+        // outline.
+        if (length > 0.0f && distance*distance - along*along <= 1.0f)
+            return along;
+
+        return isInside ? distance : -distance;
+    };
+
+    auto &glyph = font->glyphs[index];
+    glyph.advance = advance;
+
+    constexpr i32 MID = SDF_OVERSAMPLE / 2;
+
+    for (i32 ty = 0; ty < font->cellHeight; ++ty) {
+        for (i32 tx = 0; tx < font->cellWidth; ++tx) {
+            auto px = tx * SDF_OVERSAMPLE + MID;
+            auto py = ty * SDF_OVERSAMPLE + MID;
+            auto qx = f32(px);
+            auto qy = f32(py);
+
+            // The texel's centre is the corner of the four pixels in the
+            // middle of its block, and is inside if they mostly are.
+            auto isInside = (cover(px - 1, py - 1) + cover(px, py - 1) +
+                             cover(px - 1, py) + cover(px, py)) >= 2.0f;
+
+            auto distance = isInside ? INF : -INF;
+
+            if (hasEdge) {
+                auto closest = INF;
+
+                for (i32 sy = py - 1; sy <= py; ++sy) {
+                    for (i32 sx = px - 1; sx <= px; ++sx) {
+                        f32  away;
+                        auto signedDistance = edge_distance(nearest[sy*width + sx], qx, qy, isInside, &away);
+
+                        if (away < closest) {
+                            closest  = away;
+                            distance = signedDistance;
+                        }
+                    }
+                }
+            }
+
+            auto value = floorf(128.0f + distance / f32(SDF_OVERSAMPLE) * (127.0f / SDF_SPREAD) + 0.5f);
+
+            value = value < 0.0f ? 0.0f : (value > 255.0f ? 255.0f : value);
+            font->texels[size_t(glyph.y + ty) * font->width + glyph.x + tx] = u8(value);
+        }
+    }
+}
+
+/*
+ * Sampling a row of a glyph turns the field, already interpolated
+ * between two rows of texels, into premultiplied white pixels.  The
+ * texel column of pixel x is x * invScale + offset, and coverage is
+ * value * slope + bias clamped to [0, 1].  The left texel of a pixel
+ * is never the last one, so both texels under every pixel are in the
+ * row, and the last column is reached with a weight of one.  Every
+ * version rounds the same way and produces the same pixels.
+ */
+struct SdfRow {
+    f32 const *values;
+    i32        cellWidth;
+    f32        invScale;
+    f32        offset;
+    f32        slope;
+    f32        bias;
+};
+
+void sample_sdf_row_scalar(SdfRow const &row, i32 x, i32 count, u32 *out)
+{
+    auto last = f32(row.cellWidth - 1);
+    auto left = f32(row.cellWidth - 2);
+
+    for (i32 idx = 0; idx < count; ++idx) {
+        auto u  = f32(x + idx) * row.invScale + row.offset;
+        u       = u < 0.0f ? 0.0f : (u > last ? last : u);
+
+        auto i0 = i32(u < left ? u : left);
+        auto fx = u - f32(i0);
+        auto a  = row.values[i0];
+        auto b  = row.values[i0 + 1];
+
+        auto coverage = (a + (b - a) * fx) * row.slope + row.bias;
+        coverage = coverage < 0.0f ? 0.0f : (coverage > 1.0f ? 1.0f : coverage);
+
+        auto alpha = u32(coverage * 255.0f + 0.5f);
+        out[idx] = alpha * 0x01010101u;
+    }
+}
+
+#if defined(COMPOSITE_X86)
+
+/*
+ * Four pixels at a time.  SSE2 has no gather, but the two texels under
+ * a pixel are next to each other, so each pixel takes one 8 byte load
+ * and two shuffles sort the pairs into left and right texels.
+ */
+void sample_sdf_row_sse2(SdfRow const &row, i32 x, i32 count, u32 *out)
+{
+    auto invScale = _mm_set1_ps(row.invScale);
+    auto offset   = _mm_set1_ps(row.offset);
+    auto slope    = _mm_set1_ps(row.slope);
+    auto bias     = _mm_set1_ps(row.bias);
+    auto zero     = _mm_setzero_ps();
+    auto one      = _mm_set1_ps(1.0f);
+    auto last     = _mm_set1_ps(f32(row.cellWidth - 1));
+    auto left     = _mm_set1_ps(f32(row.cellWidth - 2));
+    auto steps    = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    i32  idx      = 0;
+
+    auto pair = [&](i32 column) { return _mm_castsi128_ps(_mm_loadl_epi64((__m128i const *)(row.values + column))); };
+
+    for (; idx + 4 <= count; idx += 4) {
+        auto xs = _mm_add_ps(_mm_set1_ps(f32(x + idx)), steps);
+        auto u  = _mm_add_ps(_mm_mul_ps(xs, invScale), offset);
+        u       = _mm_min_ps(_mm_max_ps(u, zero), last);
+
+        auto i0 = _mm_cvttps_epi32(_mm_min_ps(u, left));
+        auto fx = _mm_sub_ps(u, _mm_cvtepi32_ps(i0));
+
+        auto p01 = _mm_movelh_ps(pair(_mm_cvtsi128_si32(i0)), pair(_mm_cvtsi128_si32(_mm_shuffle_epi32(i0, 1))));
+        auto p23 = _mm_movelh_ps(pair(_mm_cvtsi128_si32(_mm_shuffle_epi32(i0, 2))), pair(_mm_cvtsi128_si32(_mm_shuffle_epi32(i0, 3))));
+        auto a   = _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(2, 0, 2, 0));
+        auto b   = _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(3, 1, 3, 1));
+
+        auto value    = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), fx));
+        auto coverage = _mm_add_ps(_mm_mul_ps(value, slope), bias);
+        coverage      = _mm_min_ps(_mm_max_ps(coverage, zero), one);
+
+        auto alpha = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(coverage, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+        auto pixel = _mm_or_si128(_mm_or_si128(alpha, _mm_slli_epi32(alpha, 8)),
+                                  _mm_or_si128(_mm_slli_epi32(alpha, 16), _mm_slli_epi32(alpha, 24)));
+
+        _mm_storeu_si128((__m128i *)(out + idx), pixel);
+    }
+
+    sample_sdf_row_scalar(row, x + idx, count - idx, out + idx);
+}
+
+// Eight pixels at a time, with both texels of each gathered.
+TARGET_AVX2 void sample_sdf_row_avx2(SdfRow const &row, i32 x, i32 count, u32 *out)
+{
+    auto invScale = _mm256_set1_ps(row.invScale);
+    auto offset   = _mm256_set1_ps(row.offset);
+    auto slope    = _mm256_set1_ps(row.slope);
+    auto bias     = _mm256_set1_ps(row.bias);
+    auto zero     = _mm256_setzero_ps();
+    auto one      = _mm256_set1_ps(1.0f);
+    auto last     = _mm256_set1_ps(f32(row.cellWidth - 1));
+    auto left     = _mm256_set1_ps(f32(row.cellWidth - 2));
+    auto steps    = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    i32  idx      = 0;
+
+    for (; idx + 8 <= count; idx += 8) {
+        auto xs = _mm256_add_ps(_mm256_set1_ps(f32(x + idx)), steps);
+        auto u  = _mm256_add_ps(_mm256_mul_ps(xs, invScale), offset);
+        u       = _mm256_min_ps(_mm256_max_ps(u, zero), last);
+
+        auto i0 = _mm256_cvttps_epi32(_mm256_min_ps(u, left));
+        auto fx = _mm256_sub_ps(u, _mm256_cvtepi32_ps(i0));
+        auto a  = _mm256_i32gather_ps(row.values, i0, 4);
+        auto b  = _mm256_i32gather_ps(row.values + 1, i0, 4);
+
+        auto value    = _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), fx));
+        auto coverage = _mm256_add_ps(_mm256_mul_ps(value, slope), bias);
+        coverage      = _mm256_min_ps(_mm256_max_ps(coverage, zero), one);
+
+        auto alpha = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(coverage, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+        auto pixel = _mm256_mullo_epi32(alpha, _mm256_set1_epi32(0x01010101));
+
+        _mm256_storeu_si256((__m256i *)(out + idx), pixel);
+    }
+
+    sample_sdf_row_sse2(row, x + idx, count - idx, out + idx);
+}
+
+#endif
+
+typedef void SdfRowSampler(SdfRow const &row, i32 x, i32 count, u32 *out);
+
+SdfRowSampler *SDF_ROW_SAMPLERS[Composite_LevelCount] = {
+    sample_sdf_row_scalar,
+#if defined(COMPOSITE_X86)
+    sample_sdf_row_sse2,
+    sample_sdf_row_avx2,
+#else
+    sample_sdf_row_scalar,
+    sample_sdf_row_scalar,
+#endif
+};
+
+// Follows the compositing level.
+inline SdfRowSampler *sdf_row_sampler()
+{
+    return SDF_ROW_SAMPLERS[kernels() - COMPOSITE_KERNELS];
+}
+
+/**
+ * @return The advance of text in em.
+ */
+f32 sdf_text_advance(SdfFont const &font, wchar_t const *text)
+{
+    f32 advance = 0.0f;
+
+    for (u32 idx = 0; text[idx]; ++idx) {
+        auto glyph = find_sdf_glyph(font, u32(text[idx]) & 0xFFFF);
+        advance += glyph ? glyph->advance : 0.5f;
+    }
+
+    return advance;
+}
+
+/**
+ * Draw text in a premultiplied color over a surface, with the top left
+ * corner of its line box at x, y and an em of size pixels.  Characters
+ * the font doesn't have are left as half an em of space.
+ *
+ * Text smaller than SDF_SUPERSAMPLE_SIZE has strokes about a pixel
+ * wide, where the coverage of a pixel depends on both edges of a stroke
+ * rather than the nearest one, so each pixel is the mean of four
+ * samples with edges half a pixel wide.
+ */
+void draw_sdf_text(Surface *surface, SdfFont const &font, wchar_t const *text, f32 x, f32 y, f32 size, u32 color)
+{
+    constexpr i32 SPAN = 256;  // samples
+
+    auto samples  = size < SDF_SUPERSAMPLE_SIZE ? 2 : 1;
+    auto scale    = size / f32(SDF_EM);        // pixels per texel
+    auto invScale = 1.0f / (scale * samples);  // texels per sample
+    auto slope    = SDF_SPREAD * scale * samples / 127.0f;
+    auto sample   = sdf_row_sampler();
+    auto blit     = kernels()->blit;
+
+    f32 values[2][SDF_ATLAS_WIDTH];
+    u32 span[SPAN];
+    u32 sums[SPAN];
+
+    for (u32 idx = 0; text[idx]; ++idx) {
+        auto glyph = find_sdf_glyph(font, u32(text[idx]) & 0xFFFF);
+
+        if (!glyph) {
+            x += 0.5f * size;
+            continue;
+        }
+
+        // The cell in destination pixels.
+        auto cell_x = x - SDF_PADDING * scale;
+        auto cell_y = y - SDF_PADDING * scale;
+        auto x0     = i32(floorf(cell_x));
+        auto y0     = i32(floorf(cell_y));
+        auto x1     = i32(ceilf(cell_x + font.cellWidth * scale));
+        auto y1     = i32(ceilf(cell_y + font.cellHeight * scale));
+
+        x0 = x0 < 0 ? 0 : x0;
+        y0 = y0 < 0 ? 0 : y0;
+        x1 = x1 > surface->width ? surface->width : x1;
+        y1 = y1 > surface->height ? surface->height : y1;
+
+        // Samples are numbered like pixels of the text drawn samples
+        // times larger.
+        SdfRow rows[2];
+        for (i32 sy = 0; sy < samples; ++sy) {
+            rows[sy] = SdfRow{ values[sy],
+                               font.cellWidth,
+                               invScale,
+                               (0.5f - cell_x * samples) * invScale - 0.5f,
+                               slope,
+                               0.5f - 128.0f * slope };
+        }
+
+        auto *cell = font.texels + size_t(glyph->y) * font.width + glyph->x;
+
+        for (i32 py = y0; py < y1; ++py) {
+            for (i32 sy = 0; sy < samples; ++sy) {
+                auto v  = (f32(py * samples + sy) + 0.5f - cell_y * samples) * invScale - 0.5f;
+                auto iv = i32(floorf(v));
+                auto fy = v - f32(iv);
+                auto r0 = iv < 0 ? 0 : (iv >= font.cellHeight ? font.cellHeight - 1 : iv);
+                auto r1 = iv + 1 < 0 ? 0 : (iv + 1 >= font.cellHeight ? font.cellHeight - 1 : iv + 1);
+
+                auto *above = cell + size_t(r0) * font.width;
+                auto *below = cell + size_t(r1) * font.width;
+
+                for (i32 col = 0; col < font.cellWidth; ++col)
+                    values[sy][col] = f32(above[col]) + (f32(below[col]) - f32(above[col])) * fy;
+            }
+
+            auto *line = surface->pixels + size_t(py) * surface->stride;
+
+            for (i32 px = x0; px < x1; px += SPAN / samples) {
+                auto count = x1 - px < SPAN / samples ? x1 - px : SPAN / samples;
+
+                if (samples == 1) {
+                    sample(rows[0], px, count, span);
+                }
+                else {
+                    memset(sums, 0, count * sizeof(u32));
+
+                    for (i32 sy = 0; sy < samples; ++sy) {
+                        sample(rows[sy], px * samples, count * samples, span);
+                        for (i32 at = 0; at < count; ++at)
+                            sums[at] += (span[2*at] >> 24) + (span[2*at + 1] >> 24);
+                    }
+
+                    for (i32 at = 0; at < count; ++at)
+                        span[at] = (sums[at] + 2) / 4 * 0x01010101u;
+                }
+
+                if (color != 0xFFFFFFFF) {
+                    for (i32 at = 0; at < count; ++at)
+                        span[at] = scale_pixel(color, span[at] >> 24);
+                }
+
+                blit(line + px, span, count, 255);
+            }
+        }
+
+        x += glyph->advance * size;
+    }
+}
+
+/**
+ * Size every label as drawn with the letter font at letterSize pixels,
+ * and a line of the modifier stack with the modifier font, the way
+ * measure_labels does with GDI+.
+ */
+void measure_sdf_labels(LabelMeasurements *labels,
+                        SdfFont const &letters,
+                        SdfFont const &modifiers,
+                        f32 letterSize,
+                        f32 modifierSize)
+{
+    for (u32 vk = 0; vk < COUNT_OF(labels->keys); ++vk) {
+        for (u32 level = 0; level < KeyLevel_Count; ++level) {
+            auto key = key_label(vk, KeyLevel(level));
+
+            labels->keys[vk][level] = LabelSize{};
+            if (key[0] == L'\0')
+                continue;
+
+            auto advance = sdf_text_advance(letters, key) + 2.0f * SDF_LABEL_MARGIN;
+            labels->keys[vk][level] = LabelSize{ advance * letterSize, letters.lineHeight * letterSize };
+        }
+    }
+
+    for (u32 idx = 0; idx < COUNT_OF(labels->chords); ++idx) {
+        auto chord = chord_label(idx + 1);
+
+        labels->chords[idx] = LabelSize{};
+        if (chord[0] == L'\0')
+            continue;
+
+        auto advance = sdf_text_advance(letters, chord) + 2.0f * SDF_LABEL_MARGIN;
+        labels->chords[idx] = LabelSize{ advance * letterSize, letters.lineHeight * letterSize };
+    }
+
+    auto advance = sdf_text_advance(modifiers, L"SHIFT") + 2.0f * SDF_LABEL_MARGIN;
+    labels->modifier = LabelSize{ advance * modifierSize, modifiers.lineHeight * modifierSize };
+}
+
+/**
+ * Call draw(surface, text, y, isModifier) for every line of text in an
+ * atlas, with a surface covering just the sprite the line belongs to so
+ * drawing can't spill into the sprites around it.  Lines of a modifier
+ * stack are lineHeight pixels apart.
+ */
+template <typename DrawText>
+void draw_atlas_labels(GlyphAtlas *atlas, f32 lineHeight, DrawText draw)
+{
+    auto sprite_surface = [&](Sprite sprite) {
+        return Surface{ atlas->pixels + size_t(sprite.y) * atlas->width + sprite.x,
+                        sprite.width,
+                        sprite.height,
+                        atlas->width };
+    };
+
+    for (u32 vk = 0; vk < COUNT_OF(atlas->keys); ++vk) {
+        for (u32 level = 0; level < KeyLevel_Count; ++level) {
+            auto sprite = atlas->keys[vk][level];
+            if (sprite.width == 0)
+                continue;
+
+            auto surface = sprite_surface(sprite);
+            draw(&surface, key_label(vk, KeyLevel(level)), 0.0f, false);
+        }
+    }
+
+    for (u32 idx = 0; idx < COUNT_OF(atlas->chords); ++idx) {
+        auto sprite = atlas->chords[idx];
+        if (sprite.width == 0)
+            continue;
+
+        auto surface = sprite_surface(sprite);
+        draw(&surface, chord_label(idx + 1), 0.0f, false);
+    }
+
+    for (u32 mods = 1; mods < COUNT_OF(atlas->modifiers); ++mods) {
+        auto sprite = atlas->modifiers[mods];
+        if (sprite.width == 0)
+            continue;
+
+        auto surface = sprite_surface(sprite);
+
+        if (mods & Modifier_Ctrl)
+            draw(&surface, L"CTRL", 0.0f, true);
+        if (mods & Modifier_Alt)
+            draw(&surface, L"ALT", lineHeight, true);
+        if (mods & Modifier_Shift)
+            draw(&surface, L"SHIFT", 2.0f * lineHeight, true);
+    }
+}
+
+/**
+ * Draw every label and modifier stack into an atlas that was laid out
+ * from measure_sdf_labels with the same fonts and sizes, in a
+ * premultiplied color.
+ */
+void draw_sdf_labels(GlyphAtlas *atlas,
+                     LabelMeasurements const &labels,
+                     SdfFont const &letters,
+                     SdfFont const &modifiers,
+                     f32 letterSize,
+                     f32 modifierSize,
+                     u32 color)
+{
+    draw_atlas_labels(atlas, labels.modifier.height, [&](Surface *surface, wchar_t const *text, f32 y, bool isModifier) {
+        auto &font = isModifier ? modifiers : letters;
+        auto  size = isModifier ? modifierSize : letterSize;
+
+        draw_sdf_text(surface, font, text, SDF_LABEL_MARGIN * size, y, size, color);
+    });
+}
@@ -0,0 +1,199 @@
+
+/*
+ * Distance field fonts baked into the binary ahead of time, so the
+ * labels of the default font can be drawn without asking the platform
+ * to rasterize anything.  shoki-bake builds the fonts the same way the
+ * overlay would and writes them out as C++ source, which the overlay
+ * picks up when it's built after it (see baked_fonts.inc in main.cpp).
+ *
+ * The texels are packed with PackBits.  Everything further than
+ * SDF_SPREAD outside a glyph is zero, which is most of a cell, so the
+ * fields shrink to a fraction of their size and unpack in one pass.
+ */
+
+struct BakedSdfFont {
+    wchar_t const  *family;
+    i32             width;
+    i32             height;
+    i32             cellWidth;
+    i32             cellHeight;
+    f32             lineHeight;
+    u32             glyphCount;
+    SdfGlyph const *glyphs;
+    u8 const       *packed;
+    u32             packedSize;
+};
+
+/**
+ * Pack bytes as runs of a repeated byte, a header of 257 - length and
+ * the byte, and stretches of literals, a header of length - 1 and the
+ * bytes, with at most 128 to either.
+ *
+ * @return The packed size, or zero if it doesn't fit in capacity.
+ */
+u32 pack_texels(u8 const *texels, u32 count, u8 *out, u32 capacity)
+{
+    u32 at  = 0;
+    u32 idx = 0;
+
+    while (idx < count) {
+        u32 run = 1;
+        while (idx + run < count && run < 128 && texels[idx + run] == texels[idx])
+            ++run;
+
+        if (run >= 3) {
+            if (at + 2 > capacity)
+                return 0;
+
+            out[at++] = u8(257 - run);
+            out[at++] = texels[idx];
+            idx += run;
+            continue;
+        }
+
+        // Literals up to the next run of three.
+        u32 length = 0;
+        while (idx + length < count && length < 128) {
+            auto next = idx + length;
+            if (next + 2 < count && texels[next] == texels[next + 1] && texels[next] == texels[next + 2])
+                break;
+            ++length;
+        }
+
+        if (at + 1 + length > capacity)
+            return 0;
+
+        out[at++] = u8(length - 1);
+        memcpy(out + at, texels + idx, length);
+        at  += length;
+        idx += length;
+    }
+
+    return at;
+}
+
+/**
+ * @return False if the packed bytes don't unpack to exactly count.
+ */
+bool unpack_texels(u8 const *packed, u32 size, u8 *out, u32 count)
+{
+    u32 at  = 0;
+    u32 idx = 0;
+
+    while (idx < size) {
+        auto header = packed[idx++];
+
+        if (header < 128) {
+            u32 length = header + 1u;
+            if (idx + length > size || at + length > count)
+                return false;
+
+            memcpy(out + at, packed + idx, length);
+            idx += length;
+            at  += length;
+        }
+        else {
+            u32 run = 257u - header;
+            if (idx >= size || at + run > count)
+                return false;
+
+            memset(out + at, packed[idx++], run);
+            at += run;
+        }
+    }
+
+    return at == count;
+}
+
+/**
+ * @return True if a baked font has every one of some sorted
+ * characters.
+ */
+bool does_baked_font_cover(BakedSdfFont const &baked, u32 const *codepoints, u32 count)
+{
+    u32 glyph = 0;
+
+    for (u32 idx = 0; idx < count; ++idx) {
+        while (glyph < baked.glyphCount && baked.glyphs[glyph].codepoint < codepoints[idx])
+            ++glyph;
+
+        if (glyph == baked.glyphCount || baked.glyphs[glyph].codepoint != codepoints[idx])
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Unpack a baked font into one that draws like it was just built.
+ *
+ * @return False if the texels couldn't be allocated or don't unpack.
+ */
+bool load_baked_sdf_font(BakedSdfFont const &baked, SdfFont *font)
+{
+    free_sdf_font(font);
+
+    if (baked.glyphCount > MAX_SDF_GLYPHS)
+        return false;
+
+    auto count = u32(baked.width) * u32(baked.height);
+
+    font->texels = (u8 *)malloc(count);
+    if (!font->texels || !unpack_texels(baked.packed, baked.packedSize, font->texels, count)) {
+        free_sdf_font(font);
+        return false;
+    }
+
+    font->width      = baked.width;
+    font->height     = baked.height;
+    font->cellWidth  = baked.cellWidth;
+    font->cellHeight = baked.cellHeight;
+    font->lineHeight = baked.lineHeight;
+    font->glyphCount = baked.glyphCount;
+    memcpy(font->glyphs, baked.glyphs, baked.glyphCount * sizeof(SdfGlyph));
+
+    return true;
+}
+
+/**
+ * Write a font as C++ source defining a BakedSdfFont called name.
+ *
+ * @return False if the texels couldn't be packed or the family isn't
+ * plain ASCII.
+ */
+bool write_baked_sdf_font(FILE *out, char const *name, wchar_t const *family, SdfFont const &font)
+{
+    auto count    = u32(font.width) * u32(font.height);
+    auto capacity = count + count / 128 + 1;
+    auto packed   = (u8 *)malloc(capacity);
+    defer(free(packed));
+
+    auto size = packed ? pack_texels(font.texels, count, packed, capacity) : 0;
+    if (size == 0)
+        return false;
+
+    fprintf(out, "static SdfGlyph const %s_GLYPHS[] = {\n", name);
+    for (u32 idx = 0; idx < font.glyphCount; ++idx) {
+        auto &glyph = font.glyphs[idx];
+        fprintf(out, "    { 0x%04X, %.9gf, %u, %u },\n", glyph.codepoint, glyph.advance, glyph.x, glyph.y);
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static u8 const %s_TEXELS[] = {", name);
+    for (u32 idx = 0; idx < size; ++idx)
+        fprintf(out, "%s%u,", idx % 24 == 0 ? "\n    " : "", packed[idx]);
+    fprintf(out, "\n};\n\n");
+
+    // Font families in the config are ASCII anyway.
+    fprintf(out, "static BakedSdfFont const %s = {\n    L\"", name);
+    for (u32 idx = 0; family[idx]; ++idx) {
+        if (family[idx] < 0x20 || family[idx] > 0x7E || family[idx] == L'"' || family[idx] == L'\\')
+            return false;
+        fputc(char(family[idx]), out);
+    }
+    fprintf(out, "\",\n");
+    fprintf(out, "    %d, %d, %d, %d, %.9gf, %u,\n", font.width, font.height, font.cellWidth, font.cellHeight, font.lineHeight, font.glyphCount);
+    fprintf(out, "    %s_GLYPHS,\n    %s_TEXELS,\n    %u,\n};\n\n", name, name, size);
+
+    return !ferror(out);
+}
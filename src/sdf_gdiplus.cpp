@@ -0,0 +1,97 @@
+
+/*
+ * Distance field fonts from fonts installed on Windows, rasterized
+ * with GDI+.  Shared by the overlay and shoki-bake, which bakes the
+ * default font into the overlay ahead of time.
+ */
+
+/**
+ * Rasterize the glyphs of a font once with GDI+, large enough for
+ * set_sdf_glyph, and turn them into distance fields.  Glyphs are drawn
+ * with the typographic format so their line box starts right at the
+ * point they're drawn at, and anti-aliased without grid fitting since
+ * hinting at this size means nothing at the sizes they're drawn at.
+ *
+ * @param measureCalls Counts the strings measured.
+ * @return False if GDI+ failed to draw a glyph or the field couldn't
+ * be allocated.
+ */
+bool build_sdf_font_gdiplus(SdfFont *sdf,
+                            wchar_t const *familyName,
+                            i32 style,
+                            u32 const *codepoints,
+                            u32 count,
+                            u32 *measureCalls)
+{
+    constexpr f32 EM = f32(SDF_EM * SDF_OVERSAMPLE);
+
+    gp::FontFamily family(familyName);
+    gp::Font       face(&family, EM, style, gp::UnitPixel);
+    gp::StringFormat format(gp::StringFormat::GenericTypographic());
+    format.SetFormatFlags(format.GetFormatFlags() | gp::StringFormatFlagsMeasureTrailingSpaces);
+
+    auto lineHeight = f32(family.GetLineSpacing(style)) / f32(family.GetEmHeight(style));
+
+    // Advances first, since the widest one sizes every cell.
+    gp::Bitmap   scratch(1, 1, PixelFormat32bppPARGB);
+    gp::Graphics measure(&scratch);
+    f32          advances[MAX_SDF_GLYPHS];
+    f32          maxAdvance = 0.0f;
+
+    count = count < MAX_SDF_GLYPHS ? count : MAX_SDF_GLYPHS;
+
+    for (u32 idx = 0; idx < count; ++idx) {
+        wchar_t text[2] = { wchar_t(codepoints[idx]), 0 };
+        gp::RectF dim;
+
+        measure.MeasureString(text, 1, &face, gp::PointF(0.0f, 0.0f), &format, &dim);
+        ++*measureCalls;
+
+        advances[idx] = dim.Width / EM;
+        maxAdvance    = advances[idx] > maxAdvance ? advances[idx] : maxAdvance;
+    }
+
+    if (!begin_sdf_font(sdf, codepoints, count, maxAdvance, lineHeight))
+        return false;
+
+    i32 width, height;
+    sdf_source_size(*sdf, &width, &height);
+
+    gp::Bitmap     source(width, height, PixelFormat32bppPARGB);
+    gp::Graphics   graphics(&source);
+    gp::SolidBrush white(gp::Color(255, 255, 255, 255));
+
+    graphics.SetTextRenderingHint(gp::TextRenderingHintAntiAlias);
+
+    auto coverage = (u8 *)malloc(size_t(width) * height);
+    defer(free(coverage));
+    if (!coverage)
+        return false;
+
+    auto origin = gp::PointF(f32(sdf_source_origin()), f32(sdf_source_origin()));
+    auto rect   = gp::Rect(0, 0, width, height);
+    auto isOk   = true;
+
+    for (u32 idx = 0; idx < sdf->glyphCount; ++idx) {
+        wchar_t text[2] = { wchar_t(codepoints[idx]), 0 };
+
+        graphics.Clear(gp::Color(0, 0, 0, 0));
+        isOk &= graphics.DrawString(text, 1, &face, origin, &format, &white) == gp::Ok;
+        graphics.Flush(gp::FlushIntentionSync);
+
+        gp::BitmapData data;
+        if (source.LockBits(&rect, gp::ImageLockModeRead, PixelFormat32bppPARGB, &data) != gp::Ok)
+            continue;
+
+        for (i32 y = 0; y < height; ++y) {
+            auto *row = (u32 const *)((u8 const *)data.Scan0 + y * data.Stride);
+            for (i32 x = 0; x < width; ++x)
+                coverage[y*width + x] = u8(row[x] >> 24);
+        }
+
+        source.UnlockBits(&data);
+        set_sdf_glyph(sdf, idx, advances[idx], coverage, width);
+    }
+
+    return isOk;
+}
@@ -0,0 +1,277 @@
+
+/*
+ * A stroke font for the headless tools, which have no font system to
+ * rasterize labels with.  Glyphs are polylines on a 5 by 7 grid drawn
+ * with round pens, so the distance from any point to a glyph can be
+ * worked out exactly and the same glyphs can be rasterized directly at
+ * any size, which makes them a reference for the fields in sdf_atlas.cpp
+ * as well as a source for them.  Lowercase letters are drawn as
+ * uppercase.
+ *
+ * Strokes are strings of two digit x y grid points, with a space
+ * between polylines.  A point on its own is a dot.
+ */
+
+struct SegmentGlyph {
+    wchar_t     codepoint;
+    char const *strokes;
+};
+
+constexpr SegmentGlyph SEGMENT_GLYPHS[] = {
+    { L'!',  "2024 2626" },
+    { L'"',  "1012 3032" },
+    { L'#',  "1016 3036 0242 0444" },
+    { L'$',  "413010010213334445361605 2026" },
+    { L'%',  "4006 0101 4545" },
+    { L'&',  "4612112031320405162644" },
+    { L'\'', "2022" },
+    { L'(',  "30121436" },
+    { L')',  "10323416" },
+    { L'*',  "2125 0244 0442" },
+    { L'+',  "0343 2125" },
+    { L',',  "2516" },
+    { L'-',  "0343" },
+    { L'.',  "2626" },
+    { L'/',  "4006" },
+    { L'0',  "103041453616050110 4105" },
+    { L'1',  "112026 1636" },
+    { L'2',  "01103041420646" },
+    { L'3',  "01103041423313 334445361605" },
+    { L'4',  "36300444" },
+    { L'5',  "4000033344453606" },
+    { L'6',  "30100105163645443303" },
+    { L'7',  "004016" },
+    { L'8',  "13020110304142331304051636454433" },
+    { L'9',  "43130201103041453616" },
+    { L':',  "2222 2525" },
+    { L';',  "2222 2416" },
+    { L'<',  "410345" },
+    { L'=',  "0242 0444" },
+    { L'>',  "014305" },
+    { L'?',  "01103041422324 2626" },
+    { L'@',  "343212144441301001051646" },
+    { L'A',  "0602204246 0343" },
+    { L'B',  "003041423303 334445360600" },
+    { L'C',  "4130100105163645" },
+    { L'D',  "00204244260600" },
+    { L'E',  "40000646 0333" },
+    { L'F',  "400006 0333" },
+    { L'G',  "41301001051636454323" },
+    { L'H',  "0006 4046 0343" },
+    { L'I',  "1030 2026 1636" },
+    { L'J',  "4045361605" },
+    { L'K',  "0006 4004 1346" },
+    { L'L',  "000646" },
+    { L'M',  "0600234046" },
+    { L'N',  "06004640" },
+    { L'O',  "103041453616050110" },
+    { L'P',  "06003041423303" },
+    { L'Q',  "103041453616050110 2346" },
+    { L'R',  "06003041423303 2346" },
+    { L'S',  "413010010213334445361605" },
+    { L'T',  "0040 2026" },
+    { L'U',  "000516364540" },
+    { L'V',  "002640" },
+    { L'W',  "0016233640" },
+    { L'X',  "0046 4006" },
+    { L'Y',  "002340 2326" },
+    { L'Z',  "00400646" },
+    { L'[',  "30101636" },
+    { L'\\', "0046" },
+    { L']',  "10303616" },
+    { L'^',  "022042" },
+    { L'_',  "0646" },
+    { L'`',  "1021" },
+    { L'{',  "302011120314152636" },
+    { L'|',  "2026" },
+    { L'}',  "102031324334352616" },
+    { L'~',  "03123443" },
+};
+
+// Placement of the grid in a glyph's line box, in em.
+constexpr f32 SEGMENT_ADVANCE     = 0.55f;
+constexpr f32 SEGMENT_LINE_HEIGHT = 1.2f;
+constexpr f32 SEGMENT_LEFT        = 0.08f;
+constexpr f32 SEGMENT_TOP         = 0.2f;
+constexpr f32 SEGMENT_STEP_X      = 0.1f;
+constexpr f32 SEGMENT_STEP_Y      = 0.125f;
+constexpr f32 SEGMENT_HALF_WIDTH  = 0.045f;
+
+/**
+ * @return The strokes of a character, or null if the font doesn't have
+ * it.
+ */
+char const *segment_strokes(u32 codepoint)
+{
+    if (codepoint >= 'a' && codepoint <= 'z')
+        codepoint -= 'a' - 'A';
+
+    for (auto &glyph : SEGMENT_GLYPHS) {
+        if (u32(glyph.codepoint) == codepoint)
+            return glyph.strokes;
+    }
+
+    return nullptr;
+}
+
+/**
+ * @return The signed distance in em from a point of a glyph's line box
+ * to the edge of its strokes, negative inside them.
+ */
+f32 segment_distance(char const *strokes, f32 x, f32 y)
+{
+    auto nearest = 1e20f;
+
+    auto point_x = [](char digit) { return SEGMENT_LEFT + f32(digit - '0') * SEGMENT_STEP_X; };
+    auto point_y = [](char digit) { return SEGMENT_TOP + f32(digit - '0') * SEGMENT_STEP_Y; };
+
+    for (auto at = strokes; *at;) {
+        if (*at == ' ') {
+            ++at;
+            continue;
+        }
+
+        auto ax = point_x(at[0]);
+        auto ay = point_y(at[1]);
+        at += 2;
+
+        // A point on its own is a stroke of no length.
+        auto isDot = *at == '\0' || *at == ' ';
+
+        do {
+            auto bx = isDot ? ax : point_x(at[0]);
+            auto by = isDot ? ay : point_y(at[1]);
+
+            auto dx = bx - ax;
+            auto dy = by - ay;
+            auto px = x - ax;
+            auto py = y - ay;
+            auto t  = dx*dx + dy*dy > 0.0f ? (px*dx + py*dy) / (dx*dx + dy*dy) : 0.0f;
+            t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+
+            auto ex = px - t*dx;
+            auto ey = py - t*dy;
+            auto d2 = ex*ex + ey*ey;
+            nearest = d2 < nearest ? d2 : nearest;
+
+            if (isDot)
+                break;
+
+            ax  = bx;
+            ay  = by;
+            at += 2;
+        } while (*at && *at != ' ');
+    }
+
+    return sqrtf(nearest) - SEGMENT_HALF_WIDTH;
+}
+
+/**
+ * @return Coverage from 0 to 1 of a square of a glyph's line box with
+ * its top left corner at x, y and sides of size em, from samples by
+ * samples points.
+ */
+f32 segment_coverage(char const *strokes, f32 x, f32 y, f32 size, i32 samples)
+{
+    auto step   = size / f32(samples);
+    auto inside = 0;
+
+    for (i32 sy = 0; sy < samples; ++sy) {
+        for (i32 sx = 0; sx < samples; ++sx)
+            inside += segment_distance(strokes, x + (f32(sx) + 0.5f) * step, y + (f32(sy) + 0.5f) * step) < 0.0f;
+    }
+
+    return f32(inside) / f32(samples * samples);
+}
+
+/**
+ * Build a signed distance field font with the glyphs of some
+ * characters, leaving the ones the stroke font doesn't have empty.
+ */
+bool build_segment_sdf_font(SdfFont *font, u32 const *codepoints, u32 count)
+{
+    if (!begin_sdf_font(font, codepoints, count, SEGMENT_ADVANCE, SEGMENT_LINE_HEIGHT))
+        return false;
+
+    i32 width, height;
+    sdf_source_size(*font, &width, &height);
+
+    auto coverage = (u8 *)malloc(size_t(width) * height);
+    if (!coverage)
+        return false;
+    defer(free(coverage));
+
+    auto pixel = 1.0f / f32(SDF_EM * SDF_OVERSAMPLE);  // em
+    auto left  = f32(sdf_source_origin()) * pixel;
+
+    for (u32 idx = 0; idx < font->glyphCount; ++idx) {
+        auto strokes = segment_strokes(font->glyphs[idx].codepoint);
+
+        for (i32 y = 0; y < height; ++y) {
+            for (i32 x = 0; x < width; ++x) {
+                // Coverage from the distance at the pixel's centre, which
+                // is exact for straight edges.
+                auto distance = strokes ? segment_distance(strokes, (f32(x) + 0.5f) * pixel - left, (f32(y) + 0.5f) * pixel - left) : 1.0f;
+                auto cover    = 0.5f - distance / pixel;
+
+                cover = cover < 0.0f ? 0.0f : (cover > 1.0f ? 1.0f : cover);
+                coverage[y*width + x] = u8(cover * 255.0f + 0.5f);
+            }
+        }
+
+        set_sdf_glyph(font, idx, SEGMENT_ADVANCE, coverage, width);
+    }
+
+    return true;
+}
+
+/**
+ * Rasterize text straight from the strokes, in white over a surface,
+ * the way a font system would.  The top left corner of its line box is
+ * at x, y and an em is size pixels.
+ */
+void draw_segment_text(Surface *surface, wchar_t const *text, f32 x, f32 y, f32 size)
+{
+    constexpr i32 SAMPLES = 8;
+
+    auto blit  = kernels()->blit;
+    auto pixel = 1.0f / size;  // em
+
+    for (u32 idx = 0; text[idx]; ++idx, x += SEGMENT_ADVANCE * size) {
+        auto strokes = segment_strokes(u32(text[idx]));
+        if (!strokes)
+            continue;
+
+        auto x0 = i32(floorf(x));
+        auto y0 = i32(floorf(y));
+        auto x1 = i32(ceilf(x + SEGMENT_ADVANCE * size));
+        auto y1 = i32(ceilf(y + SEGMENT_LINE_HEIGHT * size));
+
+        x0 = x0 < 0 ? 0 : x0;
+        y0 = y0 < 0 ? 0 : y0;
+        x1 = x1 > surface->width ? surface->width : x1;
+        y1 = y1 > surface->height ? surface->height : y1;
+
+        for (i32 py = y0; py < y1; ++py) {
+            for (i32 px = x0; px < x1; ++px) {
+                auto cover = segment_coverage(strokes, (f32(px) - x) * pixel, (f32(py) - y) * pixel, pixel, SAMPLES);
+                auto alpha = u32(cover * 255.0f + 0.5f);
+                auto color = alpha * 0x01010101u;
+
+                blit(surface->pixels + size_t(py) * surface->stride + px, &color, 1, 255);
+            }
+        }
+    }
+}
+
+/**
+ * Draw every label into an atlas laid out from measure_sdf_labels for a
+ * stroke font, rasterizing them directly.
+ */
+void draw_segment_labels(GlyphAtlas *atlas, LabelMeasurements const &labels, f32 letterSize, f32 modifierSize)
+{
+    draw_atlas_labels(atlas, labels.modifier.height, [&](Surface *surface, wchar_t const *text, f32 y, bool isModifier) {
+        auto size = isModifier ? modifierSize : letterSize;
+        draw_segment_text(surface, text, SDF_LABEL_MARGIN * size, y, size);
+    });
+}
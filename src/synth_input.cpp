@@ -0,0 +1,224 @@
+
+/*
+ * Synthetic keyboard input for driving shoki without a keyboard.  The
+ * generators append key events with hook-style flags and millisecond
+ * timestamps to a stream.  Key presses are allowed to overlap, the way
+ * they do when someone types quickly, so a stream has to be sorted with
+ * synth_finish before it is replayed.
+ */
+struct SynthStream {
+    KeyEvent *events;
+    u32      *order;  // tie breaker that keeps equal times in push order
+    u32       count;
+    u32       capacity;
+    u32       time;   // where the next generator starts, in milliseconds
+    u64       random;
+
+    u32 next_random() {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        return u32(random >> 32);
+    }
+
+    // Uniformly distributed in [lo, hi].
+    u32 between(u32 lo, u32 hi) {
+        return lo + next_random() % (hi - lo + 1);
+    }
+
+    void push(u32 vk, bool isDown, u32 at) {
+        assert(count < capacity);
+        events[count] = KeyEvent{ vk, isDown ? 0 : KEY_FLAG_UP, at, 0 };
+        order[count]  = count;
+        ++count;
+    }
+};
+
+SynthStream make_synth_stream(u32 capacity, u64 seed)
+{
+    auto stream = SynthStream{};
+
+    stream.events   = (KeyEvent *)malloc(capacity * sizeof(KeyEvent));
+    stream.order    = (u32 *)malloc(capacity * sizeof(u32));
+    stream.capacity = capacity;
+    stream.time     = 1000;
+    stream.random   = seed ? seed : 1;
+
+    return stream;
+}
+
+void free_synth_stream(SynthStream *stream)
+{
+    free(stream->events);
+    free(stream->order);
+    *stream = SynthStream{};
+}
+
+/**
+ * Sort the stream's events by time so it can be replayed in order.
+ */
+void synth_finish(SynthStream *stream)
+{
+    auto *events = stream->events;
+    auto *order  = stream->order;
+
+    // Insertion sort since generators emit nearly sorted events.
+    for (u32 i = 1; i < stream->count; ++i) {
+        auto event = events[i];
+        auto seq   = order[i];
+        u32  j     = i;
+
+        while (j > 0 && (events[j - 1].time > event.time ||
+                         (events[j - 1].time == event.time && order[j - 1] > seq))) {
+            events[j] = events[j - 1];
+            order[j]  = order[j - 1];
+            --j;
+        }
+
+        events[j] = event;
+        order[j]  = seq;
+    }
+}
+
+/*
+ * Keys typed in prose, weighted roughly by how often they come up.
+ */
+constexpr u32 SYNTH_TYPING_KEYS[] = {
+    0x45, 0x54, 0x41, 0x4F, 0x49, 0x4E, 0x53, 0x48, 0x52, 0x44, 0x4C, 0x55,
+    0x45, 0x54, 0x41, 0x4F, 0x49, 0x4E, 0x20, 0x20, 0x20, 0x20, 0x43, 0x4D,
+    0x57, 0x46, 0x47, 0x59, 0x50, 0x42, 0x56, 0x4B, 0x4A, 0x58, 0x51, 0x5A,
+    0xBC, 0xBE, 0x08, 0x0D, 0x31, 0x32, 0x30, 0xBF, 0xBA, 0xDE,
+};
+
+/**
+ * Bursty typing: runs of keys at about keysPerSecond with a realistic
+ * spread of dwell and flight times, roughly one in ten of them shifted,
+ * and a pause after each burst long enough for the box to fade.
+ */
+void synth_typing(SynthStream *stream, u32 keyCount, u32 keysPerSecond)
+{
+    auto interval = 1000 / keysPerSecond;
+    auto t        = stream->time;
+
+    for (u32 key = 0; key < keyCount; ++key) {
+        auto vk    = SYNTH_TYPING_KEYS[stream->next_random() % COUNT_OF(SYNTH_TYPING_KEYS)];
+        auto dwell = stream->between(40, 110);
+
+        if (stream->next_random() % 10 == 0) {
+            stream->push(KEY_LSHIFT, true, t - 20);
+            stream->push(vk, true, t);
+            stream->push(vk, false, t + dwell);
+            stream->push(KEY_LSHIFT, false, t + dwell + 15);
+        }
+        else {
+            stream->push(vk, true, t);
+            stream->push(vk, false, t + dwell);
+        }
+
+        t += stream->between(interval * 6 / 10, interval * 14 / 10);
+
+        if (key % 40 == 39)
+            t += stream->between(800, 2000);
+    }
+
+    stream->time = t + 1000;
+}
+
+/**
+ * Very fast typing at keysPerSecond, 50 or more, where every key is
+ * held across the next one or two, and shift is often let go of after
+ * the key it modifies goes down but before that key comes back up.
+ */
+void synth_fast_typing(SynthStream *stream, u32 keyCount, u32 keysPerSecond)
+{
+    auto interval = 1000 / keysPerSecond;
+    auto t        = stream->time;
+
+    for (u32 key = 0; key < keyCount; ++key) {
+        auto vk    = SYNTH_TYPING_KEYS[stream->next_random() % COUNT_OF(SYNTH_TYPING_KEYS)];
+        auto dwell = stream->between(interval, 3*interval);
+
+        if (stream->next_random() % 4 == 0) {
+            auto shift = stream->next_random() % 2 ? KEY_LSHIFT : KEY_RSHIFT;
+
+            stream->push(shift, true, t - interval/2);
+            stream->push(vk, true, t);
+            stream->push(shift, false, t + stream->between(1, dwell - 1));
+            stream->push(vk, false, t + dwell);
+        }
+        else {
+            stream->push(vk, true, t);
+            stream->push(vk, false, t + dwell);
+        }
+
+        t += stream->between(interval * 8 / 10, interval * 12 / 10);
+    }
+
+    stream->time = t + 1000;
+}
+
+/**
+ * A key held down long enough for auto-repeat, which sends a key down
+ * every repeatMilliseconds and a single key up at the end.
+ */
+void synth_repeat_storm(SynthStream *stream, u32 holds, u32 repeatsPerHold, u32 repeatMilliseconds)
+{
+    auto t = stream->time;
+
+    for (u32 hold = 0; hold < holds; ++hold) {
+        auto vk = SYNTH_TYPING_KEYS[stream->next_random() % COUNT_OF(SYNTH_TYPING_KEYS)];
+
+        for (u32 repeat = 0; repeat < repeatsPerHold; ++repeat) {
+            stream->push(vk, true, t);
+            t += repeatMilliseconds;
+        }
+
+        stream->push(vk, false, t);
+        t += stream->between(100, 400);
+    }
+
+    stream->time = t + 1000;
+}
+
+/**
+ * Editor style chords with one or more of CTRL, ALT and SHIFT held
+ * while a key is tapped, sometimes several taps per held chord.
+ */
+void synth_chords(SynthStream *stream, u32 chordCount)
+{
+    constexpr u32 MODIFIERS[] = { KEY_LCONTROL, KEY_LMENU, KEY_LSHIFT };
+
+    auto t = stream->time;
+
+    for (u32 chord = 0; chord < chordCount; ++chord) {
+        auto mods = stream->between(1, 7);
+        auto taps = stream->between(1, 3);
+
+        for (u32 idx = 0; idx < COUNT_OF(MODIFIERS); ++idx) {
+            if (mods & (1 << idx)) {
+                stream->push(MODIFIERS[idx], true, t);
+                t += stream->between(10, 40);
+            }
+        }
+
+        for (u32 tap = 0; tap < taps; ++tap) {
+            auto vk = SYNTH_TYPING_KEYS[stream->next_random() % COUNT_OF(SYNTH_TYPING_KEYS)];
+
+            stream->push(vk, true, t);
+            t += stream->between(40, 90);
+            stream->push(vk, false, t);
+            t += stream->between(60, 150);
+        }
+
+        for (u32 idx = 0; idx < COUNT_OF(MODIFIERS); ++idx) {
+            if (mods & (1 << idx)) {
+                stream->push(MODIFIERS[idx], false, t);
+                t += stream->between(5, 30);
+            }
+        }
+
+        t += stream->between(150, 1200);
+    }
+
+    stream->time = t + 1000;
+}
@@ -0,0 +1,397 @@
+
+/*
+ * Typing statistics kept for as long as shoki runs: how fast keys are
+ * being typed, which keys and combos are typed most, which pairs of
+ * them follow each other and which modifiers go with which keys.  They
+ * are fed every combo the stack takes and every chord that matches, and
+ * a summary can be written out at any time.
+ *
+ * Everything has a fixed size, so the statistics take the same memory
+ * after a minute as after a week, and adding a combo is a fixed amount
+ * of work.  There are only CHORD_SYMBOL_COUNT combos, so those are
+ * counted exactly.  Pairs of combos are too many to count that way and
+ * go into a count-min sketch, which can only overestimate, and the
+ * pairs with the highest estimates are kept in a heap to be listed.
+ * The typing rate is kept in one second buckets over the last minute.
+ */
+
+constexpr u32 STATS_SKETCH_DEPTH      = 4;
+constexpr u32 STATS_SKETCH_BITS       = 12;
+constexpr u32 STATS_SKETCH_WIDTH      = 1 << STATS_SKETCH_BITS;
+constexpr u32 STATS_HEAVY_HITTERS     = 32;
+constexpr u32 STATS_RATE_SECONDS      = 60;
+constexpr u32 STATS_CHARS_PER_WORD    = 5;
+constexpr u32 STATS_PAIR_MILLISECONDS = 2000;  // longest pause inside a pair
+constexpr u32 STATS_LISTED            = 10;    // entries in each summary list
+
+/*
+ * Counts of keys in a count-min sketch with conservative update: a key
+ * only raises the counters that are at its current estimate, which
+ * keeps estimates much closer without ever letting one fall below the
+ * true count.  An estimate is over by at most e/WIDTH of the total with
+ * probability 1 - e^-DEPTH.
+ */
+struct CountMinSketch {
+    u32 counters[STATS_SKETCH_DEPTH][STATS_SKETCH_WIDTH];
+    u32 total;
+
+    // Multiply-shift hashing, one odd multiplier to a row.
+    static u32 slot(u32 key, u32 row) {
+        static u32 const MULTIPLIERS[STATS_SKETCH_DEPTH] = {
+            0x9E3779B1u, 0x85EBCA77u, 0xC2B2AE3Du, 0x27D4EB2Fu,
+        };
+        return ((key + 1) * MULTIPLIERS[row]) >> (32 - STATS_SKETCH_BITS);
+    }
+
+    u32 estimate(u32 key) const {
+        auto lowest = counters[0][slot(key, 0)];
+        for (u32 row = 1; row < STATS_SKETCH_DEPTH; ++row) {
+            auto count = counters[row][slot(key, row)];
+            lowest = count < lowest ? count : lowest;
+        }
+        return lowest;
+    }
+
+    /**
+     * @return The key's estimate after counting it.
+     */
+    u32 add(u32 key) {
+        u32 slots[STATS_SKETCH_DEPTH];
+        u32 lowest = ~0u;
+
+        for (u32 row = 0; row < STATS_SKETCH_DEPTH; ++row) {
+            slots[row] = slot(key, row);
+            auto count = counters[row][slots[row]];
+            lowest = count < lowest ? count : lowest;
+        }
+
+        for (u32 row = 0; row < STATS_SKETCH_DEPTH; ++row) {
+            auto &counter = counters[row][slots[row]];
+            counter = counter > lowest ? counter : lowest + 1;
+        }
+
+        ++total;
+        return lowest + 1;
+    }
+};
+
+/*
+ * The keys with the highest estimates in a sketch, kept as a min-heap
+ * so the lowest is the one a new key replaces.  Each key keeps the
+ * estimate it had when it was last counted.  The lowest of them can't
+ * be higher than total / COUNT plus the sketch's error, so every key
+ * counted more than that is always kept.  There are few enough keys
+ * that finding one is a pass over all of them without branches.
+ */
+struct HeavyHitters {
+    u32 keys[STATS_HEAVY_HITTERS];
+    u32 counts[STATS_HEAVY_HITTERS];
+    u32 count;
+
+    void offer(u32 key, u32 estimate) {
+        // Going down finds a kept key before any unused slot that matches.
+        u32 found = STATS_HEAVY_HITTERS;
+        for (u32 idx = STATS_HEAVY_HITTERS; idx-- > 0;)
+            found = keys[idx] == key ? idx : found;
+
+        if (found < count) {
+            counts[found] = estimate;
+            sift_down(found);
+        }
+        else if (count < STATS_HEAVY_HITTERS) {
+            keys[count]   = key;
+            counts[count] = estimate;
+            sift_up(count++);
+        }
+        else if (estimate > counts[0]) {
+            keys[0]   = key;
+            counts[0] = estimate;
+            sift_down(0);
+        }
+    }
+
+    void swap(u32 a, u32 b) {
+        auto key    = keys[a];
+        auto number = counts[a];
+        keys[a]   = keys[b];
+        counts[a] = counts[b];
+        keys[b]   = key;
+        counts[b] = number;
+    }
+
+    void sift_up(u32 at) {
+        while (at > 0 && counts[(at - 1) / 2] > counts[at]) {
+            swap(at, (at - 1) / 2);
+            at = (at - 1) / 2;
+        }
+    }
+
+    void sift_down(u32 at) {
+        for (;;) {
+            auto lowest = at;
+            auto left   = 2*at + 1;
+            auto right  = left + 1;
+
+            if (left < count && counts[left] < counts[lowest])
+                lowest = left;
+            if (right < count && counts[right] < counts[lowest])
+                lowest = right;
+            if (lowest == at)
+                return;
+
+            swap(at, lowest);
+            at = lowest;
+        }
+    }
+};
+
+/*
+ * Events in one second buckets over the last STATS_RATE_SECONDS, with
+ * their sum kept as buckets are added and dropped.  Buckets start a
+ * whole number of seconds after the first event.  Times are on the
+ * KeyEvent clock and wrap, so they are only compared by difference.
+ */
+struct RateWindow {
+    u32  buckets[STATS_RATE_SECONDS];
+    u32  newest;     // bucket
+    u32  startTime;  // of the newest bucket
+    u32  sum;
+    u32  peak;       // highest sum seen
+    bool hasStarted;
+
+    void add(u32 time) {
+        if (!hasStarted) {
+            startTime  = time;
+            hasStarted = true;
+        }
+
+        auto since = i32(time - startTime);
+        auto slot  = newest;
+
+        // Combos come in the order keys come up, so one can be a little
+        // older than the newest bucket.
+        if (since < 0) {
+            auto back = (u32(-since) + 999) / 1000;
+            if (back >= STATS_RATE_SECONDS)
+                return;
+
+            slot = (newest + STATS_RATE_SECONDS - back) % STATS_RATE_SECONDS;
+        }
+        else if (since >= 1000) {
+            auto ahead   = u32(since) / 1000;
+            auto expired = ahead < STATS_RATE_SECONDS ? ahead : STATS_RATE_SECONDS;
+
+            for (u32 idx = 0; idx < expired; ++idx) {
+                newest = (newest + 1) % STATS_RATE_SECONDS;
+                sum   -= buckets[newest];
+                buckets[newest] = 0;
+            }
+
+            startTime += ahead * 1000;
+            slot       = newest;
+        }
+
+        ++buckets[slot];
+        ++sum;
+        peak = sum > peak ? sum : peak;
+    }
+
+    /**
+     * @return Events in the window ending at time, without moving it.
+     */
+    u32 count_at(u32 time) const {
+        auto since = i32(time - startTime);
+        if (since < 1000)
+            return sum;
+
+        auto ahead = u32(since) / 1000;
+        if (ahead >= STATS_RATE_SECONDS)
+            return 0;
+
+        auto total = sum;
+        for (u32 idx = 1; idx <= ahead; ++idx)
+            total -= buckets[(newest + idx) % STATS_RATE_SECONDS];
+        return total;
+    }
+};
+
+struct TypingStats {
+    u32            combos;
+    u32            typedCharacters;
+    u32            keys[CHORD_SYMBOL_COUNT];  // by chord_symbol
+    u32            chords[MAX_CHORD_LABELS];  // by chord label less one
+    CountMinSketch pairs;                     // by pair_key
+    HeavyHitters   topPairs;
+    RateWindow     typing;                    // characters
+    u32            lastSymbol;
+    u32            lastTime;
+    bool           hasLast;
+
+    /**
+     * @return The key of a combo followed by another in the sketch.
+     */
+    static u32 pair_key(u32 first, u32 second) {
+        return (first << 11) | second;
+    }
+
+    /**
+     * Count a combo the stack took.  A key without CTRL or ALT that
+     * types a character, or space, counts towards the typing rate.
+     */
+    void add(KeyCombo const &combo) {
+        auto symbol = chord_symbol(combo);
+
+        ++combos;
+        ++keys[symbol];
+
+        // Overlapping keys can come up out of order, which is still a pair.
+        if (hasLast && i32(combo.time - lastTime) <= i32(STATS_PAIR_MILLISECONDS)) {
+            auto pair = pair_key(lastSymbol, symbol);
+            topPairs.offer(pair, pairs.add(pair));
+        }
+
+        lastSymbol = symbol;
+        lastTime   = combo.time;
+        hasLast    = true;
+
+        auto &entry = KEY_TABLE->entries[combo.vk_key & 0xFF];
+        if (!combo.isCtrlDown && !combo.isAltDown && (entry.doesShiftAffectKey || combo.vk_key == 0x20)) {
+            ++typedCharacters;
+            typing.add(combo.time);
+        }
+    }
+
+    /**
+     * Count a labelled chord matching, one based like KeyCombo::chord.
+     */
+    void add_chord(u32 label) {
+        if (label >= 1 && label <= MAX_CHORD_LABELS)
+            ++chords[label - 1];
+    }
+
+    // A word is five characters, the way typing tests count them.
+    u32 words_per_minute(u32 time) const {
+        return typing.count_at(time) * (60 / STATS_RATE_SECONDS) / STATS_CHARS_PER_WORD;
+    }
+
+    u32 peak_words_per_minute() const {
+        return typing.peak * (60 / STATS_RATE_SECONDS) / STATS_CHARS_PER_WORD;
+    }
+};
+
+/**
+ * Find the most counted of counts, most first.
+ *
+ * @return How many were found, at most capacity, leaving out zeros.
+ */
+u32 top_counts(u32 const *counts, u32 count, u32 *out, u32 capacity)
+{
+    u32 found = 0;
+
+    for (u32 idx = 0; idx < count; ++idx) {
+        if (counts[idx] == 0)
+            continue;
+        if (found == capacity && counts[idx] <= counts[out[found - 1]])
+            continue;
+
+        auto at = found < capacity ? found++ : found - 1;
+        while (at > 0 && counts[out[at - 1]] < counts[idx]) {
+            out[at] = out[at - 1];
+            --at;
+        }
+        out[at] = idx;
+    }
+
+    return found;
+}
+
+/*
+ * Columns of the modifier heatmap, the kinds of key a modifier goes
+ * with.
+ */
+enum KeyGroup {
+    KeyGroup_Letter,
+    KeyGroup_Digit,
+    KeyGroup_Symbol,
+    KeyGroup_Editing,  // space, enter, tab, backspace and the like
+    KeyGroup_Moving,   // arrows, home, end and the page keys
+    KeyGroup_Function,
+    KeyGroup_Mouse,
+    KeyGroup_Count
+};
+
+char const *KEY_GROUP_NAMES[] = { "letter", "digit", "symbol", "editing", "moving", "function", "mouse" };
+
+inline KeyGroup key_group(u32 vk)
+{
+    if (vk >= 0x41 && vk <= 0x5A) return KeyGroup_Letter;
+    if (vk >= 0x30 && vk <= 0x39) return KeyGroup_Digit;
+    if (vk >= 0x70 && vk <= 0x87) return KeyGroup_Function;
+    if (vk >= 0x21 && vk <= 0x28) return KeyGroup_Moving;
+    if (vk < 0x10 && vk != 0x08 && vk != 0x09 && vk != 0x0D) return KeyGroup_Mouse;
+    if (vk >= 0xBA) return KeyGroup_Symbol;
+    return KeyGroup_Editing;
+}
+
+/**
+ * Write a summary of the statistics as text.
+ *
+ * @param time Now, on the KeyEvent clock, for the current typing rate.
+ */
+void print_typing_stats(FILE *out, TypingStats const &stats, u32 time)
+{
+    char keys[64];
+    u32  top[STATS_LISTED];
+
+    fprintf(out, "combos %u, characters %u, %u wpm over the last minute, %u wpm peak\n",
+            stats.combos,
+            stats.typedCharacters,
+            stats.words_per_minute(time),
+            stats.peak_words_per_minute());
+
+    fprintf(out, "\nmost typed\n");
+    auto found = top_counts(stats.keys, CHORD_SYMBOL_COUNT, top, STATS_LISTED);
+    for (u32 idx = 0; idx < found; ++idx) {
+        write_chord_keys(top[idx], keys, sizeof(keys));
+        fprintf(out, "  %-16s %8u\n", keys, stats.keys[top[idx]]);
+    }
+
+    fprintf(out, "\nmost typed pairs (each at most %u over, with 98%% probability)\n",
+            u32(2.7182818 * stats.pairs.total / STATS_SKETCH_WIDTH) + 1);
+
+    found = top_counts(stats.topPairs.counts, stats.topPairs.count, top, STATS_LISTED);
+    for (u32 idx = 0; idx < found; ++idx) {
+        auto pair   = stats.topPairs.keys[top[idx]];
+        auto length = write_chord_keys(pair >> 11, keys, sizeof(keys));
+
+        keys[length++] = ' ';
+        write_chord_keys(pair & (CHORD_SYMBOL_COUNT - 1), keys + length, sizeof(keys) - length);
+        fprintf(out, "  %-16s %8u\n", keys, stats.topPairs.counts[top[idx]]);
+    }
+
+    found = top_counts(stats.chords, MAX_CHORD_LABELS, top, STATS_LISTED);
+    if (found > 0) {
+        fprintf(out, "\nmost used chords\n");
+        for (u32 idx = 0; idx < found; ++idx)
+            fprintf(out, "  %-16ls %8u\n", chord_label(top[idx] + 1), stats.chords[top[idx]]);
+    }
+
+    // Rows are every set of modifiers, in the bit order of chord_symbol.
+    static char const *MODIFIER_ROW_NAMES[] = { "none", "C", "M", "C-M", "S", "C-S", "M-S", "C-M-S" };
+
+    u32 heatmap[8][KeyGroup_Count] = {};
+    for (u32 symbol = 0; symbol < CHORD_SYMBOL_COUNT; ++symbol)
+        heatmap[symbol >> 8][key_group(symbol & 0xFF)] += stats.keys[symbol];
+
+    fprintf(out, "\nmodifiers");
+    for (auto name : KEY_GROUP_NAMES)
+        fprintf(out, " %9s", name);
+    fprintf(out, "\n");
+
+    for (u32 mods = 0; mods < 8; ++mods) {
+        fprintf(out, "  %-7s", MODIFIER_ROW_NAMES[mods]);
+        for (u32 group = 0; group < KeyGroup_Count; ++group)
+            fprintf(out, " %9u", heatmap[mods][group]);
+        fprintf(out, "\n");
+    }
+}